@@ -1,15 +1,28 @@
+#define _DEFAULT_SOURCE // For fileno(), fsync() and clock_gettime(), which aren't part of C99
+
 #include "battery.h"
 
 #include "logging.h"
 #include "utils/os.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 
 #define PATH_TO_BATTERY_SAVE_DIR "/Library/Application Support/Zephyr/Battery/"
 #define BATTERY_SAVE_FILE_EXTENSION ".bat"
+#define BATTERY_TEMP_FILE_EXTENSION ".tmp"
+
+#define DIRTY_PAGE_IS_SET(BITMAP, PAGE) ((BITMAP)[(PAGE) / 32] & (1u << ((PAGE) % 32)))
+#define DIRTY_PAGE_SET(BITMAP, PAGE) ((BITMAP)[(PAGE) / 32] |= (1u << ((PAGE) % 32)))
+#define DIRTY_PAGE_CLEAR(BITMAP, PAGE) ((BITMAP)[(PAGE) / 32] &= ~(1u << ((PAGE) % 32)))
+
+
+static uint32_t defaultFlushIntervalMillis = BATTERY_FILE_DEFAULT_FLUSH_INTERVAL_MILLIS;
 
 
 static const char* batterySaveLocation(const char* romFilename)
@@ -28,11 +41,8 @@ static const char* batterySaveLocation(const char* romFilename)
   char* pathToSaveFile = (char*)malloc((pathToSaveFileLength + 1) * sizeof(char));
   assert(pathToSaveFile);
 
-  strncpy(&(pathToSaveFile[0]), pathToHomeDir, pathToHomeDirLength);
-  strncpy(&(pathToSaveFile[pathToHomeDirLength]), PATH_TO_BATTERY_SAVE_DIR, pathToBatterySaveDirLength);
-  strncpy(&(pathToSaveFile[pathToHomeDirLength + pathToBatterySaveDirLength]), romFilenameComponents.left, romFilenameNoExtLength);
-  strncpy(&(pathToSaveFile[pathToHomeDirLength + pathToBatterySaveDirLength + romFilenameNoExtLength]), BATTERY_SAVE_FILE_EXTENSION, batterySaveFileExtensionLength);
-  pathToSaveFile[pathToSaveFileLength] = '\0';
+  int written = snprintf(pathToSaveFile, pathToSaveFileLength + 1, "%s%s%s%s", pathToHomeDir, PATH_TO_BATTERY_SAVE_DIR, romFilenameComponents.left, BATTERY_SAVE_FILE_EXTENSION);
+  assert(written == (int)pathToSaveFileLength);
 
   free((void*)romFilenameComponents.left);
   free((void*)romFilenameComponents.right);
@@ -41,7 +51,44 @@ static const char* batterySaveLocation(const char* romFilename)
 }
 
 
-static void batteryFileCreate(const char* pathToFile, uint8_t* data, uint32_t size)
+// Writes the whole file under a temporary name and renames it over the old one, so that a crash part way through
+// leaves the previous save intact. Returns false (leaving the old file alone) if anything fails.
+static bool batteryFileReplace(const char* pathToFile, const uint8_t* data, uint32_t size)
+{
+  char pathToTempFile[PATH_MAX];
+  int pathToTempFileLength = snprintf(pathToTempFile, sizeof(pathToTempFile), "%s%s", pathToFile, BATTERY_TEMP_FILE_EXTENSION);
+  if (pathToTempFileLength < 0 || pathToTempFileLength >= (int)sizeof(pathToTempFile)) {
+    warning("Path of temporary battery file for '%s' is too long\n", pathToFile);
+    return false;
+  }
+
+  FILE* tempFile = fopen(pathToTempFile, "wb");
+  if (tempFile == NULL) {
+    warning("Failed to open temporary battery file '%s'\n", pathToTempFile);
+    return false;
+  }
+
+  size_t bytesWritten = fwrite((void*)data, 1, size, tempFile);
+  bool isFlushed = (fflush(tempFile) == 0) && (fsync(fileno(tempFile)) == 0);
+  fclose(tempFile);
+
+  if (bytesWritten != size || !isFlushed) {
+    warning("Battery file write incomplete - expected to write %u bytes, actually wrote %u bytes\n", size, bytesWritten);
+    remove(pathToTempFile);
+    return false;
+  }
+
+  if (rename(pathToTempFile, pathToFile) != 0) {
+    warning("Failed to replace battery file '%s'\n", pathToFile);
+    remove(pathToTempFile);
+    return false;
+  }
+
+  return true;
+}
+
+
+static bool batteryFileCreate(const char* pathToFile, uint8_t* data, uint32_t size)
 {
   const char* destinationDir = dirname(pathToFile);
   if (!exists(destinationDir)) {
@@ -49,13 +96,7 @@ static void batteryFileCreate(const char* pathToFile, uint8_t* data, uint32_t si
   }
   free((void*)destinationDir);
 
-  FILE* saveFile = fopen(pathToFile, "wb");
-  assert(saveFile);
-  size_t bytesWritten = fwrite((void*)data, 1, size, saveFile);
-  fclose(saveFile);
-  if (bytesWritten != size) {
-    warning("Battery file creation incomplete - expected to write %u bytes, actually wrote %u bytes\n", size, bytesWritten);
-  }
+  return batteryFileReplace(pathToFile, data, size);
 }
 
 
@@ -71,26 +112,171 @@ static void batteryFileLoad(const char* pathToFile, uint8_t* data, uint32_t size
 }
 
 
-FILE* batteryFileOpen(const char* romFilename, uint8_t* data, uint32_t size)
+// Copies each run of dirty pages into flushData and clears them. Must be called with the mutex held.
+static bool batteryFileTakeDirtyPages(BatteryFile* batteryFile)
+{
+  if (!batteryFile->isDirty) {
+    return false;
+  }
+
+  uint32_t numPages = (batteryFile->size + BATTERY_FILE_PAGE_SIZE - 1) / BATTERY_FILE_PAGE_SIZE;
+  uint32_t page = 0;
+  while (page < numPages) {
+    if (!DIRTY_PAGE_IS_SET(batteryFile->dirtyPages, page)) {
+      page++;
+      continue;
+    }
+
+    uint32_t firstPage = page;
+    while (page < numPages && DIRTY_PAGE_IS_SET(batteryFile->dirtyPages, page)) {
+      DIRTY_PAGE_CLEAR(batteryFile->dirtyPages, page);
+      page++;
+    }
+
+    uint32_t start = firstPage * BATTERY_FILE_PAGE_SIZE;
+    uint32_t end = page * BATTERY_FILE_PAGE_SIZE;
+    if (end > batteryFile->size) {
+      end = batteryFile->size;
+    }
+    memcpy(batteryFile->flushData + start, batteryFile->data + start, end - start);
+  }
+
+  batteryFile->isDirty = false;
+  return true;
+}
+
+
+static void* batteryFileFlushThread(void* arg)
+{
+  BatteryFile* batteryFile = (BatteryFile*)arg;
+
+  pthread_mutex_lock(&batteryFile->mutex);
+
+  while (!batteryFile->isClosing) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += batteryFile->flushIntervalMillis / 1000;
+    deadline.tv_nsec += (batteryFile->flushIntervalMillis % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    // Only woken early by batteryFileClose(), which does the final flush itself
+    while (!batteryFile->isClosing && pthread_cond_timedwait(&batteryFile->closing, &batteryFile->mutex, &deadline) == 0);
+
+    if (!batteryFile->isClosing && batteryFileTakeDirtyPages(batteryFile)) {
+      pthread_mutex_unlock(&batteryFile->mutex); // The emulator can carry on writing while the file is replaced
+      bool isReplaced = batteryFileReplace(batteryFile->path, batteryFile->flushData, batteryFile->size);
+      pthread_mutex_lock(&batteryFile->mutex);
+
+      // flushData still holds everything taken so far, so the next flush tries again with it
+      if (!isReplaced) {
+        batteryFile->isDirty = true;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&batteryFile->mutex);
+
+  return NULL;
+}
+
+
+void batteryFileSetFlushInterval(uint32_t flushIntervalMillis)
+{
+  defaultFlushIntervalMillis = flushIntervalMillis;
+}
+
+
+BatteryFile* batteryFileOpen(const char* romFilename, uint8_t* data, uint32_t size)
 {
-  FILE* saveFile;
   const char* pathToFile = batterySaveLocation(romFilename);
 
   if (exists(pathToFile)) {
     batteryFileLoad(pathToFile, data, size);
-  } else {
-    batteryFileCreate(pathToFile, data, size);
+  } else if (!batteryFileCreate(pathToFile, data, size)) {
+    error("Failed to create battery file '%s'\n", pathToFile);
+  }
+
+  uint32_t numPages = (size + BATTERY_FILE_PAGE_SIZE - 1) / BATTERY_FILE_PAGE_SIZE;
+  uint32_t numDirtyPageWords = (numPages + 31) / 32;
+
+  BatteryFile* batteryFile = (BatteryFile*)malloc(sizeof(BatteryFile));
+  assert(batteryFile);
+
+  batteryFile->path = (char*)pathToFile;
+  batteryFile->size = size;
+  batteryFile->data = (uint8_t*)malloc((size > 0 ? size : 1) * sizeof(uint8_t));
+  batteryFile->flushData = (uint8_t*)malloc((size > 0 ? size : 1) * sizeof(uint8_t));
+  batteryFile->dirtyPages = (uint32_t*)calloc((numDirtyPageWords > 0 ? numDirtyPageWords : 1), sizeof(uint32_t));
+  assert(batteryFile->data && batteryFile->flushData && batteryFile->dirtyPages);
+
+  memcpy(batteryFile->data, data, size);
+  memcpy(batteryFile->flushData, data, size);
+
+  batteryFile->isDirty = false;
+  batteryFile->isClosing = false;
+  batteryFile->flushIntervalMillis = defaultFlushIntervalMillis;
+
+  pthread_mutex_init(&batteryFile->mutex, NULL);
+  pthread_cond_init(&batteryFile->closing, NULL);
+  if (pthread_create(&batteryFile->flushThread, NULL, &batteryFileFlushThread, batteryFile) != 0) {
+    critical("Failed to start battery file flush thread\n");
+    exit(EXIT_FAILURE);
   }
 
-  saveFile = fopen(pathToFile, "rb+"); // rb+ to ensure that we can write to specific positions in the file
-  free((void*)pathToFile);
-  return saveFile;
+  return batteryFile;
 }
 
 
-void batteryFileWriteByte(FILE* saveFile, uint16_t address, uint8_t value)
+void batteryFileWriteByte(BatteryFile* batteryFile, uint32_t address, uint8_t value)
 {
-  fseek(saveFile, address, SEEK_SET);
-  fwrite((void*)&value, sizeof(uint8_t), 1, saveFile);
-  fflush(saveFile);
+  assert(address < batteryFile->size);
+
+  pthread_mutex_lock(&batteryFile->mutex);
+  batteryFile->data[address] = value;
+  DIRTY_PAGE_SET(batteryFile->dirtyPages, address / BATTERY_FILE_PAGE_SIZE);
+  batteryFile->isDirty = true;
+  pthread_mutex_unlock(&batteryFile->mutex);
+}
+
+
+// Writes a block of bytes that belong together (like the state of a clock) at once, so the flush thread never sees only
+// part of it
+void batteryFileWrite(BatteryFile* batteryFile, uint32_t address, const uint8_t* data, uint32_t size)
+{
+  assert(address + size <= batteryFile->size);
+
+  pthread_mutex_lock(&batteryFile->mutex);
+  memcpy(&batteryFile->data[address], data, size);
+  for (uint32_t page = address / BATTERY_FILE_PAGE_SIZE; page <= (address + size - 1) / BATTERY_FILE_PAGE_SIZE; page++) {
+    DIRTY_PAGE_SET(batteryFile->dirtyPages, page);
+  }
+  batteryFile->isDirty = true;
+  pthread_mutex_unlock(&batteryFile->mutex);
+}
+
+
+void batteryFileClose(BatteryFile* batteryFile)
+{
+  pthread_mutex_lock(&batteryFile->mutex);
+  batteryFile->isClosing = true;
+  pthread_cond_signal(&batteryFile->closing);
+  pthread_mutex_unlock(&batteryFile->mutex);
+
+  pthread_join(batteryFile->flushThread, NULL);
+
+  if (batteryFileTakeDirtyPages(batteryFile) && !batteryFileReplace(batteryFile->path, batteryFile->flushData, batteryFile->size)) {
+    error("Failed to save battery file '%s'\n", batteryFile->path);
+  }
+
+  pthread_cond_destroy(&batteryFile->closing);
+  pthread_mutex_destroy(&batteryFile->mutex);
+
+  free(batteryFile->dirtyPages);
+  free(batteryFile->flushData);
+  free(batteryFile->data);
+  free(batteryFile->path);
+  free(batteryFile);
 }
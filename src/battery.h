@@ -1,11 +1,41 @@
 #ifndef BATTERY_H_
 #define BATTERY_H_
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
 
-FILE* batteryFileOpen(const char* romFilename, uint8_t* data, uint32_t size);
-void batteryFileWriteByte(FILE* saveFile, uint16_t address, uint8_t value);
+#define BATTERY_FILE_DEFAULT_FLUSH_INTERVAL_MILLIS 1000
+#define BATTERY_FILE_PAGE_SIZE 256
+
+
+// Battery-backed data is written to an in-memory copy of the save file, with the pages that have changed since the
+// last flush marked in a dirty bitmap. A background thread copies the dirty pages and replaces the save file with the
+// new copy at a fixed interval, and once more when the file is closed.
+typedef struct {
+  char* path;
+  uint8_t* data;
+  uint8_t* flushData; // Only used by the flush thread (and by batteryFileClose() once the thread has finished)
+  uint32_t size;
+
+  uint32_t* dirtyPages; // One bit per BATTERY_FILE_PAGE_SIZE bytes of data
+  bool isDirty;
+  bool isClosing;
+  uint32_t flushIntervalMillis;
+
+  pthread_t flushThread;
+  pthread_mutex_t mutex; // Protects data, dirtyPages, isDirty and isClosing
+  pthread_cond_t closing;
+} BatteryFile;
+
+
+void batteryFileSetFlushInterval(uint32_t flushIntervalMillis); // Applies to files opened afterwards
+
+BatteryFile* batteryFileOpen(const char* romFilename, uint8_t* data, uint32_t size);
+void batteryFileWriteByte(BatteryFile* batteryFile, uint32_t address, uint8_t value);
+void batteryFileWrite(BatteryFile* batteryFile, uint32_t address, const uint8_t* data, uint32_t size);
+void batteryFileClose(BatteryFile* batteryFile);
 
 #endif // BATTERY_H_
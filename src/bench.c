@@ -0,0 +1,1209 @@
+#define _DEFAULT_SOURCE // For nanosleep(), which isn't part of C99
+
+#include "cartridge.h"
+#include "gameboy.h"
+#include "interrupts.h"
+#include "lcd.h"
+#include "lcdcompositor.h"
+#include "logging.h"
+#include "pixel.h"
+#include "sound/audioratecontrol.h"
+#include "sound/audiosamplebuffer.h"
+#include "sound/soundmixer.h"
+#include "timing.h"
+#include "upscaler.h"
+#include "upscalerkernels.h"
+#include "utils/os.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES_TO_RUN 3600 // One minute of emulated time
+
+#define DEFAULT_COMPOSITOR_TEST_SCENES 500
+#define COMPOSITOR_TEST_FRAMES_PER_SCENE 4
+
+#define DEFAULT_UPSCALE_NEAREST_SCALE 2
+
+#define DEFAULT_UPSCALE_TEST_FRAMES 200
+#define UPSCALE_TEST_MAX_STRIPE_ROWS 48
+
+#define SIMULATED_AUDIO_DEVICE_BLOCK 512
+
+#define DEFAULT_MIXER_TEST_BLOCKS 2000
+#define MIXER_TEST_SAMPLES_PER_FRAME (FULL_FRAME_CLOCK_CYCLES / (CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED / 44100))
+
+#define DEFAULT_TIMER_TEST_STEPS 200000
+#define TIMER_TEST_MAX_SHORT_STEP 600
+#define TIMER_TEST_MAX_LONG_STEP 140000 // Long enough for the 16-bit counter to wrap around twice
+
+#define DEFAULT_AUDIO_STRESS_SAMPLES 4000000
+#define AUDIO_STRESS_BUFFER_SIZE 4096
+#define AUDIO_STRESS_MAX_BLOCK 512
+#define AUDIO_STRESS_PHASE_SAMPLES 200000 // Samples sent before the producer and consumer swap which one is slower
+#define AUDIO_STRESS_SLOW_SIDE_SLEEP_NANOS 50000
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+
+static void printUsage(const char* programName)
+{
+  printf("Usage: %s PATH_TO_ROM [--frames N] [--gb|--cgb] [--no-idle-loop-skipping] [--compositor scalar|sse2|avx2] [--frame-skip N]\n", programName);
+  printf("       %*s [--audio none|point|band-limited] [--wav-output PATH_PREFIX [--wav-no-channels]]\n", (int)strlen(programName), "");
+  printf("       %*s [--audio-device-skew PERCENT [--dynamic-rate-control]]\n", (int)strlen(programName), "");
+  printf("       %*s [--upscale nearest|scale2x|scale3x|hq2x|xbr2x [--upscale-scale N] [--upscale-threads N] [--upscale-no-simd] [--upscale-output FILE.ppm]]\n", (int)strlen(programName), "");
+  printf("       %s --compositor-test [--scenes N]\n", programName);
+  printf("       %s --upscale-test [--frames N]\n", programName);
+  printf("       %s --mixer-test [--blocks N]\n", programName);
+  printf("       %s --timer-test [--steps N]\n", programName);
+  printf("       %s --audio-buffer-stress [--samples N]\n", programName);
+}
+
+
+static uint32_t fnv1a(uint32_t hash, uint8_t value)
+{
+  return (hash ^ value) * FNV_PRIME;
+}
+
+
+// Checksum of the visible contents of the frame buffer, so that optimisations can be checked for regressions
+static uint32_t pixelsChecksum(const Pixel* pixels, uint32_t count)
+{
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (uint32_t i = 0; i < count; i++) {
+    hash = fnv1a(hash, PIXEL_RED(pixels[i]));
+    hash = fnv1a(hash, PIXEL_GREEN(pixels[i]));
+    hash = fnv1a(hash, PIXEL_BLUE(pixels[i]));
+  }
+  return hash;
+}
+
+
+static uint32_t frameBufferChecksum(const Pixel* frameBuffer)
+{
+  return pixelsChecksum(frameBuffer, LCD_WIDTH * LCD_HEIGHT);
+}
+
+
+static bool parseCompositor(const char* name, LCDCompositor* compositor)
+{
+  for (int i = 0; i < LCD_COMPOSITOR_COUNT; i++) {
+    if (strcmp(name, lcdCompositorName(i)) == 0) {
+      *compositor = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+static bool parseAudioSynthesis(const char* name, SoundSynthesis* synthesis)
+{
+  for (int i = 0; i < SOUND_SYNTHESIS_COUNT; i++) {
+    if (strcmp(name, soundSynthesisName(i)) == 0) {
+      *synthesis = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+static bool parseUpscaleFilter(const char* name, UpscaleFilter* filter)
+{
+  for (int i = 0; i < UPSCALE_FILTER_COUNT; i++) {
+    if (strcmp(name, upscaleFilterName(i)) == 0) {
+      *filter = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// The most recent frame from the upscaler, copied on the upscaler's worker thread
+typedef struct {
+  Pixel* pixels;
+  uint32_t width;
+  uint32_t height;
+} UpscaledFrame;
+
+
+static void keepUpscaledFrame(const Pixel* output, uint32_t width, uint32_t height, void* context)
+{
+  UpscaledFrame* upscaledFrame = (UpscaledFrame*)context;
+  memcpy(upscaledFrame->pixels, output, width * height * sizeof(Pixel));
+  upscaledFrame->width = width;
+  upscaledFrame->height = height;
+}
+
+
+static bool writePPM(const char* path, const Pixel* pixels, uint32_t width, uint32_t height)
+{
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  fprintf(file, "P6\n%" PRIu32 " %" PRIu32 "\n255\n", width, height);
+  for (uint32_t i = 0; i < width * height; i++) {
+    uint8_t rgb[3] = {PIXEL_RED(pixels[i]), PIXEL_GREEN(pixels[i]), PIXEL_BLUE(pixels[i])};
+    fwrite(rgb, 1, sizeof(rgb), file);
+  }
+
+  return (fclose(file) == 0);
+}
+
+
+static uint32_t nextRandom(uint32_t* state)
+{
+  // xorshift32
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+
+// Random values for the registers that affect what is drawn, so that consecutive frames of a scene differ
+static void randomiseSceneRegisters(LCDController* lcdController, uint32_t* randomState)
+{
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_LCDC, nextRandom(randomState) | LCD_DISPLAY_ENABLE_BIT);
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_SCX, nextRandom(randomState));
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_SCY, nextRandom(randomState));
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_WX, nextRandom(randomState) % (LCD_WIDTH + 8));
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_WY, nextRandom(randomState) % LCD_HEIGHT);
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_BGP, nextRandom(randomState));
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_OBP0, nextRandom(randomState));
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_OBP1, nextRandom(randomState));
+}
+
+
+// Render a few frames of a synthetic scene (random tiles, maps, attributes, sprites and palettes) using the given
+// compositor, leaving the last frame in the frame buffer
+static void renderScene(LCDController* lcdController, uint8_t* vram, uint8_t* oam, Pixel* frameBuffer, uint32_t seed, LCDCompositor compositor)
+{
+  uint32_t randomState = seed;
+  CGBMode cgbMode = (seed % 2) ? COLOUR : MONOCHROME;
+
+  for (int i = 0; i < VRAM_BANK_SIZE * 2; i++) {
+    vram[i] = nextRandom(&randomState);
+  }
+
+  // Keep most sprites on screen, and bias them towards a few lines so that some lines have more than 10
+  for (int i = 0; i < MAX_SPRITES; i++) {
+    uint32_t value = nextRandom(&randomState);
+    oam[i * 4] = (i % 3 == 0) ? (64 + (value % 8)) : (value % (LCD_HEIGHT + 16));
+    oam[i * 4 + 1] = (value >> 8) % (LCD_WIDTH + 8);
+    oam[i * 4 + 2] = value >> 16;
+    oam[i * 4 + 3] = value >> 24;
+  }
+
+  InterruptController interruptController;
+  initInterruptController(&interruptController);
+
+  initLCDController(lcdController, &interruptController, vram, oam, frameBuffer, CGB, cgbMode);
+  lcdSetCompositor(lcdController, compositor);
+
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_BCPS, 0x80);
+  lcdWriteByte(lcdController, IO_REG_ADDRESS_OCPS, 0x80);
+  for (int i = 0; i < 64; i++) {
+    lcdWriteByte(lcdController, IO_REG_ADDRESS_BCPD, nextRandom(&randomState));
+    lcdWriteByte(lcdController, IO_REG_ADDRESS_OCPD, nextRandom(&randomState));
+  }
+
+  for (int frame = 0; frame < COMPOSITOR_TEST_FRAMES_PER_SCENE; frame++) {
+    randomiseSceneRegisters(lcdController, &randomState);
+
+    uint32_t cycles = 0;
+    while (cycles < FULL_FRAME_CLOCK_CYCLES) {
+      uint32_t cyclesUntilNextEvent = lcdCyclesUntilNextEvent(lcdController);
+      lcdUpdate(lcdController, cyclesUntilNextEvent);
+      cycles += cyclesUntilNextEvent;
+    }
+  }
+}
+
+
+// Shared between the threads of the audio sample buffer stress test
+typedef struct {
+  AudioSampleBuffer buffer;
+  uint32_t samplesToSend;
+  uint32_t phase; // Which side is slower - the consumer in even phases and the producer in odd ones
+  bool producerIsFinished;
+  uint64_t samplesReceived; // Only used by the consumer until it finishes
+  uint64_t errors; // Only used by the consumer until it finishes
+} AudioStressTest;
+
+
+// Every sample carries its sequence number (and a value derived from it) so the consumer can check that no sample is
+// lost, repeated, reordered or torn
+static AudioSample audioStressSample(uint32_t sequence)
+{
+  AudioSample sample;
+  sample.so1 = (int16_t)(sequence & 0xFFFF);
+  sample.so2 = (int16_t)((sequence * 40503u) >> 16);
+  return sample;
+}
+
+
+// The slower side sleeps after every block, and the faster side only gives up the CPU when it couldn't do anything
+static void audioStressWait(AudioStressTest* test, uint32_t slowPhase, bool madeProgress)
+{
+  if (__atomic_load_n(&test->phase, __ATOMIC_RELAXED) % 2 == slowPhase) {
+    struct timespec delay = {0, AUDIO_STRESS_SLOW_SIDE_SLEEP_NANOS};
+    nanosleep(&delay, NULL);
+  } else if (!madeProgress) {
+    sched_yield();
+  }
+}
+
+
+// Sends every sample in order in blocks of random sizes, sending whatever didn't fit in the buffer again
+static void* audioStressProducer(void* arg)
+{
+  AudioStressTest* test = (AudioStressTest*)arg;
+  AudioSample block[AUDIO_STRESS_MAX_BLOCK];
+  uint32_t randomState = 0x12345678;
+  uint32_t sequence = 0;
+
+  while (sequence < test->samplesToSend) {
+    uint32_t count = 1 + (nextRandom(&randomState) % AUDIO_STRESS_MAX_BLOCK);
+    if (count > test->samplesToSend - sequence) {
+      count = test->samplesToSend - sequence;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      block[i] = audioStressSample(sequence + i);
+    }
+
+    uint32_t sent;
+    if (count == 1) {
+      sent = sampleBufferPut(&test->buffer, block[0]) ? 1 : 0;
+    } else {
+      sent = sampleBufferPutN(&test->buffer, block, count);
+    }
+    sequence += sent;
+
+    __atomic_store_n(&test->phase, sequence / AUDIO_STRESS_PHASE_SAMPLES, __ATOMIC_RELAXED);
+    audioStressWait(test, 1, sent > 0);
+  }
+
+  __atomic_store_n(&test->producerIsFinished, true, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+
+static void* audioStressConsumer(void* arg)
+{
+  AudioStressTest* test = (AudioStressTest*)arg;
+  AudioSample block[AUDIO_STRESS_MAX_BLOCK];
+  uint32_t randomState = 0x87654321;
+  uint32_t expected = 0;
+
+  while (true) {
+    // Once the producer has finished, an empty read means everything has been received
+    bool producerIsFinished = __atomic_load_n(&test->producerIsFinished, __ATOMIC_ACQUIRE);
+
+    uint32_t count = 1 + (nextRandom(&randomState) % AUDIO_STRESS_MAX_BLOCK);
+    uint32_t received;
+    if (count == 1) {
+      received = (sampleBufferAvailableSamples(&test->buffer) > 0) ? 1 : 0;
+      if (received) {
+        block[0] = sampleBufferGet(&test->buffer);
+      }
+    } else {
+      received = sampleBufferGetN(&test->buffer, block, count);
+    }
+
+    for (uint32_t i = 0; i < received; i++, expected++) {
+      AudioSample expectedSample = audioStressSample(expected);
+      if (block[i].so1 != expectedSample.so1 || block[i].so2 != expectedSample.so2) {
+        if (test->errors == 0) {
+          error("Audio sample %" PRIu32 " was (%d, %d) instead of (%d, %d)\n", expected, block[i].so1, block[i].so2, expectedSample.so1, expectedSample.so2);
+        }
+        test->errors++;
+      }
+    }
+    test->samplesReceived += received;
+
+    if (producerIsFinished && received == 0) {
+      break;
+    }
+
+    audioStressWait(test, 0, received > 0);
+  }
+
+  return NULL;
+}
+
+
+// Runs a producer and a consumer thread through the audio sample buffer, with each side taking turns to be slower
+// than the other so that the buffer repeatedly fills up and runs dry
+static int runAudioBufferStressTest(int samples)
+{
+  AudioStressTest test;
+  memset(&test, 0, sizeof(test));
+  test.samplesToSend = samples;
+  sampleBufferInitialise(&test.buffer, AUDIO_STRESS_BUFFER_SIZE);
+
+  const uint64_t startTime = currentTimeMicros();
+
+  pthread_t producer;
+  pthread_t consumer;
+  if (pthread_create(&consumer, NULL, &audioStressConsumer, &test) != 0 || pthread_create(&producer, NULL, &audioStressProducer, &test) != 0) {
+    critical("Failed to start audio sample buffer stress test threads\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+
+  const uint64_t elapsedMicros = currentTimeMicros() - startTime;
+  const double elapsedSeconds = (elapsedMicros > 0 ? elapsedMicros : 1) / 1000000.0;
+
+  bool passed = (test.errors == 0 && test.samplesReceived == test.samplesToSend);
+
+  printf("Buffer size:            %" PRIu32 " samples\n", test.buffer.size);
+  printf("Samples sent:           %" PRIu32 "\n", test.samplesToSend);
+  printf("Samples received:       %" PRIu64 "\n", test.samplesReceived);
+  printf("Overruns:               %" PRIu64 " (samples sent again)\n", sampleBufferOverruns(&test.buffer));
+  printf("Underruns:              %" PRIu64 "\n", sampleBufferUnderruns(&test.buffer));
+  printf("Errors:                 %" PRIu64 "\n", test.errors);
+  printf("Samples/s:              %.0f\n", test.samplesReceived / elapsedSeconds);
+  printf("Result:                 %s\n", passed ? "passed" : "FAILED");
+
+  sampleBufferFinalise(&test.buffer);
+
+  return passed ? 0 : 1;
+}
+
+
+// Render the same synthetic scenes with every compositor the CPU supports and check that each one produces exactly
+// the same pixels as the scalar compositor
+static int runCompositorTest(int scenes)
+{
+  LCDController* lcdController = calloc(1, sizeof(LCDController));
+  uint8_t* vram = malloc(VRAM_BANK_SIZE * 2);
+  uint8_t* oam = malloc(MAX_SPRITES * 4);
+  Pixel* expectedFrameBuffer = calloc(LCD_WIDTH * LCD_HEIGHT, sizeof(Pixel));
+  Pixel* frameBuffer = calloc(LCD_WIDTH * LCD_HEIGHT, sizeof(Pixel));
+
+  if (lcdController == NULL || vram == NULL || oam == NULL || expectedFrameBuffer == NULL || frameBuffer == NULL) {
+    error("Failed to allocate memory for the compositor test\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int failures = 0;
+
+  printf("Scenes:                 %d (%d frames each)\n", scenes, COMPOSITOR_TEST_FRAMES_PER_SCENE);
+  printf("Best compositor:        %s\n", lcdCompositorName(lcdCompositorBest()));
+
+  for (int compositor = 0; compositor < LCD_COMPOSITOR_COUNT; compositor++) {
+    if (!lcdCompositorIsSupported(compositor)) {
+      printf("%-8s                not supported\n", lcdCompositorName(compositor));
+      continue;
+    }
+
+    uint32_t mismatchedScenes = 0;
+    uint64_t elapsedMicros = 0;
+
+    for (int scene = 0; scene < scenes; scene++) {
+      uint32_t seed = (uint32_t)scene * 2654435761u + 1;
+
+      if (compositor != LCD_COMPOSITOR_SCALAR) {
+        renderScene(lcdController, vram, oam, expectedFrameBuffer, seed, LCD_COMPOSITOR_SCALAR);
+      }
+
+      const uint64_t startTime = currentTimeMicros();
+      renderScene(lcdController, vram, oam, frameBuffer, seed, compositor);
+      elapsedMicros += currentTimeMicros() - startTime;
+
+      if (compositor != LCD_COMPOSITOR_SCALAR && memcmp(frameBuffer, expectedFrameBuffer, LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel)) != 0) {
+        for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+          if (frameBuffer[i] != expectedFrameBuffer[i]) {
+            error("%s: scene %d differs from scalar at (%d, %d): 0x%08" PRIX32 " != 0x%08" PRIX32 "\n", lcdCompositorName(compositor), scene, i % LCD_WIDTH, i / LCD_WIDTH, frameBuffer[i], expectedFrameBuffer[i]);
+            break;
+          }
+        }
+        mismatchedScenes++;
+      }
+    }
+
+    const double microsPerFrame = (double)elapsedMicros / (scenes * COMPOSITOR_TEST_FRAMES_PER_SCENE);
+    const char* result = (compositor == LCD_COMPOSITOR_SCALAR) ? "reference" : ((mismatchedScenes == 0) ? "pixel exact" : "MISMATCHED");
+    printf("%-8s                %.1fus/frame, %s\n", lcdCompositorName(compositor), microsPerFrame, result);
+
+    if (mismatchedScenes > 0) {
+      failures++;
+    }
+  }
+
+  free(frameBuffer);
+  free(expectedFrameBuffer);
+  free(oam);
+  free(vram);
+  free(lcdController);
+
+  return (failures == 0) ? 0 : 1;
+}
+
+// A synthetic frame for the upscaler test. Most pixels repeat the one to their left or above, so there are flat areas
+// and edges for the filters to find, and with similar colours the palette is close enough together to be around the
+// thresholds the filters compare colours with.
+static void randomiseUpscaleTestFrame(Pixel* frame, uint32_t* randomState, bool similarColours)
+{
+  Pixel palette[4];
+  const uint32_t base = nextRandom(randomState) & 0xC0C0C0;
+  for (int i = 0; i < 4; i++) {
+    const uint32_t r = nextRandom(randomState);
+    palette[i] = similarColours ? (0xFF000000 | base | (r & 0x3F3F3F)) : (0xFF000000 | r);
+  }
+
+  for (int y = 0; y < LCD_HEIGHT; y++) {
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      const uint32_t r = nextRandom(randomState);
+      if ((r & 7) < 3 && x > 0) {
+        frame[(y * LCD_WIDTH) + x] = frame[(y * LCD_WIDTH) + x - 1];
+      } else if ((r & 7) < 6 && y > 0) {
+        frame[(y * LCD_WIDTH) + x] = frame[((y - 1) * LCD_WIDTH) + x];
+      } else {
+        frame[(y * LCD_WIDTH) + x] = palette[(r >> 3) & 3];
+      }
+    }
+  }
+}
+
+
+// Upscale the same synthetic frames with every filter's scalar kernel and its SIMD kernel (if the CPU supports it) and
+// check that they produce exactly the same pixels. The frame is upscaled in one go by the scalar kernel and in stripes
+// of random heights by the other, as it is when the upscaler is split across threads.
+static int runUpscaleTest(int frames)
+{
+  const uint32_t maxOutputPixels = LCD_WIDTH * UPSCALE_NEAREST_MAX_SCALE * LCD_HEIGHT * UPSCALE_NEAREST_MAX_SCALE;
+  Pixel* input = calloc(LCD_WIDTH * LCD_HEIGHT, sizeof(Pixel));
+  Pixel* expectedOutput = calloc(maxOutputPixels, sizeof(Pixel));
+  Pixel* output = calloc(maxOutputPixels, sizeof(Pixel));
+
+  if (input == NULL || expectedOutput == NULL || output == NULL) {
+    error("Failed to allocate memory for the upscaler test\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int failures = 0;
+
+  printf("Frames:                 %d\n", frames);
+
+  for (int filter = 0; filter < UPSCALE_FILTER_COUNT; filter++) {
+    const UpscaleKernelFn scalarKernel = upscaleKernelFunction(filter, false);
+    const UpscaleKernelFn simdKernel = upscaleKernelFunction(filter, true);
+    const bool hasSIMDKernel = (simdKernel != scalarKernel);
+
+    uint32_t randomState = 0x0F1175E5;
+    uint32_t mismatchedFrames = 0;
+    uint64_t scalarMicros = 0;
+    uint64_t simdMicros = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+      const uint32_t scale = upscaleFilterScale(filter, 2 + (frame % (UPSCALE_NEAREST_MAX_SCALE - 1)));
+      randomiseUpscaleTestFrame(input, &randomState, (frame & 1) != 0);
+
+      uint32_t stripeEnds[LCD_HEIGHT];
+      uint32_t stripes = 0;
+      for (uint32_t row = 0; row < LCD_HEIGHT; stripes++) {
+        row += 1 + (nextRandom(&randomState) % UPSCALE_TEST_MAX_STRIPE_ROWS);
+        stripeEnds[stripes] = (row < LCD_HEIGHT) ? row : LCD_HEIGHT;
+      }
+
+      uint64_t startTime = currentTimeMicros();
+      scalarKernel(input, expectedOutput, scale, 0, LCD_HEIGHT);
+      scalarMicros += currentTimeMicros() - startTime;
+
+      startTime = currentTimeMicros();
+      for (uint32_t stripe = 0; stripe < stripes; stripe++) {
+        simdKernel(input, output, scale, (stripe == 0) ? 0 : stripeEnds[stripe - 1], stripeEnds[stripe]);
+      }
+      simdMicros += currentTimeMicros() - startTime;
+
+      const uint32_t outputWidth = LCD_WIDTH * scale;
+      const uint32_t outputPixels = outputWidth * LCD_HEIGHT * scale;
+      if (memcmp(output, expectedOutput, outputPixels * sizeof(Pixel)) != 0) {
+        for (uint32_t i = 0; i < outputPixels; i++) {
+          if (output[i] != expectedOutput[i]) {
+            error("%s: frame %d differs from scalar at (%" PRIu32 ", %" PRIu32 "): 0x%08" PRIX32 " != 0x%08" PRIX32 "\n", upscaleFilterName(filter), frame, i % outputWidth, i / outputWidth, output[i], expectedOutput[i]);
+            break;
+          }
+        }
+        mismatchedFrames++;
+      }
+    }
+
+    const char* result = (mismatchedFrames == 0) ? "pixel exact" : "MISMATCHED";
+    if (hasSIMDKernel) {
+      printf("%-8s                scalar %.1fus/frame, sse2 %.1fus/frame, %s\n", upscaleFilterName(filter), (double)scalarMicros / frames, (double)simdMicros / frames, result);
+    } else {
+      printf("%-8s                scalar %.1fus/frame, no SIMD kernel, stripes %s\n", upscaleFilterName(filter), (double)scalarMicros / frames, result);
+    }
+
+    if (mismatchedFrames > 0) {
+      failures++;
+    }
+  }
+
+  free(output);
+  free(expectedOutput);
+  free(input);
+
+  return (failures == 0) ? 0 : 1;
+}
+
+
+// A stand-in for the frontend's audio device, which takes samples from the audio sample buffer in the blocks Core Audio
+// asks for, with a clock running a little faster or slower than the emulated one. Like the Core Audio playback it waits
+// for startSamples to build up before it starts, and again each time it runs out.
+typedef struct {
+  double samplesPerCycle;
+  double samplesOwed;
+  uint32_t startSamples;
+  bool isPlaying;
+  uint64_t gaps;
+} SimulatedAudioDevice;
+
+
+static void simulatedAudioDeviceRun(SimulatedAudioDevice* device, AudioSampleBuffer* buffer, uint32_t cycles)
+{
+  AudioSample block[SIMULATED_AUDIO_DEVICE_BLOCK];
+
+  device->samplesOwed += cycles * device->samplesPerCycle;
+
+  while (device->samplesOwed >= SIMULATED_AUDIO_DEVICE_BLOCK) {
+    device->samplesOwed -= SIMULATED_AUDIO_DEVICE_BLOCK;
+
+    if (!device->isPlaying) {
+      if (sampleBufferAvailableSamples(buffer) < (int)device->startSamples) {
+        continue;
+      }
+      device->isPlaying = true;
+    }
+
+    if (sampleBufferGetN(buffer, block, SIMULATED_AUDIO_DEVICE_BLOCK) < SIMULATED_AUDIO_DEVICE_BLOCK) {
+      device->isPlaying = false;
+      device->gaps++;
+    }
+  }
+}
+
+
+// Random gains and channel levels for a block of point sampled output
+static void randomiseMixerBlock(SoundMixerBlock* block, uint32_t* randomState)
+{
+  for (int output = 0; output < 2; output++) {
+    for (int channel = 0; channel < 4; channel++) {
+      uint32_t r = nextRandom(randomState);
+      block->gains[output][channel] = ((r & 3) == 0) ? 0 : (r >> 2) % 8;
+    }
+  }
+
+  for (int channel = 0; channel < 4; channel++) {
+    for (int i = 0; i < SOUND_MIXER_BLOCK_SAMPLES; i++) {
+      block->levels[channel][i] = (int16_t)(nextRandom(randomState) % 31) - 15;
+    }
+  }
+}
+
+
+// Mix the same random blocks with every mixer the CPU supports and check that each one produces exactly the same
+// samples as the scalar mixer. Each block is mixed in runs of random lengths, as it is when the gains change part way
+// through a block.
+static int runMixerTest(int blocks)
+{
+  SoundMixerBlock* block = malloc(sizeof(SoundMixerBlock));
+  AudioSample* expectedSamples = calloc(SOUND_MIXER_BLOCK_SAMPLES, sizeof(AudioSample));
+  AudioSample* samples = calloc(SOUND_MIXER_BLOCK_SAMPLES, sizeof(AudioSample));
+
+  if (block == NULL || expectedSamples == NULL || samples == NULL) {
+    error("Failed to allocate memory for the mixer test\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int failures = 0;
+
+  printf("Blocks:                 %d (%d samples each)\n", blocks, SOUND_MIXER_BLOCK_SAMPLES);
+  printf("Best mixer:             %s\n", soundMixerName(soundMixerBest()));
+
+  const MixSamplesFn scalarMixSamples = soundMixerFunction(SOUND_MIXER_SCALAR);
+
+  for (int mixer = 0; mixer < SOUND_MIXER_COUNT; mixer++) {
+    if (!soundMixerIsSupported(mixer)) {
+      printf("%-8s                not supported\n", soundMixerName(mixer));
+      continue;
+    }
+
+    const MixSamplesFn mixSamples = soundMixerFunction(mixer);
+    uint32_t mismatchedBlocks = 0;
+    uint64_t elapsedMicros = 0;
+
+    for (int b = 0; b < blocks; b++) {
+      uint32_t randomState = (uint32_t)b * 2654435761u + 1;
+      randomiseMixerBlock(block, &randomState);
+
+      scalarMixSamples(block, 0, SOUND_MIXER_BLOCK_SAMPLES, expectedSamples);
+
+      const uint64_t startTime = currentTimeMicros();
+      mixSamples(block, 0, SOUND_MIXER_BLOCK_SAMPLES, samples);
+      elapsedMicros += currentTimeMicros() - startTime;
+
+      bool matched = (memcmp(samples, expectedSamples, SOUND_MIXER_BLOCK_SAMPLES * sizeof(AudioSample)) == 0);
+
+      memset(samples, 0, SOUND_MIXER_BLOCK_SAMPLES * sizeof(AudioSample));
+      for (uint32_t begin = 0, end; begin < SOUND_MIXER_BLOCK_SAMPLES; begin = end) {
+        end = begin + 1 + (nextRandom(&randomState) % 64);
+        if (end > SOUND_MIXER_BLOCK_SAMPLES) {
+          end = SOUND_MIXER_BLOCK_SAMPLES;
+        }
+        mixSamples(block, begin, end, samples);
+      }
+      matched = matched && (memcmp(samples, expectedSamples, SOUND_MIXER_BLOCK_SAMPLES * sizeof(AudioSample)) == 0);
+
+      if (!matched) {
+        for (int i = 0; i < SOUND_MIXER_BLOCK_SAMPLES; i++) {
+          if (samples[i].so1 != expectedSamples[i].so1 || samples[i].so2 != expectedSamples[i].so2) {
+            error("%s: block %d differs from scalar at sample %d: (%d, %d) != (%d, %d)\n", soundMixerName(mixer), b, i, samples[i].so1, samples[i].so2, expectedSamples[i].so1, expectedSamples[i].so2);
+            break;
+          }
+        }
+        mismatchedBlocks++;
+      }
+    }
+
+    const double microsPerFrame = (double)elapsedMicros * MIXER_TEST_SAMPLES_PER_FRAME / ((double)blocks * SOUND_MIXER_BLOCK_SAMPLES);
+    const char* result = (mixer == SOUND_MIXER_SCALAR) ? "reference" : ((mismatchedBlocks == 0) ? "bit exact" : "MISMATCHED");
+    printf("%-8s                %.3fus/frame, %s\n", soundMixerName(mixer), microsPerFrame, result);
+
+    if (mismatchedBlocks > 0) {
+      failures++;
+    }
+  }
+
+  free(samples);
+  free(expectedSamples);
+  free(block);
+
+  return (failures == 0) ? 0 : 1;
+}
+
+
+// A timer stepped one clock cycle at a time, straight from the description of the hardware - TIMA increments whenever
+// the counter bit selected by TAC (while the timer is enabled) goes from high to low
+typedef struct {
+  uint16_t counter;
+  uint8_t tima;
+  uint8_t tma;
+  uint8_t tac;
+  bool overflowed;
+} ReferenceTimer;
+
+
+static const uint16_t REFERENCE_TIMER_COUNTER_BITS[] = {1 << 9, 1 << 3, 1 << 5, 1 << 7};
+
+
+static bool referenceTimerInput(const ReferenceTimer* timer)
+{
+  return (timer->tac & TAC_TIMER_STOP_BIT) && (timer->counter & REFERENCE_TIMER_COUNTER_BITS[timer->tac & TAC_INPUT_CLOCK_SELECT_BITS]);
+}
+
+
+static void referenceTimerIncrement(ReferenceTimer* timer)
+{
+  timer->tima++;
+  if (timer->tima == 0) {
+    timer->tima = timer->tma;
+    timer->overflowed = true;
+  }
+}
+
+
+static void referenceTimerStep(ReferenceTimer* timer)
+{
+  bool input = referenceTimerInput(timer);
+  timer->counter++;
+  if (input && !referenceTimerInput(timer)) {
+    referenceTimerIncrement(timer);
+  }
+}
+
+
+static void referenceTimerWrite(ReferenceTimer* timer, uint16_t address, uint8_t value)
+{
+  bool input = referenceTimerInput(timer);
+  switch (address) {
+    case IO_REG_ADDRESS_DIV:
+      timer->counter = 0;
+      break;
+    case IO_REG_ADDRESS_TIMA:
+      timer->tima = value;
+      break;
+    case IO_REG_ADDRESS_TMA:
+      timer->tma = value;
+      break;
+    case IO_REG_ADDRESS_TAC:
+      timer->tac = value;
+      break;
+  }
+  if (input && !referenceTimerInput(timer)) {
+    referenceTimerIncrement(timer);
+  }
+}
+
+
+// Check the arithmetic timer against the reference over random writes and runs of cycles - the registers after each
+// step, DIV and TIMA read part way through each run, and that the overflow is predicted for the exact cycle it happens
+static bool timerMatchesReference(TimerController* timer, InterruptController* interruptController, ReferenceTimer* reference, uint32_t* randomState)
+{
+  uint32_t r = nextRandom(randomState);
+
+  if ((r % 4) == 0) {
+    const uint16_t address = IO_REG_ADDRESS_DIV + ((r >> 2) % 4);
+    uint8_t value = nextRandom(randomState) & 0xFF;
+    if (address == IO_REG_ADDRESS_TMA && (r & (1 << 4))) {
+      value |= 0xF0; // Overflow often
+    }
+    timerWriteByte(timer, address, value);
+    referenceTimerWrite(reference, address, value);
+  } else {
+    const uint32_t maxCycles = ((r % 16) == 1) ? TIMER_TEST_MAX_LONG_STEP : TIMER_TEST_MAX_SHORT_STEP;
+    const uint32_t cycles = 1 + (nextRandom(randomState) % maxCycles);
+    const uint32_t readCycles = nextRandom(randomState) % (cycles + 1);
+
+    const uint8_t div = timerReadByte(timer, IO_REG_ADDRESS_DIV, readCycles);
+    const uint8_t tima = timerReadByte(timer, IO_REG_ADDRESS_TIMA, readCycles);
+    const uint32_t cyclesUntilOverflow = timerCyclesUntilOverflow(timer);
+
+    uint32_t overflowCycles = SCHEDULER_NO_EVENT;
+    bool readsMatched = true;
+    const bool wasOverflowed = reference->overflowed;
+    reference->overflowed = false;
+
+    for (uint32_t cycle = 0; cycle <= cycles; cycle++) {
+      if (cycle > 0) {
+        referenceTimerStep(reference);
+      }
+      if (cycle == readCycles) {
+        readsMatched = (div == (reference->counter >> 8)) && (tima == reference->tima);
+      }
+      if (reference->overflowed && overflowCycles == SCHEDULER_NO_EVENT) {
+        overflowCycles = cycle;
+      }
+    }
+    reference->overflowed = reference->overflowed || wasOverflowed;
+
+    const bool overflowMatched = (overflowCycles == SCHEDULER_NO_EVENT) ? (cyclesUntilOverflow == SCHEDULER_NO_EVENT || cyclesUntilOverflow > cycles) : (cyclesUntilOverflow == overflowCycles);
+    if (!readsMatched || !overflowMatched) {
+      error("Timer differs from reference within %u cycles (TAC=0x%02X TMA=0x%02X): read at %u gave DIV=%u TIMA=%u, overflow predicted in %u cycles, happened in %u\n", cycles, reference->tac, reference->tma, readCycles, div, tima, cyclesUntilOverflow, overflowCycles);
+      return false;
+    }
+
+    timerUpdate(timer, cycles);
+  }
+
+  const bool overflowed = (interruptController->f & TIMER_OVERFLOW_INTERRUPT_BIT) != 0;
+  if (timer->counter != reference->counter || timer->tima != reference->tima || overflowed != reference->overflowed) {
+    error("Timer differs from reference: counter=0x%04X TIMA=%u overflowed=%d, expected counter=0x%04X TIMA=%u overflowed=%d\n", timer->counter, timer->tima, overflowed, reference->counter, reference->tima, reference->overflowed);
+    return false;
+  }
+
+  return true;
+}
+
+
+static int runTimerTest(int steps)
+{
+  InterruptController interruptController;
+  TimerController timer;
+  ReferenceTimer reference = {.counter = 0, .tima = 0, .tma = 0, .tac = 0, .overflowed = false};
+
+  initInterruptController(&interruptController);
+  initTimerController(&timer, &interruptController);
+
+  uint32_t randomState = 0x5EED71AE;
+  uint32_t overflows = 0;
+  int step = 0;
+
+  for (; step < steps; step++) {
+    if (!timerMatchesReference(&timer, &interruptController, &reference, &randomState)) {
+      break;
+    }
+
+    if (reference.overflowed) {
+      overflows++;
+      reference.overflowed = false;
+      interruptReset(&interruptController, TIMER_OVERFLOW_INTERRUPT_BIT);
+    }
+  }
+
+  printf("Steps:                  %d\n", steps);
+  printf("Overflows:              %" PRIu32 "\n", overflows);
+  printf("Timer:                  %s\n", (step == steps) ? "matches reference" : "MISMATCHED");
+
+  return (step == steps) ? 0 : 1;
+}
+
+
+// Self-tests are run as "--NAME [--COUNT_FLAG N]", where the count is how much work the test does (and is named by
+// its flag in errors)
+typedef struct SelfTest {
+  const char* name;
+  const char* countFlag;
+  int defaultCount;
+  int (*run)(int count);
+} SelfTest;
+
+
+static const SelfTest selfTests[] = {
+  {"--compositor-test", "--scenes", DEFAULT_COMPOSITOR_TEST_SCENES, &runCompositorTest},
+  {"--upscale-test", "--frames", DEFAULT_UPSCALE_TEST_FRAMES, &runUpscaleTest},
+  {"--mixer-test", "--blocks", DEFAULT_MIXER_TEST_BLOCKS, &runMixerTest},
+  {"--timer-test", "--steps", DEFAULT_TIMER_TEST_STEPS, &runTimerTest},
+  {"--audio-buffer-stress", "--samples", DEFAULT_AUDIO_STRESS_SAMPLES, &runAudioBufferStressTest}
+};
+
+#define SELF_TEST_COUNT (sizeof(selfTests) / sizeof(selfTests[0]))
+
+
+// Returns false if the arguments don't name a self-test, otherwise runs it and sets its exit status
+static bool runSelfTest(int argc, const char* argv[], int* exitStatus)
+{
+  for (size_t i = 0; i < SELF_TEST_COUNT; i++) {
+    const SelfTest* test = &selfTests[i];
+    if (strcmp(argv[1], test->name) != 0) {
+      continue;
+    }
+
+    int count = test->defaultCount;
+    if (argc == 4 && strcmp(argv[2], test->countFlag) == 0) {
+      count = atoi(argv[3]);
+    } else if (argc != 2) {
+      printUsage(argv[0]);
+      *exitStatus = 1;
+      return true;
+    }
+    if (count <= 0) {
+      error("Number of %s must be positive\n", test->countFlag + 2);
+      *exitStatus = 1;
+      return true;
+    }
+
+    *exitStatus = test->run(count);
+    return true;
+  }
+
+  return false;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  if (argc < 2) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+    printUsage(argv[0]);
+    return 0;
+  }
+
+  int selfTestExitStatus;
+  if (runSelfTest(argc, argv, &selfTestExitStatus)) {
+    return selfTestExitStatus;
+  }
+
+  // Any other option here was given before the ROM path (or is a mistyped self-test)
+  if (strncmp(argv[1], "--", 2) == 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const char* romPath = argv[1];
+  GameBoyType gameBoyType = GB;
+  int framesToRun = DEFAULT_FRAMES_TO_RUN;
+  bool idleLoopSkipping = true;
+  LCDCompositor compositor = lcdCompositorBest();
+  int frameSkip = 1;
+  SoundSynthesis audioSynthesis = SOUND_SYNTHESIS_BAND_LIMITED;
+  bool upscaling = false;
+  UpscaleFilter upscaleFilter = UPSCALE_FILTER_NEAREST;
+  int upscaleNearestScale = DEFAULT_UPSCALE_NEAREST_SCALE;
+  int upscaleThreads = 1;
+  bool upscaleSIMD = true;
+  const char* upscaleOutputPath = NULL;
+  const char* wavOutputPrefix = NULL;
+  bool wavChannels = true;
+  bool simulateAudioDevice = false;
+  double audioDeviceSkewPercent = 0;
+  bool dynamicRateControl = false;
+
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--gb") == 0) {
+      gameBoyType = GB;
+    } else if (strcmp(argv[i], "--cgb") == 0) {
+      gameBoyType = CGB;
+    } else if (strcmp(argv[i], "--no-idle-loop-skipping") == 0) {
+      idleLoopSkipping = false;
+    } else if (strcmp(argv[i], "--frames") == 0 && (i + 1) < argc) {
+      framesToRun = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--frame-skip") == 0 && (i + 1) < argc) {
+      frameSkip = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--audio") == 0 && (i + 1) < argc) {
+      if (!parseAudioSynthesis(argv[++i], &audioSynthesis)) {
+        error("Unknown audio synthesis '%s'\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--wav-output") == 0 && (i + 1) < argc) {
+      wavOutputPrefix = argv[++i];
+    } else if (strcmp(argv[i], "--wav-no-channels") == 0) {
+      wavChannels = false;
+    } else if (strcmp(argv[i], "--audio-device-skew") == 0 && (i + 1) < argc) {
+      simulateAudioDevice = true;
+      audioDeviceSkewPercent = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--dynamic-rate-control") == 0) {
+      dynamicRateControl = true;
+    } else if (strcmp(argv[i], "--upscale") == 0 && (i + 1) < argc) {
+      upscaling = true;
+      if (!parseUpscaleFilter(argv[++i], &upscaleFilter)) {
+        error("Unknown upscale filter '%s'\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--upscale-scale") == 0 && (i + 1) < argc) {
+      upscaleNearestScale = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--upscale-threads") == 0 && (i + 1) < argc) {
+      upscaleThreads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--upscale-no-simd") == 0) {
+      upscaleSIMD = false;
+    } else if (strcmp(argv[i], "--upscale-output") == 0 && (i + 1) < argc) {
+      upscaleOutputPath = argv[++i];
+    } else if (strcmp(argv[i], "--compositor") == 0 && (i + 1) < argc) {
+      if (!parseCompositor(argv[++i], &compositor) || !lcdCompositorIsSupported(compositor)) {
+        error("Compositor '%s' is unknown or not supported by this CPU\n", argv[i]);
+        return 1;
+      }
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (framesToRun <= 0) {
+    error("Number of frames to run must be positive\n");
+    return 1;
+  }
+
+  if (frameSkip < 0) {
+    error("Frame skip interval can't be negative\n");
+    return 1;
+  }
+
+  if (upscaleNearestScale < 1 || upscaleNearestScale > UPSCALE_NEAREST_MAX_SCALE) {
+    error("Upscale scale must be between 1 and %d\n", UPSCALE_NEAREST_MAX_SCALE);
+    return 1;
+  }
+
+  if (upscaleThreads < 1 || upscaleThreads > UPSCALER_MAX_THREADS) {
+    error("Number of upscale threads must be between 1 and %d\n", UPSCALER_MAX_THREADS);
+    return 1;
+  }
+
+  const char* romFilename = basename(romPath);
+
+  GameBoy gameBoy;
+  Pixel frameBuffer[LCD_WIDTH * LCD_HEIGHT];
+  AudioSampleBuffer audioSampleBuffer;
+
+  memset(frameBuffer, 0, sizeof(frameBuffer));
+
+  CartridgeROM* rom = cartridgeOpenROM(romPath);
+  if (rom == NULL) {
+    error("Failed to read cartridge from '%s'\n", romPath);
+    exit(EXIT_FAILURE);
+  }
+
+  // Samples are produced as normal but never consumed, so the buffer size only needs to match the frontend's
+  sampleBufferInitialise(&audioSampleBuffer, 512 * 10);
+
+  gbInitialise(&gameBoy, gameBoyType, rom->data, frameBuffer, romFilename);
+  gbSetIdleLoopSkipping(&gameBoy, idleLoopSkipping);
+  gbSetLCDCompositor(&gameBoy, compositor);
+  gbSetFrameSkip(&gameBoy, frameSkip);
+  gbSetAudioSynthesis(&gameBoy, audioSynthesis);
+
+  // The audio output is otherwise thrown away, so recording it is the only way to hear (or compare) it
+  AudioFileSink* audioFileSink = NULL;
+  if (wavOutputPrefix != NULL) {
+    audioFileSink = audioFileSinkOpen(wavOutputPrefix, AUDIO_SAMPLE_RATE, wavChannels);
+    if (audioFileSink == NULL) {
+      exit(EXIT_FAILURE);
+    }
+    gbSetAudioFileSink(&gameBoy, audioFileSink);
+  }
+
+  // The samples are taken by a simulated audio device, and with dynamic rate control the output is resampled after every
+  // frame to keep the device's buffer near its target
+  SimulatedAudioDevice audioDevice = {
+    .samplesPerCycle = (AUDIO_SAMPLE_RATE * (1.0 + (audioDeviceSkewPercent / 100.0))) / CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED,
+    .samplesOwed = 0,
+    .startSamples = dynamicRateControl ? AUDIO_RATE_CONTROL_DEFAULT_TARGET_SAMPLES : 0,
+    .isPlaying = false,
+    .gaps = 0
+  };
+  AudioRateControl rateControl;
+  audioRateControlInitialise(&rateControl, AUDIO_RATE_CONTROL_DEFAULT_TARGET_SAMPLES, AUDIO_RATE_CONTROL_DEFAULT_MAX_DEVIATION);
+  uint32_t minAudioSamplesBuffered = UINT32_MAX;
+  uint32_t maxAudioSamplesBuffered = 0;
+  double minAudioRateRatio = 1.0;
+  double maxAudioRateRatio = 1.0;
+
+  // Every frame is handed to the upscaler, which works through them on its own threads while the emulator runs
+  Upscaler* upscaler = NULL;
+  UpscaledFrame upscaledFrame = {NULL, 0, 0};
+  if (upscaling) {
+    uint32_t scale = upscaleFilterScale(upscaleFilter, upscaleNearestScale);
+    upscaledFrame.pixels = (Pixel*)calloc(LCD_WIDTH * scale * LCD_HEIGHT * scale, sizeof(Pixel));
+    if (upscaledFrame.pixels == NULL) {
+      error("Failed to allocate memory for the upscaled frame\n");
+      exit(EXIT_FAILURE);
+    }
+    upscaler = upscalerCreate(upscaleFilter, upscaleNearestScale, upscaleThreads, upscaleSIMD, &keepUpscaledFrame, &upscaledFrame);
+  }
+  bool lastFrameWasUpscaled = true;
+
+  // Run whole emulated frames back to back, carrying over any cycles that overshoot a frame into the next one
+  uint64_t totalCyclesRun = 0;
+  int cyclesToRun = FULL_FRAME_CLOCK_CYCLES;
+
+  const uint64_t startTime = currentTimeMicros();
+
+  for (int frame = 0; frame < framesToRun; frame++) {
+    // With a frame skip interval of 0 only the frame that starts during the second to last run is drawn, so that the
+    // frame buffer checksum still covers a complete frame
+    if (frameSkip == 0 && frame == framesToRun - 2) {
+      gbRequestFrame(&gameBoy);
+    }
+
+    int cyclesRun = gbRunAtLeastNCycles(&gameBoy, &audioSampleBuffer, cyclesToRun);
+    int extraCycles = cyclesRun - cyclesToRun;
+    cyclesToRun = FULL_FRAME_CLOCK_CYCLES - extraCycles;
+    totalCyclesRun += cyclesRun;
+
+    if (simulateAudioDevice) {
+      simulatedAudioDeviceRun(&audioDevice, &audioSampleBuffer, cyclesRun);
+
+      uint32_t samplesBuffered = sampleBufferAvailableSamples(&audioSampleBuffer);
+      if (audioDevice.isPlaying) {
+        minAudioSamplesBuffered = (samplesBuffered < minAudioSamplesBuffered) ? samplesBuffered : minAudioSamplesBuffered;
+        maxAudioSamplesBuffered = (samplesBuffered > maxAudioSamplesBuffered) ? samplesBuffered : maxAudioSamplesBuffered;
+      }
+
+      if (dynamicRateControl) {
+        double ratio = audioRateControlUpdate(&rateControl, samplesBuffered);
+        gbSetAudioRateRatio(&gameBoy, ratio);
+        minAudioRateRatio = (ratio < minAudioRateRatio) ? ratio : minAudioRateRatio;
+        maxAudioRateRatio = (ratio > maxAudioRateRatio) ? ratio : maxAudioRateRatio;
+      }
+    }
+
+    if (upscaler != NULL) {
+      lastFrameWasUpscaled = upscalerSubmitFrame(upscaler, frameBuffer);
+    }
+  }
+
+  const uint64_t elapsedMicros = currentTimeMicros() - startTime;
+
+  // The upscaled output is always of the final frame, even if the upscaler had to drop it
+  if (upscaler != NULL) {
+    upscalerFlush(upscaler);
+    if (!lastFrameWasUpscaled) {
+      upscalerSubmitFrame(upscaler, frameBuffer);
+      upscalerFlush(upscaler);
+    }
+  }
+  const double elapsedSeconds = (elapsedMicros > 0 ? elapsedMicros : 1) / 1000000.0;
+  const double emulatedSeconds = (double)totalCyclesRun / CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED;
+
+  const GameBoyStats stats = gbGetStats(&gameBoy);
+
+  printf("ROM:                    %s\n", romFilename);
+  printf("Frames:                 %d\n", framesToRun);
+  printf("CPU dispatch:           %s\n", cpuDispatchName());
+  printf("Idle loop skipping:     %s\n", idleLoopSkipping ? "on" : "off");
+  printf("LCD compositor:         %s\n", lcdCompositorName(compositor));
+  printf("Frame skip:             %s%d\n", (frameSkip == 0) ? "last frame only, " : "draw every ", frameSkip);
+  printf("Audio synthesis:        %s\n", soundSynthesisName(audioSynthesis));
+  printf("Emulated cycles:        %" PRIu64 "\n", totalCyclesRun);
+  printf("Instructions:           %" PRIu64 "\n", stats.instructionsExecuted);
+  printf("Idle cycles skipped:    %" PRIu64 " (%.1f%%, %.0f/frame)\n", stats.idleLoopCyclesSkipped, (100.0 * stats.idleLoopCyclesSkipped) / totalCyclesRun, (double)stats.idleLoopCyclesSkipped / framesToRun);
+  printf("Host time:              %.3fs\n", elapsedSeconds);
+  printf("Emulated cycles/s:      %.0f\n", totalCyclesRun / elapsedSeconds);
+  printf("Instructions/s:         %.0f\n", stats.instructionsExecuted / elapsedSeconds);
+  printf("Emulated frames/s:      %.2f\n", framesToRun / elapsedSeconds);
+  printf("Host ns/emulated frame: %.0f\n", (elapsedMicros * 1000.0) / framesToRun);
+  printf("Speed:                  %.2fx real time\n", emulatedSeconds / elapsedSeconds);
+  printf("Frame buffer checksum:  0x%08" PRIX32 "\n", frameBufferChecksum(frameBuffer));
+
+  if (simulateAudioDevice) {
+    printf("Audio device skew:      %+.3f%%\n", audioDeviceSkewPercent);
+    printf("Dynamic rate control:   %s\n", dynamicRateControl ? "on" : "off");
+    printf("Audio buffer fill:      %" PRIu32 " samples (%" PRIu32 " to %" PRIu32 " while playing)\n", (uint32_t)sampleBufferAvailableSamples(&audioSampleBuffer), (minAudioSamplesBuffered == UINT32_MAX) ? 0 : minAudioSamplesBuffered, maxAudioSamplesBuffered);
+    printf("Audio rate ratio:       %.5f (%.5f to %.5f)\n", stats.audioRateRatio, minAudioRateRatio, maxAudioRateRatio);
+    printf("Audio gaps:             %" PRIu64 " (%" PRIu64 " samples short, %" PRIu64 " dropped)\n", audioDevice.gaps, sampleBufferUnderruns(&audioSampleBuffer), sampleBufferOverruns(&audioSampleBuffer));
+  }
+
+  int result = 0;
+
+  if (upscaler != NULL) {
+    const double upscaleMicrosPerFrame = (double)upscaler->upscaleMicros / (upscaler->framesUpscaled > 0 ? upscaler->framesUpscaled : 1);
+
+    printf("Upscaler:               %s, %" PRIu32 "x%" PRIu32 ", %d thread%s%s\n", upscaleFilterName(upscaleFilter), upscaledFrame.width, upscaledFrame.height, upscaleThreads, (upscaleThreads == 1) ? "" : "s", upscaleSIMD ? "" : ", no SIMD");
+    printf("Frames upscaled:        %" PRIu64 " (%" PRIu64 " dropped)\n", upscaler->framesUpscaled, upscaler->framesDropped);
+    printf("Upscale time:           %.1fus/frame\n", upscaleMicrosPerFrame);
+    printf("Upscaled checksum:      0x%08" PRIX32 "\n", pixelsChecksum(upscaledFrame.pixels, upscaledFrame.width * upscaledFrame.height));
+
+    if (upscaleOutputPath != NULL) {
+      if (writePPM(upscaleOutputPath, upscaledFrame.pixels, upscaledFrame.width, upscaledFrame.height)) {
+        printf("Upscaled output:        %s\n", upscaleOutputPath);
+      } else {
+        error("Failed to write upscaled output to '%s'\n", upscaleOutputPath);
+        result = 1;
+      }
+    }
+
+    upscalerDestroy(upscaler);
+    free(upscaledFrame.pixels);
+  }
+
+  if (audioFileSink != NULL) {
+    gbSetAudioFileSink(&gameBoy, NULL);
+    if (audioFileSinkClose(audioFileSink)) {
+      printf("WAV output:             %s.wav%s\n", wavOutputPrefix, wavChannels ? " (and -ch1 to -ch4)" : "");
+    } else {
+      result = 1;
+    }
+  }
+
+  gbFinalise(&gameBoy);
+  sampleBufferFinalise(&audioSampleBuffer);
+
+  free((void*)romFilename);
+  cartridgeCloseROM(rom);
+
+  return result;
+}
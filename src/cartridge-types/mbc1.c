@@ -17,10 +17,30 @@ typedef struct {
   uint8_t bankSelect; // 2-bit register to select EITHER RAM Bank 00-03h or to specify the upper two bits (5 and 6, 0-based) of the ROM bank mapped to 0x4000-0x7FFF
   uint8_t modeSelect; // 1-bit register to select whether the above 2-bit register applies to ROM/RAM bank selection
 
-  FILE* batteryFile;
+  uint8_t* romBankData; // The ROM bank currently mapped to 0x4000-0x7FFF
+  uint32_t ramBankOffset; // Offset into external RAM of the bank currently mapped to 0xA000-0xBFFF
+
+  BatteryFile* batteryFile;
 } MBC1;
 
 
+// Called whenever a bank register changes. Writes to battery-backed RAM also mark the battery file dirty, so they always
+// go through mbc1WriteByte().
+static void mbc1UpdateBanks(MemoryController* memoryController)
+{
+  MBC1* mbc1 = (MBC1*)memoryController->mbc;
+
+  uint8_t romBankNumber = ((mbc1->modeSelect == 0) ? (mbc1->bankSelect << 5) : 0) | mbc1->romBank;
+  uint8_t ramBankNumber = ((mbc1->modeSelect == 1) ? mbc1->bankSelect : 0);
+
+  mbc1->romBankData = memoryController->cartridge + (romBankNumber * 16 * 1024);
+  mbc1->ramBankOffset = ramBankNumber * 8 * 1024;
+
+  memoryMapPages(memoryController, 0x4000, 16 * 1024, mbc1->romBankData, NULL);
+  memoryMapExternalRAM(memoryController, mbc1->externalRAM, mbc1->externalRAMSize, mbc1->ramBankOffset, mbc1->ramEnabled, mbc1->ramEnabled && (mbc1->batteryFile == NULL));
+}
+
+
 uint8_t mbc1ReadByte(MemoryController* memoryController, uint16_t address)
 {
   MBC1* mbc1 = (MBC1*)memoryController->mbc;
@@ -28,13 +48,10 @@ uint8_t mbc1ReadByte(MemoryController* memoryController, uint16_t address)
   if (address <= 0x3FFF) { // Read from ROM Bank 0
     return memoryController->cartridge[address];
   } else if (address >= 0x4000 && address <= 0x7FFF) { // Read from ROM Banks 01-7F
-    uint8_t bankNumber = ((mbc1->modeSelect == 0) ? (mbc1->bankSelect << 5) : 0) | mbc1->romBank;
-    uint32_t romAddress = (bankNumber * 16 * 1024) + (address - 0x4000);
-    return memoryController->cartridge[romAddress];
+    return mbc1->romBankData[address - 0x4000];
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Read from external cartridge RAM
     if (mbc1->ramEnabled) {
-      uint8_t bankNumber = ((mbc1->modeSelect == 1) ? mbc1->bankSelect : 0);
-      uint16_t ramAddress = (bankNumber * 8 * 1024) + (address - 0xA000);
+      uint16_t ramAddress = mbc1->ramBankOffset + (address - 0xA000);
       assert(ramAddress < mbc1->externalRAMSize);
       return mbc1->externalRAM[ramAddress];
     } else {
@@ -74,8 +91,7 @@ void mbc1WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
     mbc1->modeSelect = value & 1;
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Write to external cartridge RAM
     if (mbc1->ramEnabled) {
-      uint8_t bankNumber = ((mbc1->modeSelect == 1) ? mbc1->bankSelect : 0);
-      uint16_t ramAddress = (bankNumber * 8 * 1024) + (address - 0xA000);
+      uint16_t ramAddress = mbc1->ramBankOffset + (address - 0xA000);
       assert(ramAddress < mbc1->externalRAMSize);
       mbc1->externalRAM[ramAddress] = value;
       if (mbc1->batteryFile != NULL) {
@@ -87,6 +103,10 @@ void mbc1WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
   } else {
     commonWriteByte(memoryController, address, value);
   }
+
+  if (address <= 0x7FFF) {
+    mbc1UpdateBanks(memoryController);
+  }
 }
 
 
@@ -126,7 +146,11 @@ void mbc1InitialiseMemoryController(
 
   memoryController->readByteImpl = &mbc1ReadByte;
   memoryController->writeByteImpl = &mbc1WriteByte;
+  memoryController->finaliseImpl = &mbc1FinaliseMemoryController;
   memoryController->mbc = mbc1;
+
+  memoryMapPages(memoryController, 0x0000, 16 * 1024, memoryController->cartridge, NULL);
+  mbc1UpdateBanks(memoryController);
 }
 
 
@@ -135,7 +159,7 @@ void mbc1FinaliseMemoryController(MemoryController* memoryController)
   MBC1* mbc1 = (MBC1*)memoryController->mbc;
 
   if (mbc1->batteryFile != NULL) {
-    fclose(mbc1->batteryFile);
+    batteryFileClose(mbc1->batteryFile);
   }
 
   if (mbc1->externalRAM != NULL) {
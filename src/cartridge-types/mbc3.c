@@ -3,6 +3,7 @@
 #include "../battery.h"
 #include "../logging.h"
 #include "../memory.h"
+#include "../scheduler.h"
 
 #include <assert.h>
 #include <inttypes.h>
@@ -17,7 +18,9 @@
 
 #define SIZEOF_MEMBER(TYPE, MEMBER) sizeof(((TYPE*)0)->MEMBER)
 
+#define DAY_HIGH_DAY_COUNTER_MSB_BIT (1 << 0)
 #define DAY_HIGH_HALT_BIT_SELECT (1 << 6)
+#define DAY_HIGH_DAY_COUNTER_CARRY_BIT (1 << 7)
 
 // The number of CPU clock cycles that need to occur to trigger an increment to the seconds value
 // Yes, this is NOT 32,768, the frequency of the oscillator in the real MBC3 RTC
@@ -44,23 +47,109 @@ typedef struct {
   uint8_t ramBankOrRTCRegister;
   uint8_t latch;
 
-  RTC rtc;
-  RTC _rtc;
+  uint8_t* romBankData; // The ROM bank currently mapped to 0x4000-0x7FFF
+  uint32_t ramBankOffset; // Offset into external RAM of the bank currently mapped to 0xA000-0xBFFF
 
-  uint32_t cycles;
+  RTC rtc; // The latched registers the game reads
+  RTC _rtc; // The clock itself, as of the last time it was brought up to date
+
+  uint64_t cycles; // Clock cycles counted towards the clock's next seconds, which are only added when it is latched, written or saved
   time_t lastSaveTime;
 
-  FILE* batteryFile;
+  BatteryFile* batteryFile;
 } MBC3;
 
 
 #define RTC_SAVE_SIZE \
   SIZEOF_MEMBER(MBC3, rtc) + \
   SIZEOF_MEMBER(MBC3, _rtc) + \
-  SIZEOF_MEMBER(MBC3, cycles) + \
+  sizeof(uint32_t) + \
   sizeof(uint64_t)
 
 
+// Adds whole seconds to a clock in one go, carrying into the minutes, hours and 9-bit day counter, which sets the carry
+// bit when it overflows
+static void mbc3AdvanceClock(RTC* clock, uint64_t seconds)
+{
+  uint64_t total = clock->seconds + seconds;
+  clock->seconds = total % 60;
+
+  total = clock->minutes + (total / 60);
+  clock->minutes = total % 60;
+
+  total = clock->hours + (total / 60);
+  clock->hours = total % 24;
+
+  uint64_t days = (((clock->dayHigh & DAY_HIGH_DAY_COUNTER_MSB_BIT) << 8) | clock->dayLow) + (total / 24);
+  clock->dayLow = days & 0xFF;
+  clock->dayHigh = (clock->dayHigh & ~DAY_HIGH_DAY_COUNTER_MSB_BIT) | ((days >> 8) & DAY_HIGH_DAY_COUNTER_MSB_BIT) | ((days >= 512) ? DAY_HIGH_DAY_COUNTER_CARRY_BIT : 0);
+}
+
+
+// Adds the seconds counted since the clock was last brought up to date, leaving the cycles towards the next one
+static void mbc3UpdateClock(MBC3* mbc3)
+{
+  mbc3AdvanceClock(&mbc3->_rtc, mbc3->cycles / RTC_TICK_FREQUENCY);
+  mbc3->cycles %= RTC_TICK_FREQUENCY;
+}
+
+
+static void mbc3RTCRead(MBC3* mbc3, const uint8_t* rtcData)
+{
+  int i = 0;
+
+  mbc3->rtc.seconds  = rtcData[i++];
+  mbc3->rtc.minutes  = rtcData[i++];
+  mbc3->rtc.hours    = rtcData[i++];
+  mbc3->rtc.dayLow   = rtcData[i++];
+  mbc3->rtc.dayHigh  = rtcData[i++];
+  mbc3->_rtc.seconds = rtcData[i++];
+  mbc3->_rtc.minutes = rtcData[i++];
+  mbc3->_rtc.hours   = rtcData[i++];
+  mbc3->_rtc.dayLow  = rtcData[i++];
+  mbc3->_rtc.dayHigh = rtcData[i++];
+
+  mbc3->cycles = 0;
+  for (int byte = 0; byte < sizeof(uint32_t); byte++) {
+    mbc3->cycles |= (uint64_t)rtcData[i++] << (byte * 8);
+  }
+
+  uint64_t lastSaveTime = 0;
+  for (int byte = 0; byte < sizeof(uint64_t); byte++) {
+    lastSaveTime |= (uint64_t)rtcData[i++] << (byte * 8);
+  }
+  mbc3->lastSaveTime = (time_t)lastSaveTime;
+}
+
+
+// The clock is brought up to date first, so the cycles left over always fit the 32 bits saved for them
+static void mbc3RTCWrite(MBC3* mbc3, uint8_t* rtcData)
+{
+  mbc3UpdateClock(mbc3);
+
+  int i = 0;
+
+  rtcData[i++] = mbc3->rtc.seconds;
+  rtcData[i++] = mbc3->rtc.minutes;
+  rtcData[i++] = mbc3->rtc.hours;
+  rtcData[i++] = mbc3->rtc.dayLow;
+  rtcData[i++] = mbc3->rtc.dayHigh;
+  rtcData[i++] = mbc3->_rtc.seconds;
+  rtcData[i++] = mbc3->_rtc.minutes;
+  rtcData[i++] = mbc3->_rtc.hours;
+  rtcData[i++] = mbc3->_rtc.dayLow;
+  rtcData[i++] = mbc3->_rtc.dayHigh;
+
+  for (int byte = 0; byte < sizeof(uint32_t); byte++) {
+    rtcData[i++] = (mbc3->cycles >> (byte * 8)) & 0xFF;
+  }
+
+  for (int byte = 0; byte < sizeof(uint64_t); byte++) {
+    rtcData[i++] = (((uint64_t)mbc3->lastSaveTime) >> (byte * 8)) & 0xFF;
+  }
+}
+
+
 static void mbc3SaveBufferRead(MBC3* mbc3, uint8_t* saveBuffer)
 {
   int i = 0;
@@ -72,27 +161,7 @@ static void mbc3SaveBufferRead(MBC3* mbc3, uint8_t* saveBuffer)
   }
 
   if (mbc3->timer) {
-    mbc3->rtc.seconds  = saveBuffer[i++];
-    mbc3->rtc.minutes  = saveBuffer[i++];
-    mbc3->rtc.hours    = saveBuffer[i++];
-    mbc3->rtc.dayLow   = saveBuffer[i++];
-    mbc3->rtc.dayHigh  = saveBuffer[i++];
-    mbc3->_rtc.seconds = saveBuffer[i++];
-    mbc3->_rtc.minutes = saveBuffer[i++];
-    mbc3->_rtc.hours   = saveBuffer[i++];
-    mbc3->_rtc.dayLow  = saveBuffer[i++];
-    mbc3->_rtc.dayHigh = saveBuffer[i++];
-
-    mbc3->cycles = 0; // This MUST be zeroed because the following loop relies on constly updating the existing value which on the first iteration could be anything
-    for (int byte = 0; byte < sizeof(mbc3->cycles); byte++) {
-      mbc3->cycles = (saveBuffer[i++] << (byte * 8)) | mbc3->cycles;
-    }
-
-    mbc3->lastSaveTime = (time_t)0; // This MUST be zeroed because the following loop relies on constly updating the existing value which on the first iteration could be anything
-    for (int byte = 0; byte < sizeof(uint64_t); byte++) {
-      uint8_t saveByte = saveBuffer[i++];
-      mbc3->lastSaveTime = (time_t)((saveByte << (byte * 8)) | ((uint64_t)mbc3->lastSaveTime));
-    }
+    mbc3RTCRead(mbc3, &saveBuffer[i]);
   }
 }
 
@@ -110,24 +179,7 @@ static void mbc3SaveBufferWrite(MBC3* mbc3, uint8_t* saveBuffer)
   }
 
   if (mbc3->timer) {
-    saveBuffer[i++] = mbc3->rtc.seconds;
-    saveBuffer[i++] = mbc3->rtc.minutes;
-    saveBuffer[i++] = mbc3->rtc.hours;
-    saveBuffer[i++] = mbc3->rtc.dayLow;
-    saveBuffer[i++] = mbc3->rtc.dayHigh;
-    saveBuffer[i++] = mbc3->_rtc.seconds;
-    saveBuffer[i++] = mbc3->_rtc.minutes;
-    saveBuffer[i++] = mbc3->_rtc.hours;
-    saveBuffer[i++] = mbc3->_rtc.dayLow;
-    saveBuffer[i++] = mbc3->_rtc.dayHigh;
-
-    for (int byte = 0; byte < sizeof(mbc3->cycles); byte++) {
-      saveBuffer[i++] = (mbc3->cycles >> (byte * 8)) & 0xFF;
-    }
-
-    for (int byte = 0; byte < sizeof(uint64_t); byte++) {
-      saveBuffer[i++] = (((uint64_t)mbc3->lastSaveTime) >> (byte * 8)) & 0xFF;
-    }
+    mbc3RTCWrite(mbc3, &saveBuffer[i]);
   }
 }
 
@@ -153,28 +205,37 @@ static void mbc3UpdateLastSaveTime(MBC3* mbc3)
 }
 
 
+// Puts the clock (with the time it was saved at) into the battery file's copy of the save, to be written to disk with
+// the next flush of the external RAM. This happens whenever the game latches or sets the clock, and when the cartridge
+// is closed - any one of those is a consistent point for mbc3FastForwardRTC() to carry on from.
 static void mbc3SaveRTC(MBC3* mbc3)
 {
-  uint16_t saveAddress = mbc3->externalRAMSize;
-
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->rtc.seconds);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->rtc.minutes);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->rtc.hours);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->rtc.dayLow);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->rtc.dayHigh);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->_rtc.seconds);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->_rtc.minutes);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->_rtc.hours);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->_rtc.dayLow);
-  batteryFileWriteByte(mbc3->batteryFile, saveAddress++, mbc3->_rtc.dayHigh);
-
-  for (int byte = 0; byte < sizeof(mbc3->cycles); byte++) {
-    batteryFileWriteByte(mbc3->batteryFile, saveAddress++, (mbc3->cycles >> (byte * 8)) & 0xFF);
+  if (mbc3->batteryFile == NULL || !mbc3->timer) {
+    return;
   }
 
-  for (int byte = 0; byte < sizeof(uint64_t); byte++) {
-    batteryFileWriteByte(mbc3->batteryFile, saveAddress++, (((uint64_t)mbc3->lastSaveTime) >> (byte * 8)) & 0xFF);
-  }
+  uint8_t rtcData[RTC_SAVE_SIZE];
+
+  mbc3UpdateLastSaveTime(mbc3);
+  mbc3RTCWrite(mbc3, rtcData);
+
+  batteryFileWrite(mbc3->batteryFile, mbc3->externalRAMSize, rtcData, sizeof(rtcData));
+}
+
+
+// Called whenever a bank register changes. Writes to battery-backed RAM also mark the battery file dirty, so they always
+// go through mbc3WriteByte(), as do reads and writes of the RTC registers.
+static void mbc3UpdateBanks(MemoryController* memoryController)
+{
+  MBC3* mbc3 = (MBC3*)memoryController->mbc;
+
+  bool ramIsSelected = mbc3->ramAndTimerEnabled && (mbc3->ramBankOrRTCRegister <= 0x03);
+
+  mbc3->romBankData = memoryController->cartridge + (mbc3->romBank * 16 * 1024);
+  mbc3->ramBankOffset = (mbc3->ramBankOrRTCRegister <= 0x03) ? (mbc3->ramBankOrRTCRegister * 8 * 1024) : 0;
+
+  memoryMapPages(memoryController, 0x4000, 16 * 1024, mbc3->romBankData, NULL);
+  memoryMapExternalRAM(memoryController, mbc3->externalRAM, mbc3->externalRAMSize, mbc3->ramBankOffset, ramIsSelected, ramIsSelected && (mbc3->batteryFile == NULL));
 }
 
 
@@ -185,12 +246,11 @@ uint8_t mbc3ReadByte(MemoryController* memoryController, uint16_t address)
   if (address <= 0x3FFF) { // Read from ROM Bank 0
     return memoryController->cartridge[address];
   } else if (address >= 0x4000 && address <= 0x7FFF) { // Read from ROM Banks 01-7F
-    uint32_t romAddress = (mbc3->romBank * 16 * 1024) + (address - 0x4000);
-    return memoryController->cartridge[romAddress];
+    return mbc3->romBankData[address - 0x4000];
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Read from external cartridge RAM/RTC registers
     if (mbc3->ramAndTimerEnabled) {
       if (mbc3->ramBankOrRTCRegister <= 0x03) {
-        uint16_t ramAddress = (mbc3->ramBankOrRTCRegister * 8 * 1024) + (address - 0xA000);
+        uint16_t ramAddress = mbc3->ramBankOffset + (address - 0xA000);
         assert(ramAddress < mbc3->externalRAMSize);
         return mbc3->externalRAM[ramAddress];
       } else if (mbc3->ramBankOrRTCRegister >= 0x08 && mbc3->ramBankOrRTCRegister <= 0x0C) {
@@ -254,20 +314,23 @@ void mbc3WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
     mbc3->ramBankOrRTCRegister = value;
   } else if (address >= 0x6000 && address <= 0x7FFF) { // Latch Clock Data
     if (mbc3->latch == 0 && value == 1) {
+      mbc3UpdateClock(mbc3);
       mbc3->rtc = mbc3->_rtc;
+      mbc3SaveRTC(mbc3);
     }
     mbc3->latch = value;
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Write to external cartridge RAM/RTC registers
     if (mbc3->ramAndTimerEnabled) {
       if (mbc3->ramAndTimerEnabled) {
         if (mbc3->ramBankOrRTCRegister <= 0x03) {
-          uint16_t ramAddress = (mbc3->ramBankOrRTCRegister * 8 * 1024) + (address - 0xA000);
+          uint16_t ramAddress = mbc3->ramBankOffset + (address - 0xA000);
           assert(ramAddress < mbc3->externalRAMSize);
           mbc3->externalRAM[ramAddress] = value;
           if (mbc3->batteryFile != NULL) {
             batteryFileWriteByte(mbc3->batteryFile, ramAddress, value);
           }
         } else if (mbc3->ramBankOrRTCRegister >= 0x08 && mbc3->ramBankOrRTCRegister <= 0x0C) {
+          mbc3UpdateClock(mbc3); // The seconds counted so far (if any) were counted before the write, including one to the halt bit
           switch (mbc3->ramBankOrRTCRegister) {
             case 0x08:
               if (value < 60) {
@@ -299,7 +362,6 @@ void mbc3WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
               warning("MBC3: Unhandled value 0x%02X for RTC register selection\n", mbc3->ramBankOrRTCRegister);
               break;
           }
-          mbc3UpdateLastSaveTime(mbc3);
           mbc3SaveRTC(mbc3);
         } else {
           warning("MBC3: Unhandled value 0x%02X for RAM bank/RTC register selection\n", mbc3->ramBankOrRTCRegister);
@@ -313,111 +375,37 @@ void mbc3WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
   } else {
     commonWriteByte(memoryController, address, value);
   }
-}
-
-
-static void mbc3IncrementDays(MBC3* mbc3)
-{
-  uint16_t dayCounterBefore = ((mbc3->_rtc.dayHigh & 1) << 8) | mbc3->_rtc.dayLow;
-  uint16_t dayCounterAfter = (dayCounterBefore + 1) % 512;
-
-  uint8_t dayCounterMostSignificantBit = (dayCounterAfter & 0x100) >> 8;
-  uint8_t dayCounterCarry = (dayCounterAfter == 0) << 7;
-
-  mbc3->_rtc.dayLow = (dayCounterAfter & 0xFF);
-  mbc3->_rtc.dayHigh = mbc3->_rtc.dayHigh | dayCounterCarry | dayCounterMostSignificantBit;
-}
-
-
-static void mbc3IncrementHours(MBC3* mbc3)
-{
-  mbc3->_rtc.hours = (mbc3->_rtc.hours + 1) % 24;
-  if (mbc3->_rtc.hours == 0) {
-    mbc3IncrementDays(mbc3);
-  }
-}
-
-
-static void mbc3IncrementMinutes(MBC3* mbc3)
-{
-  mbc3->_rtc.minutes = (mbc3->_rtc.minutes + 1) % 60;
-  if (mbc3->_rtc.minutes == 0) {
-    mbc3IncrementHours(mbc3);
-  }
-}
-
 
-static void mbc3IncrementSeconds(MBC3* mbc3)
-{
-  mbc3->_rtc.seconds = (mbc3->_rtc.seconds + 1) % 60;
-  if (mbc3->_rtc.seconds == 0) {
-    mbc3IncrementMinutes(mbc3);
+  if (address <= 0x7FFF) {
+    mbc3UpdateBanks(memoryController);
   }
 }
 
 
+// The clock only has to be right when it is latched, so all that happens here is counting the cycles it has been
+// running for (only installed for cartridges with a clock)
 static void mbc3CartridgeUpdate(MemoryController* memoryController, uint32_t cyclesExecuted)
 {
   MBC3* mbc3 = (MBC3*)memoryController->mbc;
 
-  const int cyclesPerSecond = RTC_TICK_FREQUENCY;
-
-  if (mbc3->timer) {
-    if (((mbc3->rtc.dayHigh & DAY_HIGH_HALT_BIT_SELECT) == 0) && ((mbc3->cycles + cyclesExecuted) >= cyclesPerSecond)) {
-      mbc3IncrementSeconds(mbc3);
-
-      if (mbc3->batteryFile != NULL) {
-        mbc3UpdateLastSaveTime(mbc3);
-        mbc3SaveRTC(mbc3);
-      }
-    }
-
-    mbc3->cycles = (mbc3->cycles + cyclesExecuted) % cyclesPerSecond;
-    // It would be good to save the RTC state at this point so that we could serialise the updated
-    // value of the internal clock cycles counter, however with the frequency that this method is
-    // called this seriously affects the emulation speed, and as long as mbc3FinaliseMemoryController()
-    // is called we still have a point where we serialise the most up-to-date value of the entire timer state.
+  if ((mbc3->_rtc.dayHigh & DAY_HIGH_HALT_BIT_SELECT) == 0) {
+    mbc3->cycles += cyclesExecuted;
   }
 }
 
 
-static void mbc3FastForwardRTC(MemoryController* memoryController, MBC3* mbc3, time_t now)
+static void mbc3FastForwardRTC(MBC3* mbc3, time_t now)
 {
   // RTC would only have been ticking if enabled
-  if ((mbc3->rtc.dayHigh & DAY_HIGH_HALT_BIT_SELECT) == 0) {
-    uint64_t remainingSeconds = (uint64_t)floor(difftime(now, mbc3->lastSaveTime));
-
-    debug("\b[MBC3] Fast-forwarding MBC3 RTC by %llu seconds\n", remainingSeconds);
-
-    // Update days
-    int days = (remainingSeconds / SECONDS_IN_DAY);
-    for (int i = 0; i < days; i++) {
-      mbc3IncrementDays(mbc3);
-    }
-    remainingSeconds %= SECONDS_IN_DAY;
-
-    // Update hours
-    int hours = (remainingSeconds / SECONDS_IN_HOUR);
-    for (int i = 0; i < hours; i++) {
-      mbc3IncrementHours(mbc3);
-    }
-    remainingSeconds %= SECONDS_IN_HOUR;
-
-    // Update minutes
-    int minutes = (remainingSeconds / SECONDS_IN_MINUTE);
-    for (int i = 0; i < minutes; i++) {
-      mbc3IncrementMinutes(mbc3);
-    }
-    remainingSeconds %= SECONDS_IN_MINUTE;
-
-    // Update seconds
-    for (int i = 0; i < remainingSeconds; i++) {
-      mbc3IncrementSeconds(mbc3);
+  if ((mbc3->_rtc.dayHigh & DAY_HIGH_HALT_BIT_SELECT) == 0) {
+    double seconds = floor(difftime(now, mbc3->lastSaveTime));
+    if (seconds > 0) {
+      debug("\b[MBC3] Fast-forwarding MBC3 RTC by %.0f seconds\n", seconds);
+      mbc3AdvanceClock(&mbc3->_rtc, (uint64_t)seconds);
     }
   }
 
   // We don't need to check for a battery here because there's no reason to be fast-forwarding RTC values if there isn't one
-  mbc3UpdateLastSaveTime(mbc3);
   mbc3SaveRTC(mbc3);
 }
 
@@ -496,16 +484,21 @@ void mbc3InitialiseMemoryController(
 
   memoryController->readByteImpl = &mbc3ReadByte;
   memoryController->writeByteImpl = &mbc3WriteByte;
-  memoryController->cartridgeUpdateImpl = &mbc3CartridgeUpdate;
+  memoryController->cartridgeUpdateImpl = (timer) ? &mbc3CartridgeUpdate : NULL; // Only the clock needs to count cycles
+  memoryController->cartridgeCyclesUntilNextEventImpl = NULL; // The clock is worked out when it's latched, so it has no events
+  memoryController->finaliseImpl = &mbc3FinaliseMemoryController;
   memoryController->mbc = mbc3;
 
+  memoryMapPages(memoryController, 0x0000, 16 * 1024, memoryController->cartridge, NULL);
+  mbc3UpdateBanks(memoryController);
+
   // Fast-forward time
   // This must be done after battery-backed data is restored so we get the real time difference between now and the RTC data
   // It must ALSO be done AFTER we set the "mbc" pointer of the memoryController struct to the dynamic
   // MBC3 struct, because we may end up calling mbc3CartridgeUpdate() (also used by the main run loop,
   // so there's no direct access to the struct without knowing what type it is)
   if (timer && battery) {
-    mbc3FastForwardRTC(memoryController, mbc3, now);
+    mbc3FastForwardRTC(mbc3, now);
   }
 }
 
@@ -514,11 +507,9 @@ void mbc3FinaliseMemoryController(MemoryController* memoryController)
 {
   MBC3* mbc3 = (MBC3*)memoryController->mbc;
 
-  mbc3UpdateLastSaveTime(mbc3);
-  mbc3SaveRTC(mbc3);
-
   if (mbc3->batteryFile != NULL) {
-    fclose(mbc3->batteryFile);
+    mbc3SaveRTC(mbc3);
+    batteryFileClose(mbc3->batteryFile);
   }
 
   if (mbc3->externalRAM != NULL) {
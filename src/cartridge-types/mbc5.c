@@ -17,10 +17,29 @@ typedef struct {
   uint8_t romBankHi;
   uint8_t ramBank;
 
-  FILE* batteryFile;
+  uint8_t* romBankData; // The ROM bank currently mapped to 0x4000-0x7FFF
+  uint32_t ramBankOffset; // Offset into external RAM of the bank currently mapped to 0xA000-0xBFFF
+
+  BatteryFile* batteryFile;
 } MBC5;
 
 
+// Called whenever a bank register changes. Writes to battery-backed RAM also mark the battery file dirty, so they always
+// go through mbc5WriteByte().
+static void mbc5UpdateBanks(MemoryController* memoryController)
+{
+  MBC5* mbc5 = (MBC5*)memoryController->mbc;
+
+  uint16_t romBankNumber = (mbc5->romBankHi << 8) | mbc5->romBankLo;
+
+  mbc5->romBankData = memoryController->cartridge + (romBankNumber * 16 * 1024);
+  mbc5->ramBankOffset = mbc5->ramBank * 8 * 1024;
+
+  memoryMapPages(memoryController, 0x4000, 16 * 1024, mbc5->romBankData, NULL);
+  memoryMapExternalRAM(memoryController, mbc5->externalRAM, mbc5->externalRAMSize, mbc5->ramBankOffset, mbc5->ramEnabled, mbc5->ramEnabled && (mbc5->batteryFile == NULL));
+}
+
+
 uint8_t mbc5ReadByte(MemoryController* memoryController, uint16_t address)
 {
   MBC5* mbc5 = (MBC5*)memoryController->mbc;
@@ -28,12 +47,10 @@ uint8_t mbc5ReadByte(MemoryController* memoryController, uint16_t address)
   if (address <= 0x3FFF) { // Read from ROM Bank 0
     return memoryController->cartridge[address];
   } else if (address >= 0x4000 && address <= 0x7FFF) { // Read from ROM Banks 0-1FF
-    uint16_t bankNumber = (mbc5->romBankHi << 8) | mbc5->romBankLo;
-    uint32_t romAddress = (bankNumber * 16 * 1024) + (address - 0x4000);
-    return memoryController->cartridge[romAddress];
+    return mbc5->romBankData[address - 0x4000];
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Read from external cartridge RAM
     if (mbc5->ramEnabled) {
-      uint16_t ramAddress = (mbc5->ramBank * 8 * 1024) + (address - 0xA000);
+      uint16_t ramAddress = mbc5->ramBankOffset + (address - 0xA000);
       assert(ramAddress < mbc5->externalRAMSize);
       return mbc5->externalRAM[ramAddress];
     } else {
@@ -72,7 +89,7 @@ void mbc5WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
     }
   } else if (address >= 0xA000 && address <= 0xBFFF) { // Write to external cartridge RAM
     if (mbc5->ramEnabled) {
-      uint16_t ramAddress = (mbc5->ramBank * 8 * 1024) + (address - 0xA000);
+      uint16_t ramAddress = mbc5->ramBankOffset + (address - 0xA000);
       assert(ramAddress < mbc5->externalRAMSize);
       mbc5->externalRAM[ramAddress] = value;
       if (mbc5->batteryFile != NULL) {
@@ -84,6 +101,10 @@ void mbc5WriteByte(MemoryController* memoryController, uint16_t address, uint8_t
   } else {
     commonWriteByte(memoryController, address, value);
   }
+
+  if (address <= 0x7FFF) {
+    mbc5UpdateBanks(memoryController);
+  }
 }
 
 
@@ -123,7 +144,11 @@ void mbc5InitialiseMemoryController(
 
   memoryController->readByteImpl = &mbc5ReadByte;
   memoryController->writeByteImpl = &mbc5WriteByte;
+  memoryController->finaliseImpl = &mbc5FinaliseMemoryController;
   memoryController->mbc = mbc5;
+
+  memoryMapPages(memoryController, 0x0000, 16 * 1024, memoryController->cartridge, NULL);
+  mbc5UpdateBanks(memoryController);
 }
 
 
@@ -132,7 +157,7 @@ void mbc5FinaliseMemoryController(MemoryController* memoryController)
   MBC5* mbc5 = (MBC5*)memoryController->mbc;
 
   if (mbc5->batteryFile != NULL) {
-    fclose(mbc5->batteryFile);
+    batteryFileClose(mbc5->batteryFile);
   }
 
   if (mbc5->externalRAM != NULL) {
@@ -29,4 +29,6 @@ void romOnlyInitialiseMemoryController(MemoryController* memoryController)
 {
   memoryController->readByteImpl = &romOnlyReadByte;
   memoryController->writeByteImpl = &romOnlyWriteByte;
+
+  memoryMapPages(memoryController, 0x0000, CARTRIDGE_SIZE, memoryController->cartridge, NULL);
 }
@@ -1,8 +1,19 @@
+#define _DEFAULT_SOURCE // For MAP_ANONYMOUS, which isn't part of POSIX
+
 #include "cartridge.h"
 
 #include "logging.h"
 
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define CARTRIDGE_MAX_ROM_SIZE (8 * 1024 * 1024) // 512 banks of 16KB, the most that any supported MBC can select
 
 
 int cartridgeGetSize(FILE* cartridgeFile)
@@ -15,24 +26,126 @@ int cartridgeGetSize(FILE* cartridgeFile)
 }
 
 
-uint8_t* cartridgeLoadData(const char* pathToROM)
+static CartridgeROM* openROMs = NULL;
+static pthread_mutex_t openROMsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Reads the whole file into allocated memory, for when it can't be mapped
+static uint8_t* readROMData(int fd, uint32_t size, size_t reservedSize)
 {
-  uint8_t* cartridgeData = NULL;
+  uint8_t* data = (uint8_t*)calloc(reservedSize, sizeof(uint8_t));
+  if (data == NULL) {
+    return NULL;
+  }
+
+  size_t bytesRead = 0;
+  while (bytesRead < size) {
+    ssize_t result = read(fd, data + bytesRead, size - bytesRead);
+    if (result <= 0) {
+      free(data);
+      return NULL;
+    }
+    bytesRead += result;
+  }
+
+  return data;
+}
+
+
+// Maps the file over a reserved region of zero pages, so that reads from banks past the end of the ROM (which the
+// MBCs don't check for) return 0 rather than faulting
+static uint8_t* mapROMData(int fd, uint32_t size, size_t reservedSize)
+{
+  void* reserved = mmap(NULL, reservedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED) {
+    return NULL;
+  }
+
+  if (size > 0 && mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(reserved, reservedSize);
+    return NULL;
+  }
+
+  return (uint8_t*)reserved;
+}
+
 
-  FILE* cartridgeFile = fopen(pathToROM, "rb");
-  if (cartridgeFile == NULL) {
+CartridgeROM* cartridgeOpenROM(const char* pathToROM)
+{
+  int fd = open(pathToROM, O_RDONLY);
+  struct stat fileStat;
+  if (fd < 0 || fstat(fd, &fileStat) != 0) {
     printf("Failed to read GB cartridge from '%s'\n", pathToROM);
+    if (fd >= 0) {
+      close(fd);
+    }
     return NULL;
   }
-  long int cartridgeSize = cartridgeGetSize(cartridgeFile);
 
-  cartridgeData = (uint8_t*)malloc(cartridgeSize * sizeof(uint8_t));
+  pthread_mutex_lock(&openROMsMutex);
 
-  fseek(cartridgeFile, 0, SEEK_SET);
-  fread(cartridgeData, 1, cartridgeSize, cartridgeFile);
-  fclose(cartridgeFile);
+  CartridgeROM* rom = openROMs;
+  while (rom != NULL && (rom->device != fileStat.st_dev || rom->inode != fileStat.st_ino)) {
+    rom = rom->next;
+  }
+
+  if (rom != NULL) {
+    rom->referenceCount++;
+  } else {
+    rom = (CartridgeROM*)malloc(sizeof(CartridgeROM));
+    assert(rom);
+
+    rom->size = fileStat.st_size;
+    rom->reservedSize = (rom->size > CARTRIDGE_MAX_ROM_SIZE) ? rom->size : CARTRIDGE_MAX_ROM_SIZE;
+    rom->data = mapROMData(fd, rom->size, rom->reservedSize);
+    rom->isMapped = (rom->data != NULL);
+    if (!rom->isMapped) {
+      warning("Failed to map GB cartridge from '%s', reading it instead\n", pathToROM);
+      rom->data = readROMData(fd, rom->size, rom->reservedSize);
+    }
+
+    if (rom->data == NULL) {
+      printf("Failed to read GB cartridge from '%s'\n", pathToROM);
+      free(rom);
+      rom = NULL;
+    } else {
+      rom->device = fileStat.st_dev;
+      rom->inode = fileStat.st_ino;
+      rom->referenceCount = 1;
+      rom->next = openROMs;
+      openROMs = rom;
+    }
+  }
+
+  pthread_mutex_unlock(&openROMsMutex);
+
+  close(fd); // The mapping keeps its own reference to the file
+
+  return rom;
+}
+
+
+void cartridgeCloseROM(CartridgeROM* rom)
+{
+  pthread_mutex_lock(&openROMsMutex);
+
+  rom->referenceCount--;
+  if (rom->referenceCount == 0) {
+    CartridgeROM** link = &openROMs;
+    while (*link != rom) {
+      link = &(*link)->next;
+    }
+    *link = rom->next;
+
+    if (rom->isMapped) {
+      munmap(rom->data, rom->reservedSize);
+    } else {
+      free(rom->data);
+    }
+    free(rom);
+  }
 
-  return cartridgeData;
+  pthread_mutex_unlock(&openROMsMutex);
 }
 
 
@@ -1,8 +1,10 @@
 #ifndef CARTRIDGE_H_
 #define CARTRIDGE_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 
 #define CARTRIDGE_SIZE 0x8000
@@ -59,8 +61,26 @@
 #define CARTRIDGE_TYPE_HuC1_PLUS_RAM_PLUS_BATTERY 0xFF
 
 
+// A ROM file mapped read-only into memory. Opening the same file again (from any number of GameBoy instances in the
+// process) returns the same ROM with its reference count incremented, so all of them share the same physical pages.
+typedef struct CartridgeROM CartridgeROM;
+
+struct CartridgeROM {
+  uint8_t* data;
+  uint32_t size; // Size of the ROM file, data can be read up to reservedSize (anything after the file reads as 0)
+  size_t reservedSize;
+  bool isMapped; // false if mmap() failed and the ROM was read into allocated memory instead
+
+  dev_t device;
+  ino_t inode;
+  uint32_t referenceCount;
+  CartridgeROM* next;
+};
+
+
 int cartridgeGetSize(FILE* cartridgeFile);
-uint8_t* cartridgeLoadData(const char* pathToROM);
+CartridgeROM* cartridgeOpenROM(const char* pathToROM);
+void cartridgeCloseROM(CartridgeROM* rom);
 const char* cartridgeGetGameTitle(const uint8_t* cartridgeData); // NOTE: Caller owns memory
 uint8_t cartridgeGetCGBMode(const uint8_t* cartridgeData);
 uint8_t cartridgeGetType(const uint8_t* cartridgeData);
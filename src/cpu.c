@@ -2,6 +2,7 @@
 
 #include "logging.h"
 #include "mnemonics.h"
+#include "scheduler.h"
 #include "timer.h"
 
 #include <stdint.h>
@@ -9,6 +10,21 @@
 #include <stdlib.h>
 
 
+#if defined(CPU_DISPATCH_COMPUTED_GOTO) && !defined(__GNUC__)
+#error "CPU_DISPATCH_COMPUTED_GOTO requires a compiler with support for computed goto (GCC or Clang)"
+#endif
+
+
+#define HALF_CARRY_BIT_SHIFT 4
+#define HALF_CARRY_BIT (0x1 << HALF_CARRY_BIT_SHIFT)
+
+#define CARRY_BIT_SHIFT 8
+#define CARRY_BIT (0x1 << CARRY_BIT_SHIFT)
+
+
+typedef uint8_t (*OpcodeHandler)(CPU* cpu, MemoryController* m);
+
+
 /* Flag Set/Reset Generation Macros *************************************************************/
 #define SET_FLAG_TO_RESULT(FLAG, TEST) \
   if (TEST) { \
@@ -18,132 +34,148 @@
   } \
 
 
+// Record the inputs that a flag is derived from rather than deriving it straight away (see CPUFlags)
+#define SET_Z_FROM_RESULT(RESULT) \
+  cpu->flags.zeroResult = (RESULT);
+
+
+#define SET_H_FROM_OPERANDS(OPERAND_1, OPERAND_2, RESULT) \
+  cpu->flags.halfCarryBits = (OPERAND_1) ^ (OPERAND_2) ^ (RESULT);
+
+
+#define SET_C_FROM_RESULT(RESULT) \
+  cpu->flags.carryBits = (RESULT);
+
+
 /* Opcode Generation Macros *********************************************************************/
+// Every opcode is implemented by a handler that returns the number of clock cycles taken to execute it
+#define OPCODE_HANDLER(NAME) \
+  static uint8_t NAME(CPU* cpu, MemoryController* m)
+
+
+#define MAKE_UNKNOWN_OPCODE_HANDLER(OPCODE) \
+  OPCODE_HANDLER(opcode ## OPCODE) { \
+    fprintf(stderr, "FATAL ERROR: ENCOUNTERED UNKNOWN OPCODE: 0x%02X\n", 0x ## OPCODE); \
+    exit(EXIT_FAILURE); \
+  }
+
+
 #define MAKE_ADD_A_N_OPCODE_IMPL(SOURCE_REGISTER) \
   uint8_t old = cpu->registers.a; \
   uint8_t value = cpu->registers.SOURCE_REGISTER; \
   uint32_t new = old + value; \
   cpu->registers.a = new; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   resetN(cpu); \
-  SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF)) > 0xF) \
-  SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF)) > 0xFF) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(old, value, new) \
+  SET_C_FROM_RESULT(new) \
+  return 4;
 
 
 #define MAKE_ADC_A_N_OPCODE_IMPL(SOURCE_REGISTER) \
   uint8_t old = cpu->registers.a; \
   uint8_t value = cpu->registers.SOURCE_REGISTER; \
-  uint8_t carry = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT); \
+  uint8_t carry = getC(cpu); \
   uint32_t new = old + value + carry; \
   cpu->registers.a = new; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   resetN(cpu); \
-  SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF) + carry) > 0xF) \
-  SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF) + carry) > 0xFF) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(old, value, new) \
+  SET_C_FROM_RESULT(new) \
+  return 4;
 
 
 #define MAKE_SUB_N_OPCODE_IMPL(SOURCE_REGISTER) \
   uint8_t oldA = cpu->registers.a; \
-  int32_t newA = oldA - cpu->registers.SOURCE_REGISTER; \
+  uint8_t operand = cpu->registers.SOURCE_REGISTER; \
+  int32_t newA = oldA - operand; \
   cpu->registers.a = newA; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   setN(cpu); \
-  SET_FLAG_TO_RESULT(H, (cpu->registers.SOURCE_REGISTER & 0x0F) > (oldA & 0x0F)) \
-  SET_FLAG_TO_RESULT(C, newA < 0) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(oldA, operand, newA) \
+  SET_C_FROM_RESULT(newA) \
+  return 4;
 
 
 #define MAKE_SBC_A_N_OPCODE_IMPL(SOURCE_REGISTER) \
   uint8_t oldA = cpu->registers.a; \
-  uint8_t c = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT); \
-  int32_t newA = oldA - (cpu->registers.SOURCE_REGISTER + c); \
+  uint8_t operand = cpu->registers.SOURCE_REGISTER; \
+  uint8_t c = getC(cpu); \
+  int32_t newA = oldA - (operand + c); \
   cpu->registers.a = newA; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   setN(cpu); \
-  SET_FLAG_TO_RESULT(H, ((cpu->registers.SOURCE_REGISTER & 0x0F) + c) > (oldA & 0x0F)) \
-  SET_FLAG_TO_RESULT(C, newA < 0) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(oldA, operand, newA) \
+  SET_C_FROM_RESULT(newA) \
+  return 4;
 
 
 #define MAKE_AND_N_OPCODE_IMPL(SOURCE_REGISTER) \
   cpu->registers.a &= cpu->registers.SOURCE_REGISTER; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   resetN(cpu); \
   setH(cpu); \
   resetC(cpu); \
-  cycles += 4; \
-  break;
+  return 4;
 
 
 #define MAKE_OR_N_OPCODE_IMPL(SOURCE_REGISTER) \
   cpu->registers.a |= cpu->registers.SOURCE_REGISTER; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   resetN(cpu); \
   resetH(cpu); \
   resetC(cpu); \
-  cycles += 4; \
-  break;
+  return 4;
 
 
 #define MAKE_XOR_N_OPCODE_IMPL(SOURCE_REGISTER) \
   cpu->registers.a ^= cpu->registers.SOURCE_REGISTER; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.a) \
   resetN(cpu); \
   resetH(cpu); \
   resetC(cpu); \
-  cycles += 4; \
-  break;
+  return 4;
 
 
 #define MAKE_CP_N_OPCODE_IMPL(SOURCE_REGISTER) \
   int16_t result = cpu->registers.a - cpu->registers.SOURCE_REGISTER; \
-  SET_FLAG_TO_RESULT(Z, result == 0) \
+  SET_Z_FROM_RESULT(result) \
   setN(cpu); \
-  SET_FLAG_TO_RESULT(H, (cpu->registers.SOURCE_REGISTER & 0x0F) > (cpu->registers.a & 0x0F)) \
-  SET_FLAG_TO_RESULT(C, result < 0) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(cpu->registers.a, cpu->registers.SOURCE_REGISTER, result) \
+  SET_C_FROM_RESULT(result) \
+  return 4;
 
 
 #define MAKE_INC_N_OPCODE_IMPL(REGISTER) \
   uint8_t old = cpu->registers.REGISTER; \
   uint16_t new = old + 1; \
   cpu->registers.REGISTER = new; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
-  SET_FLAG_TO_RESULT(H, ((old & 0xF) + (1 & 0xF)) > 0xF) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(old, 1, new) \
+  return 4;
 
 
 #define MAKE_DEC_N_OPCODE_IMPL(REGISTER) \
   uint8_t oldValue = cpu->registers.REGISTER; \
   int16_t newValue = oldValue - 1; \
   cpu->registers.REGISTER = (uint8_t)newValue; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   setN(cpu); \
-  SET_FLAG_TO_RESULT(H, 1 > (oldValue & 0x0F)) \
-  cycles += 4; \
-  break;
+  SET_H_FROM_OPERANDS(oldValue, 1, newValue) \
+  return 4;
 
 
 #define MAKE_ADD_HL_N_OPCODE_IMPL(REGISTER_HIGH, REGISTER_LOW) \
   uint16_t old = (cpu->registers.h << 8) | cpu->registers.l; \
   uint16_t value = (cpu->registers.REGISTER_HIGH << 8) | cpu->registers.REGISTER_LOW; \
-  uint16_t result = old + value; \
+  uint32_t result = old + value; \
   cpu->registers.h = (result & 0xFF00) >> 8; \
   cpu->registers.l = (result & 0x00FF); \
   resetN(cpu); \
-  SET_FLAG_TO_RESULT(H, ((old & 0xFFF) + (value & 0xFFF)) > 0xFFF) \
-  SET_FLAG_TO_RESULT(C, ((old & 0xFFFF) + (value & 0xFFFF)) > 0xFFFF) \
-  cycles += 8; \
-  break;
+  SET_H_FROM_OPERANDS(old >> 8, value >> 8, result >> 8) \
+  SET_C_FROM_RESULT(result >> 8) \
+  return 8;
 
 
 #define MAKE_INC_NN_OPCODE_IMPL(REGISTER_HIGH, REGISTER_LOW) \
@@ -151,8 +183,7 @@
   if (cpu->registers.REGISTER_LOW == 0) { \
     cpu->registers.REGISTER_HIGH++; \
   } \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_DEC_NN_OPCODE_IMPL(REGISTER_HIGH, REGISTER_LOW) \
@@ -160,229 +191,213 @@
   if (cpu->registers.REGISTER_LOW == 0xFF) { \
     cpu->registers.REGISTER_HIGH--; \
   } \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_SWAP_N_OPCODE_IMPL(REGISTER) \
   cpu->registers.REGISTER = ((cpu->registers.REGISTER & 0xF0) >> 4) | ((cpu->registers.REGISTER & 0x0F) << 4); \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
   resetC(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_RLC_N_OPCODE_IMPL(REGISTER) \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_7); \
   cpu->registers.REGISTER = (cpu->registers.REGISTER << 1) | ((cpu->registers.REGISTER & BIT_7) >> BIT_7_SHIFT); \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_RL_N_OPCODE_IMPL(REGISTER) \
-  uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT; \
+  uint8_t oldCarryBit = getC(cpu); \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_7) \
   cpu->registers.REGISTER = (cpu->registers.REGISTER << 1) | oldCarryBit; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_RRC_N_OPCODE_IMPL(REGISTER) \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_0) \
   cpu->registers.REGISTER = ((cpu->registers.REGISTER & BIT_0) << BIT_7_SHIFT) | (cpu->registers.REGISTER >> 1); \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_RR_N_OPCODE_IMPL(REGISTER) \
-  uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT; \
+  uint8_t oldCarryBit = getC(cpu); \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_0) \
   cpu->registers.REGISTER = (oldCarryBit << BIT_7_SHIFT) | (cpu->registers.REGISTER >> 1); \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_SLA_N_OPCODE_IMPL(REGISTER) \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_7) \
   cpu->registers.REGISTER <<= 1; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_SRA_N_OPCODE_IMPL(REGISTER) \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_0) \
   cpu->registers.REGISTER = (cpu->registers.REGISTER & BIT_7) | (cpu->registers.REGISTER >> 1); \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_SRL_N_OPCODE_IMPL(REGISTER) \
   SET_FLAG_TO_RESULT(C, cpu->registers.REGISTER & BIT_0) \
   cpu->registers.REGISTER = cpu->registers.REGISTER >> 1; \
-  SET_FLAG_TO_RESULT(Z, cpu->registers.REGISTER == 0) \
+  SET_Z_FROM_RESULT(cpu->registers.REGISTER) \
   resetN(cpu); \
   resetH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_BIT_B_R_OPCODE_IMPL(B, REGISTER) \
-  SET_FLAG_TO_RESULT(Z, ((cpu->registers.REGISTER & (0x1 << B)) >> B) == 0) \
+  SET_Z_FROM_RESULT(((cpu->registers.REGISTER & (0x1 << B)) >> B)) \
   resetN(cpu); \
   setH(cpu); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_BIT_B_MEM_AT_HL_OPCODE_IMPL(B) \
   uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l); \
-  SET_FLAG_TO_RESULT(Z, ((value & (0x1 << B)) >> B) == 0) \
+  SET_Z_FROM_RESULT(((value & (0x1 << B)) >> B)) \
   resetN(cpu); \
   setH(cpu); \
-  cycles += 12; \
-  break;
+  return 12;
 
 
-#define MAKE_BIT_B_R_OPCODE_GROUP(B, BEGINNING_OPCODE) \
-  case BEGINNING_OPCODE - 0: { \
-    MAKE_BIT_B_R_OPCODE_IMPL(B, a) \
-  } \
-  case BEGINNING_OPCODE - 7: { \
+#define MAKE_BIT_B_R_OPCODE_GROUP(B, OPCODE_B, OPCODE_C, OPCODE_D, OPCODE_E, OPCODE_H, OPCODE_L, OPCODE_MEM_AT_HL, OPCODE_A) \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_B) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, b) \
   } \
-  case BEGINNING_OPCODE - 6: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_C) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, c) \
   } \
-  case BEGINNING_OPCODE - 5: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_D) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, d) \
   } \
-  case BEGINNING_OPCODE - 4: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_E) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, e) \
   } \
-  case BEGINNING_OPCODE - 3: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_H) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, h) \
   } \
-  case BEGINNING_OPCODE - 2: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_L) { \
     MAKE_BIT_B_R_OPCODE_IMPL(B, l) \
   } \
-  case BEGINNING_OPCODE - 1: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_MEM_AT_HL) { \
     MAKE_BIT_B_MEM_AT_HL_OPCODE_IMPL(B) \
+  } \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_A) { \
+    MAKE_BIT_B_R_OPCODE_IMPL(B, a) \
   }
 
 
 #define MAKE_SET_B_R_OPCODE_IMPL(B, REGISTER) \
   cpu->registers.REGISTER |= (0x1 << B); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_SET_B_MEM_AT_HL_OPCODE_IMPL(B) \
   uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l); \
   value |= (0x1 << B); \
   writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value); \
-  cycles += 16; \
-  break;
+  return 16;
 
 
-#define MAKE_SET_B_R_OPCODE_GROUP(B, BEGINNING_OPCODE) \
-  case BEGINNING_OPCODE - 0: { \
-    MAKE_SET_B_R_OPCODE_IMPL(B, a) \
-  } \
-  case BEGINNING_OPCODE - 7: { \
+#define MAKE_SET_B_R_OPCODE_GROUP(B, OPCODE_B, OPCODE_C, OPCODE_D, OPCODE_E, OPCODE_H, OPCODE_L, OPCODE_MEM_AT_HL, OPCODE_A) \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_B) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, b) \
   } \
-  case BEGINNING_OPCODE - 6: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_C) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, c) \
   } \
-  case BEGINNING_OPCODE - 5: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_D) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, d) \
   } \
-  case BEGINNING_OPCODE - 4: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_E) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, e) \
   } \
-  case BEGINNING_OPCODE - 3: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_H) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, h) \
   } \
-  case BEGINNING_OPCODE - 2: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_L) { \
     MAKE_SET_B_R_OPCODE_IMPL(B, l) \
   } \
-  case BEGINNING_OPCODE - 1: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_MEM_AT_HL) { \
     MAKE_SET_B_MEM_AT_HL_OPCODE_IMPL(B) \
+  } \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_A) { \
+    MAKE_SET_B_R_OPCODE_IMPL(B, a) \
   }
 
 
 #define MAKE_RES_B_R_OPCODE_IMPL(B, REGISTER) \
   cpu->registers.REGISTER &= ~(1 << B); \
-  cycles += 8; \
-  break;
+  return 8;
 
 
 #define MAKE_RES_B_MEM_AT_HL_OPCODE_IMPL(B) \
   uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l); \
   value &= ~(1 << B); \
   writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value); \
-  cycles += 16; \
-  break;
+  return 16;
 
 
-#define MAKE_RES_B_R_OPCODE_GROUP(B, BEGINNING_OPCODE) \
-  case BEGINNING_OPCODE - 0: { \
-    MAKE_RES_B_R_OPCODE_IMPL(B, a) \
-  } \
-  case BEGINNING_OPCODE - 7: { \
+#define MAKE_RES_B_R_OPCODE_GROUP(B, OPCODE_B, OPCODE_C, OPCODE_D, OPCODE_E, OPCODE_H, OPCODE_L, OPCODE_MEM_AT_HL, OPCODE_A) \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_B) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, b) \
   } \
-  case BEGINNING_OPCODE - 6: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_C) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, c) \
   } \
-  case BEGINNING_OPCODE - 5: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_D) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, d) \
   } \
-  case BEGINNING_OPCODE - 4: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_E) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, e) \
   } \
-  case BEGINNING_OPCODE - 3: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_H) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, h) \
   } \
-  case BEGINNING_OPCODE - 2: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_L) { \
     MAKE_RES_B_R_OPCODE_IMPL(B, l) \
   } \
-  case BEGINNING_OPCODE - 1: { \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_MEM_AT_HL) { \
     MAKE_RES_B_MEM_AT_HL_OPCODE_IMPL(B) \
+  } \
+  OPCODE_HANDLER(cbOpcode ## OPCODE_A) { \
+    MAKE_RES_B_R_OPCODE_IMPL(B, a) \
   }
 
 
-#define MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG_REGISTER_BIT_MASK, FLAG_REGISTER_BIT_SHIFT, CONDITION_VALUE) \
+#define MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG, CONDITION_VALUE) \
   uint16_t address = readWord(m, cpu->registers.pc); \
   cpu->registers.pc += 2; \
-  if (((cpu->registers.f & FLAG_REGISTER_BIT_MASK) >> FLAG_REGISTER_BIT_SHIFT) == CONDITION_VALUE) { \
+  if (get ## FLAG(cpu) == CONDITION_VALUE) { \
     writeByte(m, --cpu->registers.sp, ((cpu->registers.pc & 0xFF00) >> 8)); \
     writeByte(m, --cpu->registers.sp, (cpu->registers.pc & 0x00FF)); \
     cpu->registers.pc = address; \
-    cycles += 12; \
+    return 24; \
   } \
-  cycles += 12; \
-  break;
+  return 12;
 
 
 // TODO: Check the implementations here - the GB CPU Manual says to 'push present address onto
@@ -397,67 +412,172 @@
   writeByte(m, --cpu->registers.sp, ((cpu->registers.pc & 0xFF00) >> 8)); \
   writeByte(m, --cpu->registers.sp, (cpu->registers.pc & 0x00FF)); \
   cpu->registers.pc = N; \
-  cycles += 16; \
-  break;
+  return 16;
 
 
-#define MAKE_RET_CC_OPCODE_IMPL(FLAG_REGISTER_BIT_MASK, FLAG_REGISTER_BIT_SHIFT, CONDITION_VALUE) \
-  if (((cpu->registers.f & FLAG_REGISTER_BIT_MASK) >> FLAG_REGISTER_BIT_SHIFT) == CONDITION_VALUE) { \
+#define MAKE_RET_CC_OPCODE_IMPL(FLAG, CONDITION_VALUE) \
+  if (get ## FLAG(cpu) == CONDITION_VALUE) { \
     uint8_t addressLow = readByte(m, cpu->registers.sp++); \
     uint8_t addressHigh = readByte(m, cpu->registers.sp++); \
     cpu->registers.pc = (addressHigh << 8) | addressLow; \
-    cycles += 12; \
+    return 20; \
   } \
-  cycles += 8; \
-  break;
+  return 8;
 /* End Opcode Generation Macros *****************************************************************/
 
 
-void setZ(CPU* cpu)
+/* Dispatch Generation Macros *******************************************************************/
+// Expand MAKE_ENTRY(PREFIX, XY) for every opcode XY in one row, or all rows, of the opcode map, so that the handler
+// tables, switch cases and computed goto labels are all generated from the same handler names.
+#define OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, X) \
+  MAKE_ENTRY(PREFIX, X ## 0) MAKE_ENTRY(PREFIX, X ## 1) MAKE_ENTRY(PREFIX, X ## 2) MAKE_ENTRY(PREFIX, X ## 3) \
+  MAKE_ENTRY(PREFIX, X ## 4) MAKE_ENTRY(PREFIX, X ## 5) MAKE_ENTRY(PREFIX, X ## 6) MAKE_ENTRY(PREFIX, X ## 7) \
+  MAKE_ENTRY(PREFIX, X ## 8) MAKE_ENTRY(PREFIX, X ## 9) MAKE_ENTRY(PREFIX, X ## A) MAKE_ENTRY(PREFIX, X ## B) \
+  MAKE_ENTRY(PREFIX, X ## C) MAKE_ENTRY(PREFIX, X ## D) MAKE_ENTRY(PREFIX, X ## E) MAKE_ENTRY(PREFIX, X ## F)
+
+
+#define OPCODE_MAP(MAKE_ENTRY, PREFIX) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 0) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 1) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 2) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 3) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 4) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 5) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 6) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 7) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 8) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, 9) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, A) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, B) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, C) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, D) \
+  OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, E) OPCODE_MAP_ROW(MAKE_ENTRY, PREFIX, F)
+
+
+#define MAKE_HANDLER_TABLE_ENTRY(PREFIX, OPCODE) \
+  PREFIX ## OPCODE,
+
+
+#define MAKE_SWITCH_CASE(PREFIX, OPCODE) \
+  case 0x ## OPCODE: \
+    return PREFIX ## OPCODE(cpu, m);
+
+
+#define MAKE_LABEL_TABLE_ENTRY(PREFIX, OPCODE) \
+  &&PREFIX ## OPCODE ## Label,
+
+
+#define MAKE_LABEL(PREFIX, OPCODE) \
+  PREFIX ## OPCODE ## Label: \
+    return PREFIX ## OPCODE(cpu, m);
+
+
+// Run the handler for OPCODE using the dispatch method selected at build time
+#if defined(CPU_DISPATCH_TABLE)
+#define DISPATCH(PREFIX, OPCODE) \
+  { \
+    static const OpcodeHandler handlers[256] = { OPCODE_MAP(MAKE_HANDLER_TABLE_ENTRY, PREFIX) }; \
+    return handlers[OPCODE](cpu, m); \
+  }
+#elif defined(CPU_DISPATCH_COMPUTED_GOTO)
+#define DISPATCH(PREFIX, OPCODE) \
+  { \
+    static const void* const labels[256] = { OPCODE_MAP(MAKE_LABEL_TABLE_ENTRY, PREFIX) }; \
+    goto *labels[OPCODE]; \
+    OPCODE_MAP(MAKE_LABEL, PREFIX) \
+  }
+#else
+#define DISPATCH(PREFIX, OPCODE) \
+  switch (OPCODE) { \
+    OPCODE_MAP(MAKE_SWITCH_CASE, PREFIX) \
+  } \
+  return 0; // Unreachable because every opcode has a handler
+#endif
+/* End Dispatch Generation Macros ***************************************************************/
+
+
+// Flag values are held as described by CPUFlags - each of these reads or replaces the recorded value for one flag
+static inline uint8_t getZ(CPU* cpu)
+{
+  return cpu->flags.zeroResult == 0;
+}
+
+
+static inline uint8_t getN(CPU* cpu)
+{
+  return cpu->flags.subtract != 0;
+}
+
+
+static inline uint8_t getH(CPU* cpu)
+{
+  return (cpu->flags.halfCarryBits & HALF_CARRY_BIT) >> HALF_CARRY_BIT_SHIFT;
+}
+
+
+static inline uint8_t getC(CPU* cpu)
+{
+  return (cpu->flags.carryBits & CARRY_BIT) >> CARRY_BIT_SHIFT;
+}
+
+
+static inline void setZ(CPU* cpu)
+{
+  cpu->flags.zeroResult = 0;
+}
+
+
+static inline void setN(CPU* cpu)
+{
+  cpu->flags.subtract = 1;
+}
+
+
+static inline void setH(CPU* cpu)
 {
-  cpu->registers.f |= (1 << FLAG_REGISTER_Z_BIT_SHIFT);
+  cpu->flags.halfCarryBits = HALF_CARRY_BIT;
 }
 
 
-void setN(CPU* cpu)
+static inline void setC(CPU* cpu)
 {
-  cpu->registers.f |= (1 << FLAG_REGISTER_N_BIT_SHIFT);
+  cpu->flags.carryBits = CARRY_BIT;
 }
 
 
-void setH(CPU* cpu)
+static inline void resetZ(CPU* cpu)
 {
-  cpu->registers.f |= (1 << FLAG_REGISTER_H_BIT_SHIFT);
+  cpu->flags.zeroResult = 1;
 }
 
 
-void setC(CPU* cpu)
+static inline void resetN(CPU* cpu)
 {
-  cpu->registers.f |= (1 << FLAG_REGISTER_C_BIT_SHIFT);
+  cpu->flags.subtract = 0;
 }
 
 
-void resetZ(CPU* cpu)
+static inline void resetH(CPU* cpu)
 {
-  cpu->registers.f &= ~(1 << FLAG_REGISTER_Z_BIT_SHIFT);
+  cpu->flags.halfCarryBits = 0;
 }
 
 
-void resetN(CPU* cpu)
+static inline void resetC(CPU* cpu)
 {
-  cpu->registers.f &= ~(1 << FLAG_REGISTER_N_BIT_SHIFT);
+  cpu->flags.carryBits = 0;
 }
 
 
-void resetH(CPU* cpu)
+uint8_t cpuGetFlagRegister(CPU* cpu)
 {
-  cpu->registers.f &= ~(1 << FLAG_REGISTER_H_BIT_SHIFT);
+  return (getZ(cpu) << FLAG_REGISTER_Z_BIT_SHIFT) |
+    (getN(cpu) << FLAG_REGISTER_N_BIT_SHIFT) |
+    (getH(cpu) << FLAG_REGISTER_H_BIT_SHIFT) |
+    (getC(cpu) << FLAG_REGISTER_C_BIT_SHIFT);
 }
 
 
-void resetC(CPU* cpu)
+void cpuSetFlagRegister(CPU* cpu, uint8_t f)
 {
-  cpu->registers.f &= ~(1 << FLAG_REGISTER_C_BIT_SHIFT);
+  // The lower 4 bits of F don't exist so are implicitly discarded here
+  SET_FLAG_TO_RESULT(Z, f & FLAG_REGISTER_Z_BIT)
+  SET_FLAG_TO_RESULT(N, f & FLAG_REGISTER_N_BIT)
+  SET_FLAG_TO_RESULT(H, f & FLAG_REGISTER_H_BIT)
+  SET_FLAG_TO_RESULT(C, f & FLAG_REGISTER_C_BIT)
 }
 
 
@@ -466,13 +586,18 @@ void initCPU(CPU* cpu, MemoryController* memoryController, InterruptController*
   cpu->memoryController = memoryController;
   cpu->interruptController = interruptController;
   cpu->gameBoyType = gameBoyType;
+  cpu->instructionsExecuted = 0;
+
+  cpu->idleLoop.enabled = true;
+  cpu->idleLoop.isIdle = false;
+  cpu->idleLoop.numInstructions = CPU_IDLE_LOOP_MAX_INSTRUCTIONS + 1;
 }
 
 
 void cpuReset(CPU* cpu)
 {
   cpu->registers.a = (cpu->gameBoyType == CGB) ? 0x11 : 0x01;
-  cpu->registers.f = 0xB0;
+  cpuSetFlagRegister(cpu, 0xB0);
   cpu->registers.b = 0x00;
   cpu->registers.c = 0x13;
   cpu->registers.d = 0x00;
@@ -536,7 +661,7 @@ void cpuPrintState(CPU* cpu)
     cpu->registers.c,
     cpu->registers.d,
     cpu->registers.e,
-    cpu->registers.f,
+    cpuGetFlagRegister(cpu),
     cpu->registers.h,
     cpu->registers.l
   );
@@ -545,1846 +670,2402 @@ void cpuPrintState(CPU* cpu)
     cpu->registers.pc
   );
   printf("FLAG: Z: %i N: %i H: %i C: %i\n",
-    (cpu->registers.f & FLAG_REGISTER_Z_BIT) >> 7,
-    (cpu->registers.f & FLAG_REGISTER_N_BIT) >> 6,
-    (cpu->registers.f & FLAG_REGISTER_H_BIT) >> 5,
-    (cpu->registers.f & FLAG_REGISTER_C_BIT) >> 4
+    getZ(cpu),
+    getN(cpu),
+    getH(cpu),
+    getC(cpu)
   );
 }
 
 
-uint8_t cpuRunSingleOp(CPU* cpu)
+/* 8-Bit Loads ****************************************************************************/
+/* LD nn, n ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode06) // LD B, n
 {
-  MemoryController* m = cpu->memoryController;
+  cpu->registers.b = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  if (cpu->halt) {
-    // In double speed mode this value will be halved before other components are updated, so don't return 1
-    // because we don't want 0 (integer division) to be the update value for other components.
-    return 2;
-  }
+OPCODE_HANDLER(opcode0E) // LD C, n
+{
+  cpu->registers.c = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  if (generalPurposeDMAIsActive(m)) {
-    return 4;
-  }
+OPCODE_HANDLER(opcode16) // LD D, n
+{
+  cpu->registers.d = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  uint8_t opcode = readByte(m, cpu->registers.pc++);
-  // debug("\b[0x%04X][0x%02X] %s\n", cpu->registers.pc - 1, opcode, OPCODE_MNEMONICS[opcode]);
+OPCODE_HANDLER(opcode1E) // LD E, n
+{
+  cpu->registers.e = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  if (cpu->_pcFrozen) {
-    cpu->registers.pc--;
-    cpu->_pcFrozen = false;
-  }
+OPCODE_HANDLER(opcode26) // LD H, n
+{
+  cpu->registers.h = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  // TODO: Check for overflow of opcode here?
+OPCODE_HANDLER(opcode2E) // LD L, n
+{
+  cpu->registers.l = readByte(m, cpu->registers.pc++);
+  return 8;
+}
 
-  uint8_t cycles = 0;
-  switch (opcode) {
-    /* 8-Bit Loads ****************************************************************************/
-    /* LD nn, n ------------------------------------------------------------------------------*/
-    case 0x06: { // LD B, n
-      cpu->registers.b = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
-    case 0x0E: { // LD C, n
-      cpu->registers.c = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
-    case 0x16: { // LD D, n
-      cpu->registers.d = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
-    case 0x1E: { // LD E, n
-      cpu->registers.e = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
-    case 0x26: { // LD H, n
-      cpu->registers.h = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
-    case 0x2E: { // LD L, n
-      cpu->registers.l = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
-    }
 
-    /* LD r1, r2 -----------------------------------------------------------------------------*/
-    case 0x7F: { // LD A, A
-      cpu->registers.a = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x78: { // LD A, B
-      cpu->registers.a = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x79: { // LD A, C
-      cpu->registers.a = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x7A: { // LD A, D
-      cpu->registers.a = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x7B: { // LD A, E
-      cpu->registers.a = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x7C: { // LD A, H
-      cpu->registers.a = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x7D: { // LD A, L
-      cpu->registers.a = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x7E: { // LD A, (HL)
-      cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+/* LD r1, r2 -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode7F) // LD A, A
+{
+  cpu->registers.a = cpu->registers.a;
+  return 4;
+}
 
+OPCODE_HANDLER(opcode78) // LD A, B
+{
+  cpu->registers.a = cpu->registers.b;
+  return 4;
+}
 
-    case 0x40: { // LD B, B
-      cpu->registers.b = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x41: { // LD B, C
-      cpu->registers.b = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x42: { // LD B, D
-      cpu->registers.b = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x43: { // LD B, E
-      cpu->registers.b = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x44: { // LD B, H
-      cpu->registers.b = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x45: { // LD B, L
-      cpu->registers.b = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x46: { // LD B, (HL)
-      cpu->registers.b = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(opcode79) // LD A, C
+{
+  cpu->registers.a = cpu->registers.c;
+  return 4;
+}
 
+OPCODE_HANDLER(opcode7A) // LD A, D
+{
+  cpu->registers.a = cpu->registers.d;
+  return 4;
+}
 
-    case 0x48: { // LD C, B
-      cpu->registers.c = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x49: { // LD C, C
-      cpu->registers.c = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x4A: { // LD C, D
-      cpu->registers.c = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x4B: { // LD C, E
-      cpu->registers.c = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x4C: { // LD C, H
-      cpu->registers.c = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x4D: { // LD C, L
-      cpu->registers.c = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x4E: { // LD C, (HL)
-      cpu->registers.c = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(opcode7B) // LD A, E
+{
+  cpu->registers.a = cpu->registers.e;
+  return 4;
+}
 
+OPCODE_HANDLER(opcode7C) // LD A, H
+{
+  cpu->registers.a = cpu->registers.h;
+  return 4;
+}
 
-    case 0x50: { // LD D, B
-      cpu->registers.d = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x51: { // LD D, C
-      cpu->registers.d = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x52: { // LD D, D
-      cpu->registers.d = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x53: { // LD D, E
-      cpu->registers.d = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x54: { // LD D, H
-      cpu->registers.d = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x55: { // LD D, L
-      cpu->registers.d = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x56: { // LD D, (HL)
-      cpu->registers.d = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(opcode7D) // LD A, L
+{
+  cpu->registers.a = cpu->registers.l;
+  return 4;
+}
 
+OPCODE_HANDLER(opcode7E) // LD A, (HL)
+{
+  cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
 
-    case 0x58: { // LD E, B
-      cpu->registers.e = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x59: { // LD E, C
-      cpu->registers.e = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x5A: { // LD E, D
-      cpu->registers.e = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x5B: { // LD E, E
-      cpu->registers.e = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x5C: { // LD E, H
-      cpu->registers.e = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x5D: { // LD E, L
-      cpu->registers.e = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x5E: { // LD E, (HL)
-      cpu->registers.e = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
 
+OPCODE_HANDLER(opcode40) // LD B, B
+{
+  cpu->registers.b = cpu->registers.b;
+  return 4;
+}
 
-    case 0x60: { // LD H, B
-      cpu->registers.h = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x61: { // LD H, C
-      cpu->registers.h = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x62: { // LD H, D
-      cpu->registers.h = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x63: { // LD H, E
-      cpu->registers.h = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x64: { // LD H, H
-      cpu->registers.h = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x65: { // LD H, L
-      cpu->registers.h = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x66: { // LD H, (HL)
-      cpu->registers.h = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(opcode41) // LD B, C
+{
+  cpu->registers.b = cpu->registers.c;
+  return 4;
+}
 
+OPCODE_HANDLER(opcode42) // LD B, D
+{
+  cpu->registers.b = cpu->registers.d;
+  return 4;
+}
 
-    case 0x68: { // LD L, B
-      cpu->registers.l = cpu->registers.b;
-      cycles += 4;
-      break;
-    }
-    case 0x69: { // LD L, C
-      cpu->registers.l = cpu->registers.c;
-      cycles += 4;
-      break;
-    }
-    case 0x6A: { // LD L, D
-      cpu->registers.l = cpu->registers.d;
-      cycles += 4;
-      break;
-    }
-    case 0x6B: { // LD L, E
-      cpu->registers.l = cpu->registers.e;
-      cycles += 4;
-      break;
-    }
-    case 0x6C: { // LD L, H
-      cpu->registers.l = cpu->registers.h;
-      cycles += 4;
-      break;
-    }
-    case 0x6D: { // LD L, L
-      cpu->registers.l = cpu->registers.l;
-      cycles += 4;
-      break;
-    }
-    case 0x6E: { // LD L, (HL)
-      cpu->registers.l = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(opcode43) // LD B, E
+{
+  cpu->registers.b = cpu->registers.e;
+  return 4;
+}
 
-    case 0x70: { // LD (HL), B
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.b);
-      cycles += 8;
-      break;
-    }
-    case 0x71: { // LD (HL), C
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.c);
-      cycles += 8;
-      break;
-    }
-    case 0x72: { // LD (HL), D
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.d);
-      cycles += 8;
-      break;
-    }
-    case 0x73: { // LD (HL), E
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.e);
-      cycles += 8;
-      break;
-    }
-    case 0x74: { // LD (HL), H
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.h);
-      cycles += 8;
-      break;
-    }
-    case 0x75: { // LD (HL), L
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.l);
-      cycles += 8;
-      break;
-    }
-    case 0x36: { // LD (HL), n
-      // TODO: Check this line?
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, readByte(m, cpu->registers.pc++));
-      cycles += 12;
-      break;
-    }
+OPCODE_HANDLER(opcode44) // LD B, H
+{
+  cpu->registers.b = cpu->registers.h;
+  return 4;
+}
 
-    /* LD A, n -------------------------------------------------------------------------------*/
-    // NOTE: The GB CPU Manual contained duplicates of the following opcodes here: 7F, 78, 79, 7A, 7B, 7C, 7D and 3E
-    case 0x0A: { // LD A, (BC)
-      cpu->registers.a = readByte(m, (cpu->registers.b << 8) | cpu->registers.c);
-      cycles += 8;
-      break;
-    }
-    case 0x1A: { // LD A, (DE)
-      cpu->registers.a = readByte(m, (cpu->registers.d << 8) | cpu->registers.e);
-      cycles += 8;
-      break;
-    }
-    case 0xFA: { // LD A, (nn)
-      cpu->registers.a = readByte(m, readWord(m, cpu->registers.pc));
-      cpu->registers.pc += 2;
-      cycles += 16;
-      break;
-    }
-    case 0x3E: { // LD A, #
-      cpu->registers.a = readByte(m, cpu->registers.pc++);
-      cycles += 8;
-      break;
+OPCODE_HANDLER(opcode45) // LD B, L
+{
+  cpu->registers.b = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode46) // LD B, (HL)
+{
+  cpu->registers.b = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode48) // LD C, B
+{
+  cpu->registers.c = cpu->registers.b;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode49) // LD C, C
+{
+  cpu->registers.c = cpu->registers.c;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4A) // LD C, D
+{
+  cpu->registers.c = cpu->registers.d;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4B) // LD C, E
+{
+  cpu->registers.c = cpu->registers.e;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4C) // LD C, H
+{
+  cpu->registers.c = cpu->registers.h;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4D) // LD C, L
+{
+  cpu->registers.c = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4E) // LD C, (HL)
+{
+  cpu->registers.c = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode50) // LD D, B
+{
+  cpu->registers.d = cpu->registers.b;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode51) // LD D, C
+{
+  cpu->registers.d = cpu->registers.c;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode52) // LD D, D
+{
+  cpu->registers.d = cpu->registers.d;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode53) // LD D, E
+{
+  cpu->registers.d = cpu->registers.e;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode54) // LD D, H
+{
+  cpu->registers.d = cpu->registers.h;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode55) // LD D, L
+{
+  cpu->registers.d = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode56) // LD D, (HL)
+{
+  cpu->registers.d = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode58) // LD E, B
+{
+  cpu->registers.e = cpu->registers.b;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode59) // LD E, C
+{
+  cpu->registers.e = cpu->registers.c;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5A) // LD E, D
+{
+  cpu->registers.e = cpu->registers.d;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5B) // LD E, E
+{
+  cpu->registers.e = cpu->registers.e;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5C) // LD E, H
+{
+  cpu->registers.e = cpu->registers.h;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5D) // LD E, L
+{
+  cpu->registers.e = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5E) // LD E, (HL)
+{
+  cpu->registers.e = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode60) // LD H, B
+{
+  cpu->registers.h = cpu->registers.b;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode61) // LD H, C
+{
+  cpu->registers.h = cpu->registers.c;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode62) // LD H, D
+{
+  cpu->registers.h = cpu->registers.d;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode63) // LD H, E
+{
+  cpu->registers.h = cpu->registers.e;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode64) // LD H, H
+{
+  cpu->registers.h = cpu->registers.h;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode65) // LD H, L
+{
+  cpu->registers.h = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode66) // LD H, (HL)
+{
+  cpu->registers.h = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode68) // LD L, B
+{
+  cpu->registers.l = cpu->registers.b;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode69) // LD L, C
+{
+  cpu->registers.l = cpu->registers.c;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6A) // LD L, D
+{
+  cpu->registers.l = cpu->registers.d;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6B) // LD L, E
+{
+  cpu->registers.l = cpu->registers.e;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6C) // LD L, H
+{
+  cpu->registers.l = cpu->registers.h;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6D) // LD L, L
+{
+  cpu->registers.l = cpu->registers.l;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6E) // LD L, (HL)
+{
+  cpu->registers.l = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  return 8;
+}
+
+
+OPCODE_HANDLER(opcode70) // LD (HL), B
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.b);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode71) // LD (HL), C
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.c);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode72) // LD (HL), D
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.d);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode73) // LD (HL), E
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.e);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode74) // LD (HL), H
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.h);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode75) // LD (HL), L
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.l);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode36) // LD (HL), n
+{
+  // TODO: Check this line?
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, readByte(m, cpu->registers.pc++));
+  return 12;
+}
+
+
+/* LD A, n -------------------------------------------------------------------------------*/
+// NOTE: The GB CPU Manual contained duplicates of the following opcodes here: 7F, 78, 79, 7A, 7B, 7C, 7D and 3E
+OPCODE_HANDLER(opcode0A) // LD A, (BC)
+{
+  cpu->registers.a = readByte(m, (cpu->registers.b << 8) | cpu->registers.c);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode1A) // LD A, (DE)
+{
+  cpu->registers.a = readByte(m, (cpu->registers.d << 8) | cpu->registers.e);
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeFA) // LD A, (nn)
+{
+  cpu->registers.a = readByte(m, readWord(m, cpu->registers.pc));
+  cpu->registers.pc += 2;
+  return 16;
+}
+
+OPCODE_HANDLER(opcode3E) // LD A, #
+{
+  cpu->registers.a = readByte(m, cpu->registers.pc++);
+  return 8;
+}
+
+
+/* LD n, A -------------------------------------------------------------------------------*/
+// NOTE: The GB CPU Manual contained duplicates of the following opcodes here: 7F
+OPCODE_HANDLER(opcode47) // LD B, A
+{
+  cpu->registers.b = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode4F) // LD C, A
+{
+  cpu->registers.c = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode57) // LD D, A
+{
+  cpu->registers.d = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode5F) // LD E, A
+{
+  cpu->registers.e = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode67) // LD H, A
+{
+  cpu->registers.h = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode6F) // LD L, A
+{
+  cpu->registers.l = cpu->registers.a;
+  return 4;
+}
+
+OPCODE_HANDLER(opcode02) // LD (BC), A
+{
+  writeByte(m, (cpu->registers.b << 8) | cpu->registers.c, cpu->registers.a);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode12) // LD (DE), A
+{
+  writeByte(m, (cpu->registers.d << 8) | cpu->registers.e, cpu->registers.a);
+  return 8;
+}
+
+OPCODE_HANDLER(opcode77) // LD (HL), A
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.a);
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeEA) // LD (NN), A
+{
+  writeByte(m, readWord(m, cpu->registers.pc), cpu->registers.a);
+  cpu->registers.pc += 2;
+  return 16;
+}
+
+
+/* LD A, (C) -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF2) // LD A, (C)
+{
+  cpu->registers.a = readByte(m, 0xFF00 + cpu->registers.c);
+  return 8;
+}
+
+
+/* LD (C), A -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeE2) // LD (C), A
+{
+  writeByte(m, 0xFF00 + cpu->registers.c, cpu->registers.a);
+  return 8;
+}
+
+
+/* LD A, (HLD) - Same as LDD A, (HL) -----------------------------------------------------*/
+/* LD A, (HL-) - Same as LDD A, (HL) -----------------------------------------------------*/
+/* LDD A, (HL) ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode3A) // LD A, (HLD), LD A, (HL-) and LDD A, (HL)
+{
+  cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  cpu->registers.l--;
+  if (cpu->registers.l == 0xFF) { // If the resulting value is 255 then the previous value must have been 0 so also decrement H
+    cpu->registers.h--;
+  }
+  return 8;
+}
+
+
+/* LD (HLD), A - Same as LDD (HL), A -----------------------------------------------------*/
+/* LD (HL-), A - Same as LDD (HL), A -----------------------------------------------------*/
+/* LDD (HL), A ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode32) // LD (HLD), A, LD (HL-), A and LDD (HL), A
+{
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.a);
+  cpu->registers.l--;
+  if (cpu->registers.l == 0xFF) { // If the resulting value is 255 then the previous value must have been 0 so also decrement H
+    cpu->registers.h--;
+  }
+  return 8;
+}
+
+
+/* LD A, (HLI) - Same as LDI A, (HL) -----------------------------------------------------*/
+/* LD A, (HL+) - Same as LDI A, (HL) -----------------------------------------------------*/
+/* LDI A, (HL) ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode2A) // LD A, (HLI), LD A, (HL+) and LDI A, (HL)
+{
+  cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  cpu->registers.l++;
+  if (cpu->registers.l == 0x00) { // If the resulting value is 0 then the previous value must have been 255 so also increment H
+    cpu->registers.h++;
+  }
+  return 8;
+}
+
+
+/* LD (HLI), A - Same as LDI (HL), A -----------------------------------------------------*/
+/* LD (HL+), A - Same as LDI (HL), A -----------------------------------------------------*/
+/* LDI (HL), A ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode22) // LD (HLI), A, LD (HL+), A and LDI (HL), A
+{
+  writeByte(m, (cpu->registers.h) << 8 | cpu->registers.l, cpu->registers.a);
+  cpu->registers.l++;
+  if (cpu->registers.l == 0x00) { // If the resulting value is 0 then the previous value must have been 255 so also increment H
+    cpu->registers.h++;
+  }
+  return 8;
+}
+
+
+/* LDH (n), A ----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeE0) // LDH (n), A
+{
+  writeByte(m, 0xFF00 + readByte(m, cpu->registers.pc++), cpu->registers.a);
+  return 12;
+}
+
+
+/* LDH A, (n) ----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF0) // LDH A, (n)
+{
+  cpu->registers.a = readByte(m, 0xFF00 + readByte(m, cpu->registers.pc++));
+  return 12;
+}
+
+
+/* 16-Bit Loads ***************************************************************************/
+/* LD n, nn ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode01) // LD BC, nn
+{
+  cpu->registers.c = readByte(m, cpu->registers.pc++);
+  cpu->registers.b = readByte(m, cpu->registers.pc++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcode11) // LD DE, nn
+{
+  cpu->registers.e = readByte(m, cpu->registers.pc++);
+  cpu->registers.d = readByte(m, cpu->registers.pc++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcode21) // LD HL, nn
+{
+  cpu->registers.l = readByte(m, cpu->registers.pc++);
+  cpu->registers.h = readByte(m, cpu->registers.pc++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcode31) // LD SP, nn
+{
+  cpu->registers.sp = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  return 12;
+}
+
+
+/* LD SP, HL -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF9) // LD SP, HL
+{
+  cpu->registers.sp = (cpu->registers.h << 8) | cpu->registers.l;
+  return 8;
+}
+
+
+/* LD HL, SP + n - Same as LDHL SP, n ----------------------------------------------------*/
+/* LDHL SP, n ----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF8) // LD HL, SP + n and LDHL SP, n
+{
+  uint8_t unsignedValue = readByte(m, cpu->registers.pc++);
+  int8_t signedValue = (int8_t)unsignedValue;
+  uint16_t newHL = cpu->registers.sp + signedValue;
+  cpu->registers.h = (newHL & 0xFF00) >> 8;
+  cpu->registers.l = (newHL & 0x00FF);
+  uint16_t lowByteSum = (cpu->registers.sp & 0xFF) + unsignedValue;
+  resetZ(cpu);
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(cpu->registers.sp, unsignedValue, lowByteSum)
+  SET_C_FROM_RESULT(lowByteSum)
+  return 12;
+}
+
+
+/* LD (nn), SP ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode08) // LD (nn), SP
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  writeWord(m, address, cpu->registers.sp);
+  return 20;
+}
+
+
+/* PUSH nn -------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF5) // PUSH AF
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  writeByte(m, --cpu->registers.sp, cpu->registers.a);
+  writeByte(m, --cpu->registers.sp, cpuGetFlagRegister(cpu));
+  return 16;
+}
+
+OPCODE_HANDLER(opcodeC5) // PUSH BC
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  writeByte(m, --cpu->registers.sp, cpu->registers.b);
+  writeByte(m, --cpu->registers.sp, cpu->registers.c);
+  return 16;
+}
+
+OPCODE_HANDLER(opcodeD5) // PUSH DE
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  writeByte(m, --cpu->registers.sp, cpu->registers.d);
+  writeByte(m, --cpu->registers.sp, cpu->registers.e);
+  return 16;
+}
+
+OPCODE_HANDLER(opcodeE5) // PUSH HL
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  writeByte(m, --cpu->registers.sp, cpu->registers.h);
+  writeByte(m, --cpu->registers.sp, cpu->registers.l);
+  return 16;
+}
+
+
+/* POP, nn -------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF1) // POP AF
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  // TODO: Check clock cycles compared to PUSH nn
+  cpuSetFlagRegister(cpu, readByte(m, cpu->registers.sp++));
+  cpu->registers.a = readByte(m, cpu->registers.sp++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeC1) // POP BC
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  // TODO: Check clock cycles compared to PUSH nn
+  cpu->registers.c = readByte(m, cpu->registers.sp++);
+  cpu->registers.b = readByte(m, cpu->registers.sp++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeD1) // POP DE
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  // TODO: Check clock cycles compared to PUSH nn
+  cpu->registers.e = readByte(m, cpu->registers.sp++);
+  cpu->registers.d = readByte(m, cpu->registers.sp++);
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeE1) // POP HL
+{
+  // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
+  // TODO: Check clock cycles compared to PUSH nn
+  cpu->registers.l = readByte(m, cpu->registers.sp++);
+  cpu->registers.h = readByte(m, cpu->registers.sp++);
+  return 12;
+}
+
+
+/* 8-Bit ALU ******************************************************************************/
+/* ADD A, n ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode87) // ADD A, A
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode80) // ADD A, B
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode81) // ADD A, C
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode82) // ADD A, D
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode83) // ADD A, E
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode84) // ADD A, H
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode85) // ADD A, L
+{
+  MAKE_ADD_A_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode86) // ADD A, (HL)
+{
+  uint8_t old = cpu->registers.a;
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint32_t new = old + value;
+  cpu->registers.a = new;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old, value, new)
+  SET_C_FROM_RESULT(new)
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeC6) // ADD A, #
+{
+  uint8_t old = cpu->registers.a;
+  uint8_t value = readByte(m, cpu->registers.pc++);
+  uint32_t new = old + value;
+  cpu->registers.a = new;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old, value, new)
+  SET_C_FROM_RESULT(new)
+  return 8;
+}
+
+
+/* ADC A, n ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode8F) // ADC A, A
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode88) // ADC A, B
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode89) // ADC A, C
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode8A) // ADC A, D
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode8B) // ADC A, E
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode8C) // ADC A, H
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode8D) // ADC A, L
+{
+  MAKE_ADC_A_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode8E) // ADC A, (HL)
+{
+  uint8_t old = cpu->registers.a;
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint8_t carry = getC(cpu);
+  uint32_t new = old + value + carry;
+  cpu->registers.a = new;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old, value, new)
+  SET_C_FROM_RESULT(new)
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeCE) // ADC A, #
+{
+  uint8_t old = cpu->registers.a;
+  uint8_t value = readByte(m, cpu->registers.pc++);
+  uint8_t carry = getC(cpu);
+  uint32_t new = old + value + carry;
+  cpu->registers.a = new;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old, value, new)
+  SET_C_FROM_RESULT(new)
+  return 8;
+}
+
+
+/* SUB n ---------------------------------------------------------------------------------*/
+// TODO: Check all of these
+OPCODE_HANDLER(opcode97) // SUB A
+{
+  MAKE_SUB_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode90) // SUB B
+{
+  MAKE_SUB_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode91) // SUB C
+{
+  MAKE_SUB_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode92) // SUB D
+{
+  MAKE_SUB_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode93) // SUB E
+{
+  MAKE_SUB_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode94) // SUB H
+{
+  MAKE_SUB_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode95) // SUB L
+{
+  MAKE_SUB_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode96) // SUB (HL)
+{
+  uint8_t oldA = cpu->registers.a;
+  uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  int32_t newA = oldA - operand;
+  cpu->registers.a = newA;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(oldA, operand, newA)
+  SET_C_FROM_RESULT(newA)
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeD6) // SUB #
+{
+  uint8_t oldA = cpu->registers.a;
+  uint8_t operand = readByte(m, cpu->registers.pc++);
+  int32_t newA = oldA - operand;
+  cpu->registers.a = newA;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(oldA, operand, newA)
+  SET_C_FROM_RESULT(newA)
+  return 8;
+}
+
+
+/* SBC A, n ------------------------------------------------------------------------------*/
+// TODO: Check all of these
+OPCODE_HANDLER(opcode9F) // SBC A, A
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode98) // SBC A, B
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode99) // SBC A, C
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode9A) // SBC A, D
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode9B) // SBC A, E
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode9C) // SBC A, H
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode9D) // SBC A, L
+{
+  MAKE_SBC_A_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode9E) // SBC A, (HL)
+{
+  uint8_t oldA = cpu->registers.a;
+  uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint8_t c = getC(cpu);
+  int32_t newA = oldA - (operand + c);
+  cpu->registers.a = newA;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(oldA, operand, newA)
+  SET_C_FROM_RESULT(newA)
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeDE) // SBC A, #
+{
+  uint8_t oldA = cpu->registers.a;
+  uint8_t operand = readByte(m, cpu->registers.pc++);
+  uint8_t c = getC(cpu);
+  int32_t newA = oldA - (operand + c);
+  cpu->registers.a = newA;
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(oldA, operand, newA)
+  SET_C_FROM_RESULT(newA)
+  return 8;
+}
+
+
+/* AND n ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeA7) // AND A
+{
+  MAKE_AND_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcodeA0) // AND B
+{
+  MAKE_AND_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcodeA1) // AND C
+{
+  MAKE_AND_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcodeA2) // AND D
+{
+  MAKE_AND_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcodeA3) // AND E
+{
+  MAKE_AND_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcodeA4) // AND H
+{
+  MAKE_AND_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcodeA5) // AND L
+{
+  MAKE_AND_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcodeA6) // AND (HL)
+{
+  cpu->registers.a &= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  setH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeE6) // AND #
+{
+  cpu->registers.a &= readByte(m, cpu->registers.pc++);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  setH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+
+/* OR n ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeB7) // OR A
+{
+  MAKE_OR_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcodeB0) // OR B
+{
+  MAKE_OR_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcodeB1) // OR C
+{
+  MAKE_OR_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcodeB2) // OR D
+{
+  MAKE_OR_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcodeB3) // OR E
+{
+  MAKE_OR_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcodeB4) // OR H
+{
+  MAKE_OR_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcodeB5) // OR L
+{
+  MAKE_OR_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcodeB6) // OR (HL)
+{
+  cpu->registers.a |= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  resetH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeF6) // OR #
+{
+  cpu->registers.a |= readByte(m, cpu->registers.pc++);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  resetH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+
+/* XOR n ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeAF) // XOR A
+{
+  MAKE_XOR_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcodeA8) // XOR B
+{
+  MAKE_XOR_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcodeA9) // XOR C
+{
+  MAKE_XOR_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcodeAA) // XOR D
+{
+  MAKE_XOR_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcodeAB) // XOR E
+{
+  MAKE_XOR_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcodeAC) // XOR H
+{
+  MAKE_XOR_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcodeAD) // XOR L
+{
+  MAKE_XOR_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcodeAE) // XOR (HL)
+{
+  cpu->registers.a ^= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  resetH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeEE) // XOR *
+{
+  cpu->registers.a ^= readByte(m, cpu->registers.pc++);
+  SET_Z_FROM_RESULT(cpu->registers.a)
+  resetN(cpu);
+  resetH(cpu);
+  resetC(cpu);
+  return 8;
+}
+
+
+/* CP n ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeBF) // CP A
+{
+  MAKE_CP_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcodeB8) // CP B
+{
+  MAKE_CP_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcodeB9) // CP C
+{
+  MAKE_CP_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcodeBA) // CP D
+{
+  MAKE_CP_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcodeBB) // CP E
+{
+  MAKE_CP_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcodeBC) // CP H
+{
+  MAKE_CP_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcodeBD) // CP L
+{
+  MAKE_CP_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcodeBE) // CP (HL)
+{
+  uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  int16_t result = cpu->registers.a - operand;
+  SET_Z_FROM_RESULT(result)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(cpu->registers.a, operand, result)
+  SET_C_FROM_RESULT(result)
+  return 8;
+}
+
+OPCODE_HANDLER(opcodeFE) // CP #
+{
+  uint8_t operand = readByte(m, cpu->registers.pc++);
+  int16_t result = cpu->registers.a - operand;
+  SET_Z_FROM_RESULT(result)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(cpu->registers.a, operand, result)
+  SET_C_FROM_RESULT(result)
+  return 8;
+}
+
+
+/* INC n ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode3C) // INC A
+{
+  MAKE_INC_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode04) // INC B
+{
+  MAKE_INC_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode0C) // INC C
+{
+  MAKE_INC_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode14) // INC D
+{
+  MAKE_INC_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode1C) // INC E
+{
+  MAKE_INC_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode24) // INC H
+{
+  MAKE_INC_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode2C) // INC L
+{
+  MAKE_INC_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode34) // INC (HL)
+{
+  uint8_t old = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint16_t new = old + 1;
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, (uint8_t)new);
+  SET_Z_FROM_RESULT((uint8_t)new)
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old, 1, new)
+  return 12;
+}
+
+
+/* DEC n ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode3D) // DEC A
+{
+  MAKE_DEC_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(opcode05) // DEC B
+{
+  MAKE_DEC_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(opcode0D) // DEC C
+{
+  MAKE_DEC_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(opcode15) // DEC D
+{
+  MAKE_DEC_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(opcode1D) // DEC E
+{
+  MAKE_DEC_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(opcode25) // DEC H
+{
+  MAKE_DEC_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(opcode2D) // DEC L
+{
+  MAKE_DEC_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(opcode35) // DEC (HL)
+{
+  uint8_t oldValue = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  int16_t newValue = oldValue - 1;
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, (uint8_t)newValue);
+  SET_Z_FROM_RESULT((uint8_t)newValue)
+  setN(cpu);
+  SET_H_FROM_OPERANDS(oldValue, 1, newValue)
+  return 12;
+}
+
+
+/* 16-Bit Arithmetic **********************************************************************/
+/* ADD HL, n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode09) // ADD HL, BC
+{
+  MAKE_ADD_HL_N_OPCODE_IMPL(b, c)
+}
+
+OPCODE_HANDLER(opcode19) // ADD HL, DE
+{
+  MAKE_ADD_HL_N_OPCODE_IMPL(d, e)
+}
+
+OPCODE_HANDLER(opcode29) // ADD HL, HL
+{
+  MAKE_ADD_HL_N_OPCODE_IMPL(h, l)
+}
+
+OPCODE_HANDLER(opcode39) // ADD HL, SP
+{
+  uint16_t old = (cpu->registers.h << 8) | cpu->registers.l;
+  uint16_t value = cpu->registers.sp;
+  uint32_t result = old + value;
+  cpu->registers.h = (result & 0xFF00) >> 8;
+  cpu->registers.l = (result & 0x00FF);
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(old >> 8, value >> 8, result >> 8)
+  SET_C_FROM_RESULT(result >> 8)
+  return 8;
+}
+
+
+/* ADD SP, n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeE8) // ADD SP, n
+{
+  uint8_t unsignedValue = readByte(m, cpu->registers.pc++);
+  int8_t signedValue = (int8_t)unsignedValue;
+  uint16_t oldSP = cpu->registers.sp;
+  int32_t newSP = oldSP + signedValue;
+  cpu->registers.sp = newSP;
+  uint16_t lowByteSum = (oldSP & 0xFF) + unsignedValue;
+  resetZ(cpu);
+  resetN(cpu);
+  SET_H_FROM_OPERANDS(oldSP, unsignedValue, lowByteSum)
+  SET_C_FROM_RESULT(lowByteSum)
+  return 16;
+}
+
+
+/* INC nn --------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode03) // INC BC
+{
+  MAKE_INC_NN_OPCODE_IMPL(b, c)
+}
+
+OPCODE_HANDLER(opcode13) // INC DE
+{
+  MAKE_INC_NN_OPCODE_IMPL(d, e)
+}
+
+OPCODE_HANDLER(opcode23) // INC HL
+{
+  MAKE_INC_NN_OPCODE_IMPL(h, l)
+}
+
+OPCODE_HANDLER(opcode33) // INC SP
+{
+  cpu->registers.sp++;
+  return 8;
+}
+
+
+/* DEC nn --------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode0B) // DEC BC
+{
+  MAKE_DEC_NN_OPCODE_IMPL(b, c)
+}
+
+OPCODE_HANDLER(opcode1B) // DEC DE
+{
+  MAKE_DEC_NN_OPCODE_IMPL(d, e)
+}
+
+OPCODE_HANDLER(opcode2B) // DEC HL
+{
+  MAKE_DEC_NN_OPCODE_IMPL(h, l)
+}
+
+OPCODE_HANDLER(opcode3B) // DEC SP
+{
+  cpu->registers.sp--;
+  return 8;
+}
+
+
+/* Miscellaneous **************************************************************************/
+/* DAA -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode27) // DAA
+{
+  uint8_t n = getN(cpu);
+  uint8_t h = getH(cpu);
+  uint8_t c = getC(cpu);
+  uint16_t a = cpu->registers.a;
+
+  if (!n) {
+    if (h || (a & 0x0F) > 9) {
+      a += 0x06;
+    }
+    if (c || (a > 0x9F)) {
+      a += 0x60;
+    }
+  } else {
+    if (h) {
+      a = (a - 6) & 0xFF;
     }
+    if (c) {
+      a -= 0x60;
+    }
+  }
+
+  resetZ(cpu);
+  resetH(cpu);
+
+  if (a > 0xFF) {
+    setC(cpu);
+  }
+
+  cpu->registers.a = a;
+
+  if (cpu->registers.a == 0) {
+    setZ(cpu);
+  }
+
+  return 4;
+}
+
+
+/* CPL -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode2F) // CPL
+{
+  cpu->registers.a = ~cpu->registers.a;
+  setN(cpu);
+  setH(cpu);
+  return 4;
+}
+
+
+/* CCF -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode3F) // CCF
+{
+  cpu->flags.carryBits ^= CARRY_BIT;
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* SCF -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode37) // SCF
+{
+  setC(cpu);
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* NOP -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode00) // NOP
+{
+  return 4;
+}
+
+/* HALT ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode76) // HALT
+{
+  cpu->halt = true;
+  return 4;
+}
+
+
+/* STOP ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode10) // STOP
+{
+  // NOTE: Some Game Boy CPU manuals document the opcode for this instruction as 10 00 but there
+  // seems to be no reason for this to not be a single byte opcode so some assemblers simply code
+  // it as 10. There is also no indication in the number of required clock cycles of a a read of an additional byte.
+  if ((m->cgbMode == COLOUR) && (m->speedController->key1 & 1)) {
+    schedulerSyncAndReschedule(m->scheduler); // Components have to be brought up to date at the old speed
+    if ((m->speedController->key1 & (1 << 7))) {
+      m->speedController->key1 = 0;
+      info("Entering NORMAL speed mode\n");
+    } else {
+      m->speedController->key1 = (1 << 7);
+      info("Entering DOUBLE speed mode\n");
+    }
+    m->interruptController->e = 0;
+    lcdSpeedChange(m->lcdController);
+    memoryUpdateVideoPages(m);
+  } else {
+    cpu->stop = true;
+  }
+  return 4;
+}
+
+
+/* DI ------------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeF3) // DI
+{
+  cpu->di = 1;
+  return 4;
+}
+
+
+/* EI ------------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeFB) // EI
+{
+  cpu->ei = 1;
+  return 4;
+}
+
+
+/* Rotates and Shifts *********************************************************************/
+/* RLCA ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode07) // RLCA
+{
+  SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_7) // NOTE: Set the C bit of F before we modify A
+  cpu->registers.a = (cpu->registers.a << 1) | ((cpu->registers.a & BIT_7) >> BIT_7_SHIFT);
+  resetZ(cpu);
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* RLA -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode17) // RLA
+{
+  uint8_t oldCarryBit = getC(cpu);
+  SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_7) // NOTE: Set the C bit of F before we modify A
+  cpu->registers.a = (cpu->registers.a << 1) | oldCarryBit;
+  resetZ(cpu);
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* RRCA ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode0F) // RRCA
+{
+  SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_0) // NOTE: Set the C bit of F before we modify A
+  cpu->registers.a = ((cpu->registers.a & BIT_0) << BIT_7_SHIFT) | (cpu->registers.a >> 1);
+  resetZ(cpu);
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* RRA -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode1F) // RRA
+{
+  uint8_t oldCarryBit = getC(cpu);
+  SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_0) // NOTE: Set the C bit of F before we modify A
+  cpu->registers.a = (oldCarryBit << BIT_7_SHIFT) | (cpu->registers.a >> 1);
+  resetZ(cpu);
+  resetN(cpu);
+  resetH(cpu);
+  return 4;
+}
+
+
+/* Jumps **********************************************************************************/
+/* JP nn ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC3) // JP nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  cpu->registers.pc = address;
+  return 16;
+}
+
+
+/* JP cc, nn -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC2) // JP NZ, nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  if (getZ(cpu) == 0) {
+    cpu->registers.pc = address;
+    return 16;
+  }
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeCA) // JP Z, nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  if (getZ(cpu) == 1) {
+    cpu->registers.pc = address;
+    return 16;
+  }
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeD2) // JP NC, nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  if (getC(cpu) == 0) {
+    cpu->registers.pc = address;
+    return 16;
+  }
+  return 12;
+}
+
+OPCODE_HANDLER(opcodeDA) // JP C, nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  if (getC(cpu) == 1) {
+    cpu->registers.pc = address;
+    return 16;
+  }
+  return 12;
+}
+
+
+/* JP (HL) -------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeE9) // JP (HL)
+{
+  cpu->registers.pc = (cpu->registers.h << 8) | cpu->registers.l;
+  return 4;
+}
+
+
+/* JR n ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode18) // JR n
+{
+  int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
+  cpu->registers.pc += value;
+  return 12;
+}
+
+
+/* JR cc, n-------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcode20) // JR NZ, n
+{
+  int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
+  if (getZ(cpu) == 0) {
+    cpu->registers.pc += value;
+    return 12;
+  }
+  return 8;
+}
+
+OPCODE_HANDLER(opcode28) // JR Z, n
+{
+  int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
+  if (getZ(cpu) == 1) {
+    cpu->registers.pc += value;
+    return 12;
+  }
+  return 8;
+}
+
+OPCODE_HANDLER(opcode30) // JR NC, n
+{
+  int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
+  if (getC(cpu) == 0) {
+    cpu->registers.pc += value;
+    return 12;
+  }
+  return 8;
+}
+
+OPCODE_HANDLER(opcode38) // JR C, n
+{
+  int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
+  if (getC(cpu) == 1) {
+    cpu->registers.pc += value;
+    return 12;
+  }
+  return 8;
+}
+
+
+/* Calls **********************************************************************************/
+/* CALL nn -------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeCD) // CALL nn
+{
+  uint16_t address = readWord(m, cpu->registers.pc);
+  cpu->registers.pc += 2;
+  writeByte(m, --cpu->registers.sp, ((cpu->registers.pc & 0xFF00) >> 8));
+  writeByte(m, --cpu->registers.sp, (cpu->registers.pc & 0x00FF));
+  cpu->registers.pc = address;
+  return 24;
+}
+
+
+/* CALL cc, nn ---------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC4) // CALL NZ, nn
+{
+  MAKE_CALL_CC_NN_OPCODE_IMPL(Z, 0)
+}
+
+OPCODE_HANDLER(opcodeCC) // CALL Z, nn
+{
+  MAKE_CALL_CC_NN_OPCODE_IMPL(Z, 1)
+}
+
+OPCODE_HANDLER(opcodeD4) // CALL NC, nn
+{
+  MAKE_CALL_CC_NN_OPCODE_IMPL(C, 0)
+}
+
+OPCODE_HANDLER(opcodeDC) // CALL C, nn
+{
+  MAKE_CALL_CC_NN_OPCODE_IMPL(C, 1)
+}
+
+
+/* Restarts *******************************************************************************/
+/* RST n ---------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC7) // RST 00
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0000)
+}
+
+OPCODE_HANDLER(opcodeCF) // RST 08
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0008)
+}
+
+OPCODE_HANDLER(opcodeD7) // RST 10
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0010)
+}
+
+OPCODE_HANDLER(opcodeDF) // RST 18
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0018)
+}
+
+OPCODE_HANDLER(opcodeE7) // RST 20
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0020)
+}
+
+OPCODE_HANDLER(opcodeEF) // RST 28
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0028)
+}
+
+OPCODE_HANDLER(opcodeF7) // RST 30
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0030)
+}
+
+OPCODE_HANDLER(opcodeFF) // RST 38
+{
+  MAKE_RST_N_OPCODE_IMPL(0x0038)
+}
+
+
+/* Returns ********************************************************************************/
+/* RET -----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC9) // RET
+{
+  uint8_t addressLow = readByte(m, cpu->registers.sp++);
+  uint8_t addressHigh = readByte(m, cpu->registers.sp++);
+  cpu->registers.pc = (addressHigh << 8) | addressLow;
+  return 16;
+}
+
+
+/* RET cc --------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeC0) // RET NZ
+{
+  MAKE_RET_CC_OPCODE_IMPL(Z, 0)
+}
+
+OPCODE_HANDLER(opcodeC8) // RET Z
+{
+  MAKE_RET_CC_OPCODE_IMPL(Z, 1)
+}
+
+OPCODE_HANDLER(opcodeD0) // RET NC
+{
+  MAKE_RET_CC_OPCODE_IMPL(C, 0)
+}
+
+OPCODE_HANDLER(opcodeD8) // RET C
+{
+  MAKE_RET_CC_OPCODE_IMPL(C, 1)
+}
+
+
+/* RETI ----------------------------------------------------------------------------------*/
+OPCODE_HANDLER(opcodeD9) // RETI
+{
+  // TODO: Check how IME is set - is there a single instruction delay before interrupts are enabled as with DI and EI?
+  // Potentially not because this replicates the combination of the combination of "EI, RET" instructions,
+  // in which EI would cause interrupts to be enabled AFTER the RET had executed, so the effect
+  // of the single instruction delay would/should be replicated here.
+  uint8_t addressLow = readByte(m, cpu->registers.sp++);
+  uint8_t addressHigh = readByte(m, cpu->registers.sp++);
+  cpu->registers.pc = (addressHigh << 8) | addressLow;
+  cpu->ime = true;
+  return 16;
+}
+
+
+/* Unknown Opcodes ************************************************************************/
+MAKE_UNKNOWN_OPCODE_HANDLER(D3)
+MAKE_UNKNOWN_OPCODE_HANDLER(DB)
+MAKE_UNKNOWN_OPCODE_HANDLER(DD)
+MAKE_UNKNOWN_OPCODE_HANDLER(E3)
+MAKE_UNKNOWN_OPCODE_HANDLER(E4)
+MAKE_UNKNOWN_OPCODE_HANDLER(EB)
+MAKE_UNKNOWN_OPCODE_HANDLER(EC)
+MAKE_UNKNOWN_OPCODE_HANDLER(ED)
+MAKE_UNKNOWN_OPCODE_HANDLER(F4)
+MAKE_UNKNOWN_OPCODE_HANDLER(FC)
+MAKE_UNKNOWN_OPCODE_HANDLER(FD)
+
+
+/* CB-Prefixed Opcodes ********************************************************************/
+/* Miscellaneous **********************************************************************/
+/* SWAP n ----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode37) // SWAP A
+{
+  MAKE_SWAP_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(cbOpcode30) // SWAP B
+{
+  MAKE_SWAP_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(cbOpcode31) // SWAP C
+{
+  MAKE_SWAP_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(cbOpcode32) // SWAP D
+{
+  MAKE_SWAP_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(cbOpcode33) // SWAP E
+{
+  MAKE_SWAP_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(cbOpcode34) // SWAP H
+{
+  MAKE_SWAP_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(cbOpcode35) // SWAP L
+{
+  MAKE_SWAP_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(cbOpcode36) // SWAP (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  value = ((value & 0xF0) >> 4) | ((value & 0x0F) << 4);
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  resetC(cpu);
+  return 16;
+}
+
+
+/* Rotates and Shifts *****************************************************************/
+/* RLC n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode07) // RLC A
+{
+  MAKE_RLC_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(cbOpcode00) // RLC B
+{
+  MAKE_RLC_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(cbOpcode01) // RLC C
+{
+  MAKE_RLC_N_OPCODE_IMPL(c)
+}
 
-    /* LD n, A -------------------------------------------------------------------------------*/
-    // NOTE: The GB CPU Manual contained duplicates of the following opcodes here: 7F
-    case 0x47: { // LD B, A
-      cpu->registers.b = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x4F: { // LD C, A
-      cpu->registers.c = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x57: { // LD D, A
-      cpu->registers.d = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x5F: { // LD E, A
-      cpu->registers.e = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x67: { // LD H, A
-      cpu->registers.h = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x6F: { // LD L, A
-      cpu->registers.l = cpu->registers.a;
-      cycles += 4;
-      break;
-    }
-    case 0x02: { // LD (BC), A
-      writeByte(m, (cpu->registers.b << 8) | cpu->registers.c, cpu->registers.a);
-      cycles += 8;
-      break;
-    }
-    case 0x12: { // LD (DE), A
-      writeByte(m, (cpu->registers.d << 8) | cpu->registers.e, cpu->registers.a);
-      cycles += 8;
-      break;
-    }
-    case 0x77: { // LD (HL), A
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.a);
-      cycles += 8;
-      break;
-    }
-    case 0xEA: { // LD (NN), A
-      writeByte(m, readWord(m, cpu->registers.pc), cpu->registers.a);
-      cpu->registers.pc += 2;
-      cycles += 16;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode02) // RLC D
+{
+  MAKE_RLC_N_OPCODE_IMPL(d)
+}
 
-    /* LD A, (C) -----------------------------------------------------------------------------*/
-    case 0xF2: { // LD A, (C)
-      cpu->registers.a = readByte(m, 0xFF00 + cpu->registers.c);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode03) // RLC E
+{
+  MAKE_RLC_N_OPCODE_IMPL(e)
+}
 
-    /* LD (C), A -----------------------------------------------------------------------------*/
-    case 0xE2: { // LD (C), A
-      writeByte(m, 0xFF00 + cpu->registers.c, cpu->registers.a);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode04) // RLC H
+{
+  MAKE_RLC_N_OPCODE_IMPL(h)
+}
 
-    /* LD A, (HLD) - Same as LDD A, (HL) -----------------------------------------------------*/
-    /* LD A, (HL-) - Same as LDD A, (HL) -----------------------------------------------------*/
-    /* LDD A, (HL) ---------------------------------------------------------------------------*/
-    case 0x3A: { // LD A, (HLD), LD A, (HL-) and LDD A, (HL)
-      cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cpu->registers.l--;
-      if (cpu->registers.l == 0xFF) { // If the resulting value is 255 then the previous value must have been 0 so also decrement H
-        cpu->registers.h--;
-      }
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode05) // RLC L
+{
+  MAKE_RLC_N_OPCODE_IMPL(l)
+}
 
-    /* LD (HLD), A - Same as LDD (HL), A -----------------------------------------------------*/
-    /* LD (HL-), A - Same as LDD (HL), A -----------------------------------------------------*/
-    /* LDD (HL), A ---------------------------------------------------------------------------*/
-    case 0x32: { // LD (HLD), A, LD (HL-), A and LDD (HL), A
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, cpu->registers.a);
-      cpu->registers.l--;
-      if (cpu->registers.l == 0xFF) { // If the resulting value is 255 then the previous value must have been 0 so also decrement H
-        cpu->registers.h--;
-      }
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode06) // RLC (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_FLAG_TO_RESULT(C, value & BIT_7); // NOTE: Set the C bit of F BEFORE we modify the value
+  value = (value << 1) | ((value & BIT_7) >> BIT_7_SHIFT);
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-    /* LD A, (HLI) - Same as LDI A, (HL) -----------------------------------------------------*/
-    /* LD A, (HL+) - Same as LDI A, (HL) -----------------------------------------------------*/
-    /* LDI A, (HL) ---------------------------------------------------------------------------*/
-    case 0x2A: { // LD A, (HLI), LD A, (HL+) and LDI A, (HL)
-      cpu->registers.a = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      cpu->registers.l++;
-      if (cpu->registers.l == 0x00) { // If the resulting value is 0 then the previous value must have been 255 so also increment H
-        cpu->registers.h++;
-      }
-      cycles += 8;
-      break;
-    }
 
-    /* LD (HLI), A - Same as LDI (HL), A -----------------------------------------------------*/
-    /* LD (HL+), A - Same as LDI (HL), A -----------------------------------------------------*/
-    /* LDI (HL), A ---------------------------------------------------------------------------*/
-    case 0x22: { // LD (HLI), A, LD (HL+), A and LDI (HL), A
-      writeByte(m, (cpu->registers.h) << 8 | cpu->registers.l, cpu->registers.a);
-      cpu->registers.l++;
-      if (cpu->registers.l == 0x00) { // If the resulting value is 0 then the previous value must have been 255 so also increment H
-        cpu->registers.h++;
-      }
-      cycles += 8;
-      break;
-    }
+/* RL n ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode17) // RL A
+{
+  MAKE_RL_N_OPCODE_IMPL(a)
+}
 
-    /* LDH (n), A ----------------------------------------------------------------------------*/
-    case 0xE0: { // LDH (n), A
-      writeByte(m, 0xFF00 + readByte(m, cpu->registers.pc++), cpu->registers.a);
-      cycles += 12;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode10) // RL B
+{
+  MAKE_RL_N_OPCODE_IMPL(b)
+}
 
-    /* LDH A, (n) ----------------------------------------------------------------------------*/
-    case 0xF0: { // LDH A, (n)
-      cpu->registers.a = readByte(m, 0xFF00 + readByte(m, cpu->registers.pc++));
-      cycles += 12;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode11) // RL C
+{
+  MAKE_RL_N_OPCODE_IMPL(c)
+}
 
-    /* 16-Bit Loads ***************************************************************************/
-    /* LD n, nn ------------------------------------------------------------------------------*/
-    case 0x01: { // LD BC, nn
-      cpu->registers.c = readByte(m, cpu->registers.pc++);
-      cpu->registers.b = readByte(m, cpu->registers.pc++);
-      cycles += 12;
-      break;
-    }
-    case 0x11: { // LD DE, nn
-      cpu->registers.e = readByte(m, cpu->registers.pc++);
-      cpu->registers.d = readByte(m, cpu->registers.pc++);
-      cycles += 12;
-      break;
-    }
-    case 0x21: { // LD HL, nn
-      cpu->registers.l = readByte(m, cpu->registers.pc++);
-      cpu->registers.h = readByte(m, cpu->registers.pc++);
-      cycles += 12;
-      break;
-    }
-    case 0x31: { // LD SP, nn
-      cpu->registers.sp = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      cycles += 12;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode12) // RL D
+{
+  MAKE_RL_N_OPCODE_IMPL(d)
+}
 
-    /* LD SP, HL -----------------------------------------------------------------------------*/
-    case 0xF9: { // LD SP, HL
-      cpu->registers.sp = (cpu->registers.h << 8) | cpu->registers.l;
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode13) // RL E
+{
+  MAKE_RL_N_OPCODE_IMPL(e)
+}
 
-    /* LD HL, SP + n - Same as LDHL SP, n ----------------------------------------------------*/
-    /* LDHL SP, n ----------------------------------------------------------------------------*/
-    case 0xF8: { // LD HL, SP + n and LDHL SP, n
-      uint8_t unsignedValue = readByte(m, cpu->registers.pc++);
-      int8_t signedValue = (int8_t)unsignedValue;
-      uint16_t newHL = cpu->registers.sp + signedValue;
-      cpu->registers.h = (newHL & 0xFF00) >> 8;
-      cpu->registers.l = (newHL & 0x00FF);
-      resetZ(cpu);
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((cpu->registers.sp & 0x0F) + (unsignedValue & 0x0F)) > 0x0F)
-      SET_FLAG_TO_RESULT(C, ((cpu->registers.sp & 0xFF) + (unsignedValue & 0xFF)) > 0xFF)
-      cycles += 12;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode14) // RL H
+{
+  MAKE_RL_N_OPCODE_IMPL(h)
+}
 
-    /* LD (nn), SP ---------------------------------------------------------------------------*/
-    case 0x08: { // LD (nn), SP
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      writeWord(m, address, cpu->registers.sp);
-      cycles += 20;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode15) // RL L
+{
+  MAKE_RL_N_OPCODE_IMPL(l)
+}
 
-    /* PUSH nn -------------------------------------------------------------------------------*/
-    case 0xF5: { // PUSH AF
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      writeByte(m, --cpu->registers.sp, cpu->registers.a);
-      writeByte(m, --cpu->registers.sp, cpu->registers.f);
-      cycles += 16;
-      break;
-    }
-    case 0xC5: { // PUSH BC
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      writeByte(m, --cpu->registers.sp, cpu->registers.b);
-      writeByte(m, --cpu->registers.sp, cpu->registers.c);
-      cycles += 16;
-      break;
-    }
-    case 0xD5: { // PUSH DE
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      writeByte(m, --cpu->registers.sp, cpu->registers.d);
-      writeByte(m, --cpu->registers.sp, cpu->registers.e);
-      cycles += 16;
-      break;
-    }
-    case 0xE5: { // PUSH HL
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      writeByte(m, --cpu->registers.sp, cpu->registers.h);
-      writeByte(m, --cpu->registers.sp, cpu->registers.l);
-      cycles += 16;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode16) // RL (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint8_t oldCarryBit = getC(cpu);
+  SET_FLAG_TO_RESULT(C, value & BIT_7) // NOTE: Set the C bit of F BEFORE we modify the value
+  value = (value << 1) | oldCarryBit;
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-    /* POP, nn -------------------------------------------------------------------------------*/
-    case 0xF1: { // POP AF
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      // TODO: Check clock cycles compared to PUSH nn
-      cpu->registers.f = readByte(m, cpu->registers.sp++);
-      cpu->registers.a = readByte(m, cpu->registers.sp++);
-      cpu->registers.f &= 0xF0;
-      cycles += 12;
-      break;
-    }
-    case 0xC1: { // POP BC
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      // TODO: Check clock cycles compared to PUSH nn
-      cpu->registers.c = readByte(m, cpu->registers.sp++);
-      cpu->registers.b = readByte(m, cpu->registers.sp++);
-      cycles += 12;
-      break;
-    }
-    case 0xD1: { // POP DE
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      // TODO: Check clock cycles compared to PUSH nn
-      cpu->registers.e = readByte(m, cpu->registers.sp++);
-      cpu->registers.d = readByte(m, cpu->registers.sp++);
-      cycles += 12;
-      break;
-    }
-    case 0xE1: { // POP HL
-      // TODO: Check the order of registers - here we are keeping the higher-order byte of the register pair at the higher address in memory
-      // TODO: Check clock cycles compared to PUSH nn
-      cpu->registers.l = readByte(m, cpu->registers.sp++);
-      cpu->registers.h = readByte(m, cpu->registers.sp++);
-      cycles += 12;
-      break;
-    }
 
-    /* 8-Bit ALU ******************************************************************************/
-    /* ADD A, n ------------------------------------------------------------------------------*/
-    case 0x87: { // ADD A, A
-      MAKE_ADD_A_N_OPCODE_IMPL(a)
-    }
-    case 0x80: { // ADD A, B
-      MAKE_ADD_A_N_OPCODE_IMPL(b)
-    }
-    case 0x81: { // ADD A, C
-      MAKE_ADD_A_N_OPCODE_IMPL(c)
-    }
-    case 0x82: { // ADD A, D
-      MAKE_ADD_A_N_OPCODE_IMPL(d)
-    }
-    case 0x83: { // ADD A, E
-      MAKE_ADD_A_N_OPCODE_IMPL(e)
-    }
-    case 0x84: { // ADD A, H
-      MAKE_ADD_A_N_OPCODE_IMPL(h)
-    }
-    case 0x85: { // ADD A, L
-      MAKE_ADD_A_N_OPCODE_IMPL(l)
-    }
-    case 0x86: { // ADD A, (HL)
-      uint8_t old = cpu->registers.a;
-      uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      uint32_t new = old + value;
-      cpu->registers.a = new;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF)) > 0xF)
-      SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF)) > 0xFF)
-      cycles += 8;
-      break;
-    }
-    case 0xC6: { // ADD A, #
-      uint8_t old = cpu->registers.a;
-      uint8_t value = readByte(m, cpu->registers.pc++);
-      uint32_t new = old + value;
-      cpu->registers.a = new;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF)) > 0xF)
-      SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF)) > 0xFF)
-      cycles += 8;
-      break;
-    }
+/* RRC n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode0F) // RRC A
+{
+  MAKE_RRC_N_OPCODE_IMPL(a)
+}
 
-    /* ADC A, n ------------------------------------------------------------------------------*/
-    case 0x8F: { // ADC A, A
-      MAKE_ADC_A_N_OPCODE_IMPL(a)
-    }
-    case 0x88: { // ADC A, B
-      MAKE_ADC_A_N_OPCODE_IMPL(b)
-    }
-    case 0x89: { // ADC A, C
-      MAKE_ADC_A_N_OPCODE_IMPL(c)
-    }
-    case 0x8A: { // ADC A, D
-      MAKE_ADC_A_N_OPCODE_IMPL(d)
-    }
-    case 0x8B: { // ADC A, E
-      MAKE_ADC_A_N_OPCODE_IMPL(e)
-    }
-    case 0x8C: { // ADC A, H
-      MAKE_ADC_A_N_OPCODE_IMPL(h)
-    }
-    case 0x8D: { // ADC A, L
-      MAKE_ADC_A_N_OPCODE_IMPL(l)
-    }
-    case 0x8E: { // ADC A, (HL)
-      uint8_t old = cpu->registers.a;
-      uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      uint8_t carry = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT);
-      uint32_t new = old + value + carry;
-      cpu->registers.a = new;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF) + carry) > 0xF)
-      SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF) + carry) > 0xFF)
-      cycles += 8;
-      break;
-    }
-    case 0xCE: { // ADC A, #
-      uint8_t old = cpu->registers.a;
-      uint8_t value = readByte(m, cpu->registers.pc++);
-      uint8_t carry = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT);
-      uint32_t new = old + value + carry;
-      cpu->registers.a = new;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xF) + (value & 0xF) + carry) > 0xF)
-      SET_FLAG_TO_RESULT(C, ((old & 0xFF) + (value & 0xFF) + carry) > 0xFF)
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode08) // RRC B
+{
+  MAKE_RRC_N_OPCODE_IMPL(b)
+}
 
-    /* SUB n ---------------------------------------------------------------------------------*/
-    // TODO: Check all of these
-    case 0x97: { // SUB A
-      MAKE_SUB_N_OPCODE_IMPL(a)
-    }
-    case 0x90: { // SUB B
-      MAKE_SUB_N_OPCODE_IMPL(b)
-    }
-    case 0x91: { // SUB C
-      MAKE_SUB_N_OPCODE_IMPL(c)
-    }
-    case 0x92: { // SUB D
-      MAKE_SUB_N_OPCODE_IMPL(d)
-    }
-    case 0x93: { // SUB E
-      MAKE_SUB_N_OPCODE_IMPL(e)
-    }
-    case 0x94: { // SUB H
-      MAKE_SUB_N_OPCODE_IMPL(h)
-    }
-    case 0x95: { // SUB L
-      MAKE_SUB_N_OPCODE_IMPL(l)
-    }
-    case 0x96: { // SUB (HL)
-      uint8_t oldA = cpu->registers.a;
-      uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      int32_t newA = oldA - operand;
-      cpu->registers.a = newA;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, (operand & 0x0F) > (oldA & 0x0F))
-      SET_FLAG_TO_RESULT(C, newA < 0)
-      cycles += 8;
-      break;
-    }
-    case 0xD6: { // SUB #
-      uint8_t oldA = cpu->registers.a;
-      uint8_t operand = readByte(m, cpu->registers.pc++);
-      int32_t newA = oldA - operand;
-      cpu->registers.a = newA;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, (operand & 0x0F) > (oldA & 0x0F))
-      SET_FLAG_TO_RESULT(C, newA < 0)
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode09) // RRC C
+{
+  MAKE_RRC_N_OPCODE_IMPL(c)
+}
 
-    /* SBC A, n ------------------------------------------------------------------------------*/
-    // TODO: Check all of these
-    case 0x9F: { // SBC A, A
-      MAKE_SBC_A_N_OPCODE_IMPL(a)
-    }
-    case 0x98: { // SBC A, B
-      MAKE_SBC_A_N_OPCODE_IMPL(b)
-    }
-    case 0x99: { // SBC A, C
-      MAKE_SBC_A_N_OPCODE_IMPL(c)
-    }
-    case 0x9A: { // SBC A, D
-      MAKE_SBC_A_N_OPCODE_IMPL(d)
-    }
-    case 0x9B: { // SBC A, E
-      MAKE_SBC_A_N_OPCODE_IMPL(e)
-    }
-    case 0x9C: { // SBC A, H
-      MAKE_SBC_A_N_OPCODE_IMPL(h)
-    }
-    case 0x9D: { // SBC A, L
-      MAKE_SBC_A_N_OPCODE_IMPL(l)
-    }
-    case 0x9E: { // SBC A, (HL)
-      uint8_t oldA = cpu->registers.a;
-      uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      uint8_t c = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT);
-      int32_t newA = oldA - (operand + c);
-      cpu->registers.a = newA;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, ((operand & 0x0F) + c) > (oldA & 0x0F))
-      SET_FLAG_TO_RESULT(C, newA < 0)
-      cycles += 8;
-      break;
-    }
-    case 0xDE: { // SBC A, #
-      uint8_t oldA = cpu->registers.a;
-      uint8_t operand = readByte(m, cpu->registers.pc++);
-      uint8_t c = ((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT);
-      int32_t newA = oldA - (operand + c);
-      cpu->registers.a = newA;
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, ((operand & 0x0F) + c) > (oldA & 0x0F))
-      SET_FLAG_TO_RESULT(C, newA < 0)
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode0A) // RRC D
+{
+  MAKE_RRC_N_OPCODE_IMPL(d)
+}
 
-    /* AND n ---------------------------------------------------------------------------------*/
-    case 0xA7: { // AND A
-      MAKE_AND_N_OPCODE_IMPL(a)
-    }
-    case 0xA0: { // AND B
-      MAKE_AND_N_OPCODE_IMPL(b)
-    }
-    case 0xA1: { // AND C
-      MAKE_AND_N_OPCODE_IMPL(c)
-    }
-    case 0xA2: { // AND D
-      MAKE_AND_N_OPCODE_IMPL(d)
-    }
-    case 0xA3: { // AND E
-      MAKE_AND_N_OPCODE_IMPL(e)
-    }
-    case 0xA4: { // AND H
-      MAKE_AND_N_OPCODE_IMPL(h)
-    }
-    case 0xA5: { // AND L
-      MAKE_AND_N_OPCODE_IMPL(l)
-    }
-    case 0xA6: { // AND (HL)
-      cpu->registers.a &= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      setH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
-    case 0xE6: { // AND #
-      cpu->registers.a &= readByte(m, cpu->registers.pc++);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      setH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode0B) // RRC E
+{
+  MAKE_RRC_N_OPCODE_IMPL(e)
+}
 
-    /* OR n ----------------------------------------------------------------------------------*/
-    case 0xB7: { // OR A
-      MAKE_OR_N_OPCODE_IMPL(a)
-    }
-    case 0xB0: { // OR B
-      MAKE_OR_N_OPCODE_IMPL(b)
-    }
-    case 0xB1: { // OR C
-      MAKE_OR_N_OPCODE_IMPL(c)
-    }
-    case 0xB2: { // OR D
-      MAKE_OR_N_OPCODE_IMPL(d)
-    }
-    case 0xB3: { // OR E
-      MAKE_OR_N_OPCODE_IMPL(e)
-    }
-    case 0xB4: { // OR H
-      MAKE_OR_N_OPCODE_IMPL(h)
-    }
-    case 0xB5: { // OR L
-      MAKE_OR_N_OPCODE_IMPL(l)
-    }
-    case 0xB6: { // OR (HL)
-      cpu->registers.a |= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      resetH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
-    case 0xF6: { // OR #
-      cpu->registers.a |= readByte(m, cpu->registers.pc++);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      resetH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode0C) // RRC H
+{
+  MAKE_RRC_N_OPCODE_IMPL(h)
+}
 
-    /* XOR n ---------------------------------------------------------------------------------*/
-    case 0xAF: { // XOR A
-      MAKE_XOR_N_OPCODE_IMPL(a)
-    }
-    case 0xA8: { // XOR B
-      MAKE_XOR_N_OPCODE_IMPL(b)
-    }
-    case 0xA9: { // XOR C
-      MAKE_XOR_N_OPCODE_IMPL(c)
-    }
-    case 0xAA: { // XOR D
-      MAKE_XOR_N_OPCODE_IMPL(d)
-    }
-    case 0xAB: { // XOR E
-      MAKE_XOR_N_OPCODE_IMPL(e)
-    }
-    case 0xAC: { // XOR H
-      MAKE_XOR_N_OPCODE_IMPL(h)
-    }
-    case 0xAD: { // XOR L
-      MAKE_XOR_N_OPCODE_IMPL(l)
-    }
-    case 0xAE: { // XOR (HL)
-      cpu->registers.a ^= readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      resetH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
-    case 0xEE: { // XOR *
-      cpu->registers.a ^= readByte(m, cpu->registers.pc++);
-      SET_FLAG_TO_RESULT(Z, cpu->registers.a == 0)
-      resetN(cpu);
-      resetH(cpu);
-      resetC(cpu);
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode0D) // RRC L
+{
+  MAKE_RRC_N_OPCODE_IMPL(l)
+}
 
-    /* CP n ----------------------------------------------------------------------------------*/
-    case 0xBF: { // CP A
-      MAKE_CP_N_OPCODE_IMPL(a)
-    }
-    case 0xB8: { // CP B
-      MAKE_CP_N_OPCODE_IMPL(b)
-    }
-    case 0xB9: { // CP C
-      MAKE_CP_N_OPCODE_IMPL(c)
-    }
-    case 0xBA: { // CP D
-      MAKE_CP_N_OPCODE_IMPL(d)
-    }
-    case 0xBB: { // CP E
-      MAKE_CP_N_OPCODE_IMPL(e)
-    }
-    case 0xBC: { // CP H
-      MAKE_CP_N_OPCODE_IMPL(h)
-    }
-    case 0xBD: { // CP L
-      MAKE_CP_N_OPCODE_IMPL(l)
-    }
-    case 0xBE: { // CP (HL)
-      uint8_t operand = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      int16_t result = cpu->registers.a - operand;
-      SET_FLAG_TO_RESULT(Z, result == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, (operand & 0x0F) > (cpu->registers.a & 0x0F))
-      SET_FLAG_TO_RESULT(C, result < 0)
-      cycles += 8;
-      break;
-    }
-    case 0xFE: { // CP #
-      uint8_t operand = readByte(m, cpu->registers.pc++);
-      int16_t result = cpu->registers.a - operand;
-      SET_FLAG_TO_RESULT(Z, result == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, (operand & 0x0F) > (cpu->registers.a & 0x0F))
-      SET_FLAG_TO_RESULT(C, result < 0)
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode0E) // RRC (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
+  value = ((value & BIT_0) << BIT_7_SHIFT) | (value >> 1);
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-    /* INC n ---------------------------------------------------------------------------------*/
-    case 0x3C: { // INC A
-      MAKE_INC_N_OPCODE_IMPL(a)
-    }
-    case 0x04: { // INC B
-      MAKE_INC_N_OPCODE_IMPL(b)
-    }
-    case 0x0C: { // INC C
-      MAKE_INC_N_OPCODE_IMPL(c)
-    }
-    case 0x14: { // INC D
-      MAKE_INC_N_OPCODE_IMPL(d)
-    }
-    case 0x1C: { // INC E
-      MAKE_INC_N_OPCODE_IMPL(e)
-    }
-    case 0x24: { // INC H
-      MAKE_INC_N_OPCODE_IMPL(h)
-    }
-    case 0x2C: { // INC L
-      MAKE_INC_N_OPCODE_IMPL(l)
-    }
-    case 0x34: { // INC (HL)
-      uint8_t old = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      uint16_t new = old + 1;
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, (uint8_t)new);
-      SET_FLAG_TO_RESULT(Z, (uint8_t)new == 0)
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xF) + (1 & 0xF)) > 0xF)
-      cycles += 12;
-      break;
-    }
 
-    /* DEC n ---------------------------------------------------------------------------------*/
-    case 0x3D: { // DEC A
-      MAKE_DEC_N_OPCODE_IMPL(a)
-    }
-    case 0x05: { // DEC B
-      MAKE_DEC_N_OPCODE_IMPL(b)
-    }
-    case 0x0D: { // DEC C
-      MAKE_DEC_N_OPCODE_IMPL(c)
-    }
-    case 0x15: { // DEC D
-      MAKE_DEC_N_OPCODE_IMPL(d)
-    }
-    case 0x1D: { // DEC E
-      MAKE_DEC_N_OPCODE_IMPL(e)
-    }
-    case 0x25: { // DEC H
-      MAKE_DEC_N_OPCODE_IMPL(h)
-    }
-    case 0x2D: { // DEC L
-      MAKE_DEC_N_OPCODE_IMPL(l)
-    }
-    case 0x35: { // DEC (HL)
-      uint8_t oldValue = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-      int16_t newValue = oldValue - 1;
-      writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, (uint8_t)newValue);
-      SET_FLAG_TO_RESULT(Z, (uint8_t)newValue == 0)
-      setN(cpu);
-      SET_FLAG_TO_RESULT(H, 1 > (oldValue & 0x0F))
-      cycles += 12;
-      break;
-    }
+/* RR n ------------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode1F) // RR A
+{
+  MAKE_RR_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(cbOpcode18) // RR B
+{
+  MAKE_RR_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(cbOpcode19) // RR C
+{
+  MAKE_RR_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(cbOpcode1A) // RR D
+{
+  MAKE_RR_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(cbOpcode1B) // RR E
+{
+  MAKE_RR_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(cbOpcode1C) // RR H
+{
+  MAKE_RR_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(cbOpcode1D) // RR L
+{
+  MAKE_RR_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(cbOpcode1E) // RR (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  uint8_t oldCarryBit = getC(cpu);
+  SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
+  value = (oldCarryBit << BIT_7_SHIFT) | (value >> 1);
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
+
+
+/* SLA n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode27) // SLA A
+{
+  MAKE_SLA_N_OPCODE_IMPL(a)
+}
+
+OPCODE_HANDLER(cbOpcode20) // SLA B
+{
+  MAKE_SLA_N_OPCODE_IMPL(b)
+}
+
+OPCODE_HANDLER(cbOpcode21) // SLA C
+{
+  MAKE_SLA_N_OPCODE_IMPL(c)
+}
+
+OPCODE_HANDLER(cbOpcode22) // SLA D
+{
+  MAKE_SLA_N_OPCODE_IMPL(d)
+}
+
+OPCODE_HANDLER(cbOpcode23) // SLA E
+{
+  MAKE_SLA_N_OPCODE_IMPL(e)
+}
+
+OPCODE_HANDLER(cbOpcode24) // SLA H
+{
+  MAKE_SLA_N_OPCODE_IMPL(h)
+}
+
+OPCODE_HANDLER(cbOpcode25) // SLA L
+{
+  MAKE_SLA_N_OPCODE_IMPL(l)
+}
+
+OPCODE_HANDLER(cbOpcode26) // SLA (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_FLAG_TO_RESULT(C, value & BIT_7) // NOTE: Set the C bit of F BEFORE we modify the value
+  value <<= 1;
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-    /* 16-Bit Arithmetic **********************************************************************/
-    /* ADD HL, n -----------------------------------------------------------------------------*/
-    case 0x09: { // ADD HL, BC
-      MAKE_ADD_HL_N_OPCODE_IMPL(b, c)
-    }
-    case 0x19: { // ADD HL, DE
-      MAKE_ADD_HL_N_OPCODE_IMPL(d, e)
-    }
-    case 0x29: { // ADD HL, HL
-      MAKE_ADD_HL_N_OPCODE_IMPL(h, l)
-    }
-    case 0x39: { // ADD HL, SP
-      uint16_t old = (cpu->registers.h << 8) | cpu->registers.l;
-      uint16_t value = cpu->registers.sp;
-      uint16_t result = old + value;
-      cpu->registers.h = (result & 0xFF00) >> 8;
-      cpu->registers.l = (result & 0x00FF);
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((old & 0xFFF) + (value & 0xFFF)) > 0xFFF)
-      SET_FLAG_TO_RESULT(C, ((old & 0xFFFF) + (value & 0xFFFF)) > 0xFFFF)
-      cycles += 8;
-      break;
-    }
 
-    /* ADD SP, n -----------------------------------------------------------------------------*/
-    case 0xE8: { // ADD SP, n
-      uint8_t unsignedValue = readByte(m, cpu->registers.pc++);
-      int8_t signedValue = (int8_t)unsignedValue;
-      uint16_t oldSP = cpu->registers.sp;
-      int32_t newSP = oldSP + signedValue;
-      cpu->registers.sp = newSP;
-      resetZ(cpu);
-      resetN(cpu);
-      SET_FLAG_TO_RESULT(H, ((oldSP & 0x0F) + (unsignedValue & 0x0F)) > 0x0F)
-      SET_FLAG_TO_RESULT(C, ((oldSP & 0xFF) + (unsignedValue & 0xFF)) > 0xFF)
-      cycles += 16;
-      break;
-    }
+/* SRA n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode2F) // SRA A
+{
+  MAKE_SRA_N_OPCODE_IMPL(a)
+}
 
-    /* INC nn --------------------------------------------------------------------------------*/
-    case 0x03: { // INC BC
-      MAKE_INC_NN_OPCODE_IMPL(b, c)
-    }
-    case 0x13: { // INC DE
-      MAKE_INC_NN_OPCODE_IMPL(d, e)
-    }
-    case 0x23: { // INC HL
-      MAKE_INC_NN_OPCODE_IMPL(h, l)
-    }
-    case 0x33: { // INC SP
-      cpu->registers.sp++;
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode28) // SRA B
+{
+  MAKE_SRA_N_OPCODE_IMPL(b)
+}
 
-    /* DEC nn --------------------------------------------------------------------------------*/
-    case 0x0B: { // DEC BC
-      MAKE_DEC_NN_OPCODE_IMPL(b, c)
-    }
-    case 0x1B: { // DEC DE
-      MAKE_DEC_NN_OPCODE_IMPL(d, e)
-    }
-    case 0x2B: { // DEC HL
-      MAKE_DEC_NN_OPCODE_IMPL(h, l)
-    }
-    case 0x3B: { // DEC SP
-      cpu->registers.sp--;
-      cycles += 8;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode29) // SRA C
+{
+  MAKE_SRA_N_OPCODE_IMPL(c)
+}
 
-    /* Miscellaneous **************************************************************************/
-    /* DAA -----------------------------------------------------------------------------------*/
-    case 0x27: { // DAA
-      uint8_t n = (cpu->registers.f & FLAG_REGISTER_N_BIT) >> FLAG_REGISTER_N_BIT_SHIFT;
-      uint8_t h = (cpu->registers.f & FLAG_REGISTER_H_BIT) >> FLAG_REGISTER_H_BIT_SHIFT;
-      uint8_t c = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT;
-      uint16_t a = cpu->registers.a;
-
-      if (!n) {
-        if (h || (a & 0x0F) > 9) {
-          a += 0x06;
-        }
-        if (c || (a > 0x9F)) {
-          a += 0x60;
-        }
-      } else {
-        if (h) {
-          a = (a - 6) & 0xFF;
-        }
-        if (c) {
-          a -= 0x60;
-        }
-      }
+OPCODE_HANDLER(cbOpcode2A) // SRA D
+{
+  MAKE_SRA_N_OPCODE_IMPL(d)
+}
 
-      resetZ(cpu);
-      resetH(cpu);
+OPCODE_HANDLER(cbOpcode2B) // SRA E
+{
+  MAKE_SRA_N_OPCODE_IMPL(e)
+}
 
-      if (a > 0xFF) {
-        setC(cpu);
-      }
+OPCODE_HANDLER(cbOpcode2C) // SRA H
+{
+  MAKE_SRA_N_OPCODE_IMPL(h)
+}
 
-      cpu->registers.a = a;
+OPCODE_HANDLER(cbOpcode2D) // SRA L
+{
+  MAKE_SRA_N_OPCODE_IMPL(l)
+}
 
-      if (cpu->registers.a == 0) {
-        setZ(cpu);
-      }
+OPCODE_HANDLER(cbOpcode2E) // SRA (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
+  value = (value & BIT_7) | (value >> 1);
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-      cycles += 4;
-      break;
-    }
 
-    /* CPL -----------------------------------------------------------------------------------*/
-    case 0x2F: { // CPL
-      cpu->registers.a = ~cpu->registers.a;
-      setN(cpu);
-      setH(cpu);
-      cycles += 4;
-      break;
-    }
+/* SRL n -----------------------------------------------------------------------------*/
+OPCODE_HANDLER(cbOpcode3F) // SRL A
+{
+  MAKE_SRL_N_OPCODE_IMPL(a)
+}
 
-    /* CCF -----------------------------------------------------------------------------------*/
-    case 0x3F: { // CCF
-      cpu->registers.f ^= (1 << FLAG_REGISTER_C_BIT_SHIFT);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode38) // SRL B
+{
+  MAKE_SRL_N_OPCODE_IMPL(b)
+}
 
-    /* SCF -----------------------------------------------------------------------------------*/
-    case 0x37: { // SCF
-      setC(cpu);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode39) // SRL C
+{
+  MAKE_SRL_N_OPCODE_IMPL(c)
+}
 
-    /* NOP -----------------------------------------------------------------------------------*/
-    case 0x00: { // NOP
-      cycles += 4;
-      break;
-    }
-    /* HALT ----------------------------------------------------------------------------------*/
-    case 0x76: { // HALT
-      cpu->halt = true;
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode3A) // SRL D
+{
+  MAKE_SRL_N_OPCODE_IMPL(d)
+}
 
-    /* STOP ----------------------------------------------------------------------------------*/
-    case 0x10: { // STOP
-      // NOTE: Some Game Boy CPU manuals document the opcode for this instruction as 10 00 but there
-      // seems to be no reason for this to not be a single byte opcode so some assemblers simply code
-      // it as 10. There is also no indication in the number of required clock cycles of a a read of an additional byte.
-      if ((m->cgbMode == COLOUR) && (m->speedController->key1 & 1)) {
-        if ((m->speedController->key1 & (1 << 7))) {
-          m->speedController->key1 = 0;
-          info("Entering NORMAL speed mode\n");
-        } else {
-          m->speedController->key1 = (1 << 7);
-          info("Entering DOUBLE speed mode\n");
-        }
-        m->interruptController->e = 0;
-        lcdSpeedChange(m->lcdController);
-      } else {
-        cpu->stop = true;
-      }
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode3B) // SRL E
+{
+  MAKE_SRL_N_OPCODE_IMPL(e)
+}
 
-    /* DI ------------------------------------------------------------------------------------*/
-    case 0xF3: { // DI
-      cpu->di = 1;
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode3C) // SRL H
+{
+  MAKE_SRL_N_OPCODE_IMPL(h)
+}
 
-    /* EI ------------------------------------------------------------------------------------*/
-    case 0xFB: { // EI
-      cpu->ei = 1;
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode3D) // SRL L
+{
+  MAKE_SRL_N_OPCODE_IMPL(l)
+}
 
-    /* Rotates and Shifts *********************************************************************/
-    /* RLCA ----------------------------------------------------------------------------------*/
-    case 0x07: { // RLCA
-      SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_7) // NOTE: Set the C bit of F before we modify A
-      cpu->registers.a = (cpu->registers.a << 1) | ((cpu->registers.a & BIT_7) >> BIT_7_SHIFT);
-      resetZ(cpu);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
+OPCODE_HANDLER(cbOpcode3E) // SRL (HL)
+{
+  uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
+  SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
+  value = value >> 1;
+  writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
+  SET_Z_FROM_RESULT(value)
+  resetN(cpu);
+  resetH(cpu);
+  return 16;
+}
 
-    /* RLA -----------------------------------------------------------------------------------*/
-    case 0x17: { // RLA
-      uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT;
-      SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_7) // NOTE: Set the C bit of F before we modify A
-      cpu->registers.a = (cpu->registers.a << 1) | oldCarryBit;
-      resetZ(cpu);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
 
-    /* RRCA ----------------------------------------------------------------------------------*/
-    case 0x0F: { // RRCA
-      SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_0) // NOTE: Set the C bit of F before we modify A
-      cpu->registers.a = ((cpu->registers.a & BIT_0) << BIT_7_SHIFT) | (cpu->registers.a >> 1);
-      resetZ(cpu);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
+/* Bit Opcodes ************************************************************************/
+/* BIT b, r --------------------------------------------------------------------------*/
+MAKE_BIT_B_R_OPCODE_GROUP(0, 40, 41, 42, 43, 44, 45, 46, 47)
+MAKE_BIT_B_R_OPCODE_GROUP(1, 48, 49, 4A, 4B, 4C, 4D, 4E, 4F)
+MAKE_BIT_B_R_OPCODE_GROUP(2, 50, 51, 52, 53, 54, 55, 56, 57)
+MAKE_BIT_B_R_OPCODE_GROUP(3, 58, 59, 5A, 5B, 5C, 5D, 5E, 5F)
+MAKE_BIT_B_R_OPCODE_GROUP(4, 60, 61, 62, 63, 64, 65, 66, 67)
+MAKE_BIT_B_R_OPCODE_GROUP(5, 68, 69, 6A, 6B, 6C, 6D, 6E, 6F)
+MAKE_BIT_B_R_OPCODE_GROUP(6, 70, 71, 72, 73, 74, 75, 76, 77)
+MAKE_BIT_B_R_OPCODE_GROUP(7, 78, 79, 7A, 7B, 7C, 7D, 7E, 7F)
+
+/* SET b, r --------------------------------------------------------------------------*/
+MAKE_SET_B_R_OPCODE_GROUP(0, C0, C1, C2, C3, C4, C5, C6, C7)
+MAKE_SET_B_R_OPCODE_GROUP(1, C8, C9, CA, CB, CC, CD, CE, CF)
+MAKE_SET_B_R_OPCODE_GROUP(2, D0, D1, D2, D3, D4, D5, D6, D7)
+MAKE_SET_B_R_OPCODE_GROUP(3, D8, D9, DA, DB, DC, DD, DE, DF)
+MAKE_SET_B_R_OPCODE_GROUP(4, E0, E1, E2, E3, E4, E5, E6, E7)
+MAKE_SET_B_R_OPCODE_GROUP(5, E8, E9, EA, EB, EC, ED, EE, EF)
+MAKE_SET_B_R_OPCODE_GROUP(6, F0, F1, F2, F3, F4, F5, F6, F7)
+MAKE_SET_B_R_OPCODE_GROUP(7, F8, F9, FA, FB, FC, FD, FE, FF)
+
+/* RES b, r --------------------------------------------------------------------------*/
+MAKE_RES_B_R_OPCODE_GROUP(0, 80, 81, 82, 83, 84, 85, 86, 87)
+MAKE_RES_B_R_OPCODE_GROUP(1, 88, 89, 8A, 8B, 8C, 8D, 8E, 8F)
+MAKE_RES_B_R_OPCODE_GROUP(2, 90, 91, 92, 93, 94, 95, 96, 97)
+MAKE_RES_B_R_OPCODE_GROUP(3, 98, 99, 9A, 9B, 9C, 9D, 9E, 9F)
+MAKE_RES_B_R_OPCODE_GROUP(4, A0, A1, A2, A3, A4, A5, A6, A7)
+MAKE_RES_B_R_OPCODE_GROUP(5, A8, A9, AA, AB, AC, AD, AE, AF)
+MAKE_RES_B_R_OPCODE_GROUP(6, B0, B1, B2, B3, B4, B5, B6, B7)
+MAKE_RES_B_R_OPCODE_GROUP(7, B8, B9, BA, BB, BC, BD, BE, BF)
+
+
+OPCODE_HANDLER(opcodeCB)
+{
+  uint8_t opcode2 = readByte(m, cpu->registers.pc++);
+  // debug("\b[0x%04X][0x%02X] %s\n", cpu->registers.pc - 1, opcode2, CB_OPCODE_MNEMONICS[opcode]);
 
-    /* RRA -----------------------------------------------------------------------------------*/
-    case 0x1F: { // RRA
-      uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT;
-      SET_FLAG_TO_RESULT(C, cpu->registers.a & BIT_0) // NOTE: Set the C bit of F before we modify A
-      cpu->registers.a = (oldCarryBit << BIT_7_SHIFT) | (cpu->registers.a >> 1);
-      resetZ(cpu);
-      resetN(cpu);
-      resetH(cpu);
-      cycles += 4;
-      break;
-    }
+  DISPATCH(cbOpcode, opcode2)
+}
 
-    /* Jumps **********************************************************************************/
-    /* JP nn ---------------------------------------------------------------------------------*/
-    case 0xC3: { // JP nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      cpu->registers.pc = address;
-      cycles += 16;
-      break;
-    }
 
-    /* JP cc, nn -----------------------------------------------------------------------------*/
-    case 0xC2: { // JP NZ, nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      if (((cpu->registers.f & FLAG_REGISTER_Z_BIT) >> FLAG_REGISTER_Z_BIT_SHIFT) == 0) {
-        cpu->registers.pc = address;
-        cycles += 4;
-      }
-      cycles += 12;
-      break;
-    }
-    case 0xCA: { // JP Z, nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      if (((cpu->registers.f & FLAG_REGISTER_Z_BIT) >> FLAG_REGISTER_Z_BIT_SHIFT) == 1) {
-        cpu->registers.pc = address;
-        cycles += 4;
-      }
-      cycles += 12;
-      break;
-    }
-    case 0xD2: { // JP NC, nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      if (((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT) == 0) {
-        cpu->registers.pc = address;
-        cycles += 4;
-      }
-      cycles += 12;
-      break;
-    }
-    case 0xDA: { // JP C, nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      if (((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT) == 1) {
-        cpu->registers.pc = address;
-        cycles += 4;
-      }
-      cycles += 12;
-      break;
-    }
+const char* cpuDispatchName()
+{
+#if defined(CPU_DISPATCH_TABLE)
+  return "table";
+#elif defined(CPU_DISPATCH_COMPUTED_GOTO)
+  return "computed goto";
+#else
+  return "switch";
+#endif
+}
 
-    /* JP (HL) -------------------------------------------------------------------------------*/
-    case 0xE9: { // JP (HL)
-      cpu->registers.pc = (cpu->registers.h << 8) | cpu->registers.l;
-      cycles += 4;
-      break;
-    }
 
-    /* JR n ----------------------------------------------------------------------------------*/
-    case 0x18: { // JR n
-      int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
-      cpu->registers.pc += value;
-      cycles += 12;
-      break;
-    }
+static bool registersEqual(CPURegisters* a, CPURegisters* b)
+{
+  return (a->a == b->a) && (a->b == b->b) && (a->c == b->c) && (a->d == b->d) && (a->e == b->e) &&
+    (a->h == b->h) && (a->l == b->l) && (a->sp == b->sp) && (a->pc == b->pc);
+}
 
-    /* JR cc, n-------------------------------------------------------------------------------*/
-    case 0x20: { // JR NZ, n
-      int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
-      if (((cpu->registers.f & FLAG_REGISTER_Z_BIT) >> FLAG_REGISTER_Z_BIT_SHIFT) == 0) {
-        cpu->registers.pc += value;
-        cycles += 4;
-      }
-      cycles += 8;
-      break;
-    }
-    case 0x28: { // JR Z, n
-      int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
-      if (((cpu->registers.f & FLAG_REGISTER_Z_BIT) >> FLAG_REGISTER_Z_BIT_SHIFT) == 1) {
-        cpu->registers.pc += value;
-        cycles += 4;
-      }
-      cycles += 8;
-      break;
-    }
-    case 0x30: { // JR NC, n
-      int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
-      if (((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT) == 0) {
-        cpu->registers.pc += value;
-        cycles += 4;
-      }
-      cycles += 8;
-      break;
-    }
-    case 0x38: { // JR C, n
-      int8_t value = (int8_t)readByte(m, cpu->registers.pc++);
-      if (((cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT) == 1) {
-        cpu->registers.pc += value;
-        cycles += 4;
-      }
-      cycles += 8;
-      break;
-    }
 
-    /* Calls **********************************************************************************/
-    /* CALL nn -------------------------------------------------------------------------------*/
-    case 0xCD: { // CALL nn
-      uint16_t address = readWord(m, cpu->registers.pc);
-      cpu->registers.pc += 2;
-      writeByte(m, --cpu->registers.sp, ((cpu->registers.pc & 0xFF00) >> 8));
-      writeByte(m, --cpu->registers.sp, (cpu->registers.pc & 0x00FF));
-      cpu->registers.pc = address;
-      cycles += 24;
-      break;
-    }
+static void breakIdleLoop(CPU* cpu)
+{
+  cpu->idleLoop.isIdle = false;
+  cpu->idleLoop.numInstructions = CPU_IDLE_LOOP_MAX_INSTRUCTIONS + 1;
+}
 
-    /* CALL cc, nn ---------------------------------------------------------------------------*/
-    case 0xC4: { // CALL NZ, nn
-      MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG_REGISTER_Z_BIT, FLAG_REGISTER_Z_BIT_SHIFT, 0)
-    }
-    case 0xCC: { // CALL Z, nn
-      MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG_REGISTER_Z_BIT, FLAG_REGISTER_Z_BIT_SHIFT, 1)
-    }
-    case 0xD4: { // CALL NC, nn
-      MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG_REGISTER_C_BIT, FLAG_REGISTER_C_BIT_SHIFT, 0)
-    }
-    case 0xDC: { // CALL C, nn
-      MAKE_CALL_CC_NN_OPCODE_IMPL(FLAG_REGISTER_C_BIT, FLAG_REGISTER_C_BIT_SHIFT, 1)
-    }
 
-    /* Restarts *******************************************************************************/
-    /* RST n ---------------------------------------------------------------------------------*/
-    case 0xC7: { // RST 00
-      MAKE_RST_N_OPCODE_IMPL(0x0000)
-    }
-    case 0xCF: { // RST 08
-      MAKE_RST_N_OPCODE_IMPL(0x0008)
-    }
-    case 0xD7: { // RST 10
-      MAKE_RST_N_OPCODE_IMPL(0x0010)
-    }
-    case 0xDF: { // RST 18
-      MAKE_RST_N_OPCODE_IMPL(0x0018)
-    }
-    case 0xE7: { // RST 20
-      MAKE_RST_N_OPCODE_IMPL(0x0020)
-    }
-    case 0xEF: { // RST 28
-      MAKE_RST_N_OPCODE_IMPL(0x0028)
-    }
-    case 0xF7: { // RST 30
-      MAKE_RST_N_OPCODE_IMPL(0x0030)
-    }
-    case 0xFF: { // RST 38
-      MAKE_RST_N_OPCODE_IMPL(0x0038)
-    }
+static void updateIdleLoop(CPU* cpu, uint16_t opcodeAddress, uint8_t cycles)
+{
+  CPUIdleLoop* loop = &cpu->idleLoop;
+  MemoryController* m = cpu->memoryController;
 
-    /* Returns ********************************************************************************/
-    /* RET -----------------------------------------------------------------------------------*/
-    case 0xC9: { // RET
-      uint8_t addressLow = readByte(m, cpu->registers.sp++);
-      uint8_t addressHigh = readByte(m, cpu->registers.sp++);
-      cpu->registers.pc = (addressHigh << 8) | addressLow;
-      cycles += 16;
-      break;
-    }
+  loop->isIdle = false;
+  loop->cycles += cycles;
+  if (loop->numInstructions < CPU_IDLE_LOOP_MAX_INSTRUCTIONS) {
+    loop->instructionCycles[loop->numInstructions++] = cycles;
+  } else {
+    loop->numInstructions = CPU_IDLE_LOOP_MAX_INSTRUCTIONS + 1;
+  }
 
-    /* RET cc --------------------------------------------------------------------------------*/
-    case 0xC0: { // RET NZ
-      MAKE_RET_CC_OPCODE_IMPL(FLAG_REGISTER_Z_BIT, FLAG_REGISTER_Z_BIT_SHIFT, 0)
-    }
-    case 0xC8: { // RET Z
-      MAKE_RET_CC_OPCODE_IMPL(FLAG_REGISTER_Z_BIT, FLAG_REGISTER_Z_BIT_SHIFT, 1)
-    }
-    case 0xD0: { // RET NC
-      MAKE_RET_CC_OPCODE_IMPL(FLAG_REGISTER_C_BIT, FLAG_REGISTER_C_BIT_SHIFT, 0)
-    }
-    case 0xD8: { // RET C
-      MAKE_RET_CC_OPCODE_IMPL(FLAG_REGISTER_C_BIT, FLAG_REGISTER_C_BIT_SHIFT, 1)
-    }
+  // Only a short branch backwards can end an iteration
+  uint16_t pc = cpu->registers.pc;
+  if (pc >= opcodeAddress || (opcodeAddress - pc) > CPU_IDLE_LOOP_MAX_BYTES) {
+    return;
+  }
 
-    /* RETI ----------------------------------------------------------------------------------*/
-    case 0xD9: { // RETI
-      // TODO: Check how IME is set - is there a single instruction delay before interrupts are enabled as with DI and EI?
-      // Potentially not because this replicates the combination of the combination of "EI, RET" instructions,
-      // in which EI would cause interrupts to be enabled AFTER the RET had executed, so the effect
-      // of the single instruction delay would/should be replicated here.
-      uint8_t addressLow = readByte(m, cpu->registers.sp++);
-      uint8_t addressHigh = readByte(m, cpu->registers.sp++);
-      cpu->registers.pc = (addressHigh << 8) | addressLow;
-      cpu->ime = true;
-      cycles += 16;
-      break;
-    }
+  uint8_t f = cpuGetFlagRegister(cpu);
+
+  loop->isIdle = (pc == loop->start) &&
+    (opcodeAddress == loop->end) &&
+    (loop->numInstructions <= CPU_IDLE_LOOP_MAX_INSTRUCTIONS) &&
+    registersEqual(&cpu->registers, &loop->registers) &&
+    (f == loop->f) &&
+    (cpu->ime == loop->ime) &&
+    (cpu->ei == 0) &&
+    (cpu->di == 0) &&
+    (m->writeCount == loop->writeCount);
+  loop->readTimer = (m->timerReadCount != loop->timerReadCount);
+  loop->iterationCycles = loop->cycles;
+  loop->iterationInstructions = loop->numInstructions;
+
+  // Start watching the next iteration
+  loop->start = pc;
+  loop->end = opcodeAddress;
+  loop->registers = cpu->registers;
+  loop->f = f;
+  loop->ime = cpu->ime;
+  loop->writeCount = m->writeCount;
+  loop->timerReadCount = m->timerReadCount;
+  loop->cycles = 0;
+  loop->numInstructions = 0;
+}
 
-    /* CB-Prefixed Opcodes ********************************************************************/
-    case 0xCB: {
-      uint8_t opcode2 = readByte(m, cpu->registers.pc++);
-      // debug("\b[0x%04X][0x%02X] %s\n", cpu->registers.pc - 1, opcode2, CB_OPCODE_MNEMONICS[opcode]);
 
-      switch (opcode2) {
-        /* Miscellaneous **********************************************************************/
-        /* SWAP n ----------------------------------------------------------------------------*/
-        case 0x37: { // SWAP A
-          MAKE_SWAP_N_OPCODE_IMPL(a)
-        }
-        case 0x30: { // SWAP B
-          MAKE_SWAP_N_OPCODE_IMPL(b)
-        }
-        case 0x31: { // SWAP C
-          MAKE_SWAP_N_OPCODE_IMPL(c)
-        }
-        case 0x32: { // SWAP D
-          MAKE_SWAP_N_OPCODE_IMPL(d)
-        }
-        case 0x33: { // SWAP E
-          MAKE_SWAP_N_OPCODE_IMPL(e)
-        }
-        case 0x34: { // SWAP H
-          MAKE_SWAP_N_OPCODE_IMPL(h)
-        }
-        case 0x35: { // SWAP L
-          MAKE_SWAP_N_OPCODE_IMPL(l)
-        }
-        case 0x36: { // SWAP (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          value = ((value & 0xF0) >> 4) | ((value & 0x0F) << 4);
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          resetC(cpu);
-          cycles += 16;
-          break;
-        }
+bool cpuIsInIdleLoop(CPU* cpu)
+{
+  // An interrupt may have been handled since the end of the iteration
+  return cpu->idleLoop.isIdle && (cpu->registers.pc == cpu->idleLoop.start) && !cpu->halt && !cpu->_pcFrozen && (cpu->ei == 0) && (cpu->di == 0);
+}
 
-        /* Rotates and Shifts *****************************************************************/
-        /* RLC n -----------------------------------------------------------------------------*/
-        case 0x07: { // RLC A
-          MAKE_RLC_N_OPCODE_IMPL(a)
-        }
-        case 0x00: { // RLC B
-          MAKE_RLC_N_OPCODE_IMPL(b)
-        }
-        case 0x01: { // RLC C
-          MAKE_RLC_N_OPCODE_IMPL(c)
-        }
-        case 0x02: { // RLC D
-          MAKE_RLC_N_OPCODE_IMPL(d)
-        }
-        case 0x03: { // RLC E
-          MAKE_RLC_N_OPCODE_IMPL(e)
-        }
-        case 0x04: { // RLC H
-          MAKE_RLC_N_OPCODE_IMPL(h)
-        }
-        case 0x05: { // RLC L
-          MAKE_RLC_N_OPCODE_IMPL(l)
-        }
-        case 0x06: { // RLC (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          SET_FLAG_TO_RESULT(C, value & BIT_7); // NOTE: Set the C bit of F BEFORE we modify the value
-          value = (value << 1) | ((value & BIT_7) >> BIT_7_SHIFT);
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
 
-        /* RL n ------------------------------------------------------------------------------*/
-        case 0x17: { // RL A
-          MAKE_RL_N_OPCODE_IMPL(a)
-        }
-        case 0x10: { // RL B
-          MAKE_RL_N_OPCODE_IMPL(b)
-        }
-        case 0x11: { // RL C
-          MAKE_RL_N_OPCODE_IMPL(c)
-        }
-        case 0x12: { // RL D
-          MAKE_RL_N_OPCODE_IMPL(d)
-        }
-        case 0x13: { // RL E
-          MAKE_RL_N_OPCODE_IMPL(e)
-        }
-        case 0x14: { // RL H
-          MAKE_RL_N_OPCODE_IMPL(h)
-        }
-        case 0x15: { // RL L
-          MAKE_RL_N_OPCODE_IMPL(l)
-        }
-        case 0x16: { // RL (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT;
-          SET_FLAG_TO_RESULT(C, value & BIT_7) // NOTE: Set the C bit of F BEFORE we modify the value
-          value = (value << 1) | oldCarryBit;
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
+static uint8_t executeOpcode(CPU* cpu, MemoryController* m, uint8_t opcode)
+{
+  DISPATCH(opcode, opcode)
+}
 
-        /* RRC n -----------------------------------------------------------------------------*/
-        case 0x0F: { // RRC A
-          MAKE_RRC_N_OPCODE_IMPL(a)
-        }
-        case 0x08: { // RRC B
-          MAKE_RRC_N_OPCODE_IMPL(b)
-        }
-        case 0x09: { // RRC C
-          MAKE_RRC_N_OPCODE_IMPL(c)
-        }
-        case 0x0A: { // RRC D
-          MAKE_RRC_N_OPCODE_IMPL(d)
-        }
-        case 0x0B: { // RRC E
-          MAKE_RRC_N_OPCODE_IMPL(e)
-        }
-        case 0x0C: { // RRC H
-          MAKE_RRC_N_OPCODE_IMPL(h)
-        }
-        case 0x0D: { // RRC L
-          MAKE_RRC_N_OPCODE_IMPL(l)
-        }
-        case 0x0E: { // RRC (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
-          value = ((value & BIT_0) << BIT_7_SHIFT) | (value >> 1);
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
 
-        /* RR n ------------------------------------------------------------------------------*/
-        case 0x1F: { // RR A
-          MAKE_RR_N_OPCODE_IMPL(a)
-        }
-        case 0x18: { // RR B
-          MAKE_RR_N_OPCODE_IMPL(b)
-        }
-        case 0x19: { // RR C
-          MAKE_RR_N_OPCODE_IMPL(c)
-        }
-        case 0x1A: { // RR D
-          MAKE_RR_N_OPCODE_IMPL(d)
-        }
-        case 0x1B: { // RR E
-          MAKE_RR_N_OPCODE_IMPL(e)
-        }
-        case 0x1C: { // RR H
-          MAKE_RR_N_OPCODE_IMPL(h)
-        }
-        case 0x1D: { // RR L
-          MAKE_RR_N_OPCODE_IMPL(l)
-        }
-        case 0x1E: { // RR (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          uint8_t oldCarryBit = (cpu->registers.f & FLAG_REGISTER_C_BIT) >> FLAG_REGISTER_C_BIT_SHIFT;
-          SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
-          value = (oldCarryBit << BIT_7_SHIFT) | (value >> 1);
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
+uint8_t cpuRunSingleOp(CPU* cpu)
+{
+  MemoryController* m = cpu->memoryController;
 
-        /* SLA n -----------------------------------------------------------------------------*/
-        case 0x27: { // SLA A
-          MAKE_SLA_N_OPCODE_IMPL(a)
-        }
-        case 0x20: { // SLA B
-          MAKE_SLA_N_OPCODE_IMPL(b)
-        }
-        case 0x21: { // SLA C
-          MAKE_SLA_N_OPCODE_IMPL(c)
-        }
-        case 0x22: { // SLA D
-          MAKE_SLA_N_OPCODE_IMPL(d)
-        }
-        case 0x23: { // SLA E
-          MAKE_SLA_N_OPCODE_IMPL(e)
-        }
-        case 0x24: { // SLA H
-          MAKE_SLA_N_OPCODE_IMPL(h)
-        }
-        case 0x25: { // SLA L
-          MAKE_SLA_N_OPCODE_IMPL(l)
-        }
-        case 0x26: { // SLA (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          SET_FLAG_TO_RESULT(C, value & BIT_7) // NOTE: Set the C bit of F BEFORE we modify the value
-          value <<= 1;
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
+  if (cpu->halt) {
+    breakIdleLoop(cpu);
+    return CPU_HALT_CYCLES;
+  }
 
-        /* SRA n -----------------------------------------------------------------------------*/
-        case 0x2F: { // SRA A
-          MAKE_SRA_N_OPCODE_IMPL(a)
-        }
-        case 0x28: { // SRA B
-          MAKE_SRA_N_OPCODE_IMPL(b)
-        }
-        case 0x29: { // SRA C
-          MAKE_SRA_N_OPCODE_IMPL(c)
-        }
-        case 0x2A: { // SRA D
-          MAKE_SRA_N_OPCODE_IMPL(d)
-        }
-        case 0x2B: { // SRA E
-          MAKE_SRA_N_OPCODE_IMPL(e)
-        }
-        case 0x2C: { // SRA H
-          MAKE_SRA_N_OPCODE_IMPL(h)
-        }
-        case 0x2D: { // SRA L
-          MAKE_SRA_N_OPCODE_IMPL(l)
-        }
-        case 0x2E: { // SRA (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
-          value = (value & BIT_7) | (value >> 1);
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
+  if (generalPurposeDMAIsActive(m)) {
+    breakIdleLoop(cpu);
+    return 4;
+  }
 
-        /* SRL n -----------------------------------------------------------------------------*/
-        case 0x3F: { // SRL A
-          MAKE_SRL_N_OPCODE_IMPL(a)
-        }
-        case 0x38: { // SRL B
-          MAKE_SRL_N_OPCODE_IMPL(b)
-        }
-        case 0x39: { // SRL C
-          MAKE_SRL_N_OPCODE_IMPL(c)
-        }
-        case 0x3A: { // SRL D
-          MAKE_SRL_N_OPCODE_IMPL(d)
-        }
-        case 0x3B: { // SRL E
-          MAKE_SRL_N_OPCODE_IMPL(e)
-        }
-        case 0x3C: { // SRL H
-          MAKE_SRL_N_OPCODE_IMPL(h)
-        }
-        case 0x3D: { // SRL L
-          MAKE_SRL_N_OPCODE_IMPL(l)
-        }
-        case 0x3E: { // SRL (HL)
-          uint8_t value = readByte(m, (cpu->registers.h << 8) | cpu->registers.l);
-          SET_FLAG_TO_RESULT(C, value & BIT_0) // NOTE: Set the C bit of F BEFORE we modify the value
-          value = value >> 1;
-          writeByte(m, (cpu->registers.h << 8) | cpu->registers.l, value);
-          SET_FLAG_TO_RESULT(Z, value == 0)
-          resetN(cpu);
-          resetH(cpu);
-          cycles += 16;
-          break;
-        }
+  const uint16_t opcodeAddress = cpu->registers.pc;
+  uint8_t opcode = readByte(m, cpu->registers.pc++);
+  // debug("\b[0x%04X][0x%02X] %s\n", cpu->registers.pc - 1, opcode, OPCODE_MNEMONICS[opcode]);
 
-        /* Bit Opcodes ************************************************************************/
-        /* BIT b, r --------------------------------------------------------------------------*/
-        MAKE_BIT_B_R_OPCODE_GROUP(0, 0x47)
-        MAKE_BIT_B_R_OPCODE_GROUP(1, 0x4F)
-        MAKE_BIT_B_R_OPCODE_GROUP(2, 0x57)
-        MAKE_BIT_B_R_OPCODE_GROUP(3, 0x5F)
-        MAKE_BIT_B_R_OPCODE_GROUP(4, 0x67)
-        MAKE_BIT_B_R_OPCODE_GROUP(5, 0x6F)
-        MAKE_BIT_B_R_OPCODE_GROUP(6, 0x77)
-        MAKE_BIT_B_R_OPCODE_GROUP(7, 0x7F)
-
-        /* SET b, r --------------------------------------------------------------------------*/
-        MAKE_SET_B_R_OPCODE_GROUP(0, 0xC7)
-        MAKE_SET_B_R_OPCODE_GROUP(1, 0xCF)
-        MAKE_SET_B_R_OPCODE_GROUP(2, 0xD7)
-        MAKE_SET_B_R_OPCODE_GROUP(3, 0xDF)
-        MAKE_SET_B_R_OPCODE_GROUP(4, 0xE7)
-        MAKE_SET_B_R_OPCODE_GROUP(5, 0xEF)
-        MAKE_SET_B_R_OPCODE_GROUP(6, 0xF7)
-        MAKE_SET_B_R_OPCODE_GROUP(7, 0xFF)
-
-        /* RES b, r --------------------------------------------------------------------------*/
-        MAKE_RES_B_R_OPCODE_GROUP(0, 0x87)
-        MAKE_RES_B_R_OPCODE_GROUP(1, 0x8F)
-        MAKE_RES_B_R_OPCODE_GROUP(2, 0x97)
-        MAKE_RES_B_R_OPCODE_GROUP(3, 0x9F)
-        MAKE_RES_B_R_OPCODE_GROUP(4, 0xA7)
-        MAKE_RES_B_R_OPCODE_GROUP(5, 0xAF)
-        MAKE_RES_B_R_OPCODE_GROUP(6, 0xB7)
-        MAKE_RES_B_R_OPCODE_GROUP(7, 0xBF)
-
-        /**************************************************************************************/
-        default: {
-          fprintf(stderr, "FATAL ERROR: ENCOUNTERED UNKNOWN CB-PREFIXED OPCODE: 0x%02X\n", opcode2);
-          exit(EXIT_FAILURE);
-          break;
-        }
-      }
-      break;
-    }
+  if (cpu->_pcFrozen) {
+    cpu->registers.pc--;
+    cpu->_pcFrozen = false;
+  }
 
-    /******************************************************************************************/
-    default: {
-      fprintf(stderr, "FATAL ERROR: ENCOUNTERED UNKNOWN OPCODE: 0x%02X\n", opcode);
-      exit(EXIT_FAILURE);
-      break;
-    }
+  cpu->instructionsExecuted++;
+
+  // TODO: Check for overflow of opcode here?
+
+  uint8_t cyclesExecuted = executeOpcode(cpu, m, opcode);
 
+  if (cpu->idleLoop.enabled) {
+    updateIdleLoop(cpu, opcodeAddress, cyclesExecuted);
   }
 
-  return cycles;
+  return cyclesExecuted;
+}
+
+
+bool cpuCanSkipHalt(CPU* cpu)
+{
+  // While halted (with no pending change to IME) the CPU does nothing until a component raises an interrupt
+  return cpu->halt && (cpu->di == 0) && (cpu->ei == 0);
 }
 
 
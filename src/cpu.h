@@ -6,6 +6,7 @@
 #include "memory.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED 4194304
@@ -17,6 +18,10 @@
 #define CLOCK_CYCLE_FREQUENCY_SGB 4295454
 #define CLOCK_CYCLE_TIME_SECS_SGB (1.0 / CLOCK_CYCLE_FREQUENCY_SGB)
 
+// In double speed mode this value will be halved before other components are updated, so don't use 1 because we
+// don't want 0 (integer division) to be the update value for other components.
+#define CPU_HALT_CYCLES 2
+
 #define FLAG_REGISTER_C_BIT_SHIFT 4
 #define FLAG_REGISTER_H_BIT_SHIFT 5
 #define FLAG_REGISTER_N_BIT_SHIFT 6
@@ -46,10 +51,12 @@
 
 #define CPU_MIN_CYCLES_PER_SET 70224
 
+#define CPU_IDLE_LOOP_MAX_BYTES 16 // The furthest back a branch can go to be considered as the end of an idle loop
+#define CPU_IDLE_LOOP_MAX_INSTRUCTIONS 16
+
 
 typedef struct {
   uint8_t a;
-  uint8_t f;
   uint8_t b;
   uint8_t c;
   uint8_t d;
@@ -61,14 +68,49 @@ typedef struct {
 } CPURegisters;
 
 
+// The flags are recorded from the operands and results of the last instruction to affect them and are only packed into
+// an F register value when the whole register is observed (PUSH AF, debugging etc.)
+typedef struct {
+  uint8_t zeroResult; // Z is set when this is 0
+  uint8_t subtract; // N is set when this is non-zero
+  uint16_t halfCarryBits; // H is bit 4 (the operands and result XORed together, so bit 4 is the carry into it)
+  uint16_t carryBits; // C is bit 8 (the unmasked result of the operation)
+} CPUFlags;
+
+
+// Tracks short loops that branch backwards, to find loops that are only waiting for a register to change (e.g. polling
+// LY or STAT instead of using HALT). An iteration is idle if it ends in the state it started in without writing to
+// memory, in which case every following iteration will do exactly the same until something the loop reads changes.
+typedef struct {
+  bool enabled;
+  bool isIdle; // Only valid straight after the branch at the end of an iteration
+  bool readTimer; // The last iteration read DIV or TIMA
+  uint16_t start; // The address branched back to
+  uint16_t end; // The address of the branch
+  CPURegisters registers; // Register values at the start of the iteration
+  uint8_t f;
+  bool ime;
+  uint32_t writeCount;
+  uint32_t timerReadCount;
+  uint32_t cycles; // Cycles executed so far in the current iteration
+  uint8_t numInstructions; // Instructions executed so far in the current iteration (CPU_IDLE_LOOP_MAX_INSTRUCTIONS + 1 if too many)
+  uint8_t instructionCycles[CPU_IDLE_LOOP_MAX_INSTRUCTIONS];
+  uint32_t iterationCycles; // Cycles in the last complete iteration
+  uint8_t iterationInstructions; // Instructions in the last complete iteration (their cycles are in instructionCycles)
+} CPUIdleLoop;
+
+
 typedef struct {
   CPURegisters registers;
+  CPUFlags flags;
   bool halt;
   bool stop;
   bool ime;
   uint8_t di; // Control value to trigger a disable of interrupts "after the instruction after DI is executed"
   uint8_t ei; // Control value to trigger an enable of interrupts "after the instruction after EI is executed"
   bool _pcFrozen; // Emulator internal value used to implement the DI+HALT bug
+  uint64_t instructionsExecuted; // Count of executed instructions (excluding cycles spent halted), for benchmarking
+  CPUIdleLoop idleLoop;
 
   MemoryController* memoryController;
   InterruptController* interruptController;
@@ -79,7 +121,12 @@ typedef struct {
 void initCPU(CPU* cpu, MemoryController* memoryController, InterruptController* interruptController, GameBoyType gameBoyType);
 void cpuReset(CPU* cpu);
 void cpuPrintState(CPU* cpu);
+uint8_t cpuGetFlagRegister(CPU* cpu);
+void cpuSetFlagRegister(CPU* cpu, uint8_t f);
+const char* cpuDispatchName();
 uint8_t cpuRunSingleOp(CPU* cpu);
+bool cpuCanSkipHalt(CPU* cpu);
+bool cpuIsInIdleLoop(CPU* cpu);
 void cpuUpdateIME(CPU* cpu);
 void cpuHandleInterrupts(CPU* cpu);
 
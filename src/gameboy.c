@@ -2,8 +2,6 @@
 
 #include "cartridge.h"
 
-#import <AudioToolbox/AudioToolbox.h>
-
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,7 +12,18 @@
 #define OAM_SIZE_BYTES 160
 #define HRAM_SIZE_BYTES 127
 
-#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_BATCH_SAMPLES 512
+
+
+static int16_t swapInt16HostToBig(int16_t value)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  return value;
+#else
+  uint16_t v = (uint16_t)value;
+  return (int16_t)((v << 8) | (v >> 8));
+#endif
+}
 
 
 void gbInitialise(GameBoy* gameBoy, GameBoyType gameBoyType, uint8_t* cartridgeData, Pixel* frameBuffer, const char* romFilename)
@@ -44,7 +53,7 @@ void gbInitialise(GameBoy* gameBoy, GameBoyType gameBoyType, uint8_t* cartridgeD
 
   initCPU(&gameBoy->cpu, &gameBoy->memoryController, &gameBoy->interruptController, gameBoyType);
   initLCDController(&gameBoy->lcdController, &gameBoy->interruptController, gameBoy->vram, gameBoy->oam, frameBuffer, gameBoyType, cgbMode);
-  initSoundController(&gameBoy->soundController);
+  initSoundController(&gameBoy->soundController, AUDIO_SAMPLE_RATE);
   initJoypadController(&gameBoy->joypadController);
   initTimerController(&gameBoy->timerController, &gameBoy->interruptController);
   initInterruptController(&gameBoy->interruptController);
@@ -69,6 +78,7 @@ void gbInitialise(GameBoy* gameBoy, GameBoyType gameBoyType, uint8_t* cartridgeD
     &gameBoy->timerController,
     &gameBoy->interruptController,
     &gameBoy->speedController,
+    &gameBoy->scheduler,
     externalRAMSizeBytes,
     romFilename
   );
@@ -76,7 +86,11 @@ void gbInitialise(GameBoy* gameBoy, GameBoyType gameBoyType, uint8_t* cartridgeD
   gameBoy->gameBoyType = gameBoyType;
   gameBoy->cgbMode = cgbMode;
 
-  gameBoy->cyclesBeforeNextAudioSample = 0;
+  memset(&gameBoy->stats, 0, sizeof(GameBoyStats));
+  gameBoy->audioFileSink = NULL;
+
+  initScheduler(&gameBoy->scheduler, &gameBoy->memoryController);
+  gbSetAudioSynthesis(gameBoy, SOUND_SYNTHESIS_POINT_SAMPLED); // Frontends opt in to band-limited synthesis
 
   cpuReset(&gameBoy->cpu);
 }
@@ -84,6 +98,8 @@ void gbInitialise(GameBoy* gameBoy, GameBoyType gameBoyType, uint8_t* cartridgeD
 
 void gbFinalise(GameBoy* gameBoy)
 {
+  FinaliseMemoryController(&gameBoy->memoryController);
+
   free(gameBoy->vram);
   free(gameBoy->wram);
   free(gameBoy->oam);
@@ -105,23 +121,171 @@ GameBoyType gbGetGameType(uint8_t* cartridgeData)
 }
 
 
+static uint8_t getSpeedMultiplier(GameBoy* gameBoy)
+{
+  return (gameBoy->speedController.key1 & (1 << 7)) ? 2 : 1;
+}
+
+
+static void putAudioSamples(GameBoy* gameBoy, AudioSampleBuffer* audioSampleBuffer)
+{
+  AudioSample samples[AUDIO_BATCH_SAMPLES];
+  ChannelAudioSample channelSamples[AUDIO_BATCH_SAMPLES];
+
+  AudioFileSink* sink = gameBoy->audioFileSink;
+  bool readChannels = (sink != NULL) && audioFileSinkHasChannels(sink);
+
+  soundEndFrame(&gameBoy->soundController);
+
+  uint32_t count;
+  while ((count = soundReadSamples(&gameBoy->soundController, samples, readChannels ? channelSamples : NULL, AUDIO_BATCH_SAMPLES)) > 0) {
+    if (sink != NULL) {
+      audioFileSinkPut(sink, samples, channelSamples, count);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      samples[i].so1 = swapInt16HostToBig(samples[i].so1);
+      samples[i].so2 = swapInt16HostToBig(samples[i].so2);
+    }
+    sampleBufferPutN(audioSampleBuffer, samples, count);
+  }
+}
+
+
+// The number of iterations of an idle loop that can be skipped, which is up to the one that anything the loop reads
+// could change in, or the one that ends the run
+static uint32_t getIdleLoopIterations(GameBoy* gameBoy, uint32_t baseCyclesRemaining)
+{
+  CPU* cpu = &gameBoy->cpu;
+  CPUIdleLoop* loop = &cpu->idleLoop;
+  Scheduler* scheduler = &gameBoy->scheduler;
+
+  if (!cpuIsInIdleLoop(cpu)) {
+    return 0;
+  }
+
+  // The last iteration is only known to repeat if nothing it read changed part way through it
+  if (scheduler->lastVisibleEventCycles > (scheduler->cycles - loop->iterationCycles)) {
+    return 0;
+  }
+
+  uint64_t changeCycles = schedulerNextVisibleEventCycles(scheduler);
+
+  // DIV and TIMA change between events
+  if (loop->readTimer) {
+    TimerController* timerController = &gameBoy->timerController;
+    schedulerSyncDomain(scheduler, SCHEDULER_DOMAIN_SYSTEM);
+
+    uint64_t dividerIncrementCycles = scheduler->cycles + timerCyclesUntilDividerIncrement(timerController);
+    if (dividerIncrementCycles < changeCycles) {
+      changeCycles = dividerIncrementCycles;
+    }
+
+    uint32_t cyclesUntilTimerIncrement = timerCyclesUntilTimerIncrement(timerController);
+    if (cyclesUntilTimerIncrement != SCHEDULER_NO_EVENT && (scheduler->cycles + cyclesUntilTimerIncrement) < changeCycles) {
+      changeCycles = scheduler->cycles + cyclesUntilTimerIncrement;
+    }
+  }
+
+  if (changeCycles <= scheduler->cycles) {
+    return 0;
+  }
+
+  uint64_t iterations = (changeCycles - scheduler->cycles - 1) / loop->iterationCycles;
+
+  uint32_t baseCyclesPerIteration = loop->iterationCycles / getSpeedMultiplier(gameBoy);
+  uint32_t runIterations = (baseCyclesRemaining - 1) / baseCyclesPerIteration;
+
+  return (runIterations < iterations) ? runIterations : iterations;
+}
+
+
+// Run iterations of an idle loop without executing them. Only audio events can be due during them, which still need
+// to happen after the right instruction, so an iteration that one falls in is stepped through an instruction at a time.
+static void skipIdleLoopIterations(GameBoy* gameBoy, AudioSampleBuffer* audioSampleBuffer, uint32_t iterations)
+{
+  CPUIdleLoop* loop = &gameBoy->cpu.idleLoop;
+  Scheduler* scheduler = &gameBoy->scheduler;
+  const uint8_t speedMultiplier = getSpeedMultiplier(gameBoy);
+
+  gameBoy->cpu.instructionsExecuted += (uint64_t)iterations * loop->iterationInstructions;
+
+  while (iterations > 0) {
+    if (scheduler->nextEventCycles > scheduler->cycles + loop->iterationCycles) {
+      uint64_t wholeIterations = (scheduler->nextEventCycles - scheduler->cycles - 1) / loop->iterationCycles;
+      if (wholeIterations > iterations) {
+        wholeIterations = iterations;
+      }
+      scheduler->cycles += wholeIterations * loop->iterationCycles;
+      iterations -= wholeIterations;
+    } else {
+      for (int i = 0; i < loop->iterationInstructions; i++) {
+        uint8_t cpuCyclesExecuted = loop->instructionCycles[i];
+        scheduler->cycles += cpuCyclesExecuted;
+        if (scheduler->cycles >= scheduler->nextEventCycles) {
+          if (schedulerRunEvents(scheduler, cpuCyclesExecuted, cpuCyclesExecuted / speedMultiplier)) {
+            putAudioSamples(gameBoy, audioSampleBuffer);
+          }
+        }
+      }
+      iterations--;
+    }
+  }
+}
+
+
+// The number of halted steps of the CPU that can be run in one go, which is up to the step that the next scheduled
+// event (and so the next chance of an interrupt) is due in, or the step that ends the run
+static uint32_t getHaltedSteps(GameBoy* gameBoy, uint32_t baseCyclesRemaining)
+{
+  CPU* cpu = &gameBoy->cpu;
+  Scheduler* scheduler = &gameBoy->scheduler;
+
+  if (!cpuCanSkipHalt(cpu)) {
+    return 1;
+  }
+
+  const uint8_t baseCyclesPerStep = CPU_HALT_CYCLES / getSpeedMultiplier(gameBoy);
+  uint32_t steps = (baseCyclesRemaining + baseCyclesPerStep - 1) / baseCyclesPerStep;
+
+  if (scheduler->nextEventCycles != UINT64_MAX) {
+    uint64_t cyclesUntilEvent = (scheduler->nextEventCycles > scheduler->cycles) ? (scheduler->nextEventCycles - scheduler->cycles) : 0;
+    uint64_t stepsUntilEvent = (cyclesUntilEvent + CPU_HALT_CYCLES - 1) / CPU_HALT_CYCLES;
+    if (stepsUntilEvent < steps) {
+      steps = stepsUntilEvent;
+    }
+  }
+
+  return (steps > 0) ? steps : 1;
+}
+
+
 int gbRunAtLeastNCycles(GameBoy* gameBoy, AudioSampleBuffer* audioSampleBuffer, const int cycles)
 {
   CPU* cpu = &gameBoy->cpu;
-  LCDController* lcdController = &gameBoy->lcdController;
-  SoundController* soundController = &gameBoy->soundController;
-  TimerController* timerController = &gameBoy->timerController;
-  MemoryController* memoryController = &gameBoy->memoryController;
   SpeedController* speedController = &gameBoy->speedController;
-
-  const int cyclesBetweenAudioSamples = CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED / AUDIO_SAMPLE_RATE;
+  Scheduler* scheduler = &gameBoy->scheduler;
 
   // Execute instructions until we have reached at least the target number (note that as we can't execute less than a
   // complete instructions worth of cycles the actual number executed might be greater than the target)
   uint32_t totalCyclesExecuted = 0;
-  uint32_t audioSampleCycles = gameBoy->cyclesBeforeNextAudioSample;
+  schedulerReschedule(scheduler);
+
+  uint32_t idleLoopCyclesSkipped = 0;
 
   while (totalCyclesExecuted < cycles) {
+    // Repeats of a loop that is only waiting for something to change are skipped
+    uint32_t idleLoopIterations = getIdleLoopIterations(gameBoy, cycles - totalCyclesExecuted);
+    if (idleLoopIterations > 0) {
+      uint32_t baseCyclesSkipped = idleLoopIterations * (cpu->idleLoop.iterationCycles / getSpeedMultiplier(gameBoy));
+      skipIdleLoopIterations(gameBoy, audioSampleBuffer, idleLoopIterations);
+      totalCyclesExecuted += baseCyclesSkipped;
+      idleLoopCyclesSkipped += baseCyclesSkipped;
+    }
+
+    // A halted CPU only waits for an interrupt, so all of the halted steps before the next event are run at once
+    uint32_t haltedSteps = getHaltedSteps(gameBoy, cycles - totalCyclesExecuted);
+
     uint8_t cpuCyclesExecuted = cpuRunSingleOp(cpu);
 
     // Component timings are based off clock cycles instead of "real time", but because most components aren't
@@ -130,33 +294,95 @@ int gbRunAtLeastNCycles(GameBoy* gameBoy, AudioSampleBuffer* audioSampleBuffer,
     uint8_t baseCyclesExecuted = cpuCyclesExecuted / ((speedController->key1 & (1 << 7)) ? 2 : 1);
 
     cpuUpdateIME(cpu);
-    cartridgeUpdate(memoryController, baseCyclesExecuted);
-    dmaUpdate(memoryController, cpuCyclesExecuted); // Not using speed adjusted cycles because the DMA transfer runs twice as fast in double speed mode
-    hdmaUpdate(memoryController, baseCyclesExecuted);
-    timerUpdateDivider(timerController, cpuCyclesExecuted); // Not using speed adjusted cycles because the divider runs twice as fast in double speed mode
-    timerUpdateTimer(timerController, cpuCyclesExecuted); // Not using speed adjusted cycles because the timer runs twice as fast in double speed mode
-    lcdUpdate(lcdController, baseCyclesExecuted);
-    soundUpdate(soundController, baseCyclesExecuted);
-    cpuHandleInterrupts(cpu);
 
-    if (audioSampleCycles + baseCyclesExecuted >= cyclesBetweenAudioSamples) {
-      AudioSample sample = soundGetCurrentSample(soundController);
+    // Components are only updated when the scheduler has an event due, so most instructions only count cycles here
+    bool audioOutputIsDue = false;
+    scheduler->cycles += cpuCyclesExecuted * haltedSteps;
+    if (scheduler->cycles >= scheduler->nextEventCycles) {
+      audioOutputIsDue = schedulerRunEvents(scheduler, cpuCyclesExecuted, baseCyclesExecuted);
+    }
 
-      // A Core Audio'ism - don't do this inside the render callback because we might run out of time to fill the buffer
-      // TODO: Move this out of here, perhaps to a callback that allows the host app to "transform" the data
-      // (preferably as one big chunk to avoid repeated function calls)
-      sample.so1 = CFSwapInt16HostToBig(sample.so1);
-      sample.so2 = CFSwapInt16HostToBig(sample.so2);
+    cpuHandleInterrupts(cpu);
 
-      sampleBufferPut(audioSampleBuffer, sample);
+    // Only when the output has gone as long as it can without being read, otherwise it's read once at the end of the run
+    if (audioOutputIsDue) {
+      putAudioSamples(gameBoy, audioSampleBuffer);
     }
-    audioSampleCycles = (audioSampleCycles + baseCyclesExecuted) % cyclesBetweenAudioSamples;
 
-    totalCyclesExecuted += baseCyclesExecuted;
+    totalCyclesExecuted += baseCyclesExecuted * haltedSteps;
+  }
+
+  // Bring all components up to date so their state can be inspected (or changed, e.g. by the joypad) between runs
+  schedulerSync(scheduler);
+
+  // The output for the whole run is mixed (or resampled) in one batch
+  if (gameBoy->soundController.synthesis != SOUND_SYNTHESIS_NONE) {
+    putAudioSamples(gameBoy, audioSampleBuffer);
   }
 
-  // Store the current number of cycles before the next audio sample, so the next run loop can take this into account
-  gameBoy->cyclesBeforeNextAudioSample = (cyclesBetweenAudioSamples - audioSampleCycles);
+  gameBoy->stats.cyclesExecuted += totalCyclesExecuted;
+  gameBoy->stats.idleLoopCyclesSkipped += idleLoopCyclesSkipped;
+  gameBoy->stats.lastRunCyclesExecuted = totalCyclesExecuted;
+  gameBoy->stats.lastRunIdleLoopCyclesSkipped = idleLoopCyclesSkipped;
+  gameBoy->stats.audioSamplesBuffered = sampleBufferAvailableSamples(audioSampleBuffer);
 
   return totalCyclesExecuted;
 }
+
+
+void gbSetIdleLoopSkipping(GameBoy* gameBoy, bool enabled)
+{
+  gameBoy->cpu.idleLoop.enabled = enabled;
+  gameBoy->cpu.idleLoop.isIdle = false;
+}
+
+
+void gbSetLCDCompositor(GameBoy* gameBoy, LCDCompositor compositor)
+{
+  lcdSetCompositor(&gameBoy->lcdController, compositor);
+}
+
+
+// Only draw every Nth frame (or only frames requested with gbRequestFrame() if 0). Emulation is otherwise unaffected.
+void gbSetFrameSkip(GameBoy* gameBoy, uint32_t interval)
+{
+  lcdSetFrameSkip(&gameBoy->lcdController, interval);
+}
+
+
+void gbRequestFrame(GameBoy* gameBoy)
+{
+  lcdRequestFrame(&gameBoy->lcdController);
+}
+
+
+void gbSetAudioSynthesis(GameBoy* gameBoy, SoundSynthesis synthesis)
+{
+  soundSetSynthesis(&gameBoy->soundController, synthesis);
+  schedulerReschedule(&gameBoy->scheduler); // The audio output is due at a different point
+}
+
+
+// Records the audio output to files as well as putting it in the audio sample buffer. The sink stays owned by the
+// caller, who closes it after unsetting it (by passing NULL) or finalising the Game Boy.
+void gbSetAudioFileSink(GameBoy* gameBoy, AudioFileSink* sink)
+{
+  gameBoy->audioFileSink = sink;
+  soundSetChannelCapture(&gameBoy->soundController, (sink != NULL) && audioFileSinkHasChannels(sink));
+}
+
+
+// Resamples the band-limited audio output to ratio times as many samples, for dynamic rate control
+void gbSetAudioRateRatio(GameBoy* gameBoy, double ratio)
+{
+  soundSetOutputRateRatio(&gameBoy->soundController, ratio);
+}
+
+
+GameBoyStats gbGetStats(GameBoy* gameBoy)
+{
+  GameBoyStats stats = gameBoy->stats;
+  stats.instructionsExecuted = gameBoy->cpu.instructionsExecuted;
+  stats.audioRateRatio = gameBoy->soundController.outputRateRatio;
+  return stats;
+}
@@ -5,11 +5,27 @@
 #include "cpu.h"
 #include "timer.h"
 #include "pixel.h"
+#include "scheduler.h"
+#include "sound/audiofilesink.h"
 #include "sound/audiosamplebuffer.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 
+#define AUDIO_SAMPLE_RATE 44100
+
+typedef struct {
+  uint64_t instructionsExecuted; // Excluding cycles spent halted
+  uint64_t cyclesExecuted;
+  uint64_t idleLoopCyclesSkipped;
+  uint32_t lastRunCyclesExecuted; // For the last call to gbRunAtLeastNCycles() (normally a frame)
+  uint32_t lastRunIdleLoopCyclesSkipped;
+  uint32_t audioSamplesBuffered; // In the audio sample buffer at the end of the last run
+  double audioRateRatio; // Set by gbSetAudioRateRatio()
+} GameBoyStats;
+
+
 typedef struct {
   CPU cpu;
   JoypadController joypadController;
@@ -19,6 +35,7 @@ typedef struct {
   InterruptController interruptController;
   MemoryController memoryController;
   SpeedController speedController;
+  Scheduler scheduler;
   GameBoyType gameBoyType;
   CGBMode cgbMode;
 
@@ -27,7 +44,9 @@ typedef struct {
   uint8_t* oam;
   uint8_t* hram;
 
-  int cyclesBeforeNextAudioSample;
+  AudioFileSink* audioFileSink; // Also gets every sample put in the audio sample buffer, if set
+
+  GameBoyStats stats;
 } GameBoy;
 
 
@@ -38,4 +57,13 @@ GameBoyType gbGetGameType(uint8_t* cartridgeData);
 
 int gbRunAtLeastNCycles(GameBoy* gameBoy, AudioSampleBuffer* audioSampleBuffer, const int cycles);
 
+void gbSetIdleLoopSkipping(GameBoy* gameBoy, bool enabled);
+void gbSetLCDCompositor(GameBoy* gameBoy, LCDCompositor compositor);
+void gbSetFrameSkip(GameBoy* gameBoy, uint32_t interval);
+void gbRequestFrame(GameBoy* gameBoy);
+void gbSetAudioSynthesis(GameBoy* gameBoy, SoundSynthesis synthesis);
+void gbSetAudioFileSink(GameBoy* gameBoy, AudioFileSink* sink);
+void gbSetAudioRateRatio(GameBoy* gameBoy, double ratio);
+GameBoyStats gbGetStats(GameBoy* gameBoy);
+
 #endif // GAMEBOY_H_
@@ -1,17 +1,19 @@
 #include "lcd.h"
 
 #include "cpu.h"
+#include "lcdcompositor.h"
 #include "logging.h"
+#include "scheduler.h"
 #include "sprites.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 
 #define BACKGROUND_WIDTH 256
 #define BACKGROUND_HEIGHT 256
 
 #define LOW_2_BITS 3
-#define LOW_3_BITS 7
 #define LOW_5_BITS 31
 
 
@@ -22,21 +24,6 @@ typedef struct
 } Point;
 
 
-typedef struct
-{
-  int low;
-  int high;
-} TileLineData;
-
-
-typedef struct
-{
-  int r;
-  int g;
-  int b;
-} Colour;
-
-
 typedef struct
 {
   int paletteNum;
@@ -57,13 +44,200 @@ static const BGMapAttributes BG_MAP_ATTRIBUTES_DEFAULT =
 };
 
 
-static TileLineData getTileLineData(LCDController* lcdController, uint16_t address)
+static const Pixel MONOCHROME_SHADE_PIXELS[4] = {
+  PIXEL_RGB(255, 255, 255),
+  PIXEL_RGB(168, 168, 168),
+  PIXEL_RGB(84, 84, 84),
+  PIXEL_RGB(0, 0, 0)
+};
+
+
+// Every 15 bit CGB colour converted to a frame buffer pixel, shared by all LCD controllers
+static Pixel cgbColourPixels[32768];
+static bool cgbColourPixelsInitialised = false;
+
+
+static uint8_t extract5BitRedValue(uint16_t cgbColour)
 {
-  TileLineData data = {
-    .low = lcdController->vram[address],
-    .high = lcdController->vram[address + 1]
-  };
-  return data;
+  return cgbColour & LOW_5_BITS;
+}
+
+
+static uint8_t extract5BitGreenValue(uint16_t cgbColour)
+{
+  return (cgbColour >> 5) & LOW_5_BITS;
+}
+
+
+static uint8_t extract5BitBlueValue(uint16_t cgbColour)
+{
+  return (cgbColour >> 10) & LOW_5_BITS;
+}
+
+
+static uint8_t fiveBitToEightBit(uint8_t value)
+{
+  return (value * 255) / 31;
+}
+
+
+static void initCGBColourPixels()
+{
+  if (cgbColourPixelsInitialised) {
+    return;
+  }
+  for (uint32_t cgbColour = 0; cgbColour < 32768; cgbColour++) {
+    cgbColourPixels[cgbColour] = PIXEL_RGB(
+      fiveBitToEightBit(extract5BitRedValue(cgbColour)),
+      fiveBitToEightBit(extract5BitGreenValue(cgbColour)),
+      fiveBitToEightBit(extract5BitBlueValue(cgbColour))
+    );
+  }
+  cgbColourPixelsInitialised = true;
+}
+
+
+// Only BGP, OBP0 and OBP1 are used in non CGB mode, and only the palette memory is used in CGB mode
+static void updateMonochromePalettePixels(LCDController* lcdController, uint8_t palettePixelsOffset, uint8_t palette)
+{
+  if (lcdController->cgbMode != MONOCHROME) {
+    return;
+  }
+  for (uint8_t colour = 0; colour < 4; colour++) {
+    lcdController->palettePixels[palettePixelsOffset + colour] = MONOCHROME_SHADE_PIXELS[(palette >> (colour * 2)) & LOW_2_BITS];
+  }
+}
+
+
+// Index is the BCPS/OCPS index of either byte of the colour
+static void updateCGBPalettePixel(LCDController* lcdController, uint8_t palettePixelsOffset, const uint8_t* paletteMemory, uint8_t index)
+{
+  if (lcdController->cgbMode != COLOUR) {
+    return;
+  }
+  uint8_t colourIndex = index & 0x3E;
+  uint16_t cgbColour = (paletteMemory[colourIndex] | (paletteMemory[colourIndex + 1] << 8)) & 0x7FFF;
+  lcdController->palettePixels[palettePixelsOffset + (colourIndex / 2)] = cgbColourPixels[cgbColour];
+}
+
+
+// Address is an offset into VRAM (including the bank offset in CGB mode) of one of the two bytes of a tile line
+static void decodeTileLine(LCDController* lcdController, uint16_t address)
+{
+  uint16_t lineAddress = address & ~1;
+  uint16_t offsetInBank = lineAddress % VRAM_BANK_SIZE;
+
+  uint8_t low = lcdController->vram[lineAddress];
+  uint8_t high = lcdController->vram[lineAddress + 1];
+
+  uint8_t (*tile)[8][8] = lcdController->tileCache[lineAddress / VRAM_BANK_SIZE][offsetInBank / 16];
+  uint8_t lineNum = (offsetInBank % 16) / 2;
+
+  for (uint8_t pixelX = 0; pixelX < 8; pixelX++) {
+    uint8_t colour = (((high >> (7 - pixelX)) & 1) << 1) | ((low >> (7 - pixelX)) & 1);
+    tile[0][lineNum][pixelX] = colour;
+    tile[1][lineNum][7 - pixelX] = colour;
+  }
+}
+
+
+static const uint8_t* getTileLine(LCDController* lcdController, uint16_t address, bool horizontalFlip)
+{
+  uint16_t offsetInBank = address % VRAM_BANK_SIZE;
+  return lcdController->tileCache[address / VRAM_BANK_SIZE][offsetInBank / 16][horizontalFlip][(offsetInBank % 16) / 2];
+}
+
+
+// In non CGB mode sprites with lower X positions have priority, then sprites earlier in OAM. In CGB mode only the
+// position in OAM matters.
+static bool spriteHasPriorityOver(LCDController* lcdController, uint8_t spriteIndex, uint8_t otherSpriteIndex)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+  if (lcdController->cgbMode == MONOCHROME && lineSprites->x[spriteIndex] != lineSprites->x[otherSpriteIndex]) {
+    return lineSprites->x[spriteIndex] < lineSprites->x[otherSpriteIndex];
+  }
+  return spriteIndex < otherSpriteIndex;
+}
+
+
+static bool getSpriteLines(LCDController* lcdController, uint8_t spriteIndex, int* firstLine, int* lastLine)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+
+  // Sprites at these X positions are entirely off screen
+  if (lineSprites->x[spriteIndex] == 0 || lineSprites->x[spriteIndex] >= 168) {
+    return false;
+  }
+
+  // Each line shows sprites with Y positions from LY + 1 to LY + 16
+  *firstLine = lineSprites->y[spriteIndex] - 16;
+  *lastLine = lineSprites->y[spriteIndex] - 1;
+  if (*firstLine < 0) {
+    *firstLine = 0;
+  }
+  if (*lastLine > LCD_HEIGHT - 1) {
+    *lastLine = LCD_HEIGHT - 1;
+  }
+  return *firstLine <= *lastLine;
+}
+
+
+static void addSpriteToLines(LCDController* lcdController, uint8_t spriteIndex)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+
+  int firstLine;
+  int lastLine;
+  if (!getSpriteLines(lcdController, spriteIndex, &firstLine, &lastLine)) {
+    return;
+  }
+
+  for (int line = firstLine; line <= lastLine; line++) {
+    uint8_t* sprites = lineSprites->sprites[line];
+    uint8_t position = lineSprites->count[line]++;
+    while (position > 0 && spriteHasPriorityOver(lcdController, spriteIndex, sprites[position - 1])) {
+      sprites[position] = sprites[position - 1];
+      position--;
+    }
+    sprites[position] = spriteIndex;
+  }
+}
+
+
+static void removeSpriteFromLines(LCDController* lcdController, uint8_t spriteIndex)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+
+  int firstLine;
+  int lastLine;
+  if (!getSpriteLines(lcdController, spriteIndex, &firstLine, &lastLine)) {
+    return;
+  }
+
+  for (int line = firstLine; line <= lastLine; line++) {
+    uint8_t* sprites = lineSprites->sprites[line];
+    uint8_t count = lineSprites->count[line];
+    uint8_t position = 0;
+    while (sprites[position] != spriteIndex) {
+      position++;
+    }
+    memmove(&sprites[position], &sprites[position + 1], count - position - 1);
+    lineSprites->count[line] = count - 1;
+  }
+}
+
+
+static void rebuildLineSprites(LCDController* lcdController)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+
+  memset(lineSprites->count, 0, sizeof(lineSprites->count));
+  for (uint8_t spriteIndex = 0; spriteIndex < MAX_SPRITES; spriteIndex++) {
+    lineSprites->y[spriteIndex] = lcdController->oam[spriteIndex * 4];
+    lineSprites->x[spriteIndex] = lcdController->oam[spriteIndex * 4 + 1];
+    addSpriteToLines(lcdController, spriteIndex);
+  }
+  lineSprites->isStale = false;
 }
 
 
@@ -79,6 +253,94 @@ void initLCDController(LCDController* lcdController, InterruptController* interr
   lcdController->clockCycles = 0;
   lcdController->vblankCounter = 0;
   lcdController->interruptController = interruptController;
+
+  memset(lcdController->pixelAttributes, 0, sizeof(lcdController->pixelAttributes));
+
+  // Palettes are converted from whatever the palette registers hold at this point, to match reading them directly
+  initCGBColourPixels();
+  memset(lcdController->palettePixels, 0, sizeof(lcdController->palettePixels));
+  updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_BG, lcdController->bgp);
+  updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_OBJ, lcdController->obp0);
+  updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_OBJ + 4, lcdController->obp1);
+  for (uint8_t index = 0; index < 64; index += 2) {
+    updateCGBPalettePixel(lcdController, PALETTE_PIXELS_BG, lcdController->backgroundPaletteMemory, index);
+    updateCGBPalettePixel(lcdController, PALETTE_PIXELS_OBJ, lcdController->objectPaletteMemory, index);
+  }
+  lcdController->palettePixels[PALETTE_PIXELS_WHITE] = MONOCHROME_SHADE_PIXELS[0];
+
+  lcdSetCompositor(lcdController, lcdCompositorBest());
+
+  rebuildLineSprites(lcdController);
+
+  lcdController->frameSkipInterval = 1;
+  lcdController->framesStarted = 0;
+  lcdController->frameIsRequested = false;
+  lcdController->isDrawingFrame = true;
+
+  uint8_t vramBanks = (cgbMode == COLOUR) ? 2 : 1;
+  for (uint8_t bank = 0; bank < vramBanks; bank++) {
+    for (uint16_t offset = 0; offset < TILE_DATA_SIZE; offset += 2) {
+      decodeTileLine(lcdController, bank * VRAM_BANK_SIZE + offset);
+    }
+  }
+}
+
+
+void lcdTileDataWritten(LCDController* lcdController, uint16_t vramAddress)
+{
+  decodeTileLine(lcdController, vramAddress);
+}
+
+
+void lcdSetCompositor(LCDController* lcdController, LCDCompositor compositor)
+{
+  lcdController->compositeScanline = lcdCompositorFunction(compositor);
+}
+
+
+// Address is an offset into OAM
+void lcdOAMWritten(LCDController* lcdController, uint8_t oamAddress)
+{
+  LineSprites* lineSprites = &lcdController->lineSprites;
+
+  // Only the Y and X positions affect which lines a sprite is on and its priority
+  if (lineSprites->isStale || (oamAddress % 4) > 1) {
+    return;
+  }
+
+  uint8_t spriteIndex = oamAddress / 4;
+  uint8_t spriteY = lcdController->oam[spriteIndex * 4];
+  uint8_t spriteX = lcdController->oam[spriteIndex * 4 + 1];
+  if (spriteY == lineSprites->y[spriteIndex] && spriteX == lineSprites->x[spriteIndex]) {
+    return;
+  }
+
+  removeSpriteFromLines(lcdController, spriteIndex);
+  lineSprites->y[spriteIndex] = spriteY;
+  lineSprites->x[spriteIndex] = spriteX;
+  addSpriteToLines(lcdController, spriteIndex);
+}
+
+
+// OAM DMA replaces all of OAM, so rather than updating the index for every byte it is rebuilt once, when it is next used
+void lcdOAMWrittenByDMA(LCDController* lcdController)
+{
+  lcdController->lineSprites.isStale = true;
+}
+
+
+// Takes effect from the next frame, which is always drawn unless the interval is 0
+void lcdSetFrameSkip(LCDController* lcdController, uint32_t interval)
+{
+  lcdController->frameSkipInterval = interval;
+  lcdController->framesStarted = 0;
+}
+
+
+// Draw the next frame to start, regardless of the frame skip interval
+void lcdRequestFrame(LCDController* lcdController)
+{
+  lcdController->frameIsRequested = true;
 }
 
 
@@ -156,10 +418,13 @@ void lcdWriteByte(LCDController* lcdController, uint16_t address, uint8_t value)
     lcdController->lyc = value;
   } else if (address == IO_REG_ADDRESS_BGP) { // 0xFF47
     lcdController->bgp = value;
+    updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_BG, value);
   } else if (address == IO_REG_ADDRESS_OBP0) { // 0xFF48
     lcdController->obp0 = value;
+    updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_OBJ, value);
   } else if (address == IO_REG_ADDRESS_OBP1) { // 0xFF49
     lcdController->obp1 = value;
+    updateMonochromePalettePixels(lcdController, PALETTE_PIXELS_OBJ + 4, value);
   } else if (address == IO_REG_ADDRESS_WY) { // 0xFF4A
     lcdController->wy = value;
   } else if (address == IO_REG_ADDRESS_WX) { // 0xFF4B
@@ -171,6 +436,7 @@ void lcdWriteByte(LCDController* lcdController, uint16_t address, uint8_t value)
   } else if (address == IO_REG_ADDRESS_BCPD) { // 0xFF69
     uint8_t bcps = lcdController->bcps;
     lcdController->backgroundPaletteMemory[bcps & 0x3F] = value;
+    updateCGBPalettePixel(lcdController, PALETTE_PIXELS_BG, lcdController->backgroundPaletteMemory, bcps & 0x3F);
     if (bcps & (1 << 7)) {
       lcdController->bcps = (bcps & 0x80) | (((bcps & 0x3F) + 1) & 0x3F);
     }
@@ -179,6 +445,7 @@ void lcdWriteByte(LCDController* lcdController, uint16_t address, uint8_t value)
   } else if (address == IO_REG_ADDRESS_OCPD) { // 0xFF6B
     uint8_t ocps = lcdController->ocps;
     lcdController->objectPaletteMemory[ocps & 0x3F] = value;
+    updateCGBPalettePixel(lcdController, PALETTE_PIXELS_OBJ, lcdController->objectPaletteMemory, ocps & 0x3F);
     if (ocps & (1 << 7)) {
       lcdController->ocps = (ocps & 0x80) | (((ocps & 0x3F) + 1) & 0x3F);
     }
@@ -198,127 +465,15 @@ static void lcdStatSetMode(LCDController* lcdController, uint8_t mode)
 }
 
 
-static uint8_t pixelColour(TileLineData lineData, uint8_t pixelX)
-{
-  switch (pixelX) {
-    // High bit shifts for pixel colour extraction:
-    //   Pixels 0 - 5: Right by (6 - Pixel#)
-    //   Pixel 6: No Shift
-    //   Pixel 7: Left by 1
-    // Low bit shifts for pixel colour extraction:
-    //   Pixels 0 - 6: Right by (7 - Pixel#)
-    //   Pixel 7: No Shift
-    case 7:
-      return ((lineData.high << 1) & 2) | (lineData.low & 1);
-      break;
-    case 6:
-      return ((lineData.high) & 2) | ((lineData.low >> (7 - pixelX)) & 1);
-      break;
-    default: // Pixels 0 - 5
-      return ((lineData.high >> (6 - pixelX)) & 2) | ((lineData.low >> (7 - pixelX)) & 1);
-      break;
-  }
-}
-
-
-static void setPixelRGBForMonochromeShade(LCDController* lcdController, Pixel* pixel, uint8_t shade)
-{
-  switch (shade) {
-    case 0:
-      pixel->r = pixel->g = pixel->b = 1.0;
-      break;
-    case 1:
-      pixel->r = pixel->g = pixel->b = 0.66;
-      break;
-    case 2:
-      pixel->r = pixel->g = pixel->b = 0.33;
-      break;
-    case 3:
-      pixel->r = pixel->g = pixel->b = 0.0;
-      break;
-  }
-}
-
-
-static uint8_t colourToBackgroundMonochromeShade(LCDController* lcdController, uint8_t colour)
-{
-  return (lcdController->bgp >> (colour * 2)) & LOW_2_BITS;
-}
-
-
-static uint8_t colourToObjectMonochromeShade(LCDController* lcdController, uint8_t colour, uint8_t palette)
-{
-  return (palette >> (colour * 2)) & 3;
-}
-
-
-static uint8_t extract5BitRedValue(uint8_t colourByteLow)
-{
-  return colourByteLow & LOW_5_BITS;
-}
-
-
-static uint8_t extract5BitGreenValue(uint8_t colourByteLow, int8_t colourByteHigh)
-{
-  return ((colourByteHigh & 3) << LOW_2_BITS) | ((colourByteLow >> 5) & LOW_3_BITS);
-}
-
-
-static uint8_t extract5BitBlueValue(uint8_t colourByteHigh)
-{
-  return (colourByteHigh >> 2) & LOW_5_BITS;
-}
-
-
-static Colour getBackgroundColour(LCDController* lcdController, uint8_t paletteNum, uint8_t colourNum)
-{
-  Colour colour;
-
-  uint8_t paletteIndex = (paletteNum * 8) + (colourNum * 2);
-  uint8_t colourByteLow = lcdController->backgroundPaletteMemory[paletteIndex];
-  uint8_t colourByteHigh = lcdController->backgroundPaletteMemory[paletteIndex + 1];
-
-  colour.r = extract5BitRedValue(colourByteLow);
-  colour.g = extract5BitGreenValue(colourByteLow, colourByteHigh);
-  colour.b = extract5BitBlueValue(colourByteHigh);
-
-  return colour;
-}
-
-
-static Colour getObjectColour(LCDController* lcdController, uint8_t paletteNum, uint8_t colourNum)
-{
-  Colour colour;
-
-  uint8_t paletteIndex = (paletteNum * 8) + (colourNum * 2);
-  uint8_t colourByteLow = lcdController->objectPaletteMemory[paletteIndex];
-  uint8_t colourByteHigh = lcdController->objectPaletteMemory[paletteIndex + 1];
-
-  colour.r = extract5BitRedValue(colourByteLow);
-  colour.g = extract5BitGreenValue(colourByteLow, colourByteHigh);
-  colour.b = extract5BitBlueValue(colourByteHigh);
-
-  return colour;
-}
-
-
-static float fiveBitToFloat(uint8_t value)
-{
-  return value / 31.0;
-}
-
-
-static void setPixelRGBForCGBColour(LCDController* lcdController, Pixel* pixel, Colour colour)
+static Pixel* getFramebufferPixel(LCDController* lcdController, int16_t scanlineX)
 {
-  pixel->r = fiveBitToFloat(colour.r);
-  pixel->g = fiveBitToFloat(colour.g);
-  pixel->b = fiveBitToFloat(colour.b);
+  return &lcdController->frameBuffer[lcdController->ly * LCD_WIDTH + scanlineX];
 }
 
 
-static Pixel* getFramebufferPixel(LCDController* lcdController, int16_t scanlineX)
+static uint8_t* getPixelAttributes(LCDController* lcdController, int16_t scanlineX)
 {
-  return &lcdController->frameBuffer[lcdController->ly * LCD_WIDTH + scanlineX];
+  return &lcdController->pixelAttributes[lcdController->ly * LCD_WIDTH + scanlineX];
 }
 
 
@@ -380,7 +535,7 @@ static uint16_t positionToMapTileIndex(Point point)
 }
 
 
-static void lcdDrawScanlineBackground(LCDController* lcdController)
+static void lcdDrawScanlineBackground(LCDController* lcdController, ScanlineLayers* layers)
 {
   if (lcdController->lcdc & LCD_BG_DISPLAY_BIT) {
     uint16_t tileMapAddress = getBackgroundTileMapAddress(lcdController);
@@ -411,16 +566,15 @@ static void lcdDrawScanlineBackground(LCDController* lcdController)
         lineOffset += (1024 * 8);
       }
 
-      TileLineData lineData = getTileLineData(lcdController, lineOffset);
+      const uint8_t* line = getTileLine(lcdController, lineOffset, attributes.horizontalFlip);
 
       // Draw all pixels from the current tile, starting at the offset in the tile determined by the x location in the complete background
       if (lcdController->cgbMode == MONOCHROME) {
         for (uint8_t pixelX = positionInBackground.x % 8; pixelX < 8 && scanlineX < LCD_WIDTH; pixelX++) {
-          Pixel* pixel = getFramebufferPixel(lcdController, scanlineX);
+          uint8_t colour = line[pixelX];
 
-          pixel->colour = pixelColour(lineData, pixelX);
-          uint8_t shade = colourToBackgroundMonochromeShade(lcdController, pixel->colour);
-          setPixelRGBForMonochromeShade(lcdController, pixel, shade);
+          *getPixelAttributes(lcdController, scanlineX) = colour;
+          layers->bgIndexes[scanlineX] = PALETTE_PIXELS_BG + colour;
 
           // Don't increment this for the last pixel of the current tile, the increment in the outer loop will do this for us
           if (pixelX != 7) {
@@ -429,15 +583,10 @@ static void lcdDrawScanlineBackground(LCDController* lcdController)
         }
       } else if (lcdController->cgbMode == COLOUR) {
         for (uint8_t pixelX = positionInBackground.x % 8; pixelX < 8 && scanlineX < LCD_WIDTH; pixelX++) {
-          Pixel* pixel = getFramebufferPixel(lcdController, scanlineX);
-
-          uint8_t lineX = (attributes.horizontalFlip ? 7 - pixelX : pixelX);
-
-          pixel->colour = pixelColour(lineData, lineX);
-          pixel->bgPriority = attributes.bgPriority;
+          uint8_t colour = line[pixelX];
 
-          Colour colour = getBackgroundColour(lcdController, attributes.paletteNum, pixel->colour);
-          setPixelRGBForCGBColour(lcdController, pixel, colour);
+          *getPixelAttributes(lcdController, scanlineX) = colour | (attributes.bgPriority ? PIXEL_ATTR_BITS_BG_PRIORITY : 0);
+          layers->bgIndexes[scanlineX] = PALETTE_PIXELS_BG + (attributes.paletteNum * 4) + colour;
 
           // Don't increment this for the last pixel of the current tile, the increment in the outer loop will do this for us
           if (pixelX != 7) {
@@ -448,15 +597,12 @@ static void lcdDrawScanlineBackground(LCDController* lcdController)
     }
   } else {
     // The background is disabled so with a monochrome Game Boy every pixel is white
-    for (int scanlineX = 0; scanlineX < LCD_WIDTH; scanlineX++) {
-      Pixel* pixel = getFramebufferPixel(lcdController, scanlineX);
-      setPixelRGBForMonochromeShade(lcdController, pixel, 0);
-    }
+    memset(layers->bgIndexes, PALETTE_PIXELS_WHITE, sizeof(layers->bgIndexes));
   }
 }
 
 
-static void lcdDrawScanlineWindow(LCDController* lcdController)
+static void lcdDrawScanlineWindow(LCDController* lcdController, ScanlineLayers* layers)
 {
   // Check if the window offset results in a row of the window on the current scanline - if not then we're done
   if (lcdController->ly < lcdController->wy) {
@@ -498,16 +644,15 @@ static void lcdDrawScanlineWindow(LCDController* lcdController)
       lineOffset += (1024 * 8);
     }
 
-    TileLineData lineData = getTileLineData(lcdController, lineOffset);
+    const uint8_t* line = getTileLine(lcdController, lineOffset, attributes.horizontalFlip);
 
     // Draw all pixels from the current tile, starting at the offset in the tile determined by the x location in the complete background
     if (lcdController->cgbMode == MONOCHROME) {
       for (uint8_t pixelX = windowX % 8; pixelX < 8 && scanlineX < LCD_WIDTH; pixelX++) {
-        Pixel* pixel = getFramebufferPixel(lcdController, scanlineX);
-        pixel->colour = pixelColour(lineData, pixelX);
-        uint8_t shade = colourToBackgroundMonochromeShade(lcdController, pixel->colour);
+        uint8_t colour = line[pixelX];
 
-        setPixelRGBForMonochromeShade(lcdController, pixel, shade);
+        *getPixelAttributes(lcdController, scanlineX) = colour;
+        layers->bgIndexes[scanlineX] = PALETTE_PIXELS_BG + colour;
 
         // Don't increment this for the last pixel of the current tile, the increment in the outer loop will do this for us
         if (pixelX != 7) {
@@ -516,15 +661,10 @@ static void lcdDrawScanlineWindow(LCDController* lcdController)
       }
     } else if (lcdController->cgbMode == COLOUR) {
       for (uint8_t pixelX = windowX % 8; pixelX < 8 && scanlineX < LCD_WIDTH; pixelX++) {
-        Pixel* pixel = getFramebufferPixel(lcdController, scanlineX);
-
-        uint8_t lineX = (attributes.horizontalFlip ? 7 - pixelX : pixelX);
-
-        pixel->colour = pixelColour(lineData, lineX);
-        pixel->bgPriority = attributes.bgPriority;
+        uint8_t colour = line[pixelX];
 
-        Colour colour = getBackgroundColour(lcdController, attributes.paletteNum, pixel->colour);
-        setPixelRGBForCGBColour(lcdController, pixel, colour);
+        *getPixelAttributes(lcdController, scanlineX) = colour | (attributes.bgPriority ? PIXEL_ATTR_BITS_BG_PRIORITY : 0);
+        layers->bgIndexes[scanlineX] = PALETTE_PIXELS_BG + (attributes.paletteNum * 4) + colour;
 
         // Don't increment this for the last pixel of the current tile, the increment in the outer loop will do this for us
         if (pixelX != 7) {
@@ -536,34 +676,29 @@ static void lcdDrawScanlineWindow(LCDController* lcdController)
 }
 
 
+// Copy the sprites to draw on the current line, in priority order (highest first), up to the limit per line
 static uint8_t lcdCopySpritesVisibleInScanline(LCDController* lcdController, Sprite* sprites, uint8_t spriteHeight)
 {
+  LineSprites* lineSprites = &lcdController->lineSprites;
+  if (lineSprites->isStale) {
+    rebuildLineSprites(lcdController);
+  }
+
+  const uint8_t ly = lcdController->ly;
+
   uint8_t spriteCount = 0;
-  for (uint8_t spriteIndex = 0; spriteIndex < MAX_SPRITES; spriteIndex++) {
-    // Does the sprite's Y position exclude it from appearing in the scanline?
-    // TODO: Check that "spriteY == 0 ||" and "|| spriteY >= 160" are implied here?
-    uint8_t spriteY = lcdController->oam[spriteIndex * 4];
-    if (spriteHeight == 8) {
-      if (spriteY < (lcdController->ly + 8 + 1) || spriteY > (lcdController->ly + 16)) {
-        continue;
-      }
-    } else {
-      if (spriteY < (lcdController->ly + 1) || spriteY > (lcdController->ly + spriteHeight)) {
-        continue;
-      }
-    }
+  for (uint8_t i = 0; i < lineSprites->count[ly] && spriteCount < MAX_SPRITES_PER_LINE; i++) {
+    uint8_t spriteIndex = lineSprites->sprites[ly][i];
 
-    // Does the sprite's X position exclude it from appearing in the scanline?
-    // NOTE: No checks possible for overlapping of sprites at this point because we cover all columns in the scanline
-    uint8_t spriteX = lcdController->oam[spriteIndex * 4 + 1];
-    if (spriteX == 0 || spriteX >= 168) {
+    // Sprites are indexed as 16 pixels high, so 8 pixel high sprites with only their (undrawn) bottom half on this
+    // line still need to be skipped
+    uint8_t spriteY = lcdController->oam[spriteIndex * 4];
+    if (spriteHeight == 8 && spriteY < (ly + 8 + 1)) {
       continue;
     }
 
-    // If we get here the sprite should be drawn, but we can't determine the draw priorities until
-    // we have scanned all the sprites in OAM, so store the sprite data for later.
     sprites[spriteCount].yPosition = spriteY;
-    sprites[spriteCount].xPosition = spriteX;
+    sprites[spriteCount].xPosition = lcdController->oam[spriteIndex * 4 + 1];
     sprites[spriteCount].tileNumber = lcdController->oam[spriteIndex * 4 + 2];
     sprites[spriteCount].attributes = lcdController->oam[spriteIndex * 4 + 3];
 
@@ -579,54 +714,29 @@ static bool bgAndWinMasterPriority(LCDController* lcdController)
 }
 
 
-static bool pixelBGPriority(Pixel* pixel)
-{
-  return pixel->bgPriority;
-}
-
-
 static bool spriteBGPriority(Sprite* sprite)
 {
   return (sprite->attributes & SPRITE_ATTR_BITS_OBJ_TO_BG_PRIORITY);
 }
 
 
-static bool spritePixelVisibleInMonochromeMode(uint8_t spriteColourNumber, uint8_t bgOrWinColour, Pixel* pixel, Sprite* sprite)
+static void setMode3CyclesForSprites(LCDController* lcdController, uint8_t spritesToRender)
 {
-  return (spriteColourNumber != 0) &&
-    ((bgOrWinColour == 0) || (!pixelBGPriority(pixel) && !spriteBGPriority(sprite)));
-}
-
-
-static bool spritePixelVisibleInColourMode(LCDController* lcdController, uint8_t spriteColourNumber, uint8_t bgOrWinColour, Pixel* pixel, Sprite* sprite)
-{
-  return (spriteColourNumber != 0) &&
-    ((bgOrWinColour == 0) || (!bgAndWinMasterPriority(lcdController)) || (!pixelBGPriority(pixel) && !spriteBGPriority(sprite)));
+  lcdController->mode3Cycles = MODE_3_CYCLES_MIN + (spritesToRender * MODE_3_CYCLES_PER_SPRITE);
 }
 
 
-static void lcdDrawScanlineObjects(LCDController* lcdController)
+static void lcdDrawScanlineObjects(LCDController* lcdController, ScanlineLayers* layers)
 {
-  Sprite sprites[MAX_SPRITES];
+  Sprite sprites[MAX_SPRITES_PER_LINE];
 
   const uint8_t spriteHeight = ((lcdController->lcdc & LCD_OBJ_SIZE_BIT) ? 16 : 8);
 
-  // Fetch sprites that we know to be in the visible scanline
-  const uint8_t spriteCount = lcdCopySpritesVisibleInScanline(lcdController, sprites, spriteHeight);
-
-  // For non CGB mode, order sprites that are in the scanline first by X position and then by order in the sprite table
-  if (lcdController->cgbMode == MONOCHROME) {
-    qsort((void*)sprites, spriteCount, sizeof(Sprite), spritesCompareByXPosition);
-  }
-
-  // Limit the number of sprites drawn
-  uint8_t spritesToRender = spriteCount;
-  if (spritesToRender > MAX_SPRITES_PER_LINE) {
-    spritesToRender = MAX_SPRITES_PER_LINE;
-  }
+  // Fetch the highest priority sprites in the visible scanline
+  const uint8_t spritesToRender = lcdCopySpritesVisibleInScanline(lcdController, sprites, spriteHeight);
 
   // Now that we know how many sprites we're drawing we can adjust the Mode 3 timing accordingly
-  lcdController->mode3Cycles = MODE_3_CYCLES_MIN + (spritesToRender * MODE_3_CYCLES_PER_SPRITE);
+  setMode3CyclesForSprites(lcdController, spritesToRender);
 
   // Draw sprites from least to highest priority so higher priority sprites will be drawn over lower priority sprites
   // TODO: This could be improved by moving across the scanline from left to right and not drawing
@@ -657,7 +767,18 @@ static void lcdDrawScanlineObjects(LCDController* lcdController)
       }
     }
 
-    TileLineData lineData = getTileLineData(lcdController, lineOffset);
+    const uint8_t* line = getTileLine(lcdController, lineOffset, sprite.attributes & SPRITE_ATTR_BITS_X_FLIP);
+
+    uint8_t paletteNum;
+    if (lcdController->cgbMode == MONOCHROME) {
+      paletteNum = ((sprite.attributes & SPRITE_ATTR_BITS_MONOCHROME_PALETTE_NUMBER) ? 1 : 0);
+    } else {
+      paletteNum = sprite.attributes & 7;
+    }
+
+    // Sprites are drawn into the layer for their OBJ-to-BG priority, and whether they show over the background is
+    // decided when the layers are composited
+    uint8_t layer = spriteBGPriority(&sprite) ? 1 : 0;
 
     for (uint8_t lineX = 0; lineX < 8; lineX++) {
       // Stop sprite pixels from wrapping back around onto the end of the previous scanline
@@ -670,34 +791,12 @@ static void lcdDrawScanlineObjects(LCDController* lcdController)
         break;
       }
 
-      uint8_t realX = lineX;
+      uint8_t scanlineX = (sprite.xPosition - 8) + lineX;
+      uint8_t spriteColourNumber = line[lineX];
 
-      // X flip
-      if (sprite.attributes & SPRITE_ATTR_BITS_X_FLIP) {
-        realX = 7 - realX;
-      }
-
-      uint16_t pixelPos = lcdController->ly * LCD_WIDTH + (sprite.xPosition - 8) + lineX;
-
-      Pixel* pixel = &lcdController->frameBuffer[pixelPos];
-
-      uint8_t bgOrWinColour = pixel->colour;
-      uint8_t spriteColourNumber = pixelColour(lineData, realX);
-
-      if (lcdController->cgbMode == MONOCHROME) {
-        if (spritePixelVisibleInMonochromeMode(spriteColourNumber, bgOrWinColour, pixel, &sprite)) {
-          uint8_t palette = ((sprite.attributes & SPRITE_ATTR_BITS_MONOCHROME_PALETTE_NUMBER) ? lcdController->obp1 : lcdController->obp0);
-          uint8_t shade = colourToObjectMonochromeShade(lcdController, spriteColourNumber, palette);
-
-          setPixelRGBForMonochromeShade(lcdController, pixel, shade);
-        }
-      } else if (lcdController->cgbMode == COLOUR) {
-        if (spritePixelVisibleInColourMode(lcdController, spriteColourNumber, bgOrWinColour, pixel, &sprite)) {
-          uint8_t paletteNum = sprite.attributes & 7;
-
-          Colour colour = getObjectColour(lcdController, paletteNum, spriteColourNumber);
-          setPixelRGBForCGBColour(lcdController, pixel, colour);
-        }
+      if (spriteColourNumber != 0) {
+        layers->objIndexes[layer][scanlineX] = PALETTE_PIXELS_OBJ + (paletteNum * 4) + spriteColourNumber;
+        layers->objRanks[layer][scanlineX] = sp;
       }
     }
   }
@@ -706,16 +805,44 @@ static void lcdDrawScanlineObjects(LCDController* lcdController)
 
 static void lcdDrawScanline(LCDController* lcdController)
 {
-  lcdDrawScanlineBackground(lcdController);
+  ScanlineLayers layers;
+  layers.bgAttributes = getPixelAttributes(lcdController, 0);
+  layers.bgMasterPriority = (lcdController->cgbMode == MONOCHROME) || bgAndWinMasterPriority(lcdController);
+  memset(layers.objIndexes, SCANLINE_LAYERS_NO_OBJ, sizeof(layers.objIndexes));
+
+  lcdDrawScanlineBackground(lcdController, &layers);
   if (lcdController->lcdc & LCD_WINDOW_DISPLAY_ENABLE_BIT) {
-    lcdDrawScanlineWindow(lcdController);
+    lcdDrawScanlineWindow(lcdController, &layers);
+  }
+  if (lcdController->lcdc & LCD_OBJ_DISPLAY_ENABLE_BIT) {
+    lcdDrawScanlineObjects(lcdController, &layers);
   }
+
+  lcdController->compositeScanline(&layers, lcdController->palettePixels, getFramebufferPixel(lcdController, 0));
+}
+
+
+// Used instead of lcdDrawScanline() for frames that aren't drawn, because the length of mode 3 still depends on the
+// number of sprites on the line
+static void lcdSkipScanline(LCDController* lcdController)
+{
   if (lcdController->lcdc & LCD_OBJ_DISPLAY_ENABLE_BIT) {
-    lcdDrawScanlineObjects(lcdController);
+    Sprite sprites[MAX_SPRITES_PER_LINE];
+    const uint8_t spriteHeight = ((lcdController->lcdc & LCD_OBJ_SIZE_BIT) ? 16 : 8);
+    setMode3CyclesForSprites(lcdController, lcdCopySpritesVisibleInScanline(lcdController, sprites, spriteHeight));
   }
 }
 
 
+static void lcdStartFrame(LCDController* lcdController)
+{
+  uint32_t interval = lcdController->frameSkipInterval;
+  lcdController->isDrawingFrame = lcdController->frameIsRequested || (interval != 0 && (lcdController->framesStarted % interval) == 0);
+  lcdController->frameIsRequested = false;
+  lcdController->framesStarted++;
+}
+
+
 static bool hclocksIndicateMode2(LCDController* lcdController, uint16_t horizontalScanClocks)
 {
   return (horizontalScanClocks < 80);
@@ -734,7 +861,7 @@ static bool hclocksIndicateMode0(LCDController* lcdController, uint16_t horizont
 }
 
 
-static void updateInternalClockCycles(LCDController* lcdController, uint8_t cyclesExecuted)
+static void updateInternalClockCycles(LCDController* lcdController, uint32_t cyclesExecuted)
 {
   lcdController->clockCycles = (lcdController->clockCycles + cyclesExecuted) % FULL_FRAME_CLOCK_CYCLES;
 }
@@ -793,6 +920,9 @@ void updateMode(LCDController* lcdController)
           interruptFlag(lcdController->interruptController, LCDC_STATUS_INTERRUPT_BIT);
         }
         lcdController->mode3Cycles = MODE_3_CYCLES_MAX;
+        if (lcdController->ly == 0) {
+          lcdStartFrame(lcdController);
+        }
       } else if (mode == 2) { // No mode change
       } else {
         critical("%s: Invalid LCDC mode transition from %u to %u (hclocks=%u vclocks=%u)\n", __func__, mode, 2, horizontalScanClocks, lcdController->clockCycles);
@@ -801,7 +931,11 @@ void updateMode(LCDController* lcdController)
     } else if (hclocksIndicateMode3(lcdController, horizontalScanClocks)) { // Mode 3
       if (mode == 2) { // Handle mode change from mode 2
         lcdStatSetMode(lcdController, 3);
-        lcdDrawScanline(lcdController);
+        if (lcdController->isDrawingFrame) {
+          lcdDrawScanline(lcdController);
+        } else {
+          lcdSkipScanline(lcdController);
+        }
       } else if (mode == 3) { // No mode change
       } else {
         critical("%s: Invalid LCDC mode transition from %u to %u (hclocks=%u vclocks=%u)\n", __func__, mode, 3, horizontalScanClocks, lcdController->clockCycles);
@@ -869,7 +1003,7 @@ void updateMode(LCDController* lcdController)
 }
 
 
-void lcdUpdate(LCDController* lcdController, uint8_t cyclesExecuted)
+void lcdUpdate(LCDController* lcdController, uint32_t cyclesExecuted)
 {
   if (!lcdIsEnabled(lcdController)) {
     return;
@@ -881,6 +1015,24 @@ void lcdUpdate(LCDController* lcdController, uint8_t cyclesExecuted)
 }
 
 
+uint32_t lcdCyclesUntilNextEvent(LCDController* lcdController)
+{
+  if (!lcdIsEnabled(lcdController)) {
+    return SCHEDULER_NO_EVENT;
+  }
+
+  // LY and the mode can only change at these points in a line (4 clocks in is where LY rolls over early on line 153)
+  const uint16_t horizontalScanClocks = getHorizontalScanClocks(lcdController);
+  const uint16_t lineEventClocks[] = {4, 80, 80 + lcdController->mode3Cycles, SINGLE_HORIZONTAL_SCAN_CLOCK_CYCLES};
+
+  int i = 0;
+  while (horizontalScanClocks >= lineEventClocks[i]) {
+    i++;
+  }
+  return lineEventClocks[i] - horizontalScanClocks;
+}
+
+
 void lcdSpeedChange(LCDController* lcdController)
 {
   lcdController->stat = (lcdController->stat & 0xFC) | 1;
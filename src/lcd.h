@@ -67,6 +67,44 @@
 #define MODE_3_CYCLES_MIN 172
 #define MODE_3_CYCLES_PER_SPRITE ((MODE_3_CYCLES_MAX - MODE_3_CYCLES_MIN) / MAX_SPRITES_PER_LINE)
 
+#define VRAM_BANK_SIZE (8 * 1024)
+#define TILE_DATA_SIZE 0x1800 // 0x8000-0x97FF in each VRAM bank
+#define TILES_PER_BANK (TILE_DATA_SIZE / 16)
+
+#define PIXEL_ATTR_BITS_COLOUR 0x3
+#define PIXEL_ATTR_BITS_BG_PRIORITY (1 << 7)
+
+// Layout of LCDController.palettePixels - in non CGB mode BGP is BG palette 0 and OBP0 and OBP1 are OBJ palettes 0 and 1
+#define PALETTE_PIXELS_BG 0
+#define PALETTE_PIXELS_OBJ 32
+#define PALETTE_PIXELS_WHITE 64 // Used when the background is disabled
+#define PALETTE_PIXELS_COUNT 65
+
+
+typedef enum {
+  LCD_COMPOSITOR_SCALAR,
+  LCD_COMPOSITOR_SSE2,
+  LCD_COMPOSITOR_AVX2,
+  LCD_COMPOSITOR_COUNT
+} LCDCompositor;
+
+
+// The sprites that can appear on each line, kept up to date as OAM is written so that lines can be drawn without
+// searching OAM. Sprites are indexed as if they were 16 pixels high, and 8 pixel high sprites are filtered out when
+// the line is drawn.
+typedef struct {
+  uint8_t count[LCD_HEIGHT];
+  uint8_t sprites[LCD_HEIGHT][MAX_SPRITES]; // OAM numbers in priority order (highest first)
+  uint8_t y[MAX_SPRITES]; // The position each sprite is indexed at
+  uint8_t x[MAX_SPRITES];
+  bool isStale; // OAM has been written by DMA, so the index is rebuilt before it is next used
+} LineSprites;
+
+
+struct ScanlineLayers;
+
+typedef void (*CompositeScanlineFn)(const struct ScanlineLayers* layers, const Pixel* palettePixels, Pixel* scanline);
+
 
 typedef struct {
   GameBoyType gameBoyType;
@@ -95,6 +133,25 @@ typedef struct {
   uint8_t* oam;
   Pixel* frameBuffer;
 
+  // Colour number (before the palette is applied) and BG-to-OAM priority of every pixel in the frame buffer
+  uint8_t pixelAttributes[LCD_WIDTH * LCD_HEIGHT];
+
+  // Palettes converted to frame buffer pixels, kept up to date by writes to the palette registers
+  Pixel palettePixels[PALETTE_PIXELS_COUNT];
+
+  CompositeScanlineFn compositeScanline;
+
+  LineSprites lineSprites;
+
+  // Frames that aren't drawn still have exactly the same timing, but leave the frame buffer as it is
+  uint32_t frameSkipInterval; // Draw every Nth frame, or only frames requested with lcdRequestFrame() if 0
+  uint32_t framesStarted;
+  bool frameIsRequested;
+  bool isDrawingFrame;
+
+  // Every line of every tile decoded into colour numbers, as stored and flipped horizontally - [bank][tile][x flip][line]
+  uint8_t tileCache[2][TILES_PER_BANK][2][8][8];
+
   uint16_t mode3Cycles;
   uint32_t clockCycles;
 
@@ -111,7 +168,14 @@ void initLCDController(LCDController* lcdController, InterruptController* interr
 uint8_t lcdReadByte(LCDController* lcdController, uint16_t address);
 void lcdWriteByte(LCDController* lcdController, uint16_t address, uint8_t value);
 
-void lcdUpdate(LCDController* lcdController, uint8_t cyclesExecuted);
+void lcdUpdate(LCDController* lcdController, uint32_t cyclesExecuted);
+uint32_t lcdCyclesUntilNextEvent(LCDController* lcdController);
 void lcdSpeedChange(LCDController* lcdController);
+void lcdTileDataWritten(LCDController* lcdController, uint16_t vramAddress);
+void lcdSetCompositor(LCDController* lcdController, LCDCompositor compositor);
+void lcdOAMWritten(LCDController* lcdController, uint8_t oamAddress);
+void lcdOAMWrittenByDMA(LCDController* lcdController);
+void lcdSetFrameSkip(LCDController* lcdController, uint32_t interval);
+void lcdRequestFrame(LCDController* lcdController);
 
 #endif // LCD_H_
@@ -0,0 +1,188 @@
+#include "lcdcompositor.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LCD_COMPOSITOR_X86
+#include <immintrin.h>
+#endif
+
+
+static void compositeScanlineScalar(const ScanlineLayers* layers, const Pixel* palettePixels, Pixel* scanline)
+{
+  for (int x = 0; x < LCD_WIDTH; x++) {
+    uint8_t bgAttributes = layers->bgAttributes[x];
+    bool bgColourIsZero = (bgAttributes & PIXEL_ATTR_BITS_COLOUR) == 0;
+    bool bgHasPriority = bgAttributes & PIXEL_ATTR_BITS_BG_PRIORITY;
+
+    // Sprites with the OBJ-to-BG priority bit set only show over background colour 0, other sprites also show over
+    // any background pixel without the BG-to-OAM priority bit set (and both show everywhere if master priority is off)
+    bool priorityObjVisible = (layers->objIndexes[1][x] != SCANLINE_LAYERS_NO_OBJ) && (bgColourIsZero || !layers->bgMasterPriority);
+    bool objVisible = (layers->objIndexes[0][x] != SCANLINE_LAYERS_NO_OBJ) && (bgColourIsZero || !layers->bgMasterPriority || !bgHasPriority);
+
+    uint8_t index = layers->bgIndexes[x];
+    if (objVisible && (!priorityObjVisible || layers->objRanks[0][x] < layers->objRanks[1][x])) {
+      index = layers->objIndexes[0][x];
+    } else if (priorityObjVisible) {
+      index = layers->objIndexes[1][x];
+    }
+
+    scanline[x] = palettePixels[index];
+  }
+}
+
+
+#ifdef LCD_COMPOSITOR_X86
+
+// The same rules as compositeScanlineScalar() applied to 16 pixels at a time, with a scalar palette lookup at the end
+__attribute__((target("sse2")))
+static void compositeScanlineSSE2(const ScanlineLayers* layers, const Pixel* palettePixels, Pixel* scanline)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i colourBits = _mm_set1_epi8(PIXEL_ATTR_BITS_COLOUR);
+  const __m128i priorityBit = _mm_set1_epi8((char)PIXEL_ATTR_BITS_BG_PRIORITY);
+  const __m128i masterPriorityOff = layers->bgMasterPriority ? zero : _mm_set1_epi8(-1);
+
+  uint8_t indexes[16];
+
+  for (int x = 0; x < LCD_WIDTH; x += 16) {
+    __m128i bgAttributes = _mm_loadu_si128((const __m128i*)&layers->bgAttributes[x]);
+    __m128i bgColourIsZero = _mm_cmpeq_epi8(_mm_and_si128(bgAttributes, colourBits), zero);
+    __m128i bgHasNoPriority = _mm_cmpeq_epi8(_mm_and_si128(bgAttributes, priorityBit), zero);
+
+    __m128i priorityObjAllowed = _mm_or_si128(bgColourIsZero, masterPriorityOff);
+    __m128i objAllowed = _mm_or_si128(priorityObjAllowed, bgHasNoPriority);
+
+    __m128i obj = _mm_loadu_si128((const __m128i*)&layers->objIndexes[0][x]);
+    __m128i priorityObj = _mm_loadu_si128((const __m128i*)&layers->objIndexes[1][x]);
+    __m128i objVisible = _mm_andnot_si128(_mm_cmpeq_epi8(obj, zero), objAllowed);
+    __m128i priorityObjVisible = _mm_andnot_si128(_mm_cmpeq_epi8(priorityObj, zero), priorityObjAllowed);
+
+    // Ranks are never equal where both layers have a sprite pixel
+    __m128i objRank = _mm_loadu_si128((const __m128i*)&layers->objRanks[0][x]);
+    __m128i priorityObjRank = _mm_loadu_si128((const __m128i*)&layers->objRanks[1][x]);
+    __m128i objRankIsLower = _mm_cmpeq_epi8(_mm_min_epu8(objRank, priorityObjRank), objRank);
+
+    __m128i useObj = _mm_andnot_si128(_mm_andnot_si128(objRankIsLower, priorityObjVisible), objVisible);
+    __m128i usePriorityObj = _mm_andnot_si128(useObj, priorityObjVisible);
+
+    __m128i index = _mm_loadu_si128((const __m128i*)&layers->bgIndexes[x]);
+    index = _mm_or_si128(_mm_and_si128(useObj, obj), _mm_andnot_si128(useObj, index));
+    index = _mm_or_si128(_mm_and_si128(usePriorityObj, priorityObj), _mm_andnot_si128(usePriorityObj, index));
+
+    _mm_storeu_si128((__m128i*)indexes, index);
+    for (int i = 0; i < 16; i++) {
+      scanline[x + i] = palettePixels[indexes[i]];
+    }
+  }
+}
+
+
+// 32 pixels at a time, with the palette lookup done by gathering 8 pixels at a time
+__attribute__((target("avx2")))
+static void compositeScanlineAVX2(const ScanlineLayers* layers, const Pixel* palettePixels, Pixel* scanline)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i colourBits = _mm256_set1_epi8(PIXEL_ATTR_BITS_COLOUR);
+  const __m256i priorityBit = _mm256_set1_epi8((char)PIXEL_ATTR_BITS_BG_PRIORITY);
+  const __m256i masterPriorityOff = layers->bgMasterPriority ? zero : _mm256_set1_epi8(-1);
+
+  for (int x = 0; x < LCD_WIDTH; x += 32) {
+    __m256i bgAttributes = _mm256_loadu_si256((const __m256i*)&layers->bgAttributes[x]);
+    __m256i bgColourIsZero = _mm256_cmpeq_epi8(_mm256_and_si256(bgAttributes, colourBits), zero);
+    __m256i bgHasNoPriority = _mm256_cmpeq_epi8(_mm256_and_si256(bgAttributes, priorityBit), zero);
+
+    __m256i priorityObjAllowed = _mm256_or_si256(bgColourIsZero, masterPriorityOff);
+    __m256i objAllowed = _mm256_or_si256(priorityObjAllowed, bgHasNoPriority);
+
+    __m256i obj = _mm256_loadu_si256((const __m256i*)&layers->objIndexes[0][x]);
+    __m256i priorityObj = _mm256_loadu_si256((const __m256i*)&layers->objIndexes[1][x]);
+    __m256i objVisible = _mm256_andnot_si256(_mm256_cmpeq_epi8(obj, zero), objAllowed);
+    __m256i priorityObjVisible = _mm256_andnot_si256(_mm256_cmpeq_epi8(priorityObj, zero), priorityObjAllowed);
+
+    __m256i objRank = _mm256_loadu_si256((const __m256i*)&layers->objRanks[0][x]);
+    __m256i priorityObjRank = _mm256_loadu_si256((const __m256i*)&layers->objRanks[1][x]);
+    __m256i objRankIsLower = _mm256_cmpeq_epi8(_mm256_min_epu8(objRank, priorityObjRank), objRank);
+
+    __m256i useObj = _mm256_andnot_si256(_mm256_andnot_si256(objRankIsLower, priorityObjVisible), objVisible);
+    __m256i usePriorityObj = _mm256_andnot_si256(useObj, priorityObjVisible);
+
+    __m256i index = _mm256_loadu_si256((const __m256i*)&layers->bgIndexes[x]);
+    index = _mm256_blendv_epi8(index, obj, useObj);
+    index = _mm256_blendv_epi8(index, priorityObj, usePriorityObj);
+
+    __m128i indexesLow = _mm256_castsi256_si128(index);
+    __m128i indexesHigh = _mm256_extracti128_si256(index, 1);
+    __m128i indexes[4] = {indexesLow, _mm_srli_si128(indexesLow, 8), indexesHigh, _mm_srli_si128(indexesHigh, 8)};
+
+    for (int i = 0; i < 4; i++) {
+      __m256i pixels = _mm256_i32gather_epi32((const int*)palettePixels, _mm256_cvtepu8_epi32(indexes[i]), sizeof(Pixel));
+      _mm256_storeu_si256((__m256i*)&scanline[x + (i * 8)], pixels);
+    }
+  }
+}
+
+#endif // LCD_COMPOSITOR_X86
+
+
+bool lcdCompositorIsSupported(LCDCompositor compositor)
+{
+  switch (compositor) {
+    case LCD_COMPOSITOR_SCALAR:
+      return true;
+#ifdef LCD_COMPOSITOR_X86
+    case LCD_COMPOSITOR_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+    case LCD_COMPOSITOR_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+
+LCDCompositor lcdCompositorBest()
+{
+  for (int compositor = LCD_COMPOSITOR_COUNT - 1; compositor > LCD_COMPOSITOR_SCALAR; compositor--) {
+    if (lcdCompositorIsSupported(compositor)) {
+      return compositor;
+    }
+  }
+  return LCD_COMPOSITOR_SCALAR;
+}
+
+
+// Falls back to the scalar compositor if the requested one isn't supported
+CompositeScanlineFn lcdCompositorFunction(LCDCompositor compositor)
+{
+  if (!lcdCompositorIsSupported(compositor)) {
+    return &compositeScanlineScalar;
+  }
+
+  switch (compositor) {
+#ifdef LCD_COMPOSITOR_X86
+    case LCD_COMPOSITOR_SSE2:
+      return &compositeScanlineSSE2;
+    case LCD_COMPOSITOR_AVX2:
+      return &compositeScanlineAVX2;
+#endif
+    default:
+      return &compositeScanlineScalar;
+  }
+}
+
+
+const char* lcdCompositorName(LCDCompositor compositor)
+{
+  switch (compositor) {
+    case LCD_COMPOSITOR_SCALAR:
+      return "scalar";
+    case LCD_COMPOSITOR_SSE2:
+      return "sse2";
+    case LCD_COMPOSITOR_AVX2:
+      return "avx2";
+    default:
+      return "unknown";
+  }
+}
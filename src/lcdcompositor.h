@@ -0,0 +1,33 @@
+#ifndef LCDCOMPOSITOR_H_
+#define LCDCOMPOSITOR_H_
+
+#include "lcd.h"
+#include "pixel.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Index into the controller's palettePixels of a pixel drawn by a sprite, or 0 if no sprite is drawn at that position
+// (sprite pixels always have indexes of PALETTE_PIXELS_OBJ or above)
+#define SCANLINE_LAYERS_NO_OBJ 0
+
+
+// The layers of a scanline before they are combined. Because whether a sprite pixel is drawn over the background
+// depends only on the background and the sprite's own OBJ-to-BG priority bit, sprites are kept in two layers split by
+// that bit, each holding the highest priority sprite pixel at every position.
+typedef struct ScanlineLayers {
+  uint8_t bgIndexes[LCD_WIDTH]; // Index into palettePixels of the background/window pixel
+  const uint8_t* bgAttributes; // Colour number and BG-to-OAM priority of the background/window pixel
+  uint8_t objIndexes[2][LCD_WIDTH]; // [OBJ-to-BG priority]
+  uint8_t objRanks[2][LCD_WIDTH]; // Priority of each sprite pixel - lower values are drawn over higher ones
+  bool bgMasterPriority; // Always set in non CGB mode
+} ScanlineLayers;
+
+
+bool lcdCompositorIsSupported(LCDCompositor compositor);
+LCDCompositor lcdCompositorBest();
+CompositeScanlineFn lcdCompositorFunction(LCDCompositor compositor);
+const char* lcdCompositorName(LCDCompositor compositor);
+
+#endif // LCDCOMPOSITOR_H_
@@ -1,80 +1,146 @@
 #include "lcdgl.h"
 
 #include "lcd.h"
+#include "logging.h"
 #include "pixel.h"
 
+#ifdef __APPLE__
 #include <GLUT/glut.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
 
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
-#define PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_VERTEX 2
-#define PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_COLOUR 3
 
-static float PIXEL_VERTICES[PIXEL_DATA_ARRAY_NUM_ELEMENTS * PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_VERTEX];
-static float PIXEL_COLOURS[PIXEL_DATA_ARRAY_NUM_ELEMENTS * PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_COLOUR];
+#define FRAME_BUFFER_SIZE_BYTES (LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel))
 
+// The frame buffer is drawn as a single textured quad covering the whole of the (0, 0) to (LCD_WIDTH, LCD_HEIGHT)
+// projection, with the first row of the texture at the top
+static const GLfloat QUAD_VERTICES[] = {0, 0, LCD_WIDTH, 0, LCD_WIDTH, LCD_HEIGHT, 0, LCD_HEIGHT};
+static const GLfloat QUAD_TEXTURE_COORDS[] = {0, 1, 1, 1, 1, 0, 0, 0};
 
-void lcdGLInitPixelVerticesArray()
-{
-  int i = 0;
-
-  for (int y = 0; y < LCD_HEIGHT; y++) {
-    for (int x = 0; x <= LCD_WIDTH; x++) {
-      PIXEL_VERTICES[i++] = x;
-      PIXEL_VERTICES[i++] = LCD_HEIGHT - y;
-      PIXEL_VERTICES[i++] = x;
-      PIXEL_VERTICES[i++] = LCD_HEIGHT - y - 1;
-    }
+static GLuint texture;
+
+// Frames are uploaded through two pixel buffer objects used in turn, so writing a new frame never has to wait for the
+// upload of the previous one to finish. Without pixel buffer objects (before OpenGL 2.1) frames are uploaded directly.
+static bool usePixelBuffers;
+static GLuint pixelBuffers[2];
+static int nextPixelBuffer;
 
-    // Degenerate triangles
-    PIXEL_VERTICES[i++] = LCD_WIDTH;
-    PIXEL_VERTICES[i++] = LCD_HEIGHT - y - 1;
-    PIXEL_VERTICES[i++] = 0;
-    PIXEL_VERTICES[i++] = LCD_HEIGHT - y - 1;
+
+static bool lcdGLSupportsPixelBuffers()
+{
+  int major = 0;
+  int minor = 0;
+  const char* version = (const char*)glGetString(GL_VERSION);
+  if (version != NULL && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 2 || (major == 2 && minor >= 1))) {
+    return true;
   }
+
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  return (extensions != NULL && strstr(extensions, "GL_ARB_pixel_buffer_object") != NULL);
 }
 
 
-void lcdGLInit()
+void lcdGLInit(LCDGLScalingFilter scalingFilter)
 {
   glClearColor(0.0, 0.0, 0.0, 0.0);
-  glEnable(GL_DEPTH_TEST);
-  glShadeModel(GL_FLAT);
+
+  // 160x144 is not a power of two, so this needs OpenGL 2.0 (or GL_ARB_texture_non_power_of_two)
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, LCD_WIDTH, LCD_HEIGHT, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glEnable(GL_TEXTURE_2D);
+
+  lcdGLSetScalingFilter(scalingFilter);
+
+  usePixelBuffers = false;
+  pixelBuffers[0] = 0;
+  pixelBuffers[1] = 0;
+  lcdGLSetPixelBufferUpload(true);
 
   glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  glVertexPointer(2, GL_FLOAT, 0, QUAD_VERTICES);
+  glTexCoordPointer(2, GL_FLOAT, 0, QUAD_TEXTURE_COORDS);
+}
 
-  glVertexPointer(2, GL_FLOAT, 0, PIXEL_VERTICES);
-  glColorPointer(3, GL_FLOAT, 0, PIXEL_COLOURS);
+
+void lcdGLSetScalingFilter(LCDGLScalingFilter scalingFilter)
+{
+  GLint filter = (scalingFilter == LCD_GL_SCALING_FILTER_LINEAR) ? GL_LINEAR : GL_NEAREST;
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 }
 
 
-static void lcdGLFillColourArray(Pixel* frameBuffer)
+// Frames are uploaded through pixel buffer objects whenever they are supported, but can be uploaded directly instead
+// (to compare the two). Returns false if pixel buffer objects were asked for but aren't supported.
+bool lcdGLSetPixelBufferUpload(bool enabled)
 {
-  // With GL_FLAT and GL_TRIANGLE_STRIP we don't need to set r, g, and b values for the first two
-  // colours of each line because only the last colour of each triangle determines the colour.
-  // TODO: Eliminate duplication of colour values
-  int i = 6;
-  for (int y = 0; y < LCD_HEIGHT; y++) {
-    for (int x = 0; x <= LCD_WIDTH; x++) {
-      Pixel pixel = frameBuffer[y * LCD_WIDTH + x];
-      PIXEL_COLOURS[i++] = pixel.r;
-      PIXEL_COLOURS[i++] = pixel.g;
-      PIXEL_COLOURS[i++] = pixel.b;
-      PIXEL_COLOURS[i++] = pixel.r;
-      PIXEL_COLOURS[i++] = pixel.g;
-      PIXEL_COLOURS[i++] = pixel.b;
+  const bool isSupported = !enabled || lcdGLSupportsPixelBuffers();
+
+  usePixelBuffers = enabled && isSupported;
+  if (usePixelBuffers && pixelBuffers[0] == 0) {
+    glGenBuffers(2, pixelBuffers);
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, FRAME_BUFFER_SIZE_BYTES, NULL, GL_STREAM_DRAW);
     }
-    i += 6; // Skip past the two degenerate triangles because the colour doesn't matter
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    nextPixelBuffer = 0;
   }
+  debug("LCD GL frame buffer upload: %s\n", usePixelBuffers ? "pixel buffer objects" : "direct");
+
+  return isSupported;
+}
+
+
+// Frame buffer pixels are 0xAARRGGBB words, which is GL_BGRA with GL_UNSIGNED_INT_8_8_8_8_REV on any host byte order
+// (and the format most drivers can copy without converting)
+static void lcdGLUploadFrameBuffer(const Pixel* frameBuffer)
+{
+  if (usePixelBuffers) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[nextPixelBuffer]);
+    nextPixelBuffer ^= 1;
+
+    // Orphan the buffer's previous storage rather than waiting for the driver to finish with it
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, FRAME_BUFFER_SIZE_BYTES, NULL, GL_STREAM_DRAW);
+    void* pixels = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (pixels != NULL) {
+      memcpy(pixels, frameBuffer, FRAME_BUFFER_SIZE_BYTES);
+      if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LCD_WIDTH, LCD_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+      }
+    }
+
+    // The buffer couldn't be mapped (or its contents were lost) so fall back to uploading this frame directly
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LCD_WIDTH, LCD_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, frameBuffer);
 }
 
 
-void lcdGLDrawScreen(Pixel* frameBuffer)
+void lcdGLDrawScreen(const Pixel* frameBuffer)
 {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClear(GL_COLOR_BUFFER_BIT);
   glLoadIdentity();
 
-  lcdGLFillColourArray(frameBuffer);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  lcdGLUploadFrameBuffer(frameBuffer);
 
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, PIXEL_DATA_ARRAY_NUM_ELEMENTS);
+  glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
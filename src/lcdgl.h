@@ -1,16 +1,21 @@
 #ifndef LCDGL_H_
 #define LCDGL_H_
 
-#define PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_LINE (((LCD_WIDTH + 1) * 2) + 2)
-// +1 for the final "fence post"
-// *2 to specify top and bottom vertices
-// +2 to add the extra vertices for the two degenerate triangles that allow us to jump to the next row (one on each side of the line at the same height)
+#include "pixel.h"
 
-#define PIXEL_DATA_ARRAY_NUM_ELEMENTS (PIXEL_DATA_ARRAY_NUM_ELEMENTS_PER_LINE * LCD_HEIGHT)
+#include <stdbool.h>
 
 
-void lcdGLInitPixelVerticesArray();
-void lcdGLInit();
-void lcdGLDrawScreen();
+// How the frame buffer texture is scaled up to the size of the window
+typedef enum LCDGLScalingFilter {
+  LCD_GL_SCALING_FILTER_NEAREST,
+  LCD_GL_SCALING_FILTER_LINEAR
+} LCDGLScalingFilter;
+
+
+void lcdGLInit(LCDGLScalingFilter scalingFilter);
+void lcdGLSetScalingFilter(LCDGLScalingFilter scalingFilter);
+bool lcdGLSetPixelBufferUpload(bool enabled);
+void lcdGLDrawScreen(const Pixel* frameBuffer);
 
 #endif // LCDGL_H_
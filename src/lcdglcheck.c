@@ -0,0 +1,196 @@
+// Draws frames through lcdgl in an offscreen OpenGL context and reads them back, to check both ways of uploading the
+// frame buffer without a window. With Mesa, LIBGL_ALWAYS_SOFTWARE=1 runs it on the software rasteriser.
+
+#include "lcd.h"
+#include "lcdgl.h"
+#include "logging.h"
+#include "pixel.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_FRAMES 4 // Enough for each of the two pixel buffer objects to be used twice
+
+#define RGB_MASK 0x00FFFFFF // The window has no alpha channel to read back
+
+
+static uint32_t nextRandom(uint32_t* state)
+{
+  // xorshift32
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+
+// Mesa's surfaceless platform needs no display server, so it's tried before the default display
+static EGLDisplay openDisplay()
+{
+  const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (clientExtensions != NULL && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != NULL) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) {
+      EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+      if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL)) {
+        return display;
+      }
+    }
+  }
+
+  EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL)) {
+    return display;
+  }
+  return EGL_NO_DISPLAY;
+}
+
+
+// A desktop OpenGL context drawing to an LCD_WIDTH x LCD_HEIGHT pbuffer, so every pixel of the screen is one texel
+static bool createContext(EGLDisplay display)
+{
+  const EGLint configAttributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  const EGLint surfaceAttributes[] = {EGL_WIDTH, LCD_WIDTH, EGL_HEIGHT, LCD_HEIGHT, EGL_NONE};
+
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs < 1) {
+    error("No EGL config for an OpenGL pbuffer\n");
+    return false;
+  }
+
+  EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+  if (surface == EGL_NO_SURFACE || !eglBindAPI(EGL_OPENGL_API)) {
+    error("Failed to create an OpenGL pbuffer (EGL error 0x%04X)\n", eglGetError());
+    return false;
+  }
+
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+    error("Failed to create an OpenGL context (EGL error 0x%04X)\n", eglGetError());
+    return false;
+  }
+
+  return true;
+}
+
+
+// The same viewport and projection as the frontend uses for its window
+static void setViewportAndProjection()
+{
+  glViewport(0, 0, LCD_WIDTH, LCD_HEIGHT);
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(0, LCD_WIDTH, 0, LCD_HEIGHT, -1, 1);
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+}
+
+
+// Draws random frames and checks that the texture holds exactly the frame buffer, and that the screen shows it the
+// right way up. Returns the number of frames that didn't match.
+static int checkUpload(const char* name, uint32_t* randomState)
+{
+  Pixel* frameBuffer = malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel));
+  Pixel* texels = malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel));
+  Pixel* screen = malloc(LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel));
+
+  if (frameBuffer == NULL || texels == NULL || screen == NULL) {
+    error("Failed to allocate memory for the frame buffers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int mismatchedFrames = 0;
+
+  for (int frame = 0; frame < CHECK_FRAMES; frame++) {
+    for (int i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+      frameBuffer[i] = (Pixel)nextRandom(randomState);
+    }
+
+    lcdGLDrawScreen(frameBuffer);
+    glFinish();
+
+    // lcdGLDrawScreen() leaves the frame buffer texture bound
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, texels);
+    glReadPixels(0, 0, LCD_WIDTH, LCD_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, screen);
+
+    int texelMismatches = 0;
+    int screenMismatches = 0;
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+      for (int x = 0; x < LCD_WIDTH; x++) {
+        const Pixel expected = frameBuffer[(y * LCD_WIDTH) + x];
+        texelMismatches += (texels[(y * LCD_WIDTH) + x] != expected);
+        screenMismatches += ((screen[((LCD_HEIGHT - 1 - y) * LCD_WIDTH) + x] & RGB_MASK) != (expected & RGB_MASK)); // Rows are read back from the bottom up
+      }
+    }
+
+    if (texelMismatches > 0 || screenMismatches > 0 || glGetError() != GL_NO_ERROR) {
+      error("%s frame %d has %d mismatched texels and %d mismatched screen pixels\n", name, frame, texelMismatches, screenMismatches);
+      mismatchedFrames++;
+    }
+  }
+
+  printf("%-24s%s\n", name, (mismatchedFrames == 0) ? "matches frame buffer" : "MISMATCHED");
+
+  free(screen);
+  free(texels);
+  free(frameBuffer);
+
+  return mismatchedFrames;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  EGLDisplay display = openDisplay();
+  if (display == EGL_NO_DISPLAY) {
+    error("Failed to open an EGL display\n");
+    return 1;
+  }
+
+  if (!createContext(display)) {
+    eglTerminate(display);
+    return 1;
+  }
+
+  printf("Renderer:               %s\n", (const char*)glGetString(GL_RENDERER));
+  printf("Version:                %s\n", (const char*)glGetString(GL_VERSION));
+
+  setViewportAndProjection();
+  lcdGLInit(LCD_GL_SCALING_FILTER_NEAREST);
+
+  uint32_t randomState = 0x1CD61;
+  int failures = 0;
+
+  if (lcdGLSetPixelBufferUpload(true)) {
+    failures += checkUpload("Pixel buffer upload:", &randomState);
+  } else {
+    printf("Pixel buffer upload:    not supported\n");
+  }
+
+  lcdGLSetPixelBufferUpload(false);
+  failures += checkUpload("Direct upload:", &randomState);
+
+  eglTerminate(display);
+
+  return (failures == 0) ? 0 : 1;
+}
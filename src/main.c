@@ -4,6 +4,7 @@
 #include "lcdgl.h"
 #include "logging.h"
 #include "pixel.h"
+#include "sound/audioratecontrol.h"
 #include "sound/coreaudio.h"
 #include "utils/os.h"
 
@@ -73,6 +74,69 @@ GameBoyType getGameBoyType(int argc, const char* argv[])
 }
 
 
+// The value following an option given after the ROM path, or NULL if the option isn't present
+static const char* getOptionValue(int argc, const char* argv[], const char* option)
+{
+  for (int i = 2; i < argc - 1; i++) {
+    if (strcmp(argv[i], option) == 0) {
+      return argv[i + 1];
+    }
+  }
+  return NULL;
+}
+
+
+// Every frame is drawn unless a "--frame-skip N" option asks for only every Nth one
+uint32_t getFrameSkipInterval(int argc, const char* argv[])
+{
+  const char* value = getOptionValue(argc, argv, "--frame-skip");
+  if (value != NULL && atoi(value) > 0) {
+    return atoi(value);
+  } else {
+    return 1;
+  }
+}
+
+
+LCDGLScalingFilter getScalingFilter(int argc, const char* argv[])
+{
+  const char* value = getOptionValue(argc, argv, "--filter");
+  if (value != NULL && strcmp(value, "linear") == 0) {
+    return LCD_GL_SCALING_FILTER_LINEAR;
+  } else {
+    return LCD_GL_SCALING_FILTER_NEAREST;
+  }
+}
+
+
+// Band-limited unless "--audio none|point|band-limited" asks for another synthesis
+SoundSynthesis getAudioSynthesis(int argc, const char* argv[])
+{
+  const char* value = getOptionValue(argc, argv, "--audio");
+  if (value != NULL) {
+    for (int i = 0; i < SOUND_SYNTHESIS_COUNT; i++) {
+      if (strcmp(value, soundSynthesisName(i)) == 0) {
+        return i;
+      }
+    }
+  }
+  return SOUND_SYNTHESIS_BAND_LIMITED;
+}
+
+
+// With "--dynamic-rate-control" video stays paced by the display while the audio output rate follows the fill level of
+// the audio sample buffer, so the buffer neither runs dry nor overflows when the two clocks drift apart
+bool getDynamicRateControl(int argc, const char* argv[])
+{
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--dynamic-rate-control") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
 static void errorCallback(int errorCode, const char* description)
 {
   error("GLFW error: %s (%d)\n", description, errorCode);
@@ -119,25 +183,25 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
     }
     case GLFW_KEY_1: { // Toggle sound channel 1
       if (action == 1) {
-        gameBoy->soundController.channel1Master = !gameBoy->soundController.channel1Master;
+        soundSetChannelMaster(&gameBoy->soundController, 1, !gameBoy->soundController.channel1Master);
       }
       break;
     }
     case GLFW_KEY_2: { // Toggle sound channel 2
       if (action == 1) {
-        gameBoy->soundController.channel2Master = !gameBoy->soundController.channel2Master;
+        soundSetChannelMaster(&gameBoy->soundController, 2, !gameBoy->soundController.channel2Master);
       }
       break;
     }
     case GLFW_KEY_3: { // Toggle sound channel 3
       if (action == 1) {
-        gameBoy->soundController.channel3Master = !gameBoy->soundController.channel3Master;
+        soundSetChannelMaster(&gameBoy->soundController, 3, !gameBoy->soundController.channel3Master);
       }
       break;
     }
     case GLFW_KEY_4: { // Toggle sound channel 4
       if (action == 1) {
-        gameBoy->soundController.channel4Master = !gameBoy->soundController.channel4Master;
+        soundSetChannelMaster(&gameBoy->soundController, 4, !gameBoy->soundController.channel4Master);
       }
       break;
     }
@@ -148,7 +212,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 int main(int argc, const char* argv[])
 {
   if (argc < 2) {
-    printf("Usage: %s PATH_TO_ROM\n", argv[0]);
+    printf("Usage: %s PATH_TO_ROM [--gb|--cgb] [--frame-skip N] [--filter nearest|linear] [--audio none|point|band-limited] [--dynamic-rate-control]\n", argv[0]);
     return 1;
   }
 
@@ -161,17 +225,25 @@ int main(int argc, const char* argv[])
   AudioSampleBuffer audioSampleBuffer;
 
   // Load all cartridge data
-  uint8_t* cartridgeData = cartridgeLoadData(argv[1]);
-  if (cartridgeData == NULL) {
+  CartridgeROM* rom = cartridgeOpenROM(argv[1]);
+  if (rom == NULL) {
     error("Failed to read cartridge from '%s'\n", argv[1]);
     exit(EXIT_FAILURE);
   }
 
-  sampleBufferInitialise(&audioSampleBuffer, 512 * 10); // CoreAudio requests buffers of 512 samples, so ten times that
+  sampleBufferInitialise(&audioSampleBuffer, 512 * 10); // CoreAudio requests buffers of 512 samples, so ten times that (rounded up to 8192)
+
+  gbInitialise(&gameBoy, gameBoyType, rom->data, frameBuffer, romFilename);
+  gbSetFrameSkip(&gameBoy, getFrameSkipInterval(argc, argv));
+  gbSetAudioSynthesis(&gameBoy, getAudioSynthesis(argc, argv));
 
-  gbInitialise(&gameBoy, gameBoyType, cartridgeData, frameBuffer, romFilename);
+  // Playback waits for the buffer to fill to the rate control's target before it starts (and again after running dry),
+  // leaving room to absorb the difference between the display and audio clocks
+  const bool dynamicRateControl = getDynamicRateControl(argc, argv);
+  AudioRateControl audioRateControl;
+  audioRateControlInitialise(&audioRateControl, AUDIO_RATE_CONTROL_DEFAULT_TARGET_SAMPLES, AUDIO_RATE_CONTROL_DEFAULT_MAX_DEVIATION);
 
-  struct GBAudioContext* audioContext = initCoreAudioPlayback(&audioSampleBuffer);
+  struct GBAudioContext* audioContext = initCoreAudioPlayback(&audioSampleBuffer, dynamicRateControl ? AUDIO_RATE_CONTROL_DEFAULT_TARGET_SAMPLES : 0);
 
   glfwSetErrorCallback(errorCallback);
 
@@ -229,8 +301,7 @@ int main(int argc, const char* argv[])
 
   setViewportAndProjection(window, windowWidth, windowHeight);
 
-  lcdGLInit();
-  lcdGLInitPixelVerticesArray();
+  lcdGLInit(getScalingFilter(argc, argv));
 
   // GB display updates at ~59.7 frames per second, however as we're scheduling the emulator with the display of the
   // device it's running on we may have to run greater or fewer cycles per video frame than the value of
@@ -245,11 +316,21 @@ int main(int argc, const char* argv[])
   debug("GB cycles/video frame: %d\n", cyclesPerVideoFrame);
 
   int cyclesToRun = cyclesPerVideoFrame;
+  uint32_t videoFrames = 0;
   while (!glfwWindowShouldClose(window)) {
     int cyclesRun = gbRunAtLeastNCycles(&gameBoy, &audioSampleBuffer, cyclesToRun);
     int extraCycles = cyclesRun - cyclesToRun;
     cyclesToRun = cyclesPerVideoFrame - extraCycles;
 
+    if (dynamicRateControl) {
+      GameBoyStats stats = gbGetStats(&gameBoy);
+      gbSetAudioRateRatio(&gameBoy, audioRateControlUpdate(&audioRateControl, stats.audioSamplesBuffered));
+
+      if (++videoFrames % (uint32_t)round(refreshPeriod * 10) == 0) {
+        debug("Audio buffer fill: %u samples, rate ratio: %.5f\n", stats.audioSamplesBuffered, stats.audioRateRatio);
+      }
+    }
+
     lcdGLDrawScreen(frameBuffer);
 
     glfwSwapBuffers(window);
@@ -264,7 +345,7 @@ int main(int argc, const char* argv[])
   free((void*)audioContext);
   free((void*)windowTitle);
   free((void*)romFilename);
-  free(cartridgeData);
+  cartridgeCloseROM(rom);
 
   return 0;
 }
@@ -7,6 +7,7 @@
 #include "cartridge-types/romonly.h"
 #include "hdmatransfer.h"
 #include "logging.h"
+#include "scheduler.h"
 #include "speedcontroller.h"
 #include "timer.h"
 
@@ -26,6 +27,60 @@ const HDMATransfer HDMA_TRANSFER_DEFAULT =
 };
 
 
+// Regions are always mapped as a whole, so if the first page already points at the same memory the rest do too
+void memoryMapPages(MemoryController* memoryController, uint16_t address, uint32_t length, uint8_t* readMemory, uint8_t* writeMemory)
+{
+  uint8_t firstPage = address / MEMORY_PAGE_SIZE;
+  if (memoryController->readPages[firstPage] == readMemory && memoryController->writePages[firstPage] == writeMemory) {
+    return;
+  }
+
+  for (uint32_t offset = 0; offset < length; offset += MEMORY_PAGE_SIZE) {
+    uint8_t page = (address + offset) / MEMORY_PAGE_SIZE;
+    memoryController->readPages[page] = (readMemory != NULL) ? (readMemory + offset) : NULL;
+    memoryController->writePages[page] = (writeMemory != NULL) ? (writeMemory + offset) : NULL;
+  }
+}
+
+
+// Pages of A000-BFFF past the end of the external RAM are left to the MBC, which asserts on them
+void memoryMapExternalRAM(MemoryController* memoryController, uint8_t* externalRAM, uint32_t externalRAMSize, uint32_t bankOffset, bool readable, bool writable)
+{
+  for (uint32_t offset = 0; offset < 8 * 1024; offset += MEMORY_PAGE_SIZE) {
+    uint8_t page = (0xA000 + offset) / MEMORY_PAGE_SIZE;
+    bool isMapped = (externalRAM != NULL) && (bankOffset + offset + MEMORY_PAGE_SIZE <= externalRAMSize);
+    memoryController->readPages[page] = (isMapped && readable) ? (externalRAM + bankOffset + offset) : NULL;
+    memoryController->writePages[page] = (isMapped && writable) ? (externalRAM + bankOffset + offset) : NULL;
+  }
+}
+
+
+// VRAM can't be accessed while the LCD controller is reading from it in mode 3, so this has to be called whenever the
+// LCD mode or the VRAM bank changes. Writes to tile data always go through vramWriteByte() to keep the LCD controller's
+// decoded tiles up to date.
+void memoryUpdateVideoPages(MemoryController* memoryController)
+{
+  uint8_t* tileData = NULL;
+  uint8_t* tileMaps = NULL;
+  if ((memoryController->lcdController->stat & STAT_MODE_FLAG_BITS) != 3) {
+    uint16_t bankOffset = (memoryController->cgbMode == COLOUR) ? (memoryController->lcdController->vbk * 8 * 1024) : 0;
+    tileData = memoryController->vram + bankOffset;
+    tileMaps = tileData + TILE_DATA_SIZE;
+  }
+  memoryMapPages(memoryController, 0x8000, TILE_DATA_SIZE, tileData, NULL);
+  memoryMapPages(memoryController, 0x8000 + TILE_DATA_SIZE, (8 * 1024) - TILE_DATA_SIZE, tileMaps, tileMaps);
+}
+
+
+static void updateWorkRAMPages(MemoryController* memoryController)
+{
+  uint8_t* bank = memoryController->wram + ((memoryController->cgbMode == COLOUR) ? (memoryController->svbk * 4 * 1024) : 0x1000);
+  memoryMapPages(memoryController, 0xC000, 4 * 1024, memoryController->wram, memoryController->wram);
+  memoryMapPages(memoryController, 0xD000, 4 * 1024, bank, bank);
+  memoryMapPages(memoryController, 0xE000, 0xFE00 - 0xE000, memoryController->wram, memoryController->wram); // Echo
+}
+
+
 MemoryController InitMemoryController(
   uint8_t cartridgeType,
   uint8_t* vram,
@@ -40,6 +95,7 @@ MemoryController InitMemoryController(
   TimerController* timerController,
   InterruptController* interruptController,
   SpeedController* speedController,
+  Scheduler* scheduler,
   uint32_t externalRAMSizeBytes,
   const char* romFilename
 )
@@ -61,6 +117,10 @@ MemoryController InitMemoryController(
     0,
     HDMA_TRANSFER_DEFAULT,
     1, // SVBK should be initialised to 1 because writes of 0 are always translated to 1
+    0,
+    0,
+    NULL,
+    NULL,
     NULL,
     NULL,
     NULL,
@@ -71,7 +131,8 @@ MemoryController InitMemoryController(
     soundController,
     timerController,
     interruptController,
-    speedController
+    speedController,
+    scheduler
   };
 
   switch (cartridgeType) {
@@ -149,40 +210,132 @@ MemoryController InitMemoryController(
       break;
   }
 
+  // The MBCs map the cartridge pages themselves
+  memoryUpdateVideoPages(&memoryController);
+  updateWorkRAMPages(&memoryController);
+
   return memoryController;
 }
 
 
+void FinaliseMemoryController(MemoryController* memoryController)
+{
+  if (memoryController->finaliseImpl != NULL) {
+    memoryController->finaliseImpl(memoryController);
+  }
+}
+
+
+// The sound registers and wave pattern RAM (0xFF10 - 0xFF3F) belong to the sound domain, and nothing else in the I/O
+// range affects it
+static bool isSoundAddress(uint16_t address)
+{
+  return (address >= IO_REG_ADDRESS_NR10 && address <= IO_REG_ADDRESS_WAVE_PATTERN_RAM_END);
+}
+
+
+// DIV and TIMA are the only registers that change without being an event of their own. They are worked out from the
+// cycles since the timer was last updated when they are read, and the reads are counted for the idle loop detection.
+// The sound controller is only ever brought up to date when it is next needed, so it is caught up before any of its
+// registers are read.
+static void syncBeforeRead(MemoryController* memoryController, uint16_t address)
+{
+  if (address == IO_REG_ADDRESS_DIV || address == IO_REG_ADDRESS_TIMA) {
+    memoryController->timerReadCount++;
+  } else if (isSoundAddress(address)) {
+    schedulerSyncDomain(memoryController->scheduler, SCHEDULER_DOMAIN_SOUND);
+  }
+}
+
+
 uint8_t readByte(MemoryController* memoryController, uint16_t address)
 {
+  uint8_t* page = memoryController->readPages[address / MEMORY_PAGE_SIZE];
+  if (page != NULL && !memoryController->dmaIsActive) {
+    return page[address % MEMORY_PAGE_SIZE];
+  }
+
   if (memoryController->dmaIsActive && (address < 0xFF80 || address > 0xFFFE)) {
     critical("Read from non-HRAM address 0x%04X while DMA is active.\n", address);
     exit(EXIT_FAILURE);
   }
+  if (address >= 0xFF80 && address <= 0xFFFE) { // HRAM shares its page with the I/O registers
+    return memoryController->hram[address - 0xFF80];
+  }
+  syncBeforeRead(memoryController, address);
   return memoryController->readByteImpl(memoryController, address);
 }
 
 
 uint16_t readWord(MemoryController* memoryController, uint16_t address)
 {
+  uint16_t nextAddress = address + 1;
+  uint8_t* lsPage = memoryController->readPages[address / MEMORY_PAGE_SIZE];
+  uint8_t* msPage = memoryController->readPages[nextAddress / MEMORY_PAGE_SIZE];
+  if (lsPage != NULL && msPage != NULL) {
+    return (msPage[nextAddress % MEMORY_PAGE_SIZE] << 8) | lsPage[address % MEMORY_PAGE_SIZE];
+  }
+
+  syncBeforeRead(memoryController, address);
+  syncBeforeRead(memoryController, address + 1);
   uint8_t lsByte = memoryController->readByteImpl(memoryController, address);
   uint8_t msByte = memoryController->readByteImpl(memoryController, address + 1);
   return (msByte << 8) | lsByte;
 }
 
 
+// Writes to I/O registers and cartridge hardware (MBC registers, RTC registers etc.) can change when the next event
+// of a component is due, so the domain written to has to be brought up to date before the write happens.
+static void syncBeforeWrite(MemoryController* memoryController, uint16_t address)
+{
+  bool isIOWrite = (address >= 0xFF00 && address <= 0xFF7F);
+  bool isCartridgeWrite = (address < 0x8000 || (address >= 0xA000 && address <= 0xBFFF)) && (memoryController->cartridgeUpdateImpl != NULL);
+  if (isIOWrite && isSoundAddress(address)) {
+    schedulerSyncAndRescheduleDomain(memoryController->scheduler, SCHEDULER_DOMAIN_SOUND);
+  } else if (isIOWrite || isCartridgeWrite) {
+    schedulerSyncAndRescheduleDomain(memoryController->scheduler, SCHEDULER_DOMAIN_SYSTEM);
+  }
+}
+
+
 void writeByte(MemoryController* memoryController, uint16_t address, uint8_t value)
 {
+  uint8_t* page = memoryController->writePages[address / MEMORY_PAGE_SIZE];
+  if (page != NULL && !memoryController->dmaIsActive) {
+    memoryController->writeCount++;
+    page[address % MEMORY_PAGE_SIZE] = value;
+    return;
+  }
+
   if (memoryController->dmaIsActive && (address < 0xFF80 || address > 0xFFFE)) {
     critical("Write of value 0x%02X to non-HRAM address 0x%04X while DMA is active.\n", value, address);
     exit(EXIT_FAILURE);
   }
+  memoryController->writeCount++;
+  if (address >= 0xFF80 && address <= 0xFFFE) { // HRAM shares its page with the I/O registers
+    memoryController->hram[address - 0xFF80] = value;
+    return;
+  }
+  syncBeforeWrite(memoryController, address);
   memoryController->writeByteImpl(memoryController, address, value);
 }
 
 
 void writeWord(MemoryController* memoryController, uint16_t address, uint16_t value)
 {
+  uint16_t nextAddress = address + 1;
+  uint8_t* lsPage = memoryController->writePages[address / MEMORY_PAGE_SIZE];
+  uint8_t* msPage = memoryController->writePages[nextAddress / MEMORY_PAGE_SIZE];
+  if (lsPage != NULL && msPage != NULL) {
+    memoryController->writeCount++;
+    lsPage[address % MEMORY_PAGE_SIZE] = value & 0x00FF;
+    msPage[nextAddress % MEMORY_PAGE_SIZE] = (value & 0xFF00) >> 8;
+    return;
+  }
+
+  syncBeforeWrite(memoryController, address);
+  syncBeforeWrite(memoryController, address + 1);
+  memoryController->writeCount++;
   memoryController->writeByteImpl(memoryController, address, value & 0x00FF);
   memoryController->writeByteImpl(memoryController, address + 1, (value & 0xFF00) >> 8);
 }
@@ -286,7 +439,7 @@ uint8_t commonReadByte(MemoryController* memoryController, uint16_t address)
     if (address == IO_REG_ADDRESS_P1) { // 0xFF00
       return joypadReadByte(memoryController->joypadController, address);
     } else if (address >= IO_REG_ADDRESS_DIV && address <= IO_REG_ADDRESS_TAC) { // 0xFF04 - 0xFF07
-      return timerReadByte(memoryController->timerController, address);
+      return timerReadByte(memoryController->timerController, address, schedulerCyclesSinceUpdate(memoryController->scheduler, SCHEDULER_DOMAIN_SYSTEM));
     } else if (address == IO_REG_ADDRESS_IF) { // 0xFF0F
       return interruptReadByte(memoryController->interruptController, address);
     } else if (address == 0xFF1A) {
@@ -330,8 +483,14 @@ void vramWriteByte(MemoryController* memoryController, uint16_t address, uint8_t
     if (memoryController->cgbMode == COLOUR) {
       uint16_t bankOffset = (memoryController->lcdController->vbk * 8 * 1024);
       memoryController->vram[bankOffset + address - 0x8000] = value;
+      if (address < 0x8000 + TILE_DATA_SIZE) {
+        lcdTileDataWritten(memoryController->lcdController, bankOffset + address - 0x8000);
+      }
     } else {
       memoryController->vram[address - 0x8000] = value;
+      if (address < 0x8000 + TILE_DATA_SIZE) {
+        lcdTileDataWritten(memoryController->lcdController, address - 0x8000);
+      }
     }
   } else {
     warning("Invalid write of value 0x%02X to VRAM address 0x%04X while LCD is in Mode %u\n", value, address, lcdMode);
@@ -361,6 +520,7 @@ void oamWriteByte(MemoryController* memoryController, uint16_t address, uint8_t
   uint8_t lcdMode = memoryController->lcdController->stat & STAT_MODE_FLAG_BITS;
   if (lcdMode == 0 || lcdMode == 1) { // LCD Controller is in HBLANK or VBLANK so write access is okay
     memoryController->oam[address - 0xFE00] = value;
+    lcdOAMWritten(memoryController->lcdController, address - 0xFE00);
   } else {
     warning("Invalid write of value 0x%02X to OAM address 0x%04X while LCD is in Mode %u\n", value, address, lcdMode);
   }
@@ -418,6 +578,7 @@ void svbkWriteByte(MemoryController* memoryController, uint16_t address, uint8_t
   } else {
     memoryController->svbk = (value & 7);
   }
+  updateWorkRAMPages(memoryController);
 }
 
 
@@ -455,6 +616,7 @@ void commonWriteByte(MemoryController* memoryController, uint16_t address, uint8
                (address >= IO_REG_ADDRESS_BCPS && address <= IO_REG_ADDRESS_OCPD) ||  // 0xFF68 - 0xFF6B
                (address == IO_REG_ADDRESS_VBK)) {                                     // 0xFF4F
       lcdWriteByte(memoryController->lcdController, address, value);
+      memoryUpdateVideoPages(memoryController);
     } else if (address == IO_REG_ADDRESS_KEY1) { // 0xFF4D
       speedWriteByte(memoryController->speedController, address, value);
     } else if (address >= IO_REG_ADDRESS_HDMA1 && address <= IO_REG_ADDRESS_HDMA5) { // 0xFF51 - 0xFF55
@@ -474,7 +636,7 @@ void commonWriteByte(MemoryController* memoryController, uint16_t address, uint8
 }
 
 
-void cartridgeUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
+void cartridgeUpdate(MemoryController* memoryController, uint32_t cyclesExecuted)
 {
   if (memoryController->cartridgeUpdateImpl != NULL) {
     memoryController->cartridgeUpdateImpl(memoryController, cyclesExecuted);
@@ -482,7 +644,7 @@ void cartridgeUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
 }
 
 
-void dmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
+void dmaUpdate(MemoryController* memoryController, uint32_t cyclesExecuted)
 {
   if (memoryController->dmaIsActive) {
     memoryController->dmaUpdateCycles += cyclesExecuted;
@@ -494,6 +656,7 @@ void dmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
       // Memory can be transferred from ROM or RAM, so we need to use the MBC readByte() implementations instead of the "public" CPU methods to handle ROM and/or RAM banking.
       uint8_t value = memoryController->readByteImpl(memoryController, sourceAddress);
       memoryController->oam[destinationAddress - 0xFE00] = value;
+      lcdOAMWrittenByDMA(memoryController->lcdController);
 
       if ((destinationAddress + 1) < 0xFEA0) {
         memoryController->dmaNextAddress++;
@@ -507,14 +670,14 @@ void dmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
 }
 
 
-void hdmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
+void hdmaUpdate(MemoryController* memoryController, uint32_t cyclesExecuted)
 {
   HDMATransfer* transfer = &memoryController->hdmaTransfer;
 
   if (transfer->isActive) {
     if (transfer->type == GENERAL) {
       bool isDoubleSpeed = memoryController->speedController->key1 & (1 << 7);
-      uint8_t numBytesToCopy = 2 * ((isDoubleSpeed) ? (cyclesExecuted / 2) : cyclesExecuted); // 2 bytes per usec
+      uint32_t numBytesToCopy = 2 * ((isDoubleSpeed) ? (cyclesExecuted / 2) : cyclesExecuted); // 2 bytes per usec
 
       for (int i = 0; i < numBytesToCopy && transfer->length > 0; i++, transfer->length--) {
         writeByte(memoryController, transfer->nextDestinationAddr++, readByte(memoryController, transfer->nextSourceAddr++));
@@ -533,6 +696,47 @@ void hdmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted)
 }
 
 
+uint32_t cartridgeCyclesUntilNextEvent(MemoryController* memoryController)
+{
+  if (memoryController->cartridgeCyclesUntilNextEventImpl != NULL) {
+    return memoryController->cartridgeCyclesUntilNextEventImpl(memoryController);
+  }
+  return SCHEDULER_NO_EVENT;
+}
+
+
+uint32_t dmaCyclesUntilNextEvent(MemoryController* memoryController)
+{
+  if (!memoryController->dmaIsActive) {
+    return SCHEDULER_NO_EVENT;
+  }
+
+  // The end of the transfer, after which the CPU can access memory outside of HRAM again
+  uint32_t transferCycles = 4 * (0xA0 - (memoryController->dmaNextAddress & 0x00FF));
+  return (memoryController->dmaUpdateCycles < transferCycles) ? (transferCycles - memoryController->dmaUpdateCycles) : 0;
+}
+
+
+uint32_t hdmaCyclesUntilNextEvent(MemoryController* memoryController)
+{
+  HDMATransfer* transfer = &memoryController->hdmaTransfer;
+
+  if (!transfer->isActive) {
+    return SCHEDULER_NO_EVENT;
+  }
+
+  // Transfers copy on every update while they can run, and an HBLANK transfer can only start running at an LCD mode
+  // change, which is already an event
+  if (transfer->type == GENERAL) {
+    return 0;
+  } else if (((memoryController->lcdController->stat & 3) == 0) && (memoryController->lcdController->ly <= 143)) {
+    return 0;
+  } else {
+    return SCHEDULER_NO_EVENT;
+  }
+}
+
+
 bool generalPurposeDMAIsActive(MemoryController* memoryController)
 {
   return (memoryController->hdmaTransfer.isActive) && (memoryController->hdmaTransfer.type == GENERAL);
@@ -33,9 +33,11 @@ MemoryController InitMemoryController(
   TimerController* timerController,
   InterruptController* interruptController,
   SpeedController* speedController,
+  Scheduler* scheduler,
   uint32_t externalRAMSizeBytes,
   const char* romFilename
 );
+void FinaliseMemoryController(MemoryController* memoryController);
 
 
 uint8_t readByte(MemoryController* memoryController, uint16_t address);
@@ -46,10 +48,18 @@ void writeWord(MemoryController* memoryController, uint16_t address, uint16_t va
 uint8_t commonReadByte(MemoryController* memoryController, uint16_t address);
 void commonWriteByte(MemoryController* memoryController, uint16_t address, uint8_t value);
 
-void cartridgeUpdate(MemoryController* memoryController, uint8_t cyclesExecuted);
-void dmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted);
-void hdmaUpdate(MemoryController* memoryController, uint8_t cyclesExecuted);
+void cartridgeUpdate(MemoryController* memoryController, uint32_t cyclesExecuted);
+void dmaUpdate(MemoryController* memoryController, uint32_t cyclesExecuted);
+void hdmaUpdate(MemoryController* memoryController, uint32_t cyclesExecuted);
+
+uint32_t cartridgeCyclesUntilNextEvent(MemoryController* memoryController);
+uint32_t dmaCyclesUntilNextEvent(MemoryController* memoryController);
+uint32_t hdmaCyclesUntilNextEvent(MemoryController* memoryController);
 
 bool generalPurposeDMAIsActive(MemoryController* memoryController);
 
+void memoryMapPages(MemoryController* memoryController, uint16_t address, uint32_t length, uint8_t* readMemory, uint8_t* writeMemory);
+void memoryMapExternalRAM(MemoryController* memoryController, uint8_t* externalRAM, uint32_t externalRAMSize, uint32_t bankOffset, bool readable, bool writable);
+void memoryUpdateVideoPages(MemoryController* memoryController);
+
 #endif // MEMORY_H_
@@ -6,6 +6,7 @@
 #include "interrupts.h"
 #include "joypad.h"
 #include "lcd.h"
+#include "scheduler.h"
 #include "sound/soundcontroller.h"
 #include "speedcontroller.h"
 #include "timercontroller.h"
@@ -16,6 +17,9 @@
 
 #define IO_REG_ADDRESS_SVBK 0xFF70
 
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGE_COUNT (64 * 1024 / MEMORY_PAGE_SIZE)
+
 
 typedef struct MemoryController MemoryController;
 
@@ -29,7 +33,7 @@ struct MemoryController {
 
   uint8_t dma; // FF46 - DMA - DMA Transfer and Start Address (W)
   bool dmaIsActive;
-  uint8_t dmaUpdateCycles;
+  uint32_t dmaUpdateCycles;
   uint16_t dmaNextAddress;
 
   uint8_t hdma1; // FF51 - HDMA1 - New DMA Source, High - CGB Mode Only
@@ -42,9 +46,14 @@ struct MemoryController {
 
   uint8_t svbk; // FF70 - SVBK - WRAM Bank - CGB Mode Only (R/W)
 
+  uint32_t writeCount; // Writes through writeByte()/writeWord(), used to detect loops that don't change memory
+  uint32_t timerReadCount; // Reads of DIV and TIMA, which change without an event
+
   uint8_t (*readByteImpl)(MemoryController* memoryController, uint16_t address);
   void (*writeByteImpl)(MemoryController* memoryController, uint16_t address, uint8_t value);
   void (*cartridgeUpdateImpl)(MemoryController* memoryController, uint32_t cyclesExecuted);
+  uint32_t (*cartridgeCyclesUntilNextEventImpl)(MemoryController* memoryController);
+  void (*finaliseImpl)(MemoryController* memoryController);
 
   void* mbc;
 
@@ -55,6 +64,12 @@ struct MemoryController {
   TimerController* timerController;
   InterruptController* interruptController;
   SpeedController* speedController;
+  Scheduler* scheduler;
+
+  // Host memory behind each page of the address space for the pages that can currently be read or written directly,
+  // updated whenever a bank or the LCD mode changes. NULL pages go through readByteImpl()/writeByteImpl().
+  uint8_t* readPages[MEMORY_PAGE_COUNT];
+  uint8_t* writePages[MEMORY_PAGE_COUNT];
 };
 
 #endif // MEMORYCONTROLLER_H_
@@ -1,16 +1,17 @@
 #ifndef PIXEL_H_
 #define PIXEL_H_
 
-#include <stdbool.h>
 #include <stdint.h>
 
 
-typedef struct {
-  uint8_t colour;
-  bool bgPriority;
-  float r;
-  float g;
-  float b;
-} Pixel;
+// Frame buffer pixels are packed XRGB8888 (the unused top byte is always 0xFF), so each one can be written with a
+// single store and the frame buffer can be handed to the display as it is
+typedef uint32_t Pixel;
+
+#define PIXEL_RGB(r, g, b) ((Pixel)(0xFF000000 | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b)))
+
+#define PIXEL_RED(pixel) (((pixel) >> 16) & 0xFF)
+#define PIXEL_GREEN(pixel) (((pixel) >> 8) & 0xFF)
+#define PIXEL_BLUE(pixel) ((pixel) & 0xFF)
 
 #endif // PIXEL_H_
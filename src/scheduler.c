@@ -0,0 +1,218 @@
+#include "scheduler.h"
+
+#include "lcd.h"
+#include "memory.h"
+#include "timer.h"
+#include "sound/soundcontroller.h"
+
+
+void initScheduler(Scheduler* scheduler, struct MemoryController* memoryController)
+{
+  scheduler->cycles = 0;
+  scheduler->nextEventCycles = 0; // Components are always updated after the first instruction
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    scheduler->updatedCycles[i] = 0;
+    scheduler->domainEventCycles[i] = 0;
+  }
+  for (int i = 0; i < SCHEDULER_EVENT_COUNT; i++) {
+    scheduler->eventCycles[i] = 0;
+  }
+
+  scheduler->lastVisibleEventCycles = 0;
+
+  scheduler->memoryController = memoryController;
+}
+
+
+static uint8_t getSpeedMultiplier(Scheduler* scheduler)
+{
+  // Most components are driven by cycles of the base (normal speed) clock, which runs at half the rate of the CPU
+  // clock in the CGB's double speed mode
+  return (scheduler->memoryController->speedController->key1 & (1 << 7)) ? 2 : 1;
+}
+
+
+static void updateDomain(Scheduler* scheduler, SchedulerDomain domain, uint32_t cpuCyclesExecuted, uint32_t baseCyclesExecuted)
+{
+  MemoryController* memoryController = scheduler->memoryController;
+
+  switch (domain) {
+    case SCHEDULER_DOMAIN_SYSTEM:
+      cartridgeUpdate(memoryController, baseCyclesExecuted);
+      dmaUpdate(memoryController, cpuCyclesExecuted); // Not using speed adjusted cycles because the DMA transfer runs twice as fast in double speed mode
+      hdmaUpdate(memoryController, baseCyclesExecuted);
+      timerUpdate(memoryController->timerController, cpuCyclesExecuted); // Not using speed adjusted cycles because the divider and timer run twice as fast in double speed mode
+      lcdUpdate(memoryController->lcdController, baseCyclesExecuted);
+      memoryUpdateVideoPages(memoryController); // The LCD mode may have changed
+      break;
+    case SCHEDULER_DOMAIN_SOUND:
+      soundUpdate(memoryController->soundController, baseCyclesExecuted);
+      break;
+    default:
+      break;
+  }
+}
+
+
+// Update a domain with any cycles it hasn't seen yet. Because none of its events fall in this period, updating it in
+// one go is equivalent to having updated it after each instruction.
+static void catchUp(Scheduler* scheduler, SchedulerDomain domain, uint64_t cycles)
+{
+  uint32_t pendingCycles = cycles - scheduler->updatedCycles[domain];
+  if (pendingCycles > 0) {
+    scheduler->updatedCycles[domain] = cycles; // Set first so that any reads made by the components themselves don't update them again
+    updateDomain(scheduler, domain, pendingCycles, pendingCycles / getSpeedMultiplier(scheduler));
+  }
+}
+
+
+static uint64_t getEventCycles(Scheduler* scheduler, SchedulerDomain domain, uint32_t cyclesUntilEvent, uint8_t multiplier)
+{
+  if (cyclesUntilEvent == SCHEDULER_NO_EVENT) {
+    return UINT64_MAX;
+  }
+  return scheduler->updatedCycles[domain] + ((uint64_t)cyclesUntilEvent * multiplier);
+}
+
+
+static void rescheduleDomain(Scheduler* scheduler, SchedulerDomain domain)
+{
+  MemoryController* memoryController = scheduler->memoryController;
+  const uint8_t speedMultiplier = getSpeedMultiplier(scheduler);
+
+  int firstEvent;
+  int lastEvent;
+
+  switch (domain) {
+    case SCHEDULER_DOMAIN_SYSTEM:
+      scheduler->eventCycles[SCHEDULER_EVENT_CARTRIDGE] = getEventCycles(scheduler, domain, cartridgeCyclesUntilNextEvent(memoryController), speedMultiplier);
+      scheduler->eventCycles[SCHEDULER_EVENT_DMA] = getEventCycles(scheduler, domain, dmaCyclesUntilNextEvent(memoryController), 1);
+      scheduler->eventCycles[SCHEDULER_EVENT_HDMA] = getEventCycles(scheduler, domain, hdmaCyclesUntilNextEvent(memoryController), speedMultiplier);
+      scheduler->eventCycles[SCHEDULER_EVENT_TIMER] = getEventCycles(scheduler, domain, timerCyclesUntilOverflow(memoryController->timerController), 1);
+      scheduler->eventCycles[SCHEDULER_EVENT_LCD] = getEventCycles(scheduler, domain, lcdCyclesUntilNextEvent(memoryController->lcdController), speedMultiplier);
+      firstEvent = SCHEDULER_EVENT_CARTRIDGE;
+      lastEvent = SCHEDULER_EVENT_LCD;
+      break;
+    case SCHEDULER_DOMAIN_SOUND:
+      scheduler->eventCycles[SCHEDULER_EVENT_FRAME_SEQUENCER] = getEventCycles(scheduler, domain, soundCyclesUntilFrameSequencerStep(memoryController->soundController), speedMultiplier);
+      scheduler->eventCycles[SCHEDULER_EVENT_AUDIO_OUTPUT] = getEventCycles(scheduler, domain, soundCyclesUntilOutputIsDue(memoryController->soundController), speedMultiplier);
+      firstEvent = SCHEDULER_EVENT_FRAME_SEQUENCER;
+      lastEvent = SCHEDULER_EVENT_AUDIO_OUTPUT;
+      break;
+    default:
+      return;
+  }
+
+  scheduler->domainEventCycles[domain] = UINT64_MAX;
+  for (int i = firstEvent; i <= lastEvent; i++) {
+    if (scheduler->eventCycles[i] < scheduler->domainEventCycles[domain]) {
+      scheduler->domainEventCycles[domain] = scheduler->eventCycles[i];
+    }
+  }
+}
+
+
+static void updateNextEventCycles(Scheduler* scheduler)
+{
+  scheduler->nextEventCycles = UINT64_MAX;
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    if (scheduler->domainEventCycles[i] < scheduler->nextEventCycles) {
+      scheduler->nextEventCycles = scheduler->domainEventCycles[i];
+    }
+  }
+}
+
+
+void schedulerReschedule(Scheduler* scheduler)
+{
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    rescheduleDomain(scheduler, i);
+  }
+  updateNextEventCycles(scheduler);
+}
+
+
+bool schedulerRunEvents(Scheduler* scheduler, uint8_t cpuCyclesExecuted, uint8_t baseCyclesExecuted)
+{
+  bool audioOutputIsDue = false;
+
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    if (scheduler->domainEventCycles[i] > scheduler->cycles) {
+      continue;
+    }
+
+    // Audio output events don't change anything the CPU can read
+    if (i == SCHEDULER_DOMAIN_SYSTEM || scheduler->eventCycles[SCHEDULER_EVENT_FRAME_SEQUENCER] <= scheduler->cycles) {
+      scheduler->lastVisibleEventCycles = scheduler->cycles;
+    }
+
+    // Bring the domain up to the start of the last instruction, then update it for the last instruction on its own so
+    // that anything due during it happens exactly as it would have if it was updated after every instruction
+    catchUp(scheduler, i, scheduler->cycles - cpuCyclesExecuted);
+
+    scheduler->updatedCycles[i] = scheduler->cycles;
+    updateDomain(scheduler, i, cpuCyclesExecuted, baseCyclesExecuted);
+
+    if (i == SCHEDULER_DOMAIN_SOUND) {
+      audioOutputIsDue = soundOutputIsDue(scheduler->memoryController->soundController);
+    }
+
+    rescheduleDomain(scheduler, i);
+  }
+
+  updateNextEventCycles(scheduler);
+
+  return audioOutputIsDue;
+}
+
+
+void schedulerSync(Scheduler* scheduler)
+{
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    catchUp(scheduler, i, scheduler->cycles);
+  }
+}
+
+
+// Used before the CPU reads something that only one domain could have changed, leaving the other domain to carry on
+// catching up at its own next event
+void schedulerSyncDomain(Scheduler* scheduler, SchedulerDomain domain)
+{
+  catchUp(scheduler, domain, scheduler->cycles);
+}
+
+
+void schedulerSyncAndReschedule(Scheduler* scheduler)
+{
+  for (int i = 0; i < SCHEDULER_DOMAIN_COUNT; i++) {
+    schedulerSyncAndRescheduleDomain(scheduler, i);
+  }
+}
+
+
+void schedulerSyncAndRescheduleDomain(Scheduler* scheduler, SchedulerDomain domain)
+{
+  // Used before anything (normally a write from the CPU) changes the state of a component, which may move its next
+  // event. Updating the components again after the current instruction also gives the component a chance to react to
+  // the change at the same point it would have if it was updated after every instruction.
+  catchUp(scheduler, domain, scheduler->cycles);
+  scheduler->domainEventCycles[domain] = scheduler->cycles;
+  scheduler->nextEventCycles = scheduler->cycles;
+  scheduler->lastVisibleEventCycles = scheduler->cycles;
+}
+
+
+// The CPU clock cycles that a domain is behind, for components that can work out their state without being updated
+uint32_t schedulerCyclesSinceUpdate(Scheduler* scheduler, SchedulerDomain domain)
+{
+  return scheduler->cycles - scheduler->updatedCycles[domain];
+}
+
+
+uint64_t schedulerNextVisibleEventCycles(Scheduler* scheduler)
+{
+  uint64_t frameSequencerCycles = scheduler->eventCycles[SCHEDULER_EVENT_FRAME_SEQUENCER];
+  uint64_t systemEventCycles = scheduler->domainEventCycles[SCHEDULER_DOMAIN_SYSTEM];
+
+  return (frameSequencerCycles < systemEventCycles) ? frameSequencerCycles : systemEventCycles;
+}
@@ -0,0 +1,59 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Returned by the component "cycles until next event" functions when the component has nothing scheduled
+#define SCHEDULER_NO_EVENT UINT32_MAX
+
+
+typedef enum {
+  SCHEDULER_EVENT_CARTRIDGE,
+  SCHEDULER_EVENT_DMA,
+  SCHEDULER_EVENT_HDMA,
+  SCHEDULER_EVENT_TIMER,
+  SCHEDULER_EVENT_LCD,
+  SCHEDULER_EVENT_FRAME_SEQUENCER,
+  SCHEDULER_EVENT_AUDIO_OUTPUT,
+  SCHEDULER_EVENT_COUNT
+} SchedulerEvent;
+
+
+// Components in different domains don't affect each other (only the CPU affects both), so each domain is brought up
+// to date on its own when one of its events is due
+typedef enum {
+  SCHEDULER_DOMAIN_SYSTEM, // Cartridge, DMA, HDMA, timer and LCD
+  SCHEDULER_DOMAIN_SOUND, // Sound controller and audio output
+  SCHEDULER_DOMAIN_COUNT
+} SchedulerDomain;
+
+
+// Components are only updated when one of them has something observable due to happen (an LCD mode change, a
+// timer overflow, the end of a DMA transfer etc.) or when the CPU writes to one of them. In between, the cycles the
+// CPU executes are only counted, and are handed to the components in one go at the next update.
+typedef struct {
+  uint64_t cycles; // CPU clock cycles executed, up to the end of the last instruction
+  uint64_t nextEventCycles; // The earliest of domainEventCycles
+  uint64_t updatedCycles[SCHEDULER_DOMAIN_COUNT]; // The point (in CPU clock cycles) that each domain has been updated up to
+  uint64_t domainEventCycles[SCHEDULER_DOMAIN_COUNT]; // The earliest of eventCycles for each domain
+  uint64_t eventCycles[SCHEDULER_EVENT_COUNT]; // The point (in CPU clock cycles) that each event is next due
+  uint64_t lastVisibleEventCycles; // The last point that an event could have changed anything the CPU can read
+
+  struct MemoryController* memoryController;
+} Scheduler;
+
+
+void initScheduler(Scheduler* scheduler, struct MemoryController* memoryController);
+
+bool schedulerRunEvents(Scheduler* scheduler, uint8_t cpuCyclesExecuted, uint8_t baseCyclesExecuted);
+void schedulerReschedule(Scheduler* scheduler);
+void schedulerSync(Scheduler* scheduler);
+void schedulerSyncDomain(Scheduler* scheduler, SchedulerDomain domain);
+void schedulerSyncAndReschedule(Scheduler* scheduler);
+void schedulerSyncAndRescheduleDomain(Scheduler* scheduler, SchedulerDomain domain);
+uint32_t schedulerCyclesSinceUpdate(Scheduler* scheduler, SchedulerDomain domain);
+uint64_t schedulerNextVisibleEventCycles(Scheduler* scheduler);
+
+#endif // SCHEDULER_H_
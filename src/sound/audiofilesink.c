@@ -0,0 +1,276 @@
+#include "audiofilesink.h"
+
+#include "../logging.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define WAV_HEADER_SIZE 44
+#define WAV_MAX_DATA_SIZE (UINT32_MAX - (WAV_HEADER_SIZE - 8))
+
+
+static const char* const AUDIO_FILE_SUFFIXES[AUDIO_FILE_SINK_MAX_FILES] = {
+  ".wav",
+  "-ch1.wav",
+  "-ch2.wav",
+  "-ch3.wav",
+  "-ch4.wav"
+};
+
+
+static void putUint16LE(uint8_t* bytes, uint16_t value)
+{
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 8) & 0xFF;
+}
+
+
+static void putUint32LE(uint8_t* bytes, uint32_t value)
+{
+  putUint16LE(&bytes[0], value & 0xFFFF);
+  putUint16LE(&bytes[2], (value >> 16) & 0xFFFF);
+}
+
+
+// The canonical header of a PCM WAV file - a RIFF chunk holding a fmt chunk and the data chunk that follows the header.
+// Sizes too big for the format (over 4GB of samples) are clamped, which most readers cope with.
+static bool writeWavHeader(FILE* file, uint16_t channels, uint32_t sampleRate, uint64_t dataSize)
+{
+  uint8_t header[WAV_HEADER_SIZE];
+  uint32_t size = (dataSize > WAV_MAX_DATA_SIZE) ? WAV_MAX_DATA_SIZE : (uint32_t)dataSize;
+
+  memcpy(&header[0], "RIFF", 4);
+  putUint32LE(&header[4], size + (WAV_HEADER_SIZE - 8));
+  memcpy(&header[8], "WAVE", 4);
+
+  memcpy(&header[12], "fmt ", 4);
+  putUint32LE(&header[16], 16);
+  putUint16LE(&header[20], 1); // PCM
+  putUint16LE(&header[22], channels);
+  putUint32LE(&header[24], sampleRate);
+  putUint32LE(&header[28], sampleRate * channels * sizeof(int16_t));
+  putUint16LE(&header[32], channels * sizeof(int16_t));
+  putUint16LE(&header[34], 16);
+
+  memcpy(&header[36], "data", 4);
+  putUint32LE(&header[40], size);
+
+  return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+
+static void* audioFileSinkWriterThread(void* arg)
+{
+  AudioFileSink* sink = (AudioFileSink*)arg;
+
+  pthread_mutex_lock(&sink->mutex);
+
+  while (true) {
+    while (sink->queueHead == NULL && !sink->isClosing) {
+      pthread_cond_wait(&sink->queued, &sink->mutex);
+    }
+
+    // Everything queued before the sink was closed is written before the thread finishes
+    if (sink->queueHead == NULL) {
+      break;
+    }
+
+    AudioFileChunk* chunks = sink->queueHead;
+    sink->queueHead = NULL;
+    sink->queueTail = NULL;
+    pthread_mutex_unlock(&sink->mutex);
+
+    AudioFileChunk* lastChunk = chunks;
+    for (AudioFileChunk* chunk = chunks; chunk != NULL; chunk = chunk->next) {
+      AudioFile* file = &sink->files[chunk->file];
+      if (fwrite(chunk->data, 1, chunk->size, file->file) != chunk->size) {
+        warning("Audio file write incomplete - expected to write %u bytes to '%s'\n", chunk->size, file->path);
+      }
+      file->dataSize += chunk->size;
+      lastChunk = chunk;
+    }
+
+    pthread_mutex_lock(&sink->mutex);
+    lastChunk->next = sink->freeChunks;
+    sink->freeChunks = chunks;
+  }
+
+  pthread_mutex_unlock(&sink->mutex);
+
+  return NULL;
+}
+
+
+// Hands a file's chunk to the writer thread and gives the file an empty one
+static void queueChunk(AudioFileSink* sink, uint32_t fileIndex)
+{
+  AudioFile* file = &sink->files[fileIndex];
+  AudioFileChunk* chunk = file->chunk;
+  chunk->next = NULL;
+
+  pthread_mutex_lock(&sink->mutex);
+  if (sink->queueTail != NULL) {
+    sink->queueTail->next = chunk;
+  } else {
+    sink->queueHead = chunk;
+  }
+  sink->queueTail = chunk;
+  pthread_cond_signal(&sink->queued);
+
+  AudioFileChunk* nextChunk = sink->freeChunks;
+  if (nextChunk != NULL) {
+    sink->freeChunks = nextChunk->next;
+  }
+  pthread_mutex_unlock(&sink->mutex);
+
+  if (nextChunk == NULL) {
+    nextChunk = (AudioFileChunk*)malloc(sizeof(AudioFileChunk));
+    assert(nextChunk);
+  }
+  nextChunk->file = fileIndex;
+  nextChunk->size = 0;
+  file->chunk = nextChunk;
+}
+
+
+static inline void putSample(AudioFileSink* sink, uint32_t fileIndex, int16_t value)
+{
+  AudioFileChunk* chunk = sink->files[fileIndex].chunk;
+
+  putUint16LE(&chunk->data[chunk->size], (uint16_t)value);
+  chunk->size += sizeof(int16_t);
+
+  if (chunk->size == AUDIO_FILE_SINK_CHUNK_SIZE) {
+    queueChunk(sink, fileIndex);
+  }
+}
+
+
+// Writes pathPrefix.wav with the mixed output and, if channels is set, pathPrefix-ch1.wav to pathPrefix-ch4.wav with
+// each channel on its own. Returns NULL if any of the files can't be created.
+AudioFileSink* audioFileSinkOpen(const char* pathPrefix, uint32_t sampleRate, bool channels)
+{
+  AudioFileSink* sink = (AudioFileSink*)calloc(1, sizeof(AudioFileSink));
+  assert(sink);
+
+  sink->fileCount = channels ? AUDIO_FILE_SINK_MAX_FILES : 1;
+  sink->sampleRate = sampleRate;
+
+  size_t pathPrefixLength = strlen(pathPrefix);
+
+  for (uint32_t i = 0; i < sink->fileCount; i++) {
+    AudioFile* file = &sink->files[i];
+
+    size_t suffixLength = strlen(AUDIO_FILE_SUFFIXES[i]);
+    file->path = (char*)malloc((pathPrefixLength + suffixLength + 1) * sizeof(char));
+    assert(file->path);
+    memcpy(file->path, pathPrefix, pathPrefixLength);
+    memcpy(&file->path[pathPrefixLength], AUDIO_FILE_SUFFIXES[i], suffixLength + 1);
+
+    file->channels = (i == 0) ? 2 : 1;
+    file->dataSize = 0;
+    file->file = fopen(file->path, "wb");
+
+    // The header is written again with the real sizes when the file is closed
+    if (file->file == NULL || !writeWavHeader(file->file, file->channels, sampleRate, 0)) {
+      error("Failed to create audio file '%s'\n", file->path);
+      for (uint32_t j = 0; j <= i; j++) {
+        if (sink->files[j].file != NULL) {
+          fclose(sink->files[j].file);
+        }
+        free(sink->files[j].path);
+        free(sink->files[j].chunk);
+      }
+      free(sink);
+      return NULL;
+    }
+
+    file->chunk = (AudioFileChunk*)malloc(sizeof(AudioFileChunk));
+    assert(file->chunk);
+    file->chunk->file = i;
+    file->chunk->size = 0;
+  }
+
+  pthread_mutex_init(&sink->mutex, NULL);
+  pthread_cond_init(&sink->queued, NULL);
+  if (pthread_create(&sink->writerThread, NULL, &audioFileSinkWriterThread, sink) != 0) {
+    critical("Failed to start audio file writer thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return sink;
+}
+
+
+bool audioFileSinkHasChannels(AudioFileSink* sink)
+{
+  return sink->fileCount > 1;
+}
+
+
+// Called from the emulation thread. channelSamples is only read if the sink has channel files.
+void audioFileSinkPut(AudioFileSink* sink, const AudioSample* samples, const ChannelAudioSample* channelSamples, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++) {
+    putSample(sink, 0, samples[i].so1);
+    putSample(sink, 0, samples[i].so2);
+  }
+
+  for (uint32_t channel = 1; channel < sink->fileCount; channel++) {
+    for (uint32_t i = 0; i < count; i++) {
+      putSample(sink, channel, channelSamples[i].channels[channel - 1]);
+    }
+  }
+}
+
+
+// Writes everything that has been put, fills in the WAV headers and frees the sink. Returns false if any file couldn't
+// be finished.
+bool audioFileSinkClose(AudioFileSink* sink)
+{
+  pthread_mutex_lock(&sink->mutex);
+  for (uint32_t i = 0; i < sink->fileCount; i++) {
+    AudioFileChunk* chunk = sink->files[i].chunk;
+    chunk->next = NULL;
+    if (sink->queueTail != NULL) {
+      sink->queueTail->next = chunk;
+    } else {
+      sink->queueHead = chunk;
+    }
+    sink->queueTail = chunk;
+    sink->files[i].chunk = NULL;
+  }
+  sink->isClosing = true;
+  pthread_cond_signal(&sink->queued);
+  pthread_mutex_unlock(&sink->mutex);
+
+  pthread_join(sink->writerThread, NULL);
+
+  bool result = true;
+
+  for (uint32_t i = 0; i < sink->fileCount; i++) {
+    AudioFile* file = &sink->files[i];
+    bool isFinished = (fseek(file->file, 0, SEEK_SET) == 0) && writeWavHeader(file->file, file->channels, sink->sampleRate, file->dataSize);
+    isFinished = (fclose(file->file) == 0) && isFinished;
+    if (!isFinished) {
+      error("Failed to finish audio file '%s'\n", file->path);
+      result = false;
+    }
+    free(file->path);
+  }
+
+  while (sink->freeChunks != NULL) {
+    AudioFileChunk* chunk = sink->freeChunks;
+    sink->freeChunks = chunk->next;
+    free(chunk);
+  }
+
+  pthread_cond_destroy(&sink->queued);
+  pthread_mutex_destroy(&sink->mutex);
+
+  free(sink);
+
+  return result;
+}
@@ -0,0 +1,60 @@
+#ifndef SOUND_AUDIOFILESINK_H_
+#define SOUND_AUDIOFILESINK_H_
+
+#include "audiosample.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define AUDIO_FILE_SINK_CHUNK_SIZE (256 * 1024) // Bytes of sample data written to a file at once
+#define AUDIO_FILE_SINK_MAX_FILES 5 // The mixed output and each of the four channels
+
+
+typedef struct AudioFileChunk {
+  struct AudioFileChunk* next;
+  uint32_t file; // Index into the sink's files
+  uint32_t size;
+  uint8_t data[AUDIO_FILE_SINK_CHUNK_SIZE];
+} AudioFileChunk;
+
+
+typedef struct {
+  char* path;
+  FILE* file; // file and dataSize are only used by the writer thread (and by audioFileSinkClose() once it has finished)
+  uint64_t dataSize;
+  uint16_t channels;
+  AudioFileChunk* chunk; // Being filled by the emulation thread
+} AudioFile;
+
+
+// Streams the mixed output, and optionally each channel on its own, to 16-bit PCM WAV files.
+//
+// Samples are copied into a chunk per file, and each full chunk is queued for a background thread to write, so the
+// only work left on the emulation thread is the copy and a short lock for every chunk. Chunks that have been written
+// are reused, and new ones are allocated if the writer falls behind, so the emulation thread never waits for the disk.
+// The sizes in the WAV headers are filled in when the sink is closed.
+typedef struct {
+  AudioFile files[AUDIO_FILE_SINK_MAX_FILES]; // [mixed, channel 1, channel 2, channel 3, channel 4]
+  uint32_t fileCount;
+  uint32_t sampleRate;
+
+  AudioFileChunk* queueHead; // Full chunks waiting to be written, oldest first
+  AudioFileChunk* queueTail;
+  AudioFileChunk* freeChunks;
+  bool isClosing;
+
+  pthread_t writerThread;
+  pthread_mutex_t mutex; // Protects the queue, freeChunks and isClosing
+  pthread_cond_t queued;
+} AudioFileSink;
+
+
+AudioFileSink* audioFileSinkOpen(const char* pathPrefix, uint32_t sampleRate, bool channels);
+bool audioFileSinkHasChannels(AudioFileSink* sink);
+void audioFileSinkPut(AudioFileSink* sink, const AudioSample* samples, const ChannelAudioSample* channelSamples, uint32_t count);
+bool audioFileSinkClose(AudioFileSink* sink);
+
+#endif // SOUND_AUDIOFILESINK_H_
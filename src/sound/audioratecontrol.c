@@ -0,0 +1,24 @@
+#include "audioratecontrol.h"
+
+
+void audioRateControlInitialise(AudioRateControl* control, uint32_t targetSamples, double maxDeviation)
+{
+  control->targetSamples = targetSamples;
+  control->maxDeviation = maxDeviation;
+  control->smoothedFill = targetSamples;
+  control->ratio = 1.0;
+}
+
+
+// Returns the ratio to resample the output by until the next update
+double audioRateControlUpdate(AudioRateControl* control, uint32_t samplesBuffered)
+{
+  control->smoothedFill += (samplesBuffered - control->smoothedFill) * AUDIO_RATE_CONTROL_SMOOTHING;
+
+  double error = (control->targetSamples - control->smoothedFill) / control->targetSamples;
+  if (error > 1.0) error = 1.0;
+  if (error < -1.0) error = -1.0;
+
+  control->ratio = 1.0 + (error * control->maxDeviation);
+  return control->ratio;
+}
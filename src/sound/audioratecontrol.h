@@ -0,0 +1,30 @@
+#ifndef SOUND_AUDIORATECONTROL_H_
+#define SOUND_AUDIORATECONTROL_H_
+
+#include <stdint.h>
+
+
+#define AUDIO_RATE_CONTROL_DEFAULT_TARGET_SAMPLES 2048 // Four of Core Audio's usual requests, about 46ms at 44.1kHz
+#define AUDIO_RATE_CONTROL_DEFAULT_MAX_DEVIATION 0.005 // Half a percent, too little to hear as a change in pitch
+#define AUDIO_RATE_CONTROL_SMOOTHING 0.05 // Weight of each new fill level in the smoothed one
+
+
+// Dynamic rate control, for when emulation is paced by something other than the audio device (such as the display's
+// vsync) and so produces samples slightly faster or slower than the device plays them.
+//
+// Once per video frame the fill level of the audio sample buffer is measured and smoothed, and the output is resampled
+// by a ratio that moves in proportion to how far the fill level is from its target - up to 1 + maxDeviation when the
+// buffer is empty and down to 1 - maxDeviation when it's twice the target. The fill level settles where the ratio makes
+// up for the difference between the two clocks, so the buffer never runs dry or overflows.
+typedef struct {
+  uint32_t targetSamples;
+  double maxDeviation;
+  double smoothedFill; // In samples
+  double ratio;
+} AudioRateControl;
+
+
+void audioRateControlInitialise(AudioRateControl* control, uint32_t targetSamples, double maxDeviation);
+double audioRateControlUpdate(AudioRateControl* control, uint32_t samplesBuffered);
+
+#endif // SOUND_AUDIORATECONTROL_H_
@@ -10,4 +10,11 @@ typedef struct
   int16_t so2;
 } AudioSample;
 
+
+// The output of each sound channel on its own, before it is panned and scaled by the master volume
+typedef struct
+{
+  int16_t channels[4];
+} ChannelAudioSample;
+
 #endif // SOUND_AUDIOSAMPLE_H_
@@ -5,19 +5,27 @@
 #include <string.h>
 
 
+// The size is rounded up to a power of two
 void sampleBufferInitialise(AudioSampleBuffer* buffer, int size)
 {
-  buffer->data = (AudioSample*)malloc(size * sizeof(AudioSample));
+  uint32_t roundedSize = 1;
+  while (roundedSize < (uint32_t)size) {
+    roundedSize <<= 1;
+  }
+
+  buffer->data = (AudioSample*)malloc(roundedSize * sizeof(AudioSample));
   assert(buffer->data);
 
-  memset(buffer->data, 0, size * sizeof(AudioSample));
+  memset(buffer->data, 0, roundedSize * sizeof(AudioSample));
 
   buffer->last.so1 = 0;
   buffer->last.so2 = 0;
-  buffer->size = size;
+  buffer->size = roundedSize;
+  buffer->mask = roundedSize - 1;
   buffer->write = 0;
   buffer->read = 0;
-  buffer->overflowed = false;
+  buffer->underruns = 0;
+  buffer->overruns = 0;
 }
 
 
@@ -27,33 +35,107 @@ void sampleBufferFinalise(AudioSampleBuffer* buffer)
 }
 
 
+// Copies count samples between the ring and a flat array starting at the given position, in up to two parts
+static void sampleBufferCopyOut(AudioSampleBuffer* buffer, uint32_t position, AudioSample* samples, uint32_t count)
+{
+  uint32_t index = position & buffer->mask;
+  uint32_t firstPart = (count < buffer->size - index) ? count : buffer->size - index;
+  memcpy(samples, &buffer->data[index], firstPart * sizeof(AudioSample));
+  memcpy(samples + firstPart, buffer->data, (count - firstPart) * sizeof(AudioSample));
+}
+
+
+static void sampleBufferCopyIn(AudioSampleBuffer* buffer, uint32_t position, const AudioSample* samples, uint32_t count)
+{
+  uint32_t index = position & buffer->mask;
+  uint32_t firstPart = (count < buffer->size - index) ? count : buffer->size - index;
+  memcpy(&buffer->data[index], samples, firstPart * sizeof(AudioSample));
+  memcpy(buffer->data, samples + firstPart, (count - firstPart) * sizeof(AudioSample));
+}
+
+
 AudioSample sampleBufferGet(AudioSampleBuffer* buffer)
 {
-  AudioSample sample = buffer->data[buffer->read];
-  buffer->read = (buffer->read + 1) % buffer->size;
-  if (buffer->read == 0 && buffer->overflowed) {
-    buffer->overflowed = false;
+  uint32_t read = buffer->read;
+  if (read == __atomic_load_n(&buffer->write, __ATOMIC_ACQUIRE)) {
+    __atomic_fetch_add(&buffer->underruns, 1, __ATOMIC_RELAXED);
+    return buffer->last;
   }
-  buffer->last = sample;
-  return sample;
+
+  buffer->last = buffer->data[read & buffer->mask];
+  __atomic_store_n(&buffer->read, read + 1, __ATOMIC_RELEASE);
+  return buffer->last;
 }
 
 
-void sampleBufferPut(AudioSampleBuffer* buffer, AudioSample sample)
+// Reads up to count samples, returning how many were available
+uint32_t sampleBufferGetN(AudioSampleBuffer* buffer, AudioSample* samples, uint32_t count)
 {
-  buffer->data[buffer->write] = sample;
-  buffer->write = (buffer->write + 1) % buffer->size;
-  if (buffer->write == 0) {
-    buffer->overflowed = true;
+  uint32_t read = buffer->read;
+  uint32_t available = __atomic_load_n(&buffer->write, __ATOMIC_ACQUIRE) - read;
+  if (available < count) {
+    __atomic_fetch_add(&buffer->underruns, count - available, __ATOMIC_RELAXED);
+    count = available;
   }
+
+  if (count > 0) {
+    sampleBufferCopyOut(buffer, read, samples, count);
+    buffer->last = samples[count - 1];
+    __atomic_store_n(&buffer->read, read + count, __ATOMIC_RELEASE);
+  }
+  return count;
 }
 
 
-int sampleBufferAvailableSamples(AudioSampleBuffer* buffer)
+bool sampleBufferPut(AudioSampleBuffer* buffer, AudioSample sample)
 {
-  if (buffer->overflowed) {
-    return (buffer->size - buffer->read) + buffer->write;
-  } else {
-    return buffer->write - buffer->read;
+  uint32_t write = buffer->write;
+  if (write - __atomic_load_n(&buffer->read, __ATOMIC_ACQUIRE) == buffer->size) {
+    __atomic_fetch_add(&buffer->overruns, 1, __ATOMIC_RELAXED);
+    return false;
   }
+
+  buffer->data[write & buffer->mask] = sample;
+  __atomic_store_n(&buffer->write, write + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+// Adds as many of the samples as there's space for, returning how many were added
+uint32_t sampleBufferPutN(AudioSampleBuffer* buffer, const AudioSample* samples, uint32_t count)
+{
+  uint32_t write = buffer->write;
+  uint32_t space = buffer->size - (write - __atomic_load_n(&buffer->read, __ATOMIC_ACQUIRE));
+  if (space < count) {
+    __atomic_fetch_add(&buffer->overruns, count - space, __ATOMIC_RELAXED);
+    count = space;
+  }
+
+  if (count > 0) {
+    sampleBufferCopyIn(buffer, write, samples, count);
+    __atomic_store_n(&buffer->write, write + count, __ATOMIC_RELEASE);
+  }
+  return count;
+}
+
+
+// The number of samples waiting to be read. The other side may have moved on by the time this returns, so the consumer
+// can only see fewer samples than there really are and the producer can only see more.
+int sampleBufferAvailableSamples(AudioSampleBuffer* buffer)
+{
+  uint32_t write = __atomic_load_n(&buffer->write, __ATOMIC_ACQUIRE);
+  uint32_t read = __atomic_load_n(&buffer->read, __ATOMIC_ACQUIRE);
+  return (int)(write - read);
+}
+
+
+uint64_t sampleBufferUnderruns(AudioSampleBuffer* buffer)
+{
+  return __atomic_load_n(&buffer->underruns, __ATOMIC_RELAXED);
+}
+
+
+uint64_t sampleBufferOverruns(AudioSampleBuffer* buffer)
+{
+  return __atomic_load_n(&buffer->overruns, __ATOMIC_RELAXED);
 }
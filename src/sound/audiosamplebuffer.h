@@ -4,16 +4,28 @@
 #include "audiosample.h"
 
 #include <stdbool.h>
-
-
+#include <stdint.h>
+
+
+// A lock-free ring of samples with one producer (the emulation thread) and one consumer (the audio callback).
+//
+// The read and write positions are free-running counts of the samples taken and added, so the buffer is empty when
+// they're equal and full when they're size apart, and a position is turned into an index with a mask because the size
+// is always a power of two. Each side only writes its own position, storing it with release ordering after touching
+// the data, and loads the other side's position with acquire ordering before touching the data.
+//
+// Samples added while the buffer is full are dropped (and counted as overruns) rather than overwriting samples that
+// haven't been read, and samples asked for while it's empty are counted as underruns.
 typedef struct
 {
   AudioSample* data;
-  AudioSample last;
-  int size;
-  int read;
-  int write;
-  bool overflowed;
+  AudioSample last; // The last sample read, returned again when the buffer is empty
+  uint32_t size;
+  uint32_t mask;
+  uint32_t read; // Only written by the consumer
+  uint32_t write; // Only written by the producer
+  uint64_t underruns; // Only written by the consumer
+  uint64_t overruns; // Only written by the producer
 } AudioSampleBuffer;
 
 
@@ -21,8 +33,12 @@ void sampleBufferInitialise(AudioSampleBuffer* buffer, int size);
 void sampleBufferFinalise(AudioSampleBuffer* buffer);
 
 AudioSample sampleBufferGet(AudioSampleBuffer* buffer);
-void sampleBufferPut(AudioSampleBuffer* buffer, AudioSample sample);
+uint32_t sampleBufferGetN(AudioSampleBuffer* buffer, AudioSample* samples, uint32_t count);
+bool sampleBufferPut(AudioSampleBuffer* buffer, AudioSample sample);
+uint32_t sampleBufferPutN(AudioSampleBuffer* buffer, const AudioSample* samples, uint32_t count);
 
 int sampleBufferAvailableSamples(AudioSampleBuffer* buffer);
+uint64_t sampleBufferUnderruns(AudioSampleBuffer* buffer);
+uint64_t sampleBufferOverruns(AudioSampleBuffer* buffer);
 
 #endif // SOUND_AUDIOSAMPLEBUFFER_H_
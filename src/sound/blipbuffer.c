@@ -0,0 +1,135 @@
+#include "blipbuffer.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+
+#define BLIP_CUTOFF 0.42 // Of the output sample rate, leaving room for the kernel's transition band below Nyquist
+#define BLIP_PI 3.14159265358979323846
+
+
+// Shared by every buffer, and built once by whichever buffer is initialised first (on any thread)
+static int16_t blipKernel[BLIP_PHASES][BLIP_KERNEL_WIDTH];
+static pthread_once_t blipKernelOnce = PTHREAD_ONCE_INIT;
+
+
+// Every phase of the kernel is a Blackman windowed sinc centred between taps BLIP_KERNEL_WIDTH / 2 - 1 and
+// BLIP_KERNEL_WIDTH / 2, moved along by the phase. The taps are rounded so they add up to exactly 1 << BLIP_KERNEL_BITS
+// (with what's left over from rounding put in the largest tap), so a change always moves the output by exactly its
+// delta and the running sum never drifts.
+static void buildKernel(void)
+{
+  const double halfWidth = BLIP_KERNEL_WIDTH / 2;
+
+  for (int phase = 0; phase < BLIP_PHASES; phase++) {
+    double taps[BLIP_KERNEL_WIDTH];
+    double total = 0;
+
+    for (int i = 0; i < BLIP_KERNEL_WIDTH; i++) {
+      double x = i - (halfWidth - 1) - ((double)phase / BLIP_PHASES);
+      double sinc = (x == 0) ? 1.0 : sin(BLIP_PI * 2 * BLIP_CUTOFF * x) / (BLIP_PI * 2 * BLIP_CUTOFF * x);
+      double window = 0.42 + 0.5 * cos(BLIP_PI * x / halfWidth) + 0.08 * cos(2 * BLIP_PI * x / halfWidth);
+      taps[i] = sinc * window;
+      total += taps[i];
+    }
+
+    int32_t remaining = 1 << BLIP_KERNEL_BITS;
+    int largest = 0;
+    for (int i = 0; i < BLIP_KERNEL_WIDTH; i++) {
+      blipKernel[phase][i] = (int16_t)lround(taps[i] / total * (1 << BLIP_KERNEL_BITS));
+      remaining -= blipKernel[phase][i];
+      if (blipKernel[phase][i] > blipKernel[phase][largest]) {
+        largest = i;
+      }
+    }
+    blipKernel[phase][largest] += remaining;
+  }
+}
+
+
+void blipBufferInitialise(BlipBuffer* buffer, uint32_t clockRate, uint32_t sampleRate)
+{
+  pthread_once(&blipKernelOnce, &buildKernel);
+
+  blipBufferSetSampleRate(buffer, clockRate, sampleRate);
+  blipBufferClear(buffer);
+}
+
+
+// The sample rate can be fractional, and changed between frames to stretch or squeeze the output slightly. Changing
+// it part way through a frame would move the changes already added to the frame.
+void blipBufferSetSampleRate(BlipBuffer* buffer, uint32_t clockRate, double sampleRate)
+{
+  buffer->samplesPerClock = (uint64_t)((sampleRate / clockRate) * 4294967296.0 + 0.5);
+}
+
+
+void blipBufferClear(BlipBuffer* buffer)
+{
+  memset(buffer->deltas, 0, sizeof(buffer->deltas));
+  buffer->frameOffset = 0;
+  buffer->sum = 0;
+}
+
+
+void blipBufferAddDelta(BlipBuffer* buffer, uint32_t clockTime, int32_t delta)
+{
+  uint64_t position = buffer->frameOffset + (uint64_t)clockTime * buffer->samplesPerClock;
+  uint32_t index = (uint32_t)(position >> 32);
+  uint32_t phase = (uint32_t)(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+
+  // Only reachable if the buffer isn't read often enough, in which case the change is heard a little early
+  if (index > BLIP_BUFFER_SAMPLES) {
+    index = BLIP_BUFFER_SAMPLES;
+  }
+
+  int32_t* deltas = &buffer->deltas[index];
+  const int16_t* kernel = blipKernel[phase];
+  for (int i = 0; i < BLIP_KERNEL_WIDTH; i++) {
+    deltas[i] += delta * kernel[i];
+  }
+}
+
+
+void blipBufferEndFrame(BlipBuffer* buffer, uint32_t clockDuration)
+{
+  buffer->frameOffset += (uint64_t)clockDuration * buffer->samplesPerClock;
+}
+
+
+uint32_t blipBufferSamplesAvailable(BlipBuffer* buffer)
+{
+  uint64_t available = buffer->frameOffset >> 32;
+  return (available < BLIP_BUFFER_SAMPLES) ? (uint32_t)available : BLIP_BUFFER_SAMPLES;
+}
+
+
+// Reads up to count samples into every stride-th element of samples (so the two channels of a stereo pair can be read
+// from two buffers into one interleaved array), scaled by gain as 16.16 fixed point and clipped
+uint32_t blipBufferReadSamples(BlipBuffer* buffer, int16_t* samples, uint32_t count, uint32_t stride, int32_t gain)
+{
+  uint32_t available = blipBufferSamplesAvailable(buffer);
+  if (count > available) {
+    count = available;
+  }
+
+  const int shift = BLIP_KERNEL_BITS + 16;
+  int32_t sum = buffer->sum;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += buffer->deltas[i];
+    int64_t sample = ((int64_t)sum * gain + ((int64_t)1 << (shift - 1))) >> shift;
+    if (sample > INT16_MAX) sample = INT16_MAX;
+    if (sample < INT16_MIN) sample = INT16_MIN;
+    samples[i * stride] = (int16_t)sample;
+  }
+  buffer->sum = sum;
+
+  // Move the samples that are still to come (including the tails of changes near the end of the frame) to the start
+  uint32_t remaining = available + BLIP_KERNEL_WIDTH - count;
+  memmove(buffer->deltas, &buffer->deltas[count], remaining * sizeof(int32_t));
+  memset(&buffer->deltas[remaining], 0, count * sizeof(int32_t));
+  buffer->frameOffset -= (uint64_t)count << 32;
+
+  return count;
+}
@@ -0,0 +1,42 @@
+#ifndef SOUND_BLIPBUFFER_H_
+#define SOUND_BLIPBUFFER_H_
+
+#include <stdint.h>
+
+
+#define BLIP_BUFFER_SAMPLES 2048 // The most output samples that can be waiting to be read
+#define BLIP_KERNEL_WIDTH 16 // Output samples that each change of amplitude is spread over
+#define BLIP_KERNEL_BITS 15 // The taps of each kernel add up to 1 << BLIP_KERNEL_BITS
+#define BLIP_PHASE_BITS 6
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS) // Positions of a change between two output samples that are told apart
+
+
+// Band-limited synthesis of a signal that is only described by the changes in its amplitude.
+//
+// Each change is added as a band-limited impulse (a windowed sinc, picked for the fraction of an output sample the
+// change falls at) to a buffer of differences at the output sample rate, and the output is the running sum of the
+// buffer. A step in the input becomes a step without anything above the output's Nyquist frequency in it, so nothing
+// aliases, and nothing has to be done for the clock cycles where the amplitude doesn't change.
+//
+// Time is counted in input clock cycles from the start of the current frame. Ending a frame makes the samples before
+// its end available to read and starts the next frame where it finished.
+typedef struct
+{
+  int32_t deltas[BLIP_BUFFER_SAMPLES + BLIP_KERNEL_WIDTH];
+  uint64_t samplesPerClock; // 32.32 fixed point
+  uint64_t frameOffset; // Position of the start of the current frame after the first unread sample, in 32.32 fixed point samples
+  int32_t sum; // The output before the first unread sample, scaled by 1 << BLIP_KERNEL_BITS
+} BlipBuffer;
+
+
+void blipBufferInitialise(BlipBuffer* buffer, uint32_t clockRate, uint32_t sampleRate);
+void blipBufferSetSampleRate(BlipBuffer* buffer, uint32_t clockRate, double sampleRate);
+void blipBufferClear(BlipBuffer* buffer);
+
+void blipBufferAddDelta(BlipBuffer* buffer, uint32_t clockTime, int32_t delta);
+void blipBufferEndFrame(BlipBuffer* buffer, uint32_t clockDuration);
+
+uint32_t blipBufferSamplesAvailable(BlipBuffer* buffer);
+uint32_t blipBufferReadSamples(BlipBuffer* buffer, int16_t* samples, uint32_t count, uint32_t stride, int32_t gain);
+
+#endif // SOUND_BLIPBUFFER_H_
@@ -3,6 +3,9 @@
 #include "../logging.h"
 
 
+#define GB_AUDIO_RENDER_BLOCK_FRAMES 512 // Core Audio usually asks for 512 frames at a time
+
+
 static void CHECK_ERROR(OSStatus error, const char* operation)
 {
   if (error == noErr) {
@@ -35,39 +38,66 @@ static OSStatus GBAudioUnitRenderProc(void* inRefCon, AudioUnitRenderActionFlags
 
   int availableFrames = sampleBufferAvailableSamples(audioSampleBuffer);
 
+  // Wait for enough samples to ride out the variation in when the emulator produces them, rather than crackling
+  // through every gap while the buffer is nearly empty
+  if (!audioContext->isPlaying) {
+    if (availableFrames < (int)audioContext->startFrames) {
+      memset(buffer0Data, 0, inNumberFrames * sizeof(Float32));
+      memset(buffer1Data, 0, inNumberFrames * sizeof(Float32));
+      return noErr;
+    }
+    audioContext->isPlaying = true;
+  }
+
   if (availableFrames >= 4096) {
     debug("%s: Too many frames available (%d)\n", __func__, availableFrames);
   }
 
   if (availableFrames < inNumberFrames) {
-    debug("%s: audio thread needs %u samples, only %d available (zeroing buffer)\n", __func__, inNumberFrames, availableFrames);
-    for (int i = 0; i < inNumberFrames; i++) {
-      *buffer0Data++ = 0;
-      *buffer1Data++ = 0;
+    debug("%s: audio thread needs %u samples, only %d available (zeroing the rest of the buffer)\n", __func__, inNumberFrames, availableFrames);
+  }
+
+  // TODO: Implement emulator "fast mode"
+  AudioSample samples[GB_AUDIO_RENDER_BLOCK_FRAMES];
+  UInt32 framesRendered = 0;
+  while (framesRendered < inNumberFrames) {
+    UInt32 framesWanted = inNumberFrames - framesRendered;
+    if (framesWanted > GB_AUDIO_RENDER_BLOCK_FRAMES) {
+      framesWanted = GB_AUDIO_RENDER_BLOCK_FRAMES;
     }
-  } else {
-    // debug("%s: audio thread needs %u samples, %d available\n", __func__, inNumberFrames, availableFrames);
-    // TODO: Implement emulator "fast mode"
-    for (int i = 0; i < inNumberFrames; i++) {
-      AudioSample sample = sampleBufferGet(audioSampleBuffer);
 
-      Float32 left = sample.so1 / ((float)SHRT_MAX);
-      Float32 right = sample.so2 / ((float)SHRT_MAX);
+    UInt32 framesRead = sampleBufferGetN(audioSampleBuffer, samples, framesWanted);
+    for (UInt32 i = 0; i < framesRead; i++) {
+      *buffer0Data++ = samples[i].so1 / ((float)SHRT_MAX);
+      *buffer1Data++ = samples[i].so2 / ((float)SHRT_MAX);
+    }
+    framesRendered += framesRead;
 
-      *buffer0Data++ = left;
-      *buffer1Data++ = right;
+    if (framesRead < framesWanted) {
+      break;
     }
   }
 
+  if (framesRendered < inNumberFrames) {
+    audioContext->isPlaying = false;
+  }
+
+  for (UInt32 i = framesRendered; i < inNumberFrames; i++) {
+    *buffer0Data++ = 0;
+    *buffer1Data++ = 0;
+  }
+
   return noErr;
 }
 
 
-struct GBAudioContext* initCoreAudioPlayback(AudioSampleBuffer* audioSampleBuffer)
+struct GBAudioContext* initCoreAudioPlayback(AudioSampleBuffer* audioSampleBuffer, UInt32 startFrames)
 {
   struct GBAudioContext* audioContext = (struct GBAudioContext*)malloc(1 * sizeof(struct GBAudioContext));
   memset(audioContext, 0, sizeof(struct GBAudioContext));
   audioContext->audioSampleBuffer = audioSampleBuffer;
+  audioContext->startFrames = startFrames;
+  audioContext->isPlaying = false;
 
   AudioComponentDescription outputDescription = {0};
   outputDescription.componentType = kAudioUnitType_Output;
@@ -10,9 +10,11 @@ struct GBAudioContext
 {
   AudioUnit outputUnit;
   AudioSampleBuffer* audioSampleBuffer;
+  UInt32 startFrames; // Buffered before playback starts (or restarts after running out)
+  bool isPlaying;
 };
 
 
-struct GBAudioContext* initCoreAudioPlayback(AudioSampleBuffer* audioSampleBuffer);
+struct GBAudioContext* initCoreAudioPlayback(AudioSampleBuffer* audioSampleBuffer, UInt32 startFrames);
 
 #endif // COREAUDIO_H_
@@ -55,12 +55,13 @@ void soundChannel1WriteByte(SoundChannel1* channel, uint16_t address, uint8_t va
 
 void soundChannel1Reset(SoundChannel1* channel);
 void soundChannel1Trigger(SoundChannel1* channel);
-void soundChannel1Update(SoundChannel1* channel, uint8_t cyclesExecuted);
+void soundChannel1Update(SoundChannel1* channel, uint32_t cyclesExecuted);
+uint32_t soundChannel1CyclesUntilOutputChange(SoundChannel1* channel);
 
 void soundChannel1ClockLength(SoundChannel1* channel);
 void soundChannel1ClockVolume(SoundChannel1* channel);
 void soundChannel1ClockSweep(SoundChannel1* channel);
 
-int16_t soundChannel1GetCurrentSample(SoundChannel1* channel);
+int8_t soundChannel1GetCurrentLevel(SoundChannel1* channel);
 
 #endif // SOUND_SOUNDCHANNEL1_H_
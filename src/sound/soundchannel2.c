@@ -1,6 +1,7 @@
 #include "soundchannel2.h"
 
 #include "../logging.h"
+#include "../scheduler.h"
 
 #include <math.h>
 
@@ -278,7 +279,7 @@ void soundChannel2Trigger(SoundChannel2* channel)
 }
 
 
-void soundChannel2Update(SoundChannel2* channel, uint8_t cyclesExecuted)
+void soundChannel2Update(SoundChannel2* channel, uint32_t cyclesExecuted)
 {
   // uint16_t frequency = ((channel->nr24 & 7) << 8) | channel->nr23;
   // channel->frequencyCyclesInPeriod = frequencyToCycles(frequency);
@@ -336,16 +337,35 @@ void soundChannel2ClockVolume(SoundChannel2* channel)
 }
 
 
-int16_t soundChannel2GetCurrentSample(SoundChannel2* channel)
+// The duty step (or the start of the next period) that the output next changes at. frequencyCycles can be at or past
+// the end of the period for an instant after the frequency is increased, and wraps at the next update.
+uint32_t soundChannel2CyclesUntilOutputChange(SoundChannel2* channel)
 {
-  int16_t sample = 0;
+  if (!channel->on || channel->frequencyCyclesInPeriod == 0) {
+    return SCHEDULER_NO_EVENT;
+  }
+  if (channel->frequencyCycles >= channel->frequencyCyclesInPeriod) {
+    return 1;
+  }
+
+  uint32_t stepCycles = channel->frequencyCyclesInPeriod / 8;
+  uint32_t step = channel->frequencyCycles / stepCycles;
+  uint32_t changeCycles = (step >= 7) ? channel->frequencyCyclesInPeriod : (step + 1) * stepCycles;
+  return changeCycles - channel->frequencyCycles;
+}
 
-  if (channel->on) {
-    uint8_t dutyNumber = (channel->nr21 >> 6);
-    uint8_t dutyIndex = channel->frequencyCycles / (channel->frequencyCyclesInPeriod / 8);
-    int16_t value = DUTY_CYCLES[dutyNumber][dutyIndex];
-    return value * (channel->volume / 15.0);
+
+// The output as a signed DAC level between -15 and 15
+int8_t soundChannel2GetCurrentLevel(SoundChannel2* channel)
+{
+  if (!channel->on || channel->frequencyCyclesInPeriod == 0) {
+    return 0;
   }
 
-  return sample;
+  uint8_t dutyNumber = (channel->nr21 >> 6);
+  uint32_t dutyIndex = channel->frequencyCycles / (channel->frequencyCyclesInPeriod / 8);
+  if (dutyIndex > 7) {
+    dutyIndex = 7;
+  }
+  return (DUTY_CYCLES[dutyNumber][dutyIndex] > 0) ? channel->volume : -channel->volume;
 }
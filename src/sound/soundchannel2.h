@@ -47,11 +47,12 @@ void soundChannel2WriteByte(SoundChannel2* channel, uint16_t address, uint8_t va
 
 void soundChannel2Reset(SoundChannel2* channel);
 void soundChannel2Trigger(SoundChannel2* channel);
-void soundChannel2Update(SoundChannel2* channel, uint8_t cyclesExecuted);
+void soundChannel2Update(SoundChannel2* channel, uint32_t cyclesExecuted);
+uint32_t soundChannel2CyclesUntilOutputChange(SoundChannel2* channel);
 
 void soundChannel2ClockLength(SoundChannel2* channel);
 void soundChannel2ClockVolume(SoundChannel2* channel);
 
-int16_t soundChannel2GetCurrentSample(SoundChannel2* channel);
+int8_t soundChannel2GetCurrentLevel(SoundChannel2* channel);
 
 #endif // SOUND_SOUNDCHANNEL2_H_
@@ -1,6 +1,7 @@
 #include "soundchannel3.h"
 
 #include "../logging.h"
+#include "../scheduler.h"
 
 
 #define WAVE_PATTERN_RAM_NUM_SAMPLES 32
@@ -244,7 +245,7 @@ void soundChannel3Trigger(SoundChannel3* channel)
 }
 
 
-void soundChannel3Update(SoundChannel3* channel, uint8_t cyclesExecuted)
+void soundChannel3Update(SoundChannel3* channel, uint32_t cyclesExecuted)
 {
   channel->frequencyCycles = (channel->frequencyCycles + cyclesExecuted) % channel->frequencyCyclesInPeriod;
   // TODO: Store wave table position to support reading samples from the previous wave table sample on channel trigger
@@ -266,33 +267,42 @@ void soundChannel3ClockLength(SoundChannel3* channel)
 }
 
 
-int16_t soundChannel3GetCurrentSample(SoundChannel3* channel)
+// The wave sample (or the start of the next period) that the output next changes at
+uint32_t soundChannel3CyclesUntilOutputChange(SoundChannel3* channel)
 {
-  int16_t sample = 0;
-
-  if (soundChannel3On(channel)) {
-    // TODO: When to do this initially?
-    // uint16_t frequency = ((channel->nr34 & 7) << 8) | channel->nr33;
-    // channel->frequencyCyclesInPeriod = frequencyToCycles(frequency);
-
-    uint8_t wavePatternIndex = channel->frequencyCycles / (channel->frequencyCyclesInPeriod / 32);
-    uint8_t ramIndex = wavePatternIndex / 2;
-    uint8_t sampleBits = 0;
-    if (wavePatternIndex % 2 == 0) {
-      sampleBits = (channel->wavePatternRAM[ramIndex] >> 4);
-    } else {
-      sampleBits = (channel->wavePatternRAM[ramIndex] & 15);
-    }
-
-    uint8_t shift = ((channel->nr32 >> 5) & 3);
-    if (shift == 0) {
-      sample = 0;
-    } else {
-      sampleBits >>= (shift - 1);
-
-      sample = (int16_t)(((sampleBits / 15.0) * UINT16_MAX) - 1 - INT16_MAX);
-    }
+  if (!soundChannel3On(channel)) {
+    return SCHEDULER_NO_EVENT;
   }
+  if (channel->frequencyCycles >= channel->frequencyCyclesInPeriod) {
+    return 1;
+  }
+
+  uint32_t stepCycles = channel->frequencyCyclesInPeriod / WAVE_PATTERN_RAM_NUM_SAMPLES;
+  if (stepCycles == 0) {
+    return SCHEDULER_NO_EVENT;
+  }
+  uint32_t step = channel->frequencyCycles / stepCycles;
+  uint32_t changeCycles = (step >= WAVE_PATTERN_RAM_NUM_SAMPLES - 1) ? channel->frequencyCyclesInPeriod : (step + 1) * stepCycles;
+  return changeCycles - channel->frequencyCycles;
+}
+
+
+// The output as a signed DAC level between -15 and 15
+int8_t soundChannel3GetCurrentLevel(SoundChannel3* channel)
+{
+  uint8_t shift = ((channel->nr32 >> 5) & 3);
+  uint32_t stepCycles = channel->frequencyCyclesInPeriod / WAVE_PATTERN_RAM_NUM_SAMPLES;
+  if (!soundChannel3On(channel) || shift == 0 || stepCycles == 0) {
+    return 0;
+  }
+
+  uint32_t wavePatternIndex = channel->frequencyCycles / stepCycles;
+  if (wavePatternIndex > WAVE_PATTERN_RAM_NUM_SAMPLES - 1) {
+    wavePatternIndex = WAVE_PATTERN_RAM_NUM_SAMPLES - 1;
+  }
+  uint8_t sampleBits = channel->wavePatternRAM[wavePatternIndex / 2];
+  sampleBits = (wavePatternIndex % 2 == 0) ? (sampleBits >> 4) : (sampleBits & 15);
+  sampleBits >>= (shift - 1);
 
-  return sample;
+  return (2 * sampleBits) - 15;
 }
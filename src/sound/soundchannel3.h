@@ -42,10 +42,11 @@ void soundChannel3WriteByte(SoundChannel3* channel, uint16_t address, uint8_t va
 
 void soundChannel3Reset(SoundChannel3* channel);
 void soundChannel3Trigger(SoundChannel3* channel);
-void soundChannel3Update(SoundChannel3* channel, uint8_t cyclesExecuted);
+void soundChannel3Update(SoundChannel3* channel, uint32_t cyclesExecuted);
+uint32_t soundChannel3CyclesUntilOutputChange(SoundChannel3* channel);
 
 void soundChannel3ClockLength(SoundChannel3* channel);
 
-int16_t soundChannel3GetCurrentSample(SoundChannel3* channel);
+int8_t soundChannel3GetCurrentLevel(SoundChannel3* channel);
 
 #endif // SOUND_SOUNDCHANNEL3_H_
@@ -1,6 +1,7 @@
 #include "soundchannel4.h"
 
 #include "../logging.h"
+#include "../scheduler.h"
 
 #include <math.h>
 
@@ -305,7 +306,7 @@ void soundChannel4Trigger(SoundChannel4* channel)
 }
 
 
-void soundChannel4Update(SoundChannel4* channel, uint8_t cyclesExecuted)
+void soundChannel4Update(SoundChannel4* channel, uint32_t cyclesExecuted)
 {
 
   if (channel->frequencyCycles + cyclesExecuted >= channel->frequencyCyclesInPeriod) {
@@ -315,6 +316,21 @@ void soundChannel4Update(SoundChannel4* channel, uint8_t cyclesExecuted)
 }
 
 
+uint32_t soundChannel4CyclesUntilNextStep(SoundChannel4* channel)
+{
+  // The LFSR can only be heard while the channel is on and is reset when the channel is triggered, so any steps that
+  // happen while the channel is off don't need to be seen individually
+  if (!channel->on) {
+    return SCHEDULER_NO_EVENT;
+  }
+
+  if (channel->frequencyCycles >= channel->frequencyCyclesInPeriod) { // The frequency was just increased
+    return 0;
+  }
+  return channel->frequencyCyclesInPeriod - channel->frequencyCycles;
+}
+
+
 void soundChannel4ClockLength(SoundChannel4* channel)
 {
   if (!channel->on || !channel->counterSelection) {
@@ -363,13 +379,11 @@ void soundChannel4ClockVolume(SoundChannel4* channel)
 }
 
 
-int16_t soundChannel4GetCurrentSample(SoundChannel4* channel)
+// The output as a signed DAC level between -15 and 15
+int8_t soundChannel4GetCurrentLevel(SoundChannel4* channel)
 {
-  int16_t sample = 0;
-
-  if (channel->on) {
-    sample = (((channel->lfsr & 1) == 0) ? INT16_MAX : INT16_MIN) * (channel->volume / 15.0);
+  if (!channel->on) {
+    return 0;
   }
-
-  return sample;
+  return ((channel->lfsr & 1) == 0) ? channel->volume : -channel->volume;
 }
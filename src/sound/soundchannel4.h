@@ -48,11 +48,12 @@ void soundChannel4WriteByte(SoundChannel4* channel, uint16_t address, uint8_t va
 
 void soundChannel4Reset(SoundChannel4* channel);
 void soundChannel4Trigger(SoundChannel4* channel);
-void soundChannel4Update(SoundChannel4* channel, uint8_t cyclesExecuted);
+void soundChannel4Update(SoundChannel4* channel, uint32_t cyclesExecuted);
+uint32_t soundChannel4CyclesUntilNextStep(SoundChannel4* channel);
 
 void soundChannel4ClockLength(SoundChannel4* channel);
 void soundChannel4ClockVolume(SoundChannel4* channel);
 
-int16_t soundChannel4GetCurrentSample(SoundChannel4* channel);
+int8_t soundChannel4GetCurrentLevel(SoundChannel4* channel);
 
 #endif // SOUND_SOUNDCHANNEL4_H_
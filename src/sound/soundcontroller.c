@@ -1,7 +1,45 @@
 #include "soundcontroller.h"
 
+#include "../scheduler.h"
 
-void initSoundController(SoundController* soundController)
+#include <string.h>
+
+
+// Mixes the point sampled output recorded since the last call
+static void mixRecordedSamples(SoundController* soundController)
+{
+  if (soundController->samplesMixed < soundController->samplesRecorded) {
+    soundController->mixSamples(&soundController->mixerBlock, soundController->samplesMixed, soundController->samplesRecorded, soundController->mixedSamples);
+    soundController->samplesMixed = soundController->samplesRecorded;
+  }
+}
+
+
+// Called whenever NR50, NR51, the power bit of NR52 or an emulator master channel control changes. Samples recorded
+// before the change are mixed with the old gains first.
+static void updateMixerGains(SoundController* soundController)
+{
+  mixRecordedSamples(soundController);
+
+  const bool powered = soundController->nr52 & (1 << 7);
+  const bool masters[4] = {
+    soundController->channel1Master,
+    soundController->channel2Master,
+    soundController->channel3Master,
+    soundController->channel4Master
+  };
+
+  for (int output = 0; output < 2; output++) {
+    int16_t volume = (soundController->nr50 >> (output * 4)) & 7;
+    for (int channel = 0; channel < 4; channel++) {
+      bool routed = soundController->nr51 & (1 << (channel + (output * 4)));
+      soundController->mixerBlock.gains[output][channel] = (powered && masters[channel] && routed) ? volume : 0;
+    }
+  }
+}
+
+
+void initSoundController(SoundController* soundController, uint32_t sampleRate)
 {
   soundControllerReset(soundController);
 
@@ -18,6 +56,29 @@ void initSoundController(SoundController* soundController)
   soundController->channel2Master = true;
   soundController->channel3Master = true;
   soundController->channel4Master = true;
+
+  soundController->synthesis = SOUND_SYNTHESIS_POINT_SAMPLED;
+  soundController->mixSamples = soundMixerFunction(soundMixerBest());
+  soundController->samplesRecorded = 0;
+  soundController->samplesMixed = 0;
+  soundController->samplesRead = 0;
+  soundController->cyclesPerSample = SOUND_CLOCK_CYCLE_FREQUENCY / sampleRate;
+  soundController->sampleCycles = 0;
+  updateMixerGains(soundController);
+  blipBufferInitialise(&soundController->blipBuffers[0], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+  blipBufferInitialise(&soundController->blipBuffers[1], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+  soundController->outputAmplitudes[0] = 0;
+  soundController->outputAmplitudes[1] = 0;
+  soundController->synthesisCycles = 0;
+  soundController->sampleRate = sampleRate;
+  soundController->outputRateRatio = 1.0;
+  soundController->outputRateRatioIsPending = false;
+
+  soundController->channelCapture = false;
+  for (int i = 0; i < 4; i++) {
+    blipBufferInitialise(&soundController->channelBlipBuffers[i], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+    soundController->channelAmplitudes[i] = 0;
+  }
 }
 
 
@@ -41,9 +102,9 @@ void soundOff(SoundController* soundController)
 }
 
 
-static void frameSequencerUpdate(SoundController* soundController, uint8_t cyclesExecuted)
+static void frameSequencerUpdate(SoundController* soundController, uint32_t cyclesExecuted)
 {
-  if (soundController->frameSequencerCycles + cyclesExecuted >= 8192) {
+  if (soundController->frameSequencerCycles + cyclesExecuted >= FRAME_SEQUENCER_CLOCK_CYCLES) {
     soundController->frameSequencerStep = (soundController->frameSequencerStep + 1) % 8;
     switch (soundController->frameSequencerStep) {
       case 0: // Length counter clock
@@ -79,7 +140,7 @@ static void frameSequencerUpdate(SoundController* soundController, uint8_t cycle
         break;
     }
   }
-  soundController->frameSequencerCycles = (soundController->frameSequencerCycles + cyclesExecuted) % 8192;
+  soundController->frameSequencerCycles = (soundController->frameSequencerCycles + cyclesExecuted) % FRAME_SEQUENCER_CLOCK_CYCLES;
 }
 
 
@@ -123,6 +184,113 @@ static void updateChannel4Status(SoundController* soundController)
 }
 
 
+// Records any change in the mixed output since the last call as a change at the current point of the frame
+static void mixBandLimitedOutput(SoundController* soundController)
+{
+  const int8_t levels[4] = {
+    soundChannel1GetCurrentLevel(&soundController->channel1),
+    soundChannel2GetCurrentLevel(&soundController->channel2),
+    soundChannel3GetCurrentLevel(&soundController->channel3),
+    soundChannel4GetCurrentLevel(&soundController->channel4)
+  };
+
+  int32_t amplitudes[2] = {0, 0};
+  for (int i = 0; i < 4; i++) {
+    amplitudes[0] += levels[i] * soundController->mixerBlock.gains[0][i];
+    amplitudes[1] += levels[i] * soundController->mixerBlock.gains[1][i];
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (amplitudes[i] != soundController->outputAmplitudes[i]) {
+      blipBufferAddDelta(&soundController->blipBuffers[i], soundController->synthesisCycles, amplitudes[i] - soundController->outputAmplitudes[i]);
+      soundController->outputAmplitudes[i] = amplitudes[i];
+    }
+  }
+
+  if (soundController->channelCapture) {
+    for (int i = 0; i < 4; i++) {
+      if (levels[i] != soundController->channelAmplitudes[i]) {
+        blipBufferAddDelta(&soundController->channelBlipBuffers[i], soundController->synthesisCycles, levels[i] - soundController->channelAmplitudes[i]);
+        soundController->channelAmplitudes[i] = levels[i];
+      }
+    }
+  }
+}
+
+
+static uint32_t minCycles(uint32_t a, uint32_t b)
+{
+  return (a < b) ? a : b;
+}
+
+
+// Runs the channels from one change in their output to the next, recording each change in the mixed output on the way
+static void updateChannelsBandLimited(SoundController* soundController, uint32_t cyclesExecuted)
+{
+  while (cyclesExecuted > 0) {
+    uint32_t cycles = cyclesExecuted;
+    cycles = minCycles(cycles, soundChannel1CyclesUntilOutputChange(&soundController->channel1));
+    cycles = minCycles(cycles, soundChannel2CyclesUntilOutputChange(&soundController->channel2));
+    cycles = minCycles(cycles, soundChannel3CyclesUntilOutputChange(&soundController->channel3));
+    cycles = minCycles(cycles, soundChannel4CyclesUntilNextStep(&soundController->channel4));
+    if (cycles == 0) {
+      cycles = 1;
+    }
+
+    soundChannel1Update(&soundController->channel1, cycles);
+    soundChannel2Update(&soundController->channel2, cycles);
+    soundChannel3Update(&soundController->channel3, cycles);
+    soundChannel4Update(&soundController->channel4, cycles);
+
+    soundController->synthesisCycles += cycles;
+    cyclesExecuted -= cycles;
+
+    mixBandLimitedOutput(soundController);
+  }
+}
+
+
+// Records the output of each channel for point sampled synthesis. The block of samples is always read before it fills
+// up (see soundCyclesUntilOutputIsDue()).
+static void recordSample(SoundController* soundController)
+{
+  SoundMixerBlock* block = &soundController->mixerBlock;
+  uint32_t i = soundController->samplesRecorded++;
+
+  block->levels[0][i] = soundChannel1GetCurrentLevel(&soundController->channel1);
+  block->levels[1][i] = soundChannel2GetCurrentLevel(&soundController->channel2);
+  block->levels[2][i] = soundChannel3GetCurrentLevel(&soundController->channel3);
+  block->levels[3][i] = soundChannel4GetCurrentLevel(&soundController->channel4);
+}
+
+
+// Runs the channels up to each point that a sample is due and records it there. The noise channel can step more than
+// once between samples, so the channels are also run up to each of its steps.
+static void updateChannelsPointSampled(SoundController* soundController, uint32_t cyclesExecuted)
+{
+  while (cyclesExecuted > 0) {
+    uint32_t cycles = minCycles(cyclesExecuted, soundController->cyclesPerSample - soundController->sampleCycles);
+    cycles = minCycles(cycles, soundChannel4CyclesUntilNextStep(&soundController->channel4));
+    if (cycles == 0) {
+      cycles = 1;
+    }
+
+    soundChannel1Update(&soundController->channel1, cycles);
+    soundChannel2Update(&soundController->channel2, cycles);
+    soundChannel3Update(&soundController->channel3, cycles);
+    soundChannel4Update(&soundController->channel4, cycles);
+
+    soundController->sampleCycles += cycles;
+    cyclesExecuted -= cycles;
+
+    if (soundController->sampleCycles == soundController->cyclesPerSample) {
+      recordSample(soundController);
+      soundController->sampleCycles = 0;
+    }
+  }
+}
+
+
 static uint8_t readNR50(SoundController* soundController)
 {
   return soundController->nr50 | 0x00;
@@ -174,12 +342,14 @@ uint8_t soundControllerReadByte(SoundController* soundController, uint16_t addre
 static void writeNR50(SoundController* soundController, uint8_t value)
 {
   soundController->nr50 = value;
+  updateMixerGains(soundController);
 }
 
 
 static void writeNR51(SoundController* soundController, uint8_t value)
 {
   soundController->nr51 = value;
+  updateMixerGains(soundController);
 }
 
 
@@ -192,6 +362,7 @@ static void writeNR52(SoundController* soundController, uint8_t value)
     soundOff(soundController);
     // TODO: Reset all sound channel registers on a full power off
   }
+  updateMixerGains(soundController);
 }
 
 
@@ -221,17 +392,28 @@ void soundControllerWriteByte(SoundController* soundController, uint16_t address
   } else {
     // warning("Write of value 0x%02X to unhandled I/O register address 0x%04X (in sound controller range 0x%04X-0x%04X)\n", value, address, IO_REG_ADDRESS_NR10, IO_REG_ADDRESS_NR52);
   }
+
+  if (soundController->synthesis == SOUND_SYNTHESIS_BAND_LIMITED) {
+    mixBandLimitedOutput(soundController);
+  }
 }
 
 
-void soundUpdate(SoundController* soundController, uint8_t cyclesExecuted)
+void soundUpdate(SoundController* soundController, uint32_t cyclesExecuted)
 {
   frameSequencerUpdate(soundController, cyclesExecuted);
 
-  soundChannel1Update(&soundController->channel1, cyclesExecuted);
-  soundChannel2Update(&soundController->channel2, cyclesExecuted);
-  soundChannel3Update(&soundController->channel3, cyclesExecuted);
-  soundChannel4Update(&soundController->channel4, cyclesExecuted);
+  if (soundController->synthesis == SOUND_SYNTHESIS_BAND_LIMITED) {
+    mixBandLimitedOutput(soundController); // The frame sequencer may have changed a length counter or envelope
+    updateChannelsBandLimited(soundController, cyclesExecuted);
+  } else if (soundController->synthesis == SOUND_SYNTHESIS_POINT_SAMPLED) {
+    updateChannelsPointSampled(soundController, cyclesExecuted);
+  } else {
+    soundChannel1Update(&soundController->channel1, cyclesExecuted);
+    soundChannel2Update(&soundController->channel2, cyclesExecuted);
+    soundChannel3Update(&soundController->channel3, cyclesExecuted);
+    soundChannel4Update(&soundController->channel4, cyclesExecuted);
+  }
 
   // TODO: Improve how the sound channels communicate their status back to the sound controller
   updateChannel1Status(soundController);
@@ -241,55 +423,209 @@ void soundUpdate(SoundController* soundController, uint8_t cyclesExecuted)
 }
 
 
-AudioSample soundGetCurrentSample(SoundController* soundController)
+uint32_t soundCyclesUntilFrameSequencerStep(SoundController* soundController)
 {
-  AudioSample sample = {.so1 = 0, .so2 = 0};
+  return FRAME_SEQUENCER_CLOCK_CYCLES - soundController->frameSequencerCycles;
+}
 
-  if (soundController->nr52 & (1 << 7)) {
-    int16_t ch1 = (soundController->channel1Master ? soundChannel1GetCurrentSample(&soundController->channel1) / 4 : 0);
-    int16_t ch2 = (soundController->channel2Master ? soundChannel2GetCurrentSample(&soundController->channel2) / 4 : 0);
-    int16_t ch3 = (soundController->channel3Master ? soundChannel3GetCurrentSample(&soundController->channel3) / 4 : 0);
-    int16_t ch4 = (soundController->channel4Master ? soundChannel4GetCurrentSample(&soundController->channel4) / 4 : 0);
 
-    float ch1F = ch1 / ((float)INT16_MAX);
-    float ch2F = ch2 / ((float)INT16_MAX);
-    float ch3F = ch3 / ((float)INT16_MAX);
-    float ch4F = ch4 / ((float)INT16_MAX);
+// The output has to be read before the block of point sampled samples overflows, and before the band-limited output
+// goes on for longer than its buffers hold
+uint32_t soundCyclesUntilOutputIsDue(SoundController* soundController)
+{
+  switch (soundController->synthesis) {
+    case SOUND_SYNTHESIS_POINT_SAMPLED:
+      if (soundController->samplesRecorded == SOUND_MIXER_BLOCK_SAMPLES) {
+        return 0;
+      }
+      return ((SOUND_MIXER_BLOCK_SAMPLES - soundController->samplesRecorded - 1) * soundController->cyclesPerSample) + (soundController->cyclesPerSample - soundController->sampleCycles);
+    case SOUND_SYNTHESIS_BAND_LIMITED:
+      if (soundController->synthesisCycles >= SOUND_BAND_LIMITED_FRAME_CYCLES) {
+        return 0;
+      }
+      return SOUND_BAND_LIMITED_FRAME_CYCLES - soundController->synthesisCycles;
+    default:
+      return SCHEDULER_NO_EVENT;
+  }
+}
+
+
+bool soundOutputIsDue(SoundController* soundController)
+{
+  return soundCyclesUntilOutputIsDue(soundController) == 0;
+}
+
+
+// Turns one of the emulator's master channel controls (numbered 1 to 4) on or off
+void soundSetChannelMaster(SoundController* soundController, uint8_t channel, bool enabled)
+{
+  switch (channel) {
+    case 1:
+      soundController->channel1Master = enabled;
+      break;
+    case 2:
+      soundController->channel2Master = enabled;
+      break;
+    case 3:
+      soundController->channel3Master = enabled;
+      break;
+    case 4:
+      soundController->channel4Master = enabled;
+      break;
+  }
+  updateMixerGains(soundController);
+
+  if (soundController->synthesis == SOUND_SYNTHESIS_BAND_LIMITED) {
+    mixBandLimitedOutput(soundController);
+  }
+}
+
+
+// Drops any output that hasn't been read and starts again from the current point
+static void restartOutput(SoundController* soundController)
+{
+  soundController->samplesRecorded = 0;
+  soundController->samplesMixed = 0;
+  soundController->samplesRead = 0;
+  soundController->sampleCycles = 0;
+
+  blipBufferClear(&soundController->blipBuffers[0]);
+  blipBufferClear(&soundController->blipBuffers[1]);
+  soundController->outputAmplitudes[0] = 0;
+  soundController->outputAmplitudes[1] = 0;
+  for (int i = 0; i < 4; i++) {
+    blipBufferClear(&soundController->channelBlipBuffers[i]);
+    soundController->channelAmplitudes[i] = 0;
+  }
+  soundController->synthesisCycles = 0;
+
+  if (soundController->synthesis == SOUND_SYNTHESIS_BAND_LIMITED) {
+    mixBandLimitedOutput(soundController);
+  }
+}
+
+
+void soundSetSynthesis(SoundController* soundController, SoundSynthesis synthesis)
+{
+  soundController->synthesis = synthesis;
+  restartOutput(soundController);
+}
+
+
+// Keeps the output of each channel on its own for soundReadSamples(), which costs band-limited synthesis a buffer per
+// channel (point sampled synthesis records every channel anyway). Restarts the output. While it's on every read has to
+// ask for the channels too.
+void soundSetChannelCapture(SoundController* soundController, bool enabled)
+{
+  soundController->channelCapture = enabled;
+  restartOutput(soundController);
+}
 
-    ch1F *= 0.008;
-    ch2F *= 0.008;
-    ch3F *= 0.008;
-    ch4F *= 0.008;
 
-    const uint8_t nr51 = soundController->nr51;
+const char* soundSynthesisName(SoundSynthesis synthesis)
+{
+  switch (synthesis) {
+    case SOUND_SYNTHESIS_NONE:
+      return "none";
+    case SOUND_SYNTHESIS_POINT_SAMPLED:
+      return "point";
+    case SOUND_SYNTHESIS_BAND_LIMITED:
+      return "band-limited";
+    default:
+      return "unknown";
+  }
+}
 
-    float so1 = (nr51 & (1 << 0) ? ch1F : 0) +
-                (nr51 & (1 << 1) ? ch2F : 0) +
-                (nr51 & (1 << 2) ? ch3F : 0) +
-                (nr51 & (1 << 3) ? ch4F : 0);
 
-    float so2 = (nr51 & (1 << 4) ? ch1F : 0) +
-                (nr51 & (1 << 5) ? ch2F : 0) +
-                (nr51 & (1 << 6) ? ch3F : 0) +
-                (nr51 & (1 << 7) ? ch4F : 0);
+// Stretches (above 1) or squeezes (below 1) the band-limited output by resampling it to slightly more or fewer samples,
+// from the start of the next frame. Point sampled output always has one sample per output sample interval.
+void soundSetOutputRateRatio(SoundController* soundController, double ratio)
+{
+  soundController->outputRateRatio = ratio;
+  soundController->outputRateRatioIsPending = true;
+}
 
-    // Main output volume control
-    so1 *= (((soundController->nr50 >> 0) & 7) / 7.0);
-    so2 *= (((soundController->nr50 >> 4) & 7) / 7.0);
 
-    // Hard limiting
-    so1 *= 0.2;
-    so2 *= 0.2;
+static void applyOutputRateRatio(SoundController* soundController)
+{
+  double sampleRate = soundController->sampleRate * soundController->outputRateRatio;
 
-    // Clipping
-    if (so1 > 1.0f) so1 = 1.0f;
-    if (so2 > 1.0f) so2 = 1.0f;
-    if (so1 < -1.0f) so1 = -1.0f;
-    if (so2 < -1.0f) so2 = -1.0f;
+  blipBufferSetSampleRate(&soundController->blipBuffers[0], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+  blipBufferSetSampleRate(&soundController->blipBuffers[1], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+  for (int i = 0; i < 4; i++) {
+    blipBufferSetSampleRate(&soundController->channelBlipBuffers[i], SOUND_CLOCK_CYCLE_FREQUENCY, sampleRate);
+  }
+  soundController->outputRateRatioIsPending = false;
+}
 
-    sample.so1 = (int16_t)(so1 * INT16_MAX);
-    sample.so2 = (int16_t)(so2 * INT16_MAX);
+
+// Makes the output up to the current point available to soundReadSamples()
+void soundEndFrame(SoundController* soundController)
+{
+  if (soundController->synthesis == SOUND_SYNTHESIS_POINT_SAMPLED) {
+    mixRecordedSamples(soundController);
+    return;
+  }
+
+  blipBufferEndFrame(&soundController->blipBuffers[0], soundController->synthesisCycles);
+  blipBufferEndFrame(&soundController->blipBuffers[1], soundController->synthesisCycles);
+  if (soundController->channelCapture) {
+    for (int i = 0; i < 4; i++) {
+      blipBufferEndFrame(&soundController->channelBlipBuffers[i], soundController->synthesisCycles);
+    }
+  }
+  soundController->synthesisCycles = 0;
+
+  if (soundController->outputRateRatioIsPending) {
+    applyOutputRateRatio(soundController);
+  }
+}
+
+
+// Reads up to count samples of the mixed output and, if channelSamples isn't NULL, of each channel on its own (which is
+// silent for band-limited synthesis unless channel capture is on)
+uint32_t soundReadSamples(SoundController* soundController, AudioSample* samples, ChannelAudioSample* channelSamples, uint32_t count)
+{
+  if (soundController->synthesis == SOUND_SYNTHESIS_POINT_SAMPLED) {
+    uint32_t available = soundController->samplesMixed - soundController->samplesRead;
+    if (count > available) {
+      count = available;
+    }
+    memcpy(samples, &soundController->mixedSamples[soundController->samplesRead], count * sizeof(AudioSample));
+
+    if (channelSamples != NULL) {
+      for (uint32_t i = 0; i < count; i++) {
+        for (int channel = 0; channel < 4; channel++) {
+          int32_t level = soundController->mixerBlock.levels[channel][soundController->samplesRead + i];
+          channelSamples[i].channels[channel] = (int16_t)((level * SOUND_CHANNEL_GAIN + (1 << 15)) >> 16);
+        }
+      }
+    }
+
+    soundController->samplesRead += count;
+
+    // Start the next block once everything recorded has been read
+    if (soundController->samplesRead == soundController->samplesRecorded) {
+      soundController->samplesRecorded = 0;
+      soundController->samplesMixed = 0;
+      soundController->samplesRead = 0;
+    }
+    return count;
+  }
+
+  // The two outputs are read from their own buffers into alternate halves of each sample
+  blipBufferReadSamples(&soundController->blipBuffers[0], &samples[0].so1, count, 2, SOUND_MIXER_GAIN);
+  count = blipBufferReadSamples(&soundController->blipBuffers[1], &samples[0].so2, count, 2, SOUND_MIXER_GAIN);
+
+  if (channelSamples != NULL) {
+    if (soundController->channelCapture) {
+      for (int i = 0; i < 4; i++) {
+        blipBufferReadSamples(&soundController->channelBlipBuffers[i], &channelSamples[0].channels[i], count, 4, SOUND_CHANNEL_GAIN);
+      }
+    } else {
+      memset(channelSamples, 0, count * sizeof(ChannelAudioSample));
+    }
   }
 
-  return sample;
+  return count;
 }
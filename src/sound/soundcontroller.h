@@ -2,10 +2,12 @@
 #define SOUND_SOUNDCONTROLLER_H_
 
 #include "audiosample.h"
+#include "blipbuffer.h"
 #include "soundchannel1.h"
 #include "soundchannel2.h"
 #include "soundchannel3.h"
 #include "soundchannel4.h"
+#include "soundmixer.h"
 
 #include <stdint.h>
 
@@ -14,6 +16,24 @@
 #define IO_REG_ADDRESS_NR51 0xFF25
 #define IO_REG_ADDRESS_NR52 0xFF26
 
+#define FRAME_SEQUENCER_CLOCK_CYCLES 8192 // 512Hz
+
+#define SOUND_CLOCK_CYCLE_FREQUENCY (1024 * 1024 * 4)
+
+// The longest the band-limited output can go without being read (about 31ms, well inside BLIP_BUFFER_SAMPLES)
+#define SOUND_BAND_LIMITED_FRAME_CYCLES (128 * 1024)
+
+// Each channel on its own is output at the level it adds to the mix at the loudest master volume
+#define SOUND_CHANNEL_GAIN (7 * SOUND_MIXER_GAIN)
+
+
+typedef enum {
+  SOUND_SYNTHESIS_NONE, // The channels are still run (so their status can be read back) but no output is produced
+  SOUND_SYNTHESIS_POINT_SAMPLED, // The mixed output is sampled as it is at the time of each output sample
+  SOUND_SYNTHESIS_BAND_LIMITED, // Changes in the output are recorded as they happen and resampled in batches
+  SOUND_SYNTHESIS_COUNT
+} SoundSynthesis;
+
 
 typedef struct
 {
@@ -37,10 +57,31 @@ typedef struct
   bool channel2Master;
   bool channel3Master;
   bool channel4Master;
+
+  SoundSynthesis synthesis;
+  MixSamplesFn mixSamples;
+  SoundMixerBlock mixerBlock; // The gains are also used by band-limited synthesis
+  AudioSample mixedSamples[SOUND_MIXER_BLOCK_SAMPLES];
+  uint32_t samplesRecorded; // Point sampled samples waiting in mixerBlock
+  uint32_t cyclesPerSample; // Between point sampled samples
+  uint32_t sampleCycles; // Cycles since the last point sampled sample
+  uint32_t samplesMixed;
+  uint32_t samplesRead;
+  BlipBuffer blipBuffers[2]; // [SO1, SO2]
+  int32_t outputAmplitudes[2]; // The amplitudes of SO1 and SO2 last added to blipBuffers
+  uint32_t synthesisCycles; // Cycles since the band-limited output was last read
+  uint32_t sampleRate;
+  double outputRateRatio; // Output samples per sample at sampleRate, for dynamic rate control
+  bool outputRateRatioIsPending; // Changed since the band-limited output was last read
+
+  // Band-limited output of each channel on its own, only kept when channel capture is on
+  bool channelCapture;
+  BlipBuffer channelBlipBuffers[4];
+  int32_t channelAmplitudes[4];
 } SoundController;
 
 
-void initSoundController(SoundController* soundController);
+void initSoundController(SoundController* soundController, uint32_t sampleRate);
 
 void soundControllerReset(SoundController* soundController);
 void soundOn(SoundController* soundController);
@@ -49,7 +90,17 @@ void soundOff(SoundController* soundController);
 uint8_t soundControllerReadByte(SoundController* soundController, uint16_t address);
 void soundControllerWriteByte(SoundController* soundController, uint16_t address, uint8_t value);
 
-void soundUpdate(SoundController* soundController, uint8_t cyclesExecuted);
-AudioSample soundGetCurrentSample(SoundController* soundController);
+void soundUpdate(SoundController* soundController, uint32_t cyclesExecuted);
+uint32_t soundCyclesUntilFrameSequencerStep(SoundController* soundController);
+uint32_t soundCyclesUntilOutputIsDue(SoundController* soundController);
+bool soundOutputIsDue(SoundController* soundController);
+
+void soundSetChannelMaster(SoundController* soundController, uint8_t channel, bool enabled);
+void soundSetChannelCapture(SoundController* soundController, bool enabled);
+void soundSetSynthesis(SoundController* soundController, SoundSynthesis synthesis);
+const char* soundSynthesisName(SoundSynthesis synthesis);
+void soundSetOutputRateRatio(SoundController* soundController, double ratio);
+void soundEndFrame(SoundController* soundController);
+uint32_t soundReadSamples(SoundController* soundController, AudioSample* samples, ChannelAudioSample* channelSamples, uint32_t count);
 
 #endif // SOUND_SOUNDCONTROLLER_H_
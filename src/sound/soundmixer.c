@@ -0,0 +1,126 @@
+#include "soundmixer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOUND_MIXER_X86
+#include <immintrin.h>
+#endif
+
+
+static void mixSamplesScalar(const SoundMixerBlock* block, uint32_t begin, uint32_t end, AudioSample* samples)
+{
+  for (uint32_t i = begin; i < end; i++) {
+    int32_t so1 = 0;
+    int32_t so2 = 0;
+    for (int channel = 0; channel < 4; channel++) {
+      so1 += block->levels[channel][i] * block->gains[0][channel];
+      so2 += block->levels[channel][i] * block->gains[1][channel];
+    }
+
+    samples[i].so1 = (int16_t)((so1 * SOUND_MIXER_GAIN + (1 << 15)) >> 16);
+    samples[i].so2 = (int16_t)((so2 * SOUND_MIXER_GAIN + (1 << 15)) >> 16);
+  }
+}
+
+
+#ifdef SOUND_MIXER_X86
+
+// The same sums as mixSamplesScalar() for 8 samples at a time. Every sum fits in 16 bits, so it is scaled (with its
+// rounding term) by multiplying the pair (sum, 2) by (SOUND_MIXER_GAIN, 1 << 14) and adding the products.
+__attribute__((target("sse2")))
+static void mixSamplesSSE2(const SoundMixerBlock* block, uint32_t begin, uint32_t end, AudioSample* samples)
+{
+  const __m128i twos = _mm_set1_epi16(2);
+  const __m128i scale = _mm_set1_epi32((1 << 30) | SOUND_MIXER_GAIN);
+
+  __m128i gains[2][4];
+  for (int output = 0; output < 2; output++) {
+    for (int channel = 0; channel < 4; channel++) {
+      gains[output][channel] = _mm_set1_epi16(block->gains[output][channel]);
+    }
+  }
+
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m128i levels[4];
+    for (int channel = 0; channel < 4; channel++) {
+      levels[channel] = _mm_loadu_si128((const __m128i*)&block->levels[channel][i]);
+    }
+
+    __m128i outputs[2];
+    for (int output = 0; output < 2; output++) {
+      __m128i sum = _mm_mullo_epi16(levels[0], gains[output][0]);
+      sum = _mm_add_epi16(sum, _mm_mullo_epi16(levels[1], gains[output][1]));
+      sum = _mm_add_epi16(sum, _mm_mullo_epi16(levels[2], gains[output][2]));
+      sum = _mm_add_epi16(sum, _mm_mullo_epi16(levels[3], gains[output][3]));
+
+      __m128i low = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(sum, twos), scale), 16);
+      __m128i high = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(sum, twos), scale), 16);
+      outputs[output] = _mm_packs_epi32(low, high);
+    }
+
+    _mm_storeu_si128((__m128i*)&samples[i], _mm_unpacklo_epi16(outputs[0], outputs[1]));
+    _mm_storeu_si128((__m128i*)&samples[i + 4], _mm_unpackhi_epi16(outputs[0], outputs[1]));
+  }
+
+  mixSamplesScalar(block, i, end, samples);
+}
+
+#endif // SOUND_MIXER_X86
+
+
+bool soundMixerIsSupported(SoundMixer mixer)
+{
+  switch (mixer) {
+    case SOUND_MIXER_SCALAR:
+      return true;
+#ifdef SOUND_MIXER_X86
+    case SOUND_MIXER_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+#endif
+    default:
+      return false;
+  }
+}
+
+
+SoundMixer soundMixerBest()
+{
+  for (int mixer = SOUND_MIXER_COUNT - 1; mixer > SOUND_MIXER_SCALAR; mixer--) {
+    if (soundMixerIsSupported(mixer)) {
+      return mixer;
+    }
+  }
+  return SOUND_MIXER_SCALAR;
+}
+
+
+// Falls back to the scalar mixer if the requested one isn't supported
+MixSamplesFn soundMixerFunction(SoundMixer mixer)
+{
+  if (!soundMixerIsSupported(mixer)) {
+    return &mixSamplesScalar;
+  }
+
+  switch (mixer) {
+#ifdef SOUND_MIXER_X86
+    case SOUND_MIXER_SSE2:
+      return &mixSamplesSSE2;
+#endif
+    default:
+      return &mixSamplesScalar;
+  }
+}
+
+
+const char* soundMixerName(SoundMixer mixer)
+{
+  switch (mixer) {
+    case SOUND_MIXER_SCALAR:
+      return "scalar";
+    case SOUND_MIXER_SSE2:
+      return "sse2";
+    default:
+      return "unknown";
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef SOUND_SOUNDMIXER_H_
+#define SOUND_SOUNDMIXER_H_
+
+#include "audiosample.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define SOUND_MIXER_BLOCK_SAMPLES 1024
+
+// Scales the sum of each output (DAC levels of up to 15 per channel, multiplied by a master volume of up to 7) to a
+// sample as 16.16 fixed point - 32767 / 15 / 4 * 0.008 / 7 * 0.2, the level the original floating point mixer gave. The
+// loudest output is 4 * 15 * 7 * 8181 >> 16 = 52, so nothing is ever clipped.
+#define SOUND_MIXER_GAIN 8181
+
+
+// Point sampled output waiting to be mixed. The levels are kept a channel at a time so a run of samples can be mixed
+// several at once.
+typedef struct
+{
+  int16_t gains[2][4]; // [SO1, SO2][channel] - the NR50 volume of the output if NR51 sends the channel to it, else 0
+  int16_t levels[4][SOUND_MIXER_BLOCK_SAMPLES]; // [channel][sample] - signed DAC levels between -15 and 15
+} SoundMixerBlock;
+
+
+// Mixes samples begin to end - 1 of the block into the same elements of samples
+typedef void (*MixSamplesFn)(const SoundMixerBlock* block, uint32_t begin, uint32_t end, AudioSample* samples);
+
+
+typedef enum {
+  SOUND_MIXER_SCALAR,
+  SOUND_MIXER_SSE2,
+  SOUND_MIXER_COUNT
+} SoundMixer;
+
+
+bool soundMixerIsSupported(SoundMixer mixer);
+SoundMixer soundMixerBest();
+MixSamplesFn soundMixerFunction(SoundMixer mixer);
+const char* soundMixerName(SoundMixer mixer);
+
+#endif // SOUND_SOUNDMIXER_H_
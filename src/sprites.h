@@ -19,7 +19,4 @@ typedef struct {
   uint8_t attributes;
 } Sprite;
 
-
-int spritesCompareByXPosition(const void* a, const void* b);
-
 #endif // SPRITES_H_
@@ -1,15 +1,83 @@
 #include "timer.h"
 
+#include "scheduler.h"
 
-static const uint32_t INPUT_CLOCKS[] = {4096, 262144, 65536, 16384};
 
+// The counter bit whose falling edge increments TIMA for each input clock (4096Hz, 262144Hz, 65536Hz and 16384Hz), so
+// TIMA increments every 1 << (shift + 1) clock cycles
+static const uint8_t INPUT_CLOCK_COUNTER_BITS[] = {9, 3, 5, 7};
 
-uint8_t timerReadByte(TimerController* timerController, uint16_t address)
+
+static uint8_t getInputClockShift(TimerController* timerController)
+{
+  return INPUT_CLOCK_COUNTER_BITS[timerController->tac & TAC_INPUT_CLOCK_SELECT_BITS] + 1;
+}
+
+
+static uint32_t getTimerIncrementClockCycles(TimerController* timerController)
+{
+  // NOTE: No need to double the number of clock cycles in double-speed mode - the timer is driven by the same counter
+  // as the divider, which counts CPU clock cycles and so runs twice as fast too.
+  return 1 << getInputClockShift(timerController);
+}
+
+
+// The input to TIMA - the selected counter bit, while the timer is enabled. Anything that takes it from high to low
+// increments TIMA, including writes to DIV and TAC.
+static bool getTimerInput(TimerController* timerController)
+{
+  const uint16_t counterBit = 1 << (getInputClockShift(timerController) - 1);
+  return (timerController->tac & TAC_TIMER_STOP_BIT) && (timerController->counter & counterBit);
+}
+
+
+// The number of times TIMA increments over the next cycles clock cycles
+static uint32_t getTimerIncrements(TimerController* timerController, uint32_t cycles)
+{
+  if (!(timerController->tac & TAC_TIMER_STOP_BIT)) {
+    return 0;
+  }
+
+  const uint8_t shift = getInputClockShift(timerController);
+  const uint32_t phase = timerController->counter & ((1 << shift) - 1);
+  return (uint32_t)(((uint64_t)phase + cycles) >> shift);
+}
+
+
+// Returns TIMA after the given number of increments. Each overflow reloads TMA, after which another 256 - TMA
+// increments overflow it again.
+static uint8_t getIncrementedTimer(TimerController* timerController, uint32_t increments, bool* overflowed)
+{
+  const uint32_t incrementsUntilOverflow = 256 - timerController->tima;
+  if (increments < incrementsUntilOverflow) {
+    *overflowed = false;
+    return timerController->tima + increments;
+  }
+
+  *overflowed = true;
+  return timerController->tma + ((increments - incrementsUntilOverflow) % (256 - timerController->tma));
+}
+
+
+static void incrementTimer(TimerController* timerController, uint32_t increments)
+{
+  bool overflowed;
+  timerController->tima = getIncrementedTimer(timerController, increments, &overflowed);
+  if (overflowed) {
+    interruptFlag(timerController->interruptController, TIMER_OVERFLOW_INTERRUPT_BIT);
+  }
+}
+
+
+// DIV and TIMA are worked out for cyclesSinceUpdate clock cycles after the timer was last updated, so they can be read
+// without bringing the timer (or anything else) up to date first
+uint8_t timerReadByte(TimerController* timerController, uint16_t address, uint32_t cyclesSinceUpdate)
 {
   if (address == IO_REG_ADDRESS_DIV) { // 0xFF04
-    return timerController->div;
+    return (uint16_t)(timerController->counter + cyclesSinceUpdate) >> 8;
   } else if (address == IO_REG_ADDRESS_TIMA) { // 0xFF05
-    return timerController->tima;
+    bool overflowed;
+    return getIncrementedTimer(timerController, getTimerIncrements(timerController, cyclesSinceUpdate), &overflowed);
   } else if (address == IO_REG_ADDRESS_TMA) { // 0xFF06
     return timerController->tma;
   } else if (address == IO_REG_ADDRESS_TAC) { // 0xFF07
@@ -22,8 +90,10 @@ uint8_t timerReadByte(TimerController* timerController, uint16_t address)
 
 void timerWriteByte(TimerController* timerController, uint16_t address, uint8_t value)
 {
+  const bool timerInput = getTimerInput(timerController);
+
   if (address == IO_REG_ADDRESS_DIV) { // 0xFF04
-    timerController->div = 0x00;
+    timerController->counter = 0; // Any write resets the whole counter, not just the part that DIV shows
   } else if (address == IO_REG_ADDRESS_TIMA) { // 0xFF05
     timerController->tima = value;
   } else if (address == IO_REG_ADDRESS_TMA) { // 0xFF06
@@ -31,54 +101,50 @@ void timerWriteByte(TimerController* timerController, uint16_t address, uint8_t
   } else if (address == IO_REG_ADDRESS_TAC) { // 0xFF07
     timerController->tac = value;
   }
+
+  if (timerInput && !getTimerInput(timerController)) {
+    incrementTimer(timerController, 1);
+  }
+}
+
+
+// Nothing here depends on how many cycles are passed at once. Overflows are scheduled events, so the timer is always
+// updated up to the cycle that TIMA overflows in, and the interrupt is raised on time.
+void timerUpdate(TimerController* timerController, uint32_t cyclesExecuted)
+{
+  uint32_t increments = getTimerIncrements(timerController, cyclesExecuted);
+  if (increments > 0) {
+    incrementTimer(timerController, increments);
+  }
+
+  timerController->counter += cyclesExecuted; // Wraps around like the 16-bit counter it stands for
 }
 
 
-void timerUpdateDivider(TimerController* timerController, uint8_t cyclesExecuted)
+uint32_t timerCyclesUntilDividerIncrement(TimerController* timerController)
 {
-  // If we have executed enough clock cycles-worth of time since the last update then increment the DIV register
-  // (taking into account any 'excess' clock cycles that we should include), otherwise simply update the clock cycle count.
-  // NOTE: In double-speed mode the divider increments twice as fast at 32768Hz, however because we
-  // increment based on clock cycles instead of real time values we don't need to do anything else here,
-  // because when double-speed mode is enabled (and the clock is effectively twice as fast) the same
-  // number of increments happens in the same period of time.
-  // Alternatively, in double-speed mode the base clock is twice as fast, but the update frequency sis also twice as fast,
-  // so the same number of clock cycles are executed before the register is incremented, so we don't have to do anything special here.
-  if (timerController->dividerCounter + cyclesExecuted >= DIV_INCREMENT_CLOCK_CYCLES) {
-    timerController->div++;
+  return DIV_INCREMENT_CLOCK_CYCLES - (timerController->counter % DIV_INCREMENT_CLOCK_CYCLES);
+}
+
+
+uint32_t timerCyclesUntilTimerIncrement(TimerController* timerController)
+{
+  if (!(timerController->tac & TAC_TIMER_STOP_BIT)) {
+    return SCHEDULER_NO_EVENT;
   }
-  timerController->dividerCounter = (timerController->dividerCounter + cyclesExecuted) % DIV_INCREMENT_CLOCK_CYCLES;
+
+  uint32_t timerIncrementClockCycles = getTimerIncrementClockCycles(timerController);
+  return timerIncrementClockCycles - (timerController->counter & (timerIncrementClockCycles - 1));
 }
 
 
-void timerUpdateTimer(TimerController* timerController, uint8_t cyclesExecuted)
+uint32_t timerCyclesUntilOverflow(TimerController* timerController)
 {
-  // Only update the timer if the enable bit is set in the TAC I/O register
-  if (timerController->tac & TAC_TIMER_STOP_BIT) {
-    // Determine the clock frequency for timer updates
-    uint32_t selectedInputClock = INPUT_CLOCKS[timerController->tac & TAC_INPUT_CLOCK_SELECT_BITS];
-
-    // Work out the number of cycles that should pass before we update the internal counter that ends with an increment to the TIMA register
-    // NOTE: Double the required number of clock cyles if double-speed mode is enabled, because while
-    // the base clock speed is twice as fast the timer frequency is fixed.
-    uint32_t timerIncrementClockCycles = (CLOCK_CYCLE_FREQUENCY_NORMAL_SPEED / selectedInputClock) * 1;
-
-    int remainingCycles = cyclesExecuted;
-    while (remainingCycles > 0) {
-      int updateCycles = ((remainingCycles > timerIncrementClockCycles) ? timerIncrementClockCycles : remainingCycles);
-      // Check for updates
-      if ((timerController->timerCounter + updateCycles) >= timerIncrementClockCycles) {
-        // Increment TIMA and trigger an interrupt and load of TMA if an overflow occurred
-        timerController->tima++;
-        // debug("TIMA: %u\n", timerController->tima);
-        if (timerController->tima == 0) {
-          // debug("TIMA INTERRUPT! TAC=0x%02X\n", timerController->tac);
-          timerController->tima = timerController->tma;
-          interruptFlag(timerController->interruptController, TIMER_OVERFLOW_INTERRUPT_BIT);
-        }
-      }
-      timerController->timerCounter = (timerController->timerCounter + updateCycles) % timerIncrementClockCycles;
-      remainingCycles -= updateCycles;
-    }
+  if (!(timerController->tac & TAC_TIMER_STOP_BIT)) {
+    return SCHEDULER_NO_EVENT;
   }
+
+  // Only the overflow (and the interrupt that comes with it) needs to happen on time - DIV and TIMA are worked out
+  // whenever they are read
+  return timerCyclesUntilTimerIncrement(timerController) + ((255 - timerController->tima) * getTimerIncrementClockCycles(timerController));
 }
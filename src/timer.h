@@ -25,10 +25,13 @@
 #define TIMER_OVERFLOW_INTERRUPT_BIT (1 << 2)
 
 
-uint8_t timerReadByte(TimerController* timerController, uint16_t address);
+uint8_t timerReadByte(TimerController* timerController, uint16_t address, uint32_t cyclesSinceUpdate);
 void timerWriteByte(TimerController* timerController, uint16_t address, uint8_t value);
 
-void timerUpdateDivider(TimerController* timerController, uint8_t cyclesExecuted);
-void timerUpdateTimer(TimerController* timerController, uint8_t cyclesExecuted);
+void timerUpdate(TimerController* timerController, uint32_t cyclesExecuted);
+
+uint32_t timerCyclesUntilDividerIncrement(TimerController* timerController);
+uint32_t timerCyclesUntilTimerIncrement(TimerController* timerController);
+uint32_t timerCyclesUntilOverflow(TimerController* timerController);
 
 #endif // TIMER_H_
@@ -3,7 +3,9 @@
 
 void initTimerController(TimerController* timerController, InterruptController* interruptController)
 {
-  timerController->dividerCounter = 0;
-  timerController->timerCounter = 0;
+  timerController->counter = 0;
+  timerController->tima = 0;
+  timerController->tma = 0;
+  timerController->tac = 0;
   timerController->interruptController = interruptController;
 }
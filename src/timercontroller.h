@@ -7,14 +7,11 @@
 
 
 typedef struct {
-  uint8_t div;  // FF04 - Divider Register (R/W)
+  uint16_t counter; // Counts CPU clock cycles - DIV (FF04) is its upper byte, and TIMA increments on the falling edges of the bit TAC selects
   uint8_t tima; // FF05 - Timer Counter (R/W)
   uint8_t tma;  // FF06 - Timer Modulo (R/W)
   uint8_t tac;  // FF07 - Timer Control (R/W)
 
-  uint32_t dividerCounter;
-  uint32_t timerCounter;
-
   InterruptController* interruptController;
 } TimerController;
 
@@ -0,0 +1,226 @@
+#include "upscaler.h"
+
+#include "logging.h"
+#include "timing.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void upscalerUpscaleStripe(Upscaler* upscaler, const Pixel* input, uint32_t stripe)
+{
+  uint32_t firstRow = (LCD_HEIGHT * stripe) / upscaler->threadCount;
+  uint32_t lastRow = (LCD_HEIGHT * (stripe + 1)) / upscaler->threadCount;
+  upscaler->kernel(input, upscaler->output, upscaler->scale, firstRow, lastRow);
+}
+
+
+static void* upscalerStripeThread(void* arg)
+{
+  UpscalerStripeThread* stripeThread = (UpscalerStripeThread*)arg;
+  Upscaler* upscaler = stripeThread->upscaler;
+  uint32_t generation = 0;
+
+  pthread_mutex_lock(&upscaler->stripeMutex);
+
+  while (true) {
+    while (!upscaler->stripeThreadsAreClosing && upscaler->stripeGeneration == generation) {
+      pthread_cond_wait(&upscaler->stripesStarted, &upscaler->stripeMutex);
+    }
+    if (upscaler->stripeThreadsAreClosing) {
+      break;
+    }
+
+    generation = upscaler->stripeGeneration;
+    const Pixel* input = upscaler->stripeInput;
+    pthread_mutex_unlock(&upscaler->stripeMutex);
+
+    upscalerUpscaleStripe(upscaler, input, stripeThread->stripe);
+
+    pthread_mutex_lock(&upscaler->stripeMutex);
+    if (--upscaler->stripesRemaining == 0) {
+      pthread_cond_signal(&upscaler->stripesFinished);
+    }
+  }
+
+  pthread_mutex_unlock(&upscaler->stripeMutex);
+
+  return NULL;
+}
+
+
+static void upscalerUpscaleFrame(Upscaler* upscaler, const Pixel* input)
+{
+  if (upscaler->threadCount > 1) {
+    pthread_mutex_lock(&upscaler->stripeMutex);
+    upscaler->stripeInput = input;
+    upscaler->stripesRemaining = upscaler->threadCount - 1;
+    upscaler->stripeGeneration++;
+    pthread_cond_broadcast(&upscaler->stripesStarted);
+    pthread_mutex_unlock(&upscaler->stripeMutex);
+  }
+
+  upscalerUpscaleStripe(upscaler, input, 0);
+
+  if (upscaler->threadCount > 1) {
+    pthread_mutex_lock(&upscaler->stripeMutex);
+    while (upscaler->stripesRemaining > 0) {
+      pthread_cond_wait(&upscaler->stripesFinished, &upscaler->stripeMutex);
+    }
+    pthread_mutex_unlock(&upscaler->stripeMutex);
+  }
+}
+
+
+static void* upscalerWorkerThread(void* arg)
+{
+  Upscaler* upscaler = (Upscaler*)arg;
+  uint32_t head = upscaler->queueHead;
+
+  while (true) {
+    if (head == __atomic_load_n(&upscaler->queueTail, __ATOMIC_ACQUIRE)) {
+      // The sleeping flag is set before the queue is checked again, and upscalerSubmitFrame() adds to the queue before
+      // checking the flag, so either this sees the new frame or the emulator sees the flag and wakes the worker
+      pthread_mutex_lock(&upscaler->mutex);
+      __atomic_store_n(&upscaler->workerIsSleeping, true, __ATOMIC_SEQ_CST);
+      while (!upscaler->isClosing && head == __atomic_load_n(&upscaler->queueTail, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&upscaler->frameQueued, &upscaler->mutex);
+      }
+      __atomic_store_n(&upscaler->workerIsSleeping, false, __ATOMIC_SEQ_CST);
+      bool isClosing = upscaler->isClosing;
+      pthread_mutex_unlock(&upscaler->mutex);
+
+      if (isClosing) {
+        break;
+      }
+      continue;
+    }
+
+    const uint64_t startTime = currentTimeMicros();
+    upscalerUpscaleFrame(upscaler, upscaler->queue[head % UPSCALER_QUEUE_LENGTH]);
+    upscaler->upscaleMicros += currentTimeMicros() - startTime;
+    upscaler->framesUpscaled++;
+
+    if (upscaler->outputFn != NULL) {
+      upscaler->outputFn(upscaler->output, upscaler->outputWidth, upscaler->outputHeight, upscaler->outputContext);
+    }
+
+    // Only give the frame's slot back to the emulator once it's finished with
+    head++;
+    __atomic_store_n(&upscaler->queueHead, head, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&upscaler->mutex);
+    pthread_cond_broadcast(&upscaler->frameFinished);
+    pthread_mutex_unlock(&upscaler->mutex);
+  }
+
+  return NULL;
+}
+
+
+Upscaler* upscalerCreate(UpscaleFilter filter, uint32_t nearestScale, uint32_t threadCount, bool allowSIMD, UpscalerOutputFn outputFn, void* outputContext)
+{
+  Upscaler* upscaler = (Upscaler*)calloc(1, sizeof(Upscaler));
+  assert(upscaler);
+
+  upscaler->filter = filter;
+  upscaler->kernel = upscaleKernelFunction(filter, allowSIMD);
+  upscaler->scale = upscaleFilterScale(filter, nearestScale);
+  upscaler->outputWidth = LCD_WIDTH * upscaler->scale;
+  upscaler->outputHeight = LCD_HEIGHT * upscaler->scale;
+  upscaler->output = (Pixel*)calloc(upscaler->outputWidth * upscaler->outputHeight, sizeof(Pixel));
+  assert(upscaler->output);
+  upscaler->outputFn = outputFn;
+  upscaler->outputContext = outputContext;
+
+  upscaler->threadCount = (threadCount < 1) ? 1 : ((threadCount > UPSCALER_MAX_THREADS) ? UPSCALER_MAX_THREADS : threadCount);
+
+  pthread_mutex_init(&upscaler->mutex, NULL);
+  pthread_cond_init(&upscaler->frameQueued, NULL);
+  pthread_cond_init(&upscaler->frameFinished, NULL);
+  pthread_mutex_init(&upscaler->stripeMutex, NULL);
+  pthread_cond_init(&upscaler->stripesStarted, NULL);
+  pthread_cond_init(&upscaler->stripesFinished, NULL);
+
+  for (uint32_t i = 0; i < upscaler->threadCount - 1; i++) {
+    UpscalerStripeThread* stripeThread = &upscaler->stripeThreads[i];
+    stripeThread->upscaler = upscaler;
+    stripeThread->stripe = i + 1;
+    if (pthread_create(&stripeThread->thread, NULL, &upscalerStripeThread, stripeThread) != 0) {
+      critical("Failed to start upscaler stripe thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (pthread_create(&upscaler->worker, NULL, &upscalerWorkerThread, upscaler) != 0) {
+    critical("Failed to start upscaler worker thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return upscaler;
+}
+
+
+// Copies a finished frame into the queue to be upscaled, or returns false (and drops the frame) if the queue is full
+bool upscalerSubmitFrame(Upscaler* upscaler, const Pixel* frameBuffer)
+{
+  uint32_t tail = upscaler->queueTail;
+  if (tail - __atomic_load_n(&upscaler->queueHead, __ATOMIC_ACQUIRE) == UPSCALER_QUEUE_LENGTH) {
+    upscaler->framesDropped++;
+    return false;
+  }
+
+  memcpy(upscaler->queue[tail % UPSCALER_QUEUE_LENGTH], frameBuffer, LCD_WIDTH * LCD_HEIGHT * sizeof(Pixel));
+  __atomic_store_n(&upscaler->queueTail, tail + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&upscaler->workerIsSleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&upscaler->mutex);
+    pthread_cond_signal(&upscaler->frameQueued);
+    pthread_mutex_unlock(&upscaler->mutex);
+  }
+
+  return true;
+}
+
+
+// Waits until every frame in the queue has been upscaled and passed to the output function
+void upscalerFlush(Upscaler* upscaler)
+{
+  pthread_mutex_lock(&upscaler->mutex);
+  while (__atomic_load_n(&upscaler->queueHead, __ATOMIC_ACQUIRE) != upscaler->queueTail) {
+    pthread_cond_wait(&upscaler->frameFinished, &upscaler->mutex);
+  }
+  pthread_mutex_unlock(&upscaler->mutex);
+}
+
+
+// Any frames still in the queue are upscaled before the worker stops
+void upscalerDestroy(Upscaler* upscaler)
+{
+  pthread_mutex_lock(&upscaler->mutex);
+  upscaler->isClosing = true;
+  pthread_cond_signal(&upscaler->frameQueued);
+  pthread_mutex_unlock(&upscaler->mutex);
+
+  pthread_join(upscaler->worker, NULL);
+
+  pthread_mutex_lock(&upscaler->stripeMutex);
+  upscaler->stripeThreadsAreClosing = true;
+  pthread_cond_broadcast(&upscaler->stripesStarted);
+  pthread_mutex_unlock(&upscaler->stripeMutex);
+
+  for (uint32_t i = 0; i < upscaler->threadCount - 1; i++) {
+    pthread_join(upscaler->stripeThreads[i].thread, NULL);
+  }
+
+  pthread_cond_destroy(&upscaler->stripesFinished);
+  pthread_cond_destroy(&upscaler->stripesStarted);
+  pthread_mutex_destroy(&upscaler->stripeMutex);
+  pthread_cond_destroy(&upscaler->frameFinished);
+  pthread_cond_destroy(&upscaler->frameQueued);
+  pthread_mutex_destroy(&upscaler->mutex);
+
+  free(upscaler->output);
+  free(upscaler);
+}
@@ -0,0 +1,81 @@
+#ifndef UPSCALER_H_
+#define UPSCALER_H_
+
+#include "lcd.h"
+#include "pixel.h"
+#include "upscalerkernels.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define UPSCALER_QUEUE_LENGTH 4
+#define UPSCALER_MAX_THREADS 8
+
+
+// Called on the upscaler's worker thread with each upscaled frame, which is only valid until the function returns
+typedef void (*UpscalerOutputFn)(const Pixel* output, uint32_t width, uint32_t height, void* context);
+
+
+struct Upscaler;
+
+typedef struct {
+  struct Upscaler* upscaler;
+  uint32_t stripe;
+  pthread_t thread;
+} UpscalerStripeThread;
+
+
+// Frames are upscaled on a worker thread, so the emulator only has to copy each finished frame into a queue.
+//
+// The queue is a single producer, single consumer ring of frames with the emulator as the producer and the worker as
+// the consumer. Neither side takes a lock to add or remove a frame - the mutex is only used for the worker to sleep
+// when there's nothing to do. Frames that arrive while the queue is full are dropped rather than making the emulator
+// wait.
+//
+// With more than one thread each frame is split into horizontal stripes, with the worker upscaling the first stripe
+// and a pool of stripe threads upscaling the rest.
+typedef struct Upscaler {
+  UpscaleFilter filter;
+  UpscaleKernelFn kernel;
+  uint32_t scale;
+  uint32_t outputWidth;
+  uint32_t outputHeight;
+  Pixel* output;
+  UpscalerOutputFn outputFn;
+  void* outputContext;
+
+  Pixel queue[UPSCALER_QUEUE_LENGTH][LCD_WIDTH * LCD_HEIGHT];
+  uint32_t queueHead; // Count of frames taken from the queue, only written by the worker
+  uint32_t queueTail; // Count of frames added to the queue, only written by the emulator
+  bool workerIsSleeping;
+  bool isClosing;
+
+  pthread_t worker;
+  pthread_mutex_t mutex; // Protects isClosing, and is held by the worker while it decides to sleep
+  pthread_cond_t frameQueued;
+  pthread_cond_t frameFinished;
+
+  uint32_t threadCount;
+  UpscalerStripeThread stripeThreads[UPSCALER_MAX_THREADS - 1];
+  pthread_mutex_t stripeMutex; // Protects everything below
+  pthread_cond_t stripesStarted;
+  pthread_cond_t stripesFinished;
+  const Pixel* stripeInput;
+  uint32_t stripeGeneration;
+  uint32_t stripesRemaining;
+  bool stripeThreadsAreClosing;
+
+  uint64_t framesUpscaled; // Only written by the worker
+  uint64_t framesDropped; // Only written by the emulator
+  uint64_t upscaleMicros; // Only written by the worker
+} Upscaler;
+
+
+Upscaler* upscalerCreate(UpscaleFilter filter, uint32_t nearestScale, uint32_t threadCount, bool allowSIMD, UpscalerOutputFn outputFn, void* outputContext);
+bool upscalerSubmitFrame(Upscaler* upscaler, const Pixel* frameBuffer);
+void upscalerFlush(Upscaler* upscaler);
+void upscalerDestroy(Upscaler* upscaler);
+
+#endif // UPSCALER_H_
@@ -0,0 +1,880 @@
+#include "upscalerkernels.h"
+
+#include "lcd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UPSCALE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+// Pixel at (x, y), with coordinates outside the frame clamped to its edges
+static Pixel pixelAt(const Pixel* input, int x, int y)
+{
+  x = (x < 0) ? 0 : ((x >= LCD_WIDTH) ? LCD_WIDTH - 1 : x);
+  y = (y < 0) ? 0 : ((y >= LCD_HEIGHT) ? LCD_HEIGHT - 1 : y);
+  return input[y * LCD_WIDTH + x];
+}
+
+
+static Pixel* outputRow(Pixel* output, uint32_t scale, uint32_t y, uint32_t subRow)
+{
+  return output + (((y * scale) + subRow) * LCD_WIDTH * scale);
+}
+
+
+static void upscaleNearestScalar(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    const Pixel* in = input + (y * LCD_WIDTH);
+    Pixel* out = outputRow(output, scale, y, 0);
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      for (uint32_t i = 0; i < scale; i++) {
+        out[(x * scale) + i] = in[x];
+      }
+    }
+    for (uint32_t subRow = 1; subRow < scale; subRow++) {
+      memcpy(outputRow(output, scale, y, subRow), out, LCD_WIDTH * scale * sizeof(Pixel));
+    }
+  }
+}
+
+
+// Scale2x (AdvMAME2x), where each pixel E and its neighbours
+//   A B C
+//   D E F
+//   G H I
+// become E0 E1 / E2 E3, taking the colour of a neighbour where two neighbours meet at a corner
+static void upscaleScale2xScalar(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    Pixel* out0 = outputRow(output, 2, y, 0);
+    Pixel* out1 = outputRow(output, 2, y, 1);
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      Pixel B = pixelAt(input, x, y - 1);
+      Pixel D = pixelAt(input, x - 1, y);
+      Pixel E = pixelAt(input, x, y);
+      Pixel F = pixelAt(input, x + 1, y);
+      Pixel H = pixelAt(input, x, y + 1);
+
+      if (B != H && D != F) {
+        out0[x * 2] = (D == B) ? D : E;
+        out0[x * 2 + 1] = (B == F) ? F : E;
+        out1[x * 2] = (D == H) ? D : E;
+        out1[x * 2 + 1] = (H == F) ? F : E;
+      } else {
+        out0[x * 2] = out0[x * 2 + 1] = out1[x * 2] = out1[x * 2 + 1] = E;
+      }
+    }
+  }
+}
+
+
+// Scale3x (AdvMAME3x), which becomes E0 E1 E2 / E3 E4 E5 / E6 E7 E8 using the same neighbour names as Scale2x
+static void upscaleScale3xScalar(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    Pixel* out0 = outputRow(output, 3, y, 0);
+    Pixel* out1 = outputRow(output, 3, y, 1);
+    Pixel* out2 = outputRow(output, 3, y, 2);
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      Pixel A = pixelAt(input, x - 1, y - 1);
+      Pixel B = pixelAt(input, x, y - 1);
+      Pixel C = pixelAt(input, x + 1, y - 1);
+      Pixel D = pixelAt(input, x - 1, y);
+      Pixel E = pixelAt(input, x, y);
+      Pixel F = pixelAt(input, x + 1, y);
+      Pixel G = pixelAt(input, x - 1, y + 1);
+      Pixel H = pixelAt(input, x, y + 1);
+      Pixel I = pixelAt(input, x + 1, y + 1);
+
+      Pixel* e = &out0[x * 3];
+      Pixel* e3 = &out1[x * 3];
+      Pixel* e6 = &out2[x * 3];
+
+      if (B != H && D != F) {
+        e[0] = (D == B) ? D : E;
+        e[1] = ((D == B && E != C) || (B == F && E != A)) ? B : E;
+        e[2] = (B == F) ? F : E;
+        e3[0] = ((D == B && E != G) || (D == H && E != A)) ? D : E;
+        e3[1] = E;
+        e3[2] = ((B == F && E != I) || (H == F && E != C)) ? F : E;
+        e6[0] = (D == H) ? D : E;
+        e6[1] = ((D == H && E != I) || (H == F && E != G)) ? H : E;
+        e6[2] = (H == F) ? F : E;
+      } else {
+        for (int i = 0; i < 3; i++) {
+          e[i] = e3[i] = e6[i] = E;
+        }
+      }
+    }
+  }
+}
+
+
+// Perceptual distance between two colours, as the weighted difference of their YUV components (scaled by 1000)
+static uint32_t colourDistance(Pixel a, Pixel b)
+{
+  int r = (int)PIXEL_RED(a) - (int)PIXEL_RED(b);
+  int g = (int)PIXEL_GREEN(a) - (int)PIXEL_GREEN(b);
+  int bl = (int)PIXEL_BLUE(a) - (int)PIXEL_BLUE(b);
+
+  int y = (299 * r) + (587 * g) + (114 * bl);
+  int u = (-169 * r) - (331 * g) + (500 * bl);
+  int v = (500 * r) - (419 * g) - (81 * bl);
+
+  return (48 * abs(y)) + (7 * abs(u)) + (6 * abs(v));
+}
+
+
+// Mixes quarters of two colours, where amount is the number of quarters of b
+static Pixel blendPixels(Pixel a, Pixel b, uint32_t amount)
+{
+  return PIXEL_RGB(
+    ((PIXEL_RED(a) * (4 - amount)) + (PIXEL_RED(b) * amount)) / 4,
+    ((PIXEL_GREEN(a) * (4 - amount)) + (PIXEL_GREEN(b) * amount)) / 4,
+    ((PIXEL_BLUE(a) * (4 - amount)) + (PIXEL_BLUE(b) * amount)) / 4
+  );
+}
+
+
+// 2xBR, which looks at the 5x5 neighbourhood of each pixel (without its corners) to find edges passing close to each
+// of the pixel's corners and blends the output pixels at that corner towards the colour on the other side of the edge.
+// Every corner uses the rules for the bottom right one, with the neighbourhood mirrored so that the corner being
+// looked at is the bottom right one.
+static void upscaleXBR2xScalar(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  static const int CORNER_DIRECTIONS[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}; // {y, x}
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      Pixel E = pixelAt(input, x, y);
+      Pixel out[2][2] = {{E, E}, {E, E}};
+
+      for (int corner = 0; corner < 4; corner++) {
+        const int sy = CORNER_DIRECTIONS[corner][0];
+        const int sx = CORNER_DIRECTIONS[corner][1];
+
+#define N(dx, dy) pixelAt(input, x + (sx * (dx)), y + (sy * (dy)))
+        Pixel F = N(1, 0), H = N(0, 1);
+        if (E == F || E == H) {
+          continue;
+        }
+
+        Pixel B = N(0, -1), C = N(1, -1), D = N(-1, 0), G = N(-1, 1), I = N(1, 1);
+        Pixel F4 = N(2, 0), I4 = N(2, 1), H5 = N(0, 2), I5 = N(1, 2);
+#undef N
+
+        // Weighted lengths of the edges running along F-H and along E-I
+        uint32_t edgeFH = colourDistance(E, C) + colourDistance(E, G) + colourDistance(I, H5) + colourDistance(I, F4) + (4 * colourDistance(H, F));
+        uint32_t edgeEI = colourDistance(H, D) + colourDistance(H, I5) + colourDistance(F, I4) + colourDistance(F, B) + (4 * colourDistance(E, I));
+        if (edgeFH >= edgeEI) {
+          continue;
+        }
+
+        Pixel colour = (colourDistance(E, F) <= colourDistance(E, H)) ? F : H;
+
+        // Output pixels in the mirrored neighbourhood, so (1, 1) is always the one at the corner
+        Pixel* corner11 = &out[(sy > 0) ? 1 : 0][(sx > 0) ? 1 : 0];
+        Pixel* corner01 = &out[(sy > 0) ? 0 : 1][(sx > 0) ? 1 : 0];
+        Pixel* corner10 = &out[(sy > 0) ? 1 : 0][(sx > 0) ? 0 : 1];
+
+        // Shallow and steep edges also cover part of the next output pixel along them
+        uint32_t shallow = colourDistance(F, G);
+        uint32_t steep = colourDistance(H, C);
+        if ((shallow * 2) <= steep && E != G && D != G) {
+          *corner10 = blendPixels(*corner10, colour, 1);
+          *corner11 = blendPixels(*corner11, colour, 3);
+        } else if ((steep * 2) <= shallow && E != C && B != C) {
+          *corner01 = blendPixels(*corner01, colour, 1);
+          *corner11 = blendPixels(*corner11, colour, 3);
+        } else {
+          *corner11 = blendPixels(*corner11, colour, 2);
+        }
+      }
+
+      Pixel* out0 = outputRow(output, 2, y, 0);
+      Pixel* out1 = outputRow(output, 2, y, 1);
+      out0[x * 2] = out[0][0];
+      out0[x * 2 + 1] = out[0][1];
+      out1[x * 2] = out[1][0];
+      out1[x * 2 + 1] = out[1][1];
+    }
+  }
+}
+
+
+// HQ2x treats two colours as different when any of their YUV components are further apart than these
+#define HQ2X_Y_THRESHOLD 48
+#define HQ2X_U_THRESHOLD 7
+#define HQ2X_V_THRESHOLD 6
+
+// Bits of a pattern besides the 8 for the neighbours, for whether the neighbours either side of the corner are
+// different from each other
+#define HQ2X_PATTERN_BF (1 << 8)
+#define HQ2X_PATTERN_HD (1 << 9)
+#define HQ2X_PATTERN_DB (1 << 10)
+
+
+// Every output pixel is worked out as if it were the top left one, with the neighbourhood mirrored to put it there.
+// These are where each of A to I comes from in the neighbourhood for each output pixel.
+static const int HQ2X_CORNER_POSITIONS[4][9] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8}, // Top left
+  {2, 1, 0, 5, 4, 3, 8, 7, 6}, // Top right
+  {6, 7, 8, 3, 4, 5, 0, 1, 2}, // Bottom left
+  {8, 7, 6, 5, 4, 3, 2, 1, 0} // Bottom right
+};
+
+
+// YUV of a colour packed as 0x00YYUUVV, with U and V offset so that every component is positive and fits in a byte
+static uint32_t hq2xYUV(Pixel pixel)
+{
+  const uint32_t r = PIXEL_RED(pixel);
+  const uint32_t g = PIXEL_GREEN(pixel);
+  const uint32_t b = PIXEL_BLUE(pixel);
+
+  const uint32_t y = (r + g + b) >> 2;
+  const uint32_t u = (512 + r - b) >> 2;
+  const uint32_t v = (1024 + (2 * g) - r - b) >> 3;
+
+  return (y << 16) | (u << 8) | v;
+}
+
+
+static bool hq2xColoursDiffer(uint32_t yuvA, uint32_t yuvB)
+{
+  return abs((int)((yuvA >> 16) & 0xFF) - (int)((yuvB >> 16) & 0xFF)) > HQ2X_Y_THRESHOLD
+    || abs((int)((yuvA >> 8) & 0xFF) - (int)((yuvB >> 8) & 0xFF)) > HQ2X_U_THRESHOLD
+    || abs((int)(yuvA & 0xFF) - (int)(yuvB & 0xFF)) > HQ2X_V_THRESHOLD;
+}
+
+
+// Mixes three colours, where the weights add up to 1 << shift
+static Pixel hq2xMix(Pixel a, uint32_t weightA, Pixel b, uint32_t weightB, Pixel c, uint32_t weightC, uint32_t shift)
+{
+  return PIXEL_RGB(
+    ((PIXEL_RED(a) * weightA) + (PIXEL_RED(b) * weightB) + (PIXEL_RED(c) * weightC)) >> shift,
+    ((PIXEL_GREEN(a) * weightA) + (PIXEL_GREEN(b) * weightB) + (PIXEL_GREEN(c) * weightC)) >> shift,
+    ((PIXEL_BLUE(a) * weightA) + (PIXEL_BLUE(b) * weightB) + (PIXEL_BLUE(c) * weightC)) >> shift
+  );
+}
+
+
+// The top left output pixel of E. Which neighbours are different from E make a pattern (bit 0 for A to bit 7 for I,
+// skipping E) that picks how much of E is mixed with the neighbours touching the corner, A, B and D.
+static Pixel hq2xCornerPixel(Pixel A, Pixel B, Pixel D, Pixel E, uint32_t pattern)
+{
+  const bool BF = (pattern & HQ2X_PATTERN_BF) != 0;
+  const bool HD = (pattern & HQ2X_PATTERN_HD) != 0;
+  const bool DB = (pattern & HQ2X_PATTERN_DB) != 0;
+
+#define P(mask, result) ((pattern & (mask)) == (result))
+  if ((P(0xBF, 0x37) || P(0xDB, 0x13)) && BF) {
+    return hq2xMix(E, 3, D, 1, E, 0, 2);
+  }
+  if ((P(0xDB, 0x49) || P(0xEF, 0x6D)) && HD) {
+    return hq2xMix(E, 3, B, 1, E, 0, 2);
+  }
+  if ((P(0x0B, 0x0B) || P(0xFE, 0x4A) || P(0xFE, 0x1A)) && DB) {
+    return E;
+  }
+  if ((P(0x6F, 0x2A) || P(0x5B, 0x0A) || P(0xBF, 0x3A) || P(0xDF, 0x5A) || P(0x9F, 0x8A) || P(0xCF, 0x8A) || P(0xEF, 0x4E)
+       || P(0x3F, 0x0E) || P(0xFB, 0x5A) || P(0xBB, 0x8A) || P(0x7F, 0x5A) || P(0xAF, 0x8A) || P(0xEB, 0x8A)) && DB) {
+    return hq2xMix(E, 3, A, 1, E, 0, 2);
+  }
+  if (P(0x0B, 0x08)) {
+    return hq2xMix(E, 2, A, 1, B, 1, 2);
+  }
+  if (P(0x0B, 0x02)) {
+    return hq2xMix(E, 2, A, 1, D, 1, 2);
+  }
+  if (P(0x2F, 0x2F)) {
+    return hq2xMix(E, 14, D, 1, B, 1, 4);
+  }
+  if (P(0xBF, 0x37) || P(0xDB, 0x13)) {
+    return hq2xMix(E, 5, B, 2, D, 1, 3);
+  }
+  if (P(0xDB, 0x49) || P(0xEF, 0x6D)) {
+    return hq2xMix(E, 5, D, 2, B, 1, 3);
+  }
+  if (P(0x1B, 0x03) || P(0x4F, 0x43) || P(0x8B, 0x83) || P(0x6B, 0x43)) {
+    return hq2xMix(E, 3, D, 1, E, 0, 2);
+  }
+  if (P(0x4B, 0x09) || P(0x8B, 0x89) || P(0x1F, 0x19) || P(0x3B, 0x19)) {
+    return hq2xMix(E, 3, B, 1, E, 0, 2);
+  }
+  if (P(0x7E, 0x2A) || P(0xEF, 0xAB) || P(0xBF, 0x8F) || P(0x7E, 0x0E)) {
+    return hq2xMix(E, 2, D, 3, B, 3, 3);
+  }
+  if (P(0xFB, 0x6A) || P(0x6F, 0x6E) || P(0x3F, 0x3E) || P(0xFB, 0xFA) || P(0xDF, 0xDE) || P(0xDF, 0x1E)) {
+    return hq2xMix(E, 3, A, 1, E, 0, 2);
+  }
+  if (P(0x0A, 0x00) || P(0x4F, 0x4B) || P(0x9F, 0x1B) || P(0x2F, 0x0B) || P(0xBE, 0x0A) || P(0xEE, 0x0A) || P(0x7E, 0x0A)
+      || P(0xEB, 0x4B) || P(0x3B, 0x1B)) {
+    return hq2xMix(E, 2, D, 1, B, 1, 2);
+  }
+#undef P
+
+  return hq2xMix(E, 6, D, 1, B, 1, 3);
+}
+
+
+// Writes the output pixels of E from the pattern for each of them
+static void hq2xWritePixels(Pixel* out0, Pixel* out1, int x, const Pixel* w, const uint32_t* patterns)
+{
+  Pixel* outputs[4] = {&out0[x * 2], &out0[x * 2 + 1], &out1[x * 2], &out1[x * 2 + 1]};
+  for (int corner = 0; corner < 4; corner++) {
+    const int* p = HQ2X_CORNER_POSITIONS[corner];
+    *outputs[corner] = hq2xCornerPixel(w[p[0]], w[p[1]], w[p[3]], w[4], patterns[corner]);
+  }
+}
+
+
+// HQ2x (Maxim Stepin's hq2x), which compares the 3x3 neighbourhood A to I of each pixel in YUV to find which
+// neighbours are a different colour and mixes each output pixel from E and its nearest neighbours depending on the
+// pattern they make
+static void upscaleHQ2xScalar(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    Pixel* out0 = outputRow(output, 2, y, 0);
+    Pixel* out1 = outputRow(output, 2, y, 1);
+    for (int x = 0; x < LCD_WIDTH; x++) {
+      Pixel w[9];
+      uint32_t yuv[9];
+      for (int i = 0; i < 9; i++) {
+        w[i] = pixelAt(input, x + (i % 3) - 1, y + (i / 3) - 1);
+        yuv[i] = hq2xYUV(w[i]);
+      }
+
+      bool differsFromE[9];
+      for (int i = 0; i < 9; i++) {
+        differsFromE[i] = (i != 4) && hq2xColoursDiffer(yuv[i], yuv[4]);
+      }
+
+      uint32_t patterns[4];
+      for (int corner = 0; corner < 4; corner++) {
+        const int* p = HQ2X_CORNER_POSITIONS[corner];
+        uint32_t pattern = 0;
+        for (int n = 0; n < 8; n++) {
+          pattern |= differsFromE[p[(n < 4) ? n : n + 1]] ? (1 << n) : 0;
+        }
+        pattern |= hq2xColoursDiffer(yuv[p[1]], yuv[p[5]]) ? HQ2X_PATTERN_BF : 0;
+        pattern |= hq2xColoursDiffer(yuv[p[7]], yuv[p[3]]) ? HQ2X_PATTERN_HD : 0;
+        pattern |= hq2xColoursDiffer(yuv[p[3]], yuv[p[1]]) ? HQ2X_PATTERN_DB : 0;
+        patterns[corner] = pattern;
+      }
+
+      hq2xWritePixels(out0, out1, x, w, patterns);
+    }
+  }
+}
+
+
+#ifdef UPSCALE_KERNELS_X86
+
+// Each group of 4 input pixels is spread over scale registers of 4 output pixels by shuffling
+__attribute__((target("sse2")))
+static void upscaleNearestSSE2(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  if (scale != 2 && scale != 3 && scale != 4) {
+    upscaleNearestScalar(input, output, scale, firstRow, lastRow);
+    return;
+  }
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    const Pixel* in = input + (y * LCD_WIDTH);
+    Pixel* out = outputRow(output, scale, y, 0);
+    for (int x = 0; x < LCD_WIDTH; x += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i*)&in[x]);
+      __m128i* dest = (__m128i*)&out[x * scale];
+      if (scale == 2) {
+        _mm_storeu_si128(dest, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 0, 0)));
+        _mm_storeu_si128(dest + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 2, 2)));
+      } else if (scale == 3) {
+        _mm_storeu_si128(dest, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 0, 0, 0)));
+        _mm_storeu_si128(dest + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 1, 1)));
+        _mm_storeu_si128(dest + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 2)));
+      } else {
+        _mm_storeu_si128(dest, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 0, 0, 0)));
+        _mm_storeu_si128(dest + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 1, 1)));
+        _mm_storeu_si128(dest + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 2, 2)));
+        _mm_storeu_si128(dest + 3, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 3)));
+      }
+    }
+    for (uint32_t subRow = 1; subRow < scale; subRow++) {
+      memcpy(outputRow(output, scale, y, subRow), out, LCD_WIDTH * scale * sizeof(Pixel));
+    }
+  }
+}
+
+
+static __m128i selectPixels(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+// The same rules as upscaleScale2xScalar() for 4 pixels at a time. D and F are read from a copy of the row with its
+// edge pixels repeated, so that they can be loaded one pixel either side of E.
+__attribute__((target("sse2")))
+static void upscaleScale2xSSE2(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  Pixel row[LCD_WIDTH + 2];
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    const Pixel* above = input + ((y > 0 ? y - 1 : y) * LCD_WIDTH);
+    const Pixel* below = input + ((y < LCD_HEIGHT - 1 ? y + 1 : y) * LCD_WIDTH);
+    memcpy(&row[1], input + (y * LCD_WIDTH), LCD_WIDTH * sizeof(Pixel));
+    row[0] = row[1];
+    row[LCD_WIDTH + 1] = row[LCD_WIDTH];
+
+    Pixel* out0 = outputRow(output, 2, y, 0);
+    Pixel* out1 = outputRow(output, 2, y, 1);
+
+    for (int x = 0; x < LCD_WIDTH; x += 4) {
+      __m128i B = _mm_loadu_si128((const __m128i*)&above[x]);
+      __m128i D = _mm_loadu_si128((const __m128i*)&row[x]);
+      __m128i E = _mm_loadu_si128((const __m128i*)&row[x + 1]);
+      __m128i F = _mm_loadu_si128((const __m128i*)&row[x + 2]);
+      __m128i H = _mm_loadu_si128((const __m128i*)&below[x]);
+
+      // Lanes where B != H and D != F
+      __m128i isCorner = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), _mm_set1_epi32(-1));
+
+      __m128i e0 = selectPixels(_mm_and_si128(isCorner, _mm_cmpeq_epi32(D, B)), D, E);
+      __m128i e1 = selectPixels(_mm_and_si128(isCorner, _mm_cmpeq_epi32(B, F)), F, E);
+      __m128i e2 = selectPixels(_mm_and_si128(isCorner, _mm_cmpeq_epi32(D, H)), D, E);
+      __m128i e3 = selectPixels(_mm_and_si128(isCorner, _mm_cmpeq_epi32(H, F)), F, E);
+
+      _mm_storeu_si128((__m128i*)&out0[x * 2], _mm_unpacklo_epi32(e0, e1));
+      _mm_storeu_si128((__m128i*)&out0[x * 2 + 4], _mm_unpackhi_epi32(e0, e1));
+      _mm_storeu_si128((__m128i*)&out1[x * 2], _mm_unpacklo_epi32(e2, e3));
+      _mm_storeu_si128((__m128i*)&out1[x * 2 + 4], _mm_unpackhi_epi32(e2, e3));
+    }
+  }
+}
+
+
+// Copies row y (clamped to the frame) with its edge pixels repeated padding times either side, so that neighbours
+// either side of a group of pixels can be loaded without checking for the edges
+static void copyPaddedRow(Pixel* row, const Pixel* input, int y, int padding)
+{
+  y = (y < 0) ? 0 : ((y >= LCD_HEIGHT) ? LCD_HEIGHT - 1 : y);
+  memcpy(&row[padding], input + (y * LCD_WIDTH), LCD_WIDTH * sizeof(Pixel));
+  for (int i = 0; i < padding; i++) {
+    row[i] = row[padding];
+    row[padding + LCD_WIDTH + i] = row[padding + LCD_WIDTH - 1];
+  }
+}
+
+
+// Stores 4 pixels from each of a, b and c as a0 b0 c0 a1 b1 c1 a2 b2 c2 a3 b3 c3
+__attribute__((target("sse2")))
+static void storeInterleaved3(Pixel* dest, __m128i a, __m128i b, __m128i c)
+{
+  __m128i ab0 = _mm_unpacklo_epi32(a, b); // a0 b0 a1 b1
+  __m128i ab1 = _mm_unpackhi_epi32(a, b); // a2 b2 a3 b3
+  __m128i bc0 = _mm_unpacklo_epi32(b, c); // b0 c0 b1 c1
+  __m128i bc1 = _mm_unpackhi_epi32(b, c); // b2 c2 b3 c3
+  __m128i ca0 = _mm_unpacklo_epi32(c, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 1, 1, 1))); // c0 a1 ...
+  __m128i ca1 = _mm_unpackhi_epi32(c, _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 3, 3))); // c2 a3 ...
+
+  _mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi64(ab0, ca0));
+  _mm_storeu_si128((__m128i*)(dest + 4), _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(bc0), _mm_castsi128_pd(ab1), 1)));
+  _mm_storeu_si128((__m128i*)(dest + 8), _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(ca1), _mm_castsi128_pd(bc1), 2)));
+}
+
+
+// The same rules as upscaleScale3xScalar() for 4 pixels at a time, with the rows above and below padded as well for
+// the corner neighbours
+__attribute__((target("sse2")))
+static void upscaleScale3xSSE2(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  Pixel rows[3][LCD_WIDTH + 2];
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    for (int i = 0; i < 3; i++) {
+      copyPaddedRow(rows[i], input, (int)y + i - 1, 1);
+    }
+
+    Pixel* out0 = outputRow(output, 3, y, 0);
+    Pixel* out1 = outputRow(output, 3, y, 1);
+    Pixel* out2 = outputRow(output, 3, y, 2);
+
+    for (int x = 0; x < LCD_WIDTH; x += 4) {
+      __m128i A = _mm_loadu_si128((const __m128i*)&rows[0][x]);
+      __m128i B = _mm_loadu_si128((const __m128i*)&rows[0][x + 1]);
+      __m128i C = _mm_loadu_si128((const __m128i*)&rows[0][x + 2]);
+      __m128i D = _mm_loadu_si128((const __m128i*)&rows[1][x]);
+      __m128i E = _mm_loadu_si128((const __m128i*)&rows[1][x + 1]);
+      __m128i F = _mm_loadu_si128((const __m128i*)&rows[1][x + 2]);
+      __m128i G = _mm_loadu_si128((const __m128i*)&rows[2][x]);
+      __m128i H = _mm_loadu_si128((const __m128i*)&rows[2][x + 1]);
+      __m128i I = _mm_loadu_si128((const __m128i*)&rows[2][x + 2]);
+
+      // Lanes where B != H and D != F
+      __m128i isCorner = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), _mm_set1_epi32(-1));
+
+      __m128i DB = _mm_and_si128(isCorner, _mm_cmpeq_epi32(D, B));
+      __m128i BF = _mm_and_si128(isCorner, _mm_cmpeq_epi32(B, F));
+      __m128i DH = _mm_and_si128(isCorner, _mm_cmpeq_epi32(D, H));
+      __m128i HF = _mm_and_si128(isCorner, _mm_cmpeq_epi32(H, F));
+      __m128i EA = _mm_cmpeq_epi32(E, A);
+      __m128i EC = _mm_cmpeq_epi32(E, C);
+      __m128i EG = _mm_cmpeq_epi32(E, G);
+      __m128i EI = _mm_cmpeq_epi32(E, I);
+
+      __m128i e0 = selectPixels(DB, D, E);
+      __m128i e1 = selectPixels(_mm_or_si128(_mm_andnot_si128(EC, DB), _mm_andnot_si128(EA, BF)), B, E);
+      __m128i e2 = selectPixels(BF, F, E);
+      __m128i e3 = selectPixels(_mm_or_si128(_mm_andnot_si128(EG, DB), _mm_andnot_si128(EA, DH)), D, E);
+      __m128i e5 = selectPixels(_mm_or_si128(_mm_andnot_si128(EI, BF), _mm_andnot_si128(EC, HF)), F, E);
+      __m128i e6 = selectPixels(DH, D, E);
+      __m128i e7 = selectPixels(_mm_or_si128(_mm_andnot_si128(EI, DH), _mm_andnot_si128(EG, HF)), H, E);
+      __m128i e8 = selectPixels(HF, F, E);
+
+      storeInterleaved3(&out0[x * 3], e0, e1, e2);
+      storeInterleaved3(&out1[x * 3], e3, E, e5);
+      storeInterleaved3(&out2[x * 3], e6, e7, e8);
+    }
+  }
+}
+
+
+// The YUV components colourDistance() weighs, for 4 pixels at a time. The distance between two colours is the same
+// as the weighted difference of their components, so they only have to be worked out once for each pixel.
+typedef struct {
+  __m128i y;
+  __m128i u;
+  __m128i v;
+} XBRYUV;
+
+
+// Components of every pixel of a padded row, multiplied out with red and green paired up as 16 bit values so that
+// each component is two multiply-adds
+__attribute__((target("sse2")))
+static void xbrRowYUV(int32_t (*yuv)[LCD_WIDTH + 4], const Pixel* row)
+{
+  const __m128i channelMask = _mm_set1_epi32(0xFF);
+
+#define WEIGHTS(first, second) _mm_set1_epi32((int32_t)(((uint32_t)(uint16_t)(second) << 16) | (uint16_t)(first)))
+  for (int x = 0; x < LCD_WIDTH + 4; x += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)&row[x]);
+    __m128i rg = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 16), channelMask), _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(pixels, 8), channelMask), 16));
+    __m128i b = _mm_and_si128(pixels, channelMask);
+
+    _mm_storeu_si128((__m128i*)&yuv[0][x], _mm_add_epi32(_mm_madd_epi16(rg, WEIGHTS(299, 587)), _mm_madd_epi16(b, WEIGHTS(114, 0))));
+    _mm_storeu_si128((__m128i*)&yuv[1][x], _mm_add_epi32(_mm_madd_epi16(rg, WEIGHTS(-169, -331)), _mm_madd_epi16(b, WEIGHTS(500, 0))));
+    _mm_storeu_si128((__m128i*)&yuv[2][x], _mm_add_epi32(_mm_madd_epi16(rg, WEIGHTS(500, -419)), _mm_madd_epi16(b, WEIGHTS(-81, 0))));
+  }
+#undef WEIGHTS
+}
+
+
+__attribute__((target("sse2")))
+static __m128i absSSE2(__m128i value)
+{
+  __m128i sign = _mm_srai_epi32(value, 31);
+  return _mm_sub_epi32(_mm_xor_si128(value, sign), sign);
+}
+
+
+// colourDistance() for 4 pairs of colours at a time, with the weights made of shifts and adds
+__attribute__((target("sse2")))
+static __m128i colourDistanceSSE2(XBRYUV a, XBRYUV b)
+{
+  __m128i y = absSSE2(_mm_sub_epi32(a.y, b.y));
+  __m128i u = absSSE2(_mm_sub_epi32(a.u, b.u));
+  __m128i v = absSSE2(_mm_sub_epi32(a.v, b.v));
+
+  // 48y + 7u + 6v
+  __m128i distance = _mm_add_epi32(_mm_slli_epi32(y, 5), _mm_slli_epi32(y, 4));
+  distance = _mm_add_epi32(distance, _mm_sub_epi32(_mm_slli_epi32(u, 3), u));
+  return _mm_add_epi32(distance, _mm_add_epi32(_mm_slli_epi32(v, 2), _mm_slli_epi32(v, 1)));
+}
+
+
+// blendPixels() for 4 pixels at a time, with each channel widened to 16 bits
+__attribute__((target("sse2")))
+static __m128i blendPixelsSSE2(__m128i a, __m128i b, int amount)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weightA = _mm_set1_epi16((int16_t)(4 - amount));
+  const __m128i weightB = _mm_set1_epi16((int16_t)amount);
+
+  __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weightA), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weightB));
+  __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weightA), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weightB));
+  return _mm_packus_epi16(_mm_srli_epi16(low, 2), _mm_srli_epi16(high, 2));
+}
+
+
+// The same rules as upscaleXBR2xScalar() for 4 pixels at a time. The conditions that make the scalar version skip a
+// corner become masks of the lanes that blend, and the blends are applied corner by corner in the same order so that
+// output pixels blended by two corners come out the same.
+__attribute__((target("sse2")))
+static void upscaleXBR2xSSE2(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  static const int CORNER_DIRECTIONS[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}; // {y, x}
+
+  Pixel rows[5][LCD_WIDTH + 4];
+  int32_t yuvRows[5][3][LCD_WIDTH + 4];
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    for (int i = 0; i < 5; i++) {
+      copyPaddedRow(rows[i], input, (int)y + i - 2, 2);
+      xbrRowYUV(yuvRows[i], rows[i]);
+    }
+
+    Pixel* out0 = outputRow(output, 2, y, 0);
+    Pixel* out1 = outputRow(output, 2, y, 1);
+
+    for (int x = 0; x < LCD_WIDTH; x += 4) {
+      __m128i E = _mm_loadu_si128((const __m128i*)&rows[2][x + 2]);
+      __m128i out[2][2] = {{E, E}, {E, E}};
+
+#define YUV(row, column) {_mm_loadu_si128((const __m128i*)&yuvRows[row][0][column]), _mm_loadu_si128((const __m128i*)&yuvRows[row][1][column]), _mm_loadu_si128((const __m128i*)&yuvRows[row][2][column])}
+      const XBRYUV yuvE = YUV(2, x + 2);
+
+      for (int corner = 0; corner < 4; corner++) {
+        const int sy = CORNER_DIRECTIONS[corner][0];
+        const int sx = CORNER_DIRECTIONS[corner][1];
+
+#define N(dx, dy) _mm_loadu_si128((const __m128i*)&rows[2 + (sy * (dy))][x + 2 + (sx * (dx))])
+#define N_YUV(dx, dy) YUV(2 + (sy * (dy)), x + 2 + (sx * (dx)))
+        __m128i F = N(1, 0), H = N(0, 1);
+
+        // Lanes where E == F or E == H, which don't blend
+        __m128i isFlat = _mm_or_si128(_mm_cmpeq_epi32(E, F), _mm_cmpeq_epi32(E, H));
+        if (_mm_movemask_epi8(isFlat) == 0xFFFF) {
+          continue;
+        }
+
+        __m128i B = N(0, -1), C = N(1, -1), D = N(-1, 0), G = N(-1, 1);
+        const XBRYUV yuvF = N_YUV(1, 0), yuvH = N_YUV(0, 1);
+        const XBRYUV yuvB = N_YUV(0, -1), yuvC = N_YUV(1, -1), yuvD = N_YUV(-1, 0), yuvG = N_YUV(-1, 1), yuvI = N_YUV(1, 1);
+        const XBRYUV yuvF4 = N_YUV(2, 0), yuvI4 = N_YUV(2, 1), yuvH5 = N_YUV(0, 2), yuvI5 = N_YUV(1, 2);
+#undef N_YUV
+#undef N
+
+        __m128i edgeFH = _mm_add_epi32(colourDistanceSSE2(yuvE, yuvC), colourDistanceSSE2(yuvE, yuvG));
+        edgeFH = _mm_add_epi32(edgeFH, _mm_add_epi32(colourDistanceSSE2(yuvI, yuvH5), colourDistanceSSE2(yuvI, yuvF4)));
+        edgeFH = _mm_add_epi32(edgeFH, _mm_slli_epi32(colourDistanceSSE2(yuvH, yuvF), 2));
+        __m128i edgeEI = _mm_add_epi32(colourDistanceSSE2(yuvH, yuvD), colourDistanceSSE2(yuvH, yuvI5));
+        edgeEI = _mm_add_epi32(edgeEI, _mm_add_epi32(colourDistanceSSE2(yuvF, yuvI4), colourDistanceSSE2(yuvF, yuvB)));
+        edgeEI = _mm_add_epi32(edgeEI, _mm_slli_epi32(colourDistanceSSE2(yuvE, yuvI), 2));
+
+        // Lanes where E != F, E != H and edgeFH < edgeEI
+        __m128i blends = _mm_andnot_si128(isFlat, _mm_cmplt_epi32(edgeFH, edgeEI));
+        if (_mm_movemask_epi8(blends) == 0) {
+          continue;
+        }
+
+        __m128i colour = selectPixels(_mm_cmpgt_epi32(colourDistanceSSE2(yuvE, yuvF), colourDistanceSSE2(yuvE, yuvH)), H, F);
+
+        __m128i* corner11 = &out[(sy > 0) ? 1 : 0][(sx > 0) ? 1 : 0];
+        __m128i* corner01 = &out[(sy > 0) ? 0 : 1][(sx > 0) ? 1 : 0];
+        __m128i* corner10 = &out[(sy > 0) ? 1 : 0][(sx > 0) ? 0 : 1];
+
+        // Shallow and steep edges, where the scalar version checks shallow first
+        __m128i shallow = colourDistanceSSE2(yuvF, yuvG);
+        __m128i steep = colourDistanceSSE2(yuvH, yuvC);
+        __m128i canBeShallow = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(E, G), _mm_cmpeq_epi32(D, G)), blends);
+        __m128i canBeSteep = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(E, C), _mm_cmpeq_epi32(B, C)), blends);
+        __m128i isShallow = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_slli_epi32(shallow, 1), steep), canBeShallow);
+        __m128i isSteep = _mm_andnot_si128(isShallow, _mm_andnot_si128(_mm_cmpgt_epi32(_mm_slli_epi32(steep, 1), shallow), canBeSteep));
+        __m128i isLong = _mm_or_si128(isShallow, isSteep);
+
+        *corner10 = selectPixels(isShallow, blendPixelsSSE2(*corner10, colour, 1), *corner10);
+        *corner01 = selectPixels(isSteep, blendPixelsSSE2(*corner01, colour, 1), *corner01);
+        *corner11 = selectPixels(isLong, blendPixelsSSE2(*corner11, colour, 3), selectPixels(blends, blendPixelsSSE2(*corner11, colour, 2), *corner11));
+      }
+#undef YUV
+
+      _mm_storeu_si128((__m128i*)&out0[x * 2], _mm_unpacklo_epi32(out[0][0], out[0][1]));
+      _mm_storeu_si128((__m128i*)&out0[x * 2 + 4], _mm_unpackhi_epi32(out[0][0], out[0][1]));
+      _mm_storeu_si128((__m128i*)&out1[x * 2], _mm_unpacklo_epi32(out[1][0], out[1][1]));
+      _mm_storeu_si128((__m128i*)&out1[x * 2 + 4], _mm_unpackhi_epi32(out[1][0], out[1][1]));
+    }
+  }
+}
+
+
+// hq2xYUV() for 4 pixels at a time
+__attribute__((target("sse2")))
+static __m128i hq2xYUVSSE2(__m128i pixels)
+{
+  const __m128i channelMask = _mm_set1_epi32(0xFF);
+
+  __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), channelMask);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), channelMask);
+  __m128i b = _mm_and_si128(pixels, channelMask);
+
+  __m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(r, g), b), 2);
+  __m128i u = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(512), r), b), 2);
+  __m128i v = _mm_srli_epi32(_mm_sub_epi32(_mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(1024), _mm_slli_epi32(g, 1)), r), b), 3);
+
+  return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(y, 16), _mm_slli_epi32(u, 8)), v);
+}
+
+
+// hq2xColoursDiffer() for 4 pairs of colours at a time, as a mask of the lanes that differ. The components are bytes,
+// so a saturating subtract both ways gives their absolute differences and a second one against the thresholds leaves
+// only what's above them.
+__attribute__((target("sse2")))
+static int hq2xColoursDifferSSE2(__m128i yuvA, __m128i yuvB)
+{
+  const __m128i thresholds = _mm_set1_epi32((HQ2X_Y_THRESHOLD << 16) | (HQ2X_U_THRESHOLD << 8) | HQ2X_V_THRESHOLD);
+
+  __m128i difference = _mm_or_si128(_mm_subs_epu8(yuvA, yuvB), _mm_subs_epu8(yuvB, yuvA));
+  __m128i isSimilar = _mm_cmpeq_epi32(_mm_subs_epu8(difference, thresholds), _mm_setzero_si128());
+  return _mm_movemask_ps(_mm_castsi128_ps(isSimilar)) ^ 0xF;
+}
+
+
+// Spreads the 4 lanes of a mask from hq2xColoursDifferSSE2() out to the lowest bit of each 16 bit quarter, so that
+// the patterns of 4 pixels can be built up at once
+static uint64_t hq2xSpreadLanes(int lanes)
+{
+  return ((uint64_t)lanes * 0x0000200040008001) & 0x0001000100010001;
+}
+
+
+// HQ2x with the YUV conversions and comparisons done for 4 pixels at a time. The patterns they make are then looked
+// up pixel by pixel with the same rules as upscaleHQ2xScalar().
+__attribute__((target("sse2")))
+static void upscaleHQ2xSSE2(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow)
+{
+  Pixel rows[3][LCD_WIDTH + 2];
+  uint32_t yuvRows[3][LCD_WIDTH + 2];
+
+  for (uint32_t y = firstRow; y < lastRow; y++) {
+    for (int i = 0; i < 3; i++) {
+      copyPaddedRow(rows[i], input, (int)y + i - 1, 1);
+      for (int x = 0; x < LCD_WIDTH; x += 4) {
+        _mm_storeu_si128((__m128i*)&yuvRows[i][x], hq2xYUVSSE2(_mm_loadu_si128((const __m128i*)&rows[i][x])));
+      }
+      yuvRows[i][LCD_WIDTH] = hq2xYUV(rows[i][LCD_WIDTH]);
+      yuvRows[i][LCD_WIDTH + 1] = hq2xYUV(rows[i][LCD_WIDTH + 1]);
+    }
+
+    Pixel* out0 = outputRow(output, 2, y, 0);
+    Pixel* out1 = outputRow(output, 2, y, 1);
+
+    for (int x = 0; x < LCD_WIDTH; x += 4) {
+      __m128i yuv[9];
+      for (int i = 0; i < 9; i++) {
+        yuv[i] = _mm_loadu_si128((const __m128i*)&yuvRows[i / 3][x + (i % 3)]);
+      }
+
+      int differsFromE[9];
+      for (int i = 0; i < 9; i++) {
+        differsFromE[i] = (i == 4) ? 0 : hq2xColoursDifferSSE2(yuv[i], yuv[4]);
+      }
+
+      // The patterns of the 4 pixels for each corner, 16 bits each
+      uint64_t patterns[4];
+      for (int corner = 0; corner < 4; corner++) {
+        const int* p = HQ2X_CORNER_POSITIONS[corner];
+        uint64_t pattern = 0;
+        for (int n = 0; n < 8; n++) {
+          pattern |= hq2xSpreadLanes(differsFromE[p[(n < 4) ? n : n + 1]]) << n;
+        }
+        pattern |= hq2xSpreadLanes(hq2xColoursDifferSSE2(yuv[p[1]], yuv[p[5]])) * HQ2X_PATTERN_BF;
+        pattern |= hq2xSpreadLanes(hq2xColoursDifferSSE2(yuv[p[7]], yuv[p[3]])) * HQ2X_PATTERN_HD;
+        pattern |= hq2xSpreadLanes(hq2xColoursDifferSSE2(yuv[p[3]], yuv[p[1]])) * HQ2X_PATTERN_DB;
+        patterns[corner] = pattern;
+      }
+
+      for (int lane = 0; lane < 4; lane++) {
+        Pixel w[9];
+        for (int i = 0; i < 9; i++) {
+          w[i] = rows[i / 3][x + lane + (i % 3)];
+        }
+
+        uint32_t lanePatterns[4];
+        for (int corner = 0; corner < 4; corner++) {
+          lanePatterns[corner] = (patterns[corner] >> (16 * lane)) & 0xFFFF;
+        }
+        hq2xWritePixels(out0, out1, x + lane, w, lanePatterns);
+      }
+    }
+  }
+}
+
+
+static bool upscaleKernelsSupportSSE2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+#endif // UPSCALE_KERNELS_X86
+
+
+// The output size is LCD_WIDTH * scale by LCD_HEIGHT * scale, where only nearest neighbour has a choice of scale
+uint32_t upscaleFilterScale(UpscaleFilter filter, uint32_t nearestScale)
+{
+  switch (filter) {
+    case UPSCALE_FILTER_NEAREST:
+      return (nearestScale < 1) ? 1 : ((nearestScale > UPSCALE_NEAREST_MAX_SCALE) ? UPSCALE_NEAREST_MAX_SCALE : nearestScale);
+    case UPSCALE_FILTER_SCALE3X:
+      return 3;
+    default:
+      return 2;
+  }
+}
+
+
+UpscaleKernelFn upscaleKernelFunction(UpscaleFilter filter, bool allowSIMD)
+{
+#ifdef UPSCALE_KERNELS_X86
+  if (allowSIMD && upscaleKernelsSupportSSE2()) {
+    if (filter == UPSCALE_FILTER_NEAREST) {
+      return &upscaleNearestSSE2;
+    } else if (filter == UPSCALE_FILTER_SCALE2X) {
+      return &upscaleScale2xSSE2;
+    } else if (filter == UPSCALE_FILTER_SCALE3X) {
+      return &upscaleScale3xSSE2;
+    } else if (filter == UPSCALE_FILTER_HQ2X) {
+      return &upscaleHQ2xSSE2;
+    } else if (filter == UPSCALE_FILTER_XBR2X) {
+      return &upscaleXBR2xSSE2;
+    }
+  }
+#endif
+
+  switch (filter) {
+    case UPSCALE_FILTER_SCALE2X:
+      return &upscaleScale2xScalar;
+    case UPSCALE_FILTER_SCALE3X:
+      return &upscaleScale3xScalar;
+    case UPSCALE_FILTER_HQ2X:
+      return &upscaleHQ2xScalar;
+    case UPSCALE_FILTER_XBR2X:
+      return &upscaleXBR2xScalar;
+    default:
+      return &upscaleNearestScalar;
+  }
+}
+
+
+const char* upscaleFilterName(UpscaleFilter filter)
+{
+  switch (filter) {
+    case UPSCALE_FILTER_NEAREST:
+      return "nearest";
+    case UPSCALE_FILTER_SCALE2X:
+      return "scale2x";
+    case UPSCALE_FILTER_SCALE3X:
+      return "scale3x";
+    case UPSCALE_FILTER_HQ2X:
+      return "hq2x";
+    case UPSCALE_FILTER_XBR2X:
+      return "xbr2x";
+    default:
+      return "unknown";
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef UPSCALERKERNELS_H_
+#define UPSCALERKERNELS_H_
+
+#include "pixel.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define UPSCALE_NEAREST_MAX_SCALE 4
+
+
+typedef enum UpscaleFilter {
+  UPSCALE_FILTER_NEAREST,
+  UPSCALE_FILTER_SCALE2X,
+  UPSCALE_FILTER_SCALE3X,
+  UPSCALE_FILTER_HQ2X,
+  UPSCALE_FILTER_XBR2X,
+  UPSCALE_FILTER_COUNT
+} UpscaleFilter;
+
+
+// Upscales rows firstRow to lastRow - 1 of an LCD_WIDTH x LCD_HEIGHT frame into the same rows of the output (which
+// is LCD_WIDTH * scale pixels wide). Rows outside the range are only read, so a frame can be split into stripes that
+// are upscaled at the same time.
+typedef void (*UpscaleKernelFn)(const Pixel* input, Pixel* output, uint32_t scale, uint32_t firstRow, uint32_t lastRow);
+
+
+uint32_t upscaleFilterScale(UpscaleFilter filter, uint32_t nearestScale);
+UpscaleKernelFn upscaleKernelFunction(UpscaleFilter filter, bool allowSIMD);
+const char* upscaleFilterName(UpscaleFilter filter);
+
+#endif // UPSCALERKERNELS_H_
@@ -16,16 +16,16 @@ bool exists(const char* path)
 const char* basename(const char* path)
 {
   size_t pathLength = strlen(path);
-  size_t endPos = pathLength - 1;
-  while (path[endPos] != '/') {
-    endPos--;
+  size_t startPos = pathLength;
+  while (startPos > 0 && path[startPos - 1] != '/') { // NOTE: A path without any separators is its own basename
+    startPos--;
   }
-  size_t baseLength = pathLength - endPos - 1;
+  size_t baseLength = pathLength - startPos;
 
   char* d = (char*)malloc((baseLength + 1) * sizeof(char));
   assert(d);
 
-  strncpy(d, &(path[endPos + 1]), baseLength);
+  strncpy(d, &(path[startPos]), baseLength);
   d[baseLength] = '\0';
 
   return d;
@@ -34,10 +34,17 @@ const char* basename(const char* path)
 
 const char* dirname(const char* path)
 {
-  size_t endPos = strlen(path) - 1;
-  while (path[endPos] != '/') {
+  size_t endPos = strlen(path);
+  while (endPos > 0 && path[endPos - 1] != '/') {
     endPos--;
   }
+  if (endPos == 0) { // No separators, so the path is relative to the current directory
+    char* d = (char*)malloc(2 * sizeof(char));
+    assert(d);
+    strcpy(d, ".");
+    return d;
+  }
+  endPos--;
 
   char* d = (char*)malloc((endPos + 1) * sizeof(char));
   assert(d);